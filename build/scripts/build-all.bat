@@ -52,11 +52,14 @@ echo ===============================================
 echo Phase 1: Building Core Runtime Components
 echo ===============================================
 
-call :CollectSources CORE_SOURCES "%SOLUTION_DIR%\src\phase1-userland\core\*.cpp"
+call :CollectSources CORE_SOURCES ^
+   "%SOLUTION_DIR%\src\phase1-userland\core\*.cpp" ^
+   "%SOLUTION_DIR%\src\phase1-userland\vm\*.cpp"
 
 echo [BUILD] CLRNetCore.dll - Main runtime library
 :: Add /arch:AVX2 and /EHsc flags to enable AVX2 instructions and exception handling
-cl /nologo /W3 /O2 /MD /DWIN32 /DNDEBUG /D_WINDOWS /D_USRDLL /DCLRNET_EXPORTS ^
+:: The userspace IL VM (phase1-userland\vm) uses C++20 (std::atomic_ref)
+cl /nologo /W3 /O2 /MD /std:c++20 /DWIN32 /DNDEBUG /D_WINDOWS /D_USRDLL /DCLRNET_EXPORTS ^
    /I"%SOLUTION_DIR%\src" /I"%SOLUTION_DIR%\include" ^
    /Fo"%SOLUTION_DIR%\build\obj\%BUILD_PLATFORM%\%BUILD_CONFIG%\\" ^
    /Fd"%SOLUTION_DIR%\build\obj\%BUILD_PLATFORM%\%BUILD_CONFIG%\CLRNetCore.pdb" ^
@@ -1,6 +1,7 @@
 #include "AssemblyLoader.h"
 #include "OverlayConfig.h"
 #include <cassert>
+#include <cstring>
 #include <algorithm>
 #include <cwctype>
 
@@ -84,6 +85,35 @@ std::string WideToUtf8(const std::wstring& value) {
     return result;
 }
 
+// ECMA-335 II.23.2 compressed unsigned integer; false if it runs past end
+bool ReadCompressedUInt(const BYTE*& cursor, const BYTE* end, DWORD& value) {
+    if (cursor >= end) {
+        return false;
+    }
+
+    BYTE first = cursor[0];
+    if ((first & 0x80) == 0) {
+        value = first;
+        cursor += 1;
+    } else if ((first & 0xC0) == 0x80) {
+        if (end - cursor < 2) {
+            return false;
+        }
+        value = (static_cast<DWORD>(first & 0x3F) << 8) | cursor[1];
+        cursor += 2;
+    } else if ((first & 0xE0) == 0xC0) {
+        if (end - cursor < 4) {
+            return false;
+        }
+        value = (static_cast<DWORD>(first & 0x1F) << 24) | (static_cast<DWORD>(cursor[1]) << 16) |
+                (static_cast<DWORD>(cursor[2]) << 8) | cursor[3];
+        cursor += 4;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 } // namespace
 
 namespace CLRNet {
@@ -108,7 +138,11 @@ LoadedAssembly::LoadedAssembly(const std::wstring& path)
     , m_optionalHeader(nullptr)
     , m_cliHeader(nullptr)
     , m_metadataRoot(nullptr)
-    , m_metadataSize(0) {
+    , m_metadataSize(0)
+    , m_tables(nullptr)
+    , m_tablesEnd(nullptr)
+    , m_rowCounts()
+    , m_heapSizes(0) {
 }
 
 LoadedAssembly::~LoadedAssembly() {
@@ -156,6 +190,8 @@ void LoadedAssembly::Unload() {
     
     m_typeCache.clear();
     m_streams.clear();
+    m_tables = nullptr;
+    m_tablesEnd = nullptr;
     UnmapFile();
     m_loaded = false;
 }
@@ -309,7 +345,7 @@ bool LoadedAssembly::ParseMetadata() {
     }
     
     // Parse streams
-    return ParseStreams();
+    return ParseStreams() && ParseTables();
 }
 
 bool LoadedAssembly::ParseStreams() {
@@ -317,30 +353,185 @@ bool LoadedAssembly::ParseStreams() {
     
     MetadataHeader* metaHeader = static_cast<MetadataHeader*>(m_metadataRoot);
     
-    // Skip version string to get to stream headers
+    // Skip version string to get to the flags and stream count
     char* versionStart = reinterpret_cast<char*>(metaHeader + 1);
-    char* streamHeaderStart = versionStart + ((metaHeader->versionLength + 3) & ~3);
-    
-    // Parse stream headers
-    char* current = streamHeaderStart;
+    char* current = versionStart + ((metaHeader->versionLength + 3) & ~3);
     char* metadataEnd = static_cast<char*>(m_metadataRoot) + m_metadataSize;
-    
-    while (current < metadataEnd) {
+    if (current + 2 * sizeof(WORD) > metadataEnd) {
+        return false;
+    }
+
+    WORD streamCount = *reinterpret_cast<WORD*>(current + sizeof(WORD));
+    current += 2 * sizeof(WORD);
+
+    // Parse stream headers
+    for (WORD i = 0; i < streamCount; ++i) {
+        if (current + 2 * sizeof(DWORD) >= metadataEnd) {
+            return false;
+        }
         StreamHeader* streamHeader = reinterpret_cast<StreamHeader*>(current);
-        
-        // Extract stream name
-        std::string streamName(streamHeader->name);
-        m_streams[streamName] = streamHeader;
-        
+
+        // Extract stream name (at most 32 characters including the terminator)
+        const char* name = current + 2 * sizeof(DWORD);
+        size_t nameLength = strnlen(name, std::min<size_t>(32, metadataEnd - name));
+        if (name + nameLength >= metadataEnd ||
+            static_cast<size_t>(streamHeader->offset) + streamHeader->size > m_metadataSize) {
+            return false;
+        }
+        m_streams[std::string(name, nameLength)] = streamHeader;
+
         // Move to next stream header
-        size_t nameLength = streamName.length() + 1; // Include null terminator
-        size_t alignedNameLength = (nameLength + 3) & ~3; // Align to 4-byte boundary
+        size_t alignedNameLength = (nameLength + 1 + 3) & ~3; // Include null terminator, align to 4 bytes
         current += sizeof(DWORD) + sizeof(DWORD) + alignedNameLength;
-        
-        // Break if we've read all streams (implementation dependent)
-        if (streamName.empty()) break;
     }
-    
+
+    return true;
+}
+
+bool LoadedAssembly::ParseTables() {
+    auto stream = m_streams.find("#~");
+    if (stream == m_streams.end()) {
+        return true; // Nothing to index; table lookups fail
+    }
+
+    const BYTE* begin = static_cast<const BYTE*>(m_metadataRoot) + stream->second->offset;
+    const BYTE* end = begin + stream->second->size;
+    if (end - begin < 24) {
+        return false;
+    }
+
+    // Reserved, MajorVersion, MinorVersion, HeapSizes, Reserved, Valid, Sorted, then one row count
+    // per present table
+    m_heapSizes = begin[6];
+    ULONGLONG valid;
+    memcpy(&valid, begin + 8, sizeof(valid));
+
+    const BYTE* cursor = begin + 24;
+    for (int table = 0; table < 64; ++table) {
+        m_rowCounts[table] = 0;
+        if ((valid >> table) & 1) {
+            if (end - cursor < 4) {
+                return false;
+            }
+            memcpy(&m_rowCounts[table], cursor, sizeof(DWORD));
+            cursor += 4;
+        }
+    }
+    if (m_heapSizes & 0x40) {
+        cursor += 4; // Extra data
+    }
+
+    m_tables = cursor;
+    m_tablesEnd = end;
+    return m_tables <= m_tablesEnd;
+}
+
+DWORD LoadedAssembly::GetRowSize(MetadataTable table) const {
+    DWORD stringIndex = (m_heapSizes & 0x01) ? 4 : 2;
+    DWORD guidIndex = (m_heapSizes & 0x02) ? 4 : 2;
+    DWORD blobIndex = (m_heapSizes & 0x04) ? 4 : 2;
+
+    auto index = [&](BYTE target) -> DWORD {
+        return m_rowCounts[target] < 0x10000 ? 2 : 4;
+    };
+    auto coded = [&](std::initializer_list<BYTE> targets, DWORD tagBits) -> DWORD {
+        DWORD maxRows = 0;
+        for (BYTE target : targets) {
+            maxRows = std::max(maxRows, m_rowCounts[target]);
+        }
+        return maxRows < (1u << (16 - tagBits)) ? 2 : 4;
+    };
+
+    DWORD typeDefOrRef = coded({ TABLE_TYPEDEF, TABLE_TYPEREF, TABLE_TYPESPEC }, 2);
+
+    switch (table) {
+    case TABLE_MODULE:
+        return 2 + stringIndex + 3 * guidIndex;
+    case TABLE_TYPEREF:
+        return coded({ TABLE_MODULE, TABLE_MODULEREF, TABLE_ASSEMBLYREF, TABLE_TYPEREF }, 2) + 2 * stringIndex;
+    case TABLE_TYPEDEF:
+        return 4 + 2 * stringIndex + typeDefOrRef + index(TABLE_FIELD) + index(TABLE_METHODDEF);
+    case 0x03: // FieldPtr
+        return index(TABLE_FIELD);
+    case TABLE_FIELD:
+        return 2 + stringIndex + blobIndex;
+    case 0x05: // MethodPtr
+        return index(TABLE_METHODDEF);
+    case TABLE_METHODDEF:
+        return 8 + stringIndex + blobIndex + index(TABLE_PARAM);
+    case 0x07: // ParamPtr
+        return index(TABLE_PARAM);
+    case TABLE_PARAM:
+        return 4 + stringIndex;
+    case TABLE_INTERFACEIMPL:
+        return index(TABLE_TYPEDEF) + typeDefOrRef;
+    case TABLE_MEMBERREF:
+        return coded({ TABLE_TYPEDEF, TABLE_TYPEREF, TABLE_MODULEREF, TABLE_METHODDEF, TABLE_TYPESPEC }, 3) +
+               stringIndex + blobIndex;
+    case TABLE_CONSTANT:
+        return 2 + coded({ TABLE_FIELD, TABLE_PARAM, TABLE_PROPERTY }, 2) + blobIndex;
+    case TABLE_CUSTOMATTRIBUTE:
+        return coded({ TABLE_METHODDEF, TABLE_FIELD, TABLE_TYPEREF, TABLE_TYPEDEF, TABLE_PARAM,
+                       TABLE_INTERFACEIMPL, TABLE_MEMBERREF, TABLE_MODULE, TABLE_DECLSECURITY, TABLE_PROPERTY,
+                       TABLE_EVENT, TABLE_STANDALONESIG, TABLE_MODULEREF, TABLE_TYPESPEC, TABLE_ASSEMBLY,
+                       TABLE_ASSEMBLYREF, TABLE_FILE, TABLE_EXPORTEDTYPE, TABLE_MANIFESTRESOURCE,
+                       TABLE_GENERICPARAM, TABLE_GENERICPARAMCONSTRAINT, TABLE_METHODSPEC }, 5) +
+               coded({ TABLE_METHODDEF, TABLE_MEMBERREF }, 3) + blobIndex;
+    case TABLE_FIELDMARSHAL:
+        return coded({ TABLE_FIELD, TABLE_PARAM }, 1) + blobIndex;
+    case TABLE_DECLSECURITY:
+        return 2 + coded({ TABLE_TYPEDEF, TABLE_METHODDEF, TABLE_ASSEMBLY }, 2) + blobIndex;
+    case TABLE_CLASSLAYOUT:
+        return 6 + index(TABLE_TYPEDEF);
+    case TABLE_FIELDLAYOUT:
+        return 4 + index(TABLE_FIELD);
+    case TABLE_STANDALONESIG:
+        return blobIndex;
+    default:
+        return 0; // Not needed by any lookup yet
+    }
+}
+
+bool LoadedAssembly::GetStandAloneSignature(DWORD token, const BYTE** signature, DWORD* length) {
+    DWORD rid = RIDFromToken(token);
+    if (!m_tables || !signature || !length || TableFromToken(token) != TABLE_STANDALONESIG ||
+        rid == 0 || rid > m_rowCounts[TABLE_STANDALONESIG]) {
+        return false;
+    }
+
+    auto blobStream = m_streams.find("#Blob");
+    if (blobStream == m_streams.end()) {
+        return false;
+    }
+
+    // The tables are laid out in table order, so StandAloneSig follows every table before it
+    size_t offset = 0;
+    for (BYTE table = 0; table < TABLE_STANDALONESIG; ++table) {
+        offset += static_cast<size_t>(m_rowCounts[table]) * GetRowSize(static_cast<MetadataTable>(table));
+    }
+    DWORD rowSize = GetRowSize(TABLE_STANDALONESIG);
+    offset += static_cast<size_t>(rid - 1) * rowSize;
+    if (offset + rowSize > static_cast<size_t>(m_tablesEnd - m_tables)) {
+        return false;
+    }
+
+    DWORD blobOffset = 0;
+    memcpy(&blobOffset, m_tables + offset, rowSize); // Little-endian 2- or 4-byte heap index
+
+    const BYTE* heap = static_cast<const BYTE*>(m_metadataRoot) + blobStream->second->offset;
+    const BYTE* heapEnd = heap + blobStream->second->size;
+    if (blobOffset >= blobStream->second->size) {
+        return false;
+    }
+
+    const BYTE* cursor = heap + blobOffset;
+    DWORD size = 0;
+    if (!ReadCompressedUInt(cursor, heapEnd, size) || size > static_cast<size_t>(heapEnd - cursor)) {
+        return false;
+    }
+
+    *signature = cursor;
+    *length = size;
     return true;
 }
 
@@ -817,14 +1008,10 @@ std::vector<BYTE> ReadBlob(const void* blobHeap, DWORD offset) {
     
     const BYTE* blob = static_cast<const BYTE*>(blobHeap) + offset;
     
-    // First bytes indicate size (simplified)
-    DWORD size = blob[0];
-    if (size & 0x80) {
-        // Multi-byte size encoding
-        size = ((size & 0x7F) << 8) | blob[1];
-        blob += 2;
-    } else {
-        blob += 1;
+    // Compressed length prefix of 1, 2 or 4 bytes (the heap size is unknown here)
+    DWORD size = 0;
+    if (!ReadCompressedUInt(blob, blob + 4, size)) {
+        return result;
     }
     
     result.assign(blob, blob + size);
@@ -229,6 +229,10 @@ public:
     // Metadata access
     const void* GetMetadataRoot() const { return m_metadataRoot; }
     size_t GetMetadataSize() const { return m_metadataSize; }
+
+    // Signature blob of a StandAloneSig token, such as a method header's LocalVarSigTok. The blob
+    // points into the mapped image and stays valid while the assembly is loaded.
+    bool GetStandAloneSignature(DWORD token, const BYTE** signature, DWORD* length);
     
 private:
     std::wstring m_path;
@@ -252,6 +256,12 @@ private:
     void* m_metadataRoot;
     size_t m_metadataSize;
     std::unordered_map<std::string, StreamHeader*> m_streams;
+
+    // Tables stream (#~)
+    const BYTE* m_tables;         // First row of the first present table
+    const BYTE* m_tablesEnd;
+    DWORD m_rowCounts[64];
+    BYTE m_heapSizes;
     
     // Type cache
     std::unordered_map<std::string, MethodTable*> m_typeCache;
@@ -263,6 +273,8 @@ private:
     bool ParseCLIHeader();
     bool ParseMetadata();
     bool ParseStreams();
+    bool ParseTables();
+    DWORD GetRowSize(MetadataTable table) const;
     
     // Metadata parsing
     void* RVAToPointer(DWORD rva);
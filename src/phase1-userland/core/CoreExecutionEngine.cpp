@@ -3,6 +3,7 @@
 #include "GarbageCollector.h" 
 #include "AssemblyLoader.h"
 #include "SimpleJIT.h"
+#include "StringInternTable.h"
 #include <iostream>
 #include <cstring> // Added for memcpy
 
@@ -97,6 +98,9 @@ bool CoreExecutionEngine::InitializeSubsystems() {
 void CoreExecutionEngine::CleanupSubsystems() {
     m_methodCache.clear();
     m_gcRoots.clear();
+
+    // Interned strings point at the string MethodTable owned by the type system
+    GetStringInternTable().Clear();
     
     // Clear global instances
     g_jitCompiler = nullptr;
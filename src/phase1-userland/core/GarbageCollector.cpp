@@ -13,6 +13,13 @@ std::vector<void**> GCRootManager::s_roots;
 CRITICAL_SECTION GCRootManager::s_rootsLock;
 bool GCRootManager::s_initialized = false;
 
+namespace {
+
+// Account the calling thread's allocations are charged to
+thread_local GCAllocationScope* t_allocationScope = nullptr;
+
+} // namespace
+
 //=============================================================================
 // ManagedHeap Implementation
 //=============================================================================
@@ -239,6 +246,12 @@ void* GarbageCollector::AllocateObject(size_t size) {
     
     // Calculate total size including GC header
     size_t totalSize = sizeof(GCObjectHeader) + size;
+
+    // Charge the thread's allocation scope before doing any work for an allocation it refuses
+    GCAllocationScope* scope = t_allocationScope;
+    if (scope && !scope->TryCharge(totalSize)) {
+        return nullptr;
+    }
     
     // Check if we should collect before allocation
     if (ShouldCollect()) {
@@ -248,7 +261,10 @@ void* GarbageCollector::AllocateObject(size_t size) {
     
     // Allocate from heap
     void* memory = m_heap->Allocate(totalSize);
-    if (!memory) return nullptr;
+    if (!memory) {
+        if (scope) scope->Release(totalSize);
+        return nullptr;
+    }
     
     // Initialize GC header
     GCObjectHeader* header = static_cast<GCObjectHeader*>(memory);
@@ -270,6 +286,12 @@ void* GarbageCollector::AllocateObject(size_t size) {
     return header->GetObjectData();
 }
 
+GCAllocationScope* GarbageCollector::SetAllocationScope(GCAllocationScope* scope) {
+    GCAllocationScope* previous = t_allocationScope;
+    t_allocationScope = scope;
+    return previous;
+}
+
 void* GarbageCollector::AllocateArray(size_t elementSize, size_t count) {
     // Simple array allocation - in full implementation would have array header
     return AllocateObject(elementSize * count);
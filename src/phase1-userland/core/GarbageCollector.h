@@ -115,6 +115,33 @@ struct GCStats {
     }
 };
 
+// Byte account for the objects one piece of work allocates. While a scope is installed on a thread,
+// every allocation made there is charged to it. An allocation that would take `bytes` past `limit`
+// fails and sets `exceeded`. Objects are charged when allocated and are not credited back when
+// they are collected.
+struct GCAllocationScope {
+    size_t bytes;
+    size_t limit;
+    bool exceeded;
+
+    GCAllocationScope()
+        : bytes(0)
+        , limit(static_cast<size_t>(-1))
+        , exceeded(false) {}
+
+    // bytes never exceeds limit, so the check is one comparison that cannot overflow
+    bool TryCharge(size_t size) {
+        if (size > limit - bytes) {
+            exceeded = true;
+            return false;
+        }
+        bytes += size;
+        return true;
+    }
+
+    void Release(size_t size) { bytes -= size; }
+};
+
 // Main garbage collector class
 class GarbageCollector {
 public:
@@ -130,6 +157,9 @@ public:
     void* AllocateArray(size_t elementSize, size_t count);
     void PinObject(void* obj);
     void UnpinObject(void* obj);
+
+    // Installs the calling thread's allocation scope (null for none) and returns the previous one
+    static GCAllocationScope* SetAllocationScope(GCAllocationScope* scope);
     
     // Collection control
     void Collect(const std::vector<void**>& roots);
@@ -657,6 +657,12 @@ __declspec(dllexport) void JIT_InitializeString(void* str, const wchar_t* data)
     }
 }
 
+__declspec(dllexport) void JIT_GetStringInternStats(StringInternStats* stats) {
+    if (stats) {
+        GetStringInternTable().GetStatistics(*stats);
+    }
+}
+
 __declspec(dllexport) void JIT_CallStaticMethod(void* methodPtr) {
     // Call static method - simplified
     if (methodPtr) {
@@ -11,6 +11,7 @@
 #include <vector>
 #include <unordered_map>
 #include "TypeSystem.h"
+#include "StringInternTable.h"
 
 namespace CLRNet {
 namespace Phase1 {
@@ -204,6 +205,8 @@ extern "C" {
     // String operations
     __declspec(dllexport) void* JIT_AllocateString(int length);
     __declspec(dllexport) void JIT_InitializeString(void* str, const wchar_t* data);
+    // Interned strings are shared and must not be written through JIT_InitializeString
+    __declspec(dllexport) void JIT_GetStringInternStats(StringInternStats* stats);
     
     // Method calls
     __declspec(dllexport) void JIT_CallStaticMethod(void* methodPtr);
@@ -0,0 +1,224 @@
+#include "StringInternTable.h"
+#include "TypeSystem.h"
+#include <cstring>
+#include <new>
+
+namespace CLRNet {
+namespace Phase1 {
+
+namespace {
+
+const size_t InitialCapacity = 256;
+const size_t FrozenChunkSize = 64 * 1024;
+
+uint64_t HashContent(const wchar_t* data, size_t length) {
+    // FNV-1a over the UTF-16 code units
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint16_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t StringObjectSize(size_t length) {
+    return sizeof(ObjectHeader) + (length + 1) * sizeof(wchar_t);
+}
+
+} // namespace
+
+template <typename Entry>
+StringInternTable::Table<Entry>::Table(size_t capacity)
+    : mask(capacity - 1)
+    , count(0)
+    , slots(new std::atomic<Entry*>[capacity]) {
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+StringInternTable::StringInternTable()
+    : m_frozenUsed(0)
+    , m_frozenCapacity(0)
+    , m_contentLookups(0)
+    , m_contentHits(0)
+    , m_internedStrings(0)
+    , m_internedBytes(0)
+    , m_bytesSaved(0) {
+    InitializeCriticalSection(&m_lock);
+    m_contents.current.store(nullptr, std::memory_order_relaxed);
+    Reset();
+}
+
+StringInternTable::~StringInternTable() {
+    DeleteCriticalSection(&m_lock);
+}
+
+void* StringInternTable::Intern(const wchar_t* data, size_t length) {
+    if (!data && length > 0) {
+        return nullptr;
+    }
+
+    m_contentLookups.fetch_add(1, std::memory_order_relaxed);
+    uint64_t hash = HashContent(data, length);
+
+    ContentEntry* entry = FindContent(data, length, hash);
+    if (!entry) {
+        EnterCriticalSection(&m_lock);
+        entry = FindContent(data, length, hash);
+        if (!entry) {
+            entry = CreateContent(data, length, hash);
+            LeaveCriticalSection(&m_lock);
+            return entry ? entry->object : nullptr;
+        }
+        LeaveCriticalSection(&m_lock);
+    }
+
+    m_contentHits.fetch_add(1, std::memory_order_relaxed);
+    m_bytesSaved.fetch_add(entry->objectSize, std::memory_order_relaxed);
+    return entry->object;
+}
+
+void StringInternTable::Clear() {
+    EnterCriticalSection(&m_lock);
+    Reset();
+    LeaveCriticalSection(&m_lock);
+}
+
+void StringInternTable::GetStatistics(StringInternStats& stats) const {
+    stats.contentLookups = m_contentLookups.load(std::memory_order_relaxed);
+    stats.contentHits = m_contentHits.load(std::memory_order_relaxed);
+    stats.internedStrings = m_internedStrings.load(std::memory_order_relaxed);
+    stats.internedBytes = m_internedBytes.load(std::memory_order_relaxed);
+    stats.bytesSaved = m_bytesSaved.load(std::memory_order_relaxed);
+}
+
+uint64_t StringInternTable::HashOf(const ContentEntry& entry) {
+    return entry.hash;
+}
+
+template <typename Entry>
+void StringInternTable::Insert(TableSet<Entry>& set, std::unique_ptr<Entry> entry) {
+    Table<Entry>* table = set.current.load(std::memory_order_relaxed);
+
+    // Keep the load factor at or below one half so probe sequences stay short
+    if ((table->count + 1) * 2 > table->mask + 1) {
+        std::unique_ptr<Table<Entry>> grown(new Table<Entry>((table->mask + 1) * 2));
+        for (const std::unique_ptr<Entry>& existing : set.entries) {
+            size_t index = static_cast<size_t>(HashOf(*existing)) & grown->mask;
+            while (grown->slots[index].load(std::memory_order_relaxed)) {
+                index = (index + 1) & grown->mask;
+            }
+            grown->slots[index].store(existing.get(), std::memory_order_relaxed);
+        }
+        grown->count = set.entries.size();
+        table = grown.get();
+        set.tables.push_back(std::move(grown));
+        set.current.store(table, std::memory_order_release);
+    }
+
+    size_t index = static_cast<size_t>(HashOf(*entry)) & table->mask;
+    while (table->slots[index].load(std::memory_order_relaxed)) {
+        index = (index + 1) & table->mask;
+    }
+    table->slots[index].store(entry.get(), std::memory_order_release);
+    ++table->count;
+    set.entries.push_back(std::move(entry));
+}
+
+StringInternTable::ContentEntry* StringInternTable::FindContent(const wchar_t* data, size_t length,
+                                                               uint64_t hash) const {
+    Table<ContentEntry>* table = m_contents.current.load(std::memory_order_acquire);
+    size_t index = static_cast<size_t>(hash) & table->mask;
+    while (ContentEntry* entry = table->slots[index].load(std::memory_order_acquire)) {
+        if (entry->hash == hash && entry->length == length &&
+            (length == 0 || std::memcmp(entry->data, data, length * sizeof(wchar_t)) == 0)) {
+            return entry;
+        }
+        index = (index + 1) & table->mask;
+    }
+    return nullptr;
+}
+
+StringInternTable::ContentEntry* StringInternTable::CreateContent(const wchar_t* data, size_t length,
+                                                                 uint64_t hash) {
+    size_t objectSize = StringObjectSize(length);
+    void* object = AllocateFrozen(objectSize);
+    if (!object) {
+        return nullptr;
+    }
+
+    ObjectHeader* header = static_cast<ObjectHeader*>(object);
+    header->methodTable = g_typeSystem ? g_typeSystem->GetStringMethodTable() : nullptr;
+    header->syncBlock = 0;
+
+    wchar_t* characters = reinterpret_cast<wchar_t*>(static_cast<uint8_t*>(object) + sizeof(ObjectHeader));
+    if (length > 0) {
+        std::memcpy(characters, data, length * sizeof(wchar_t));
+    }
+    characters[length] = L'\0';
+
+    std::unique_ptr<ContentEntry> entry(new ContentEntry());
+    entry->hash = hash;
+    entry->length = length;
+    entry->data = characters;
+    entry->object = object;
+    entry->objectSize = objectSize;
+
+    ContentEntry* published = entry.get();
+    Insert(m_contents, std::move(entry));
+
+    m_internedStrings.fetch_add(1, std::memory_order_relaxed);
+    m_internedBytes.fetch_add(objectSize, std::memory_order_relaxed);
+    return published;
+}
+
+void* StringInternTable::AllocateFrozen(size_t size) {
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    // Oversized strings get a chunk of their own so the current chunk keeps its tail
+    if (size > FrozenChunkSize / 4) {
+        std::unique_ptr<uint8_t[]> chunk(new (std::nothrow) uint8_t[size]);
+        if (!chunk) {
+            return nullptr;
+        }
+        void* object = chunk.get();
+        m_frozenChunks.insert(m_frozenChunks.end() - (m_frozenChunks.empty() ? 0 : 1), std::move(chunk));
+        return object;
+    }
+
+    if (m_frozenChunks.empty() || m_frozenUsed + size > m_frozenCapacity) {
+        std::unique_ptr<uint8_t[]> chunk(new (std::nothrow) uint8_t[FrozenChunkSize]);
+        if (!chunk) {
+            return nullptr;
+        }
+        m_frozenChunks.push_back(std::move(chunk));
+        m_frozenUsed = 0;
+        m_frozenCapacity = FrozenChunkSize;
+    }
+
+    void* object = m_frozenChunks.back().get() + m_frozenUsed;
+    m_frozenUsed += size;
+    return object;
+}
+
+void StringInternTable::Reset() {
+    m_contents.entries.clear();
+    m_contents.tables.clear();
+    m_contents.tables.emplace_back(new Table<ContentEntry>(InitialCapacity));
+    m_contents.current.store(m_contents.tables.back().get(), std::memory_order_release);
+
+    m_frozenChunks.clear();
+    m_frozenUsed = 0;
+    m_frozenCapacity = 0;
+    m_internedStrings.store(0, std::memory_order_relaxed);
+    m_internedBytes.store(0, std::memory_order_relaxed);
+}
+
+StringInternTable& GetStringInternTable() {
+    static StringInternTable table;
+    return table;
+}
+
+} // namespace Phase1
+} // namespace CLRNet
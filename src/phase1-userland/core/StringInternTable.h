@@ -0,0 +1,106 @@
+#pragma once
+
+// Runtime-wide string intern table for CLRNET Phase 1 runtime
+// Interns the ldstr literals of the IL virtual machine by content
+
+#ifndef STRING_INTERN_TABLE_H
+#define STRING_INTERN_TABLE_H
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "RuntimeTypes.h"
+
+namespace CLRNet {
+namespace Phase1 {
+
+// Counters reported by StringInternTable::GetStatistics
+struct StringInternStats {
+    uint64_t contentLookups;    // Interning requests by content
+    uint64_t contentHits;
+    uint64_t internedStrings;   // Distinct strings owned by the table
+    uint64_t internedBytes;     // Storage used by those strings, headers included
+    uint64_t bytesSaved;        // Allocations avoided because an existing string was returned
+
+    StringInternStats() {
+        memset(this, 0, sizeof(StringInternStats));
+    }
+};
+
+// Interned strings live in frozen storage owned by the table: they are never moved or collected,
+// and use the JIT_InitializeString layout (ObjectHeader followed by NUL-terminated UTF-16).
+// Lookups are lock-free; inserts take the table lock and publish entries with release stores.
+class StringInternTable {
+public:
+    StringInternTable();
+    ~StringInternTable();
+
+    // Returns the one frozen string object with these contents, creating it on first use
+    void* Intern(const wchar_t* data, size_t length);
+
+    // Drops every string; only safe once no managed or VM code can still reference them
+    void Clear();
+
+    void GetStatistics(StringInternStats& stats) const;
+
+private:
+    struct ContentEntry {
+        uint64_t hash;
+        size_t length;
+        const wchar_t* data;
+        void* object;
+        size_t objectSize;
+    };
+
+    // Open-addressed, insert-only; grown by publishing a larger copy
+    template <typename Entry>
+    struct Table {
+        size_t mask;
+        size_t count;
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+
+        explicit Table(size_t capacity);
+    };
+
+    template <typename Entry>
+    struct TableSet {
+        std::atomic<Table<Entry>*> current;
+        std::vector<std::unique_ptr<Table<Entry>>> tables;   // Older tables stay valid for in-flight readers
+        std::vector<std::unique_ptr<Entry>> entries;
+    };
+
+    static uint64_t HashOf(const ContentEntry& entry);
+
+    template <typename Entry>
+    static void Insert(TableSet<Entry>& set, std::unique_ptr<Entry> entry);
+
+    ContentEntry* FindContent(const wchar_t* data, size_t length, uint64_t hash) const;
+    ContentEntry* CreateContent(const wchar_t* data, size_t length, uint64_t hash);
+    void* AllocateFrozen(size_t size);
+    void Reset();
+
+    CRITICAL_SECTION m_lock;
+    TableSet<ContentEntry> m_contents;
+
+    std::vector<std::unique_ptr<uint8_t[]>> m_frozenChunks;
+    size_t m_frozenUsed;
+    size_t m_frozenCapacity;
+
+    std::atomic<uint64_t> m_contentLookups;
+    std::atomic<uint64_t> m_contentHits;
+    std::atomic<uint64_t> m_internedStrings;
+    std::atomic<uint64_t> m_internedBytes;
+    std::atomic<uint64_t> m_bytesSaved;
+};
+
+// Process-wide table; created on first use so the VM can intern without a CoreExecutionEngine
+StringInternTable& GetStringInternTable();
+
+} // namespace Phase1
+} // namespace CLRNet
+
+#endif // STRING_INTERN_TABLE_H
@@ -1,4 +1,5 @@
 #include "BytecodeCache.h"
+#include "BytecodeCompiler.h"
 #include "VirtualMachine.h"
 
 #include <bcrypt.h>
@@ -7,6 +8,7 @@
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <vector>
 
 #pragma comment(lib, "bcrypt.lib")
 
@@ -32,6 +34,104 @@ std::wstring GetExecutableDirectory() {
     return path.substr(0, separator);
 }
 
+// Entries start with this, so files from builds with the fixed 16-byte instruction records or
+// without call signatures on the call sites are recompiled rather than misread
+const uint32_t CacheEntryMagic = 0x33434D56;   // "VMC3"
+
+// Operands an opcode carries on disk. The arithmetic opcodes' op1 deoptimization counter is
+// per-process state and starts over on load.
+uint32_t GetOperandCount(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::Nop:
+    case VmOpcode::LoadNull:
+    case VmOpcode::Add:
+    case VmOpcode::Subtract:
+    case VmOpcode::Multiply:
+    case VmOpcode::Divide:
+    case VmOpcode::CompareEqual:
+    case VmOpcode::CompareNotEqual:
+    case VmOpcode::CompareGreaterThan:
+    case VmOpcode::CompareLessThan:
+    case VmOpcode::Return:
+    case VmOpcode::Pop:
+    case VmOpcode::LoadLength:
+    case VmOpcode::ConvertToInt32:
+        return 0;
+    case VmOpcode::Switch:
+        return 2;
+    case VmOpcode::AddLocalConstant:
+    case VmOpcode::ArithmeticLocals:
+        return 3;
+    default:
+        return opcode >= VmOpcode::AddI4 && opcode <= VmOpcode::DivideR8 ? 0 : 1;
+    }
+}
+
+// Zigzag LEB128, so small negative operands stay short too
+void WriteVarint(std::vector<uint8_t>& out, int32_t value) {
+    uint32_t encoded = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    while (encoded >= 0x80) {
+        out.push_back(static_cast<uint8_t>(encoded | 0x80));
+        encoded >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(encoded));
+}
+
+bool ReadVarint(const uint8_t*& cursor, const uint8_t* end, int32_t& value) {
+    uint32_t encoded = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        if (cursor == end) {
+            return false;
+        }
+        uint8_t byte = *cursor++;
+        encoded |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            value = static_cast<int32_t>(encoded >> 1) ^ -static_cast<int32_t>(encoded & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// One opcode byte, then the opcode's operands as varints
+void EncodeInstructions(const std::vector<VmInstruction>& instructions, std::vector<uint8_t>& out) {
+    for (const VmInstruction& instruction : instructions) {
+        out.push_back(static_cast<uint8_t>(instruction.opcode));
+        uint32_t operands = GetOperandCount(instruction.opcode);
+        if (operands > 0) {
+            WriteVarint(out, instruction.operand0);
+        }
+        if (operands > 1) {
+            WriteVarint(out, instruction.operand1);
+        }
+        if (operands > 2) {
+            WriteVarint(out, instruction.operand2);
+        }
+    }
+}
+
+bool DecodeInstructions(const std::vector<uint8_t>& code, std::vector<VmInstruction>& instructions) {
+    const uint8_t* cursor = code.data();
+    const uint8_t* end = cursor + code.size();
+    for (VmInstruction& instruction : instructions) {
+        if (cursor == end || *cursor > static_cast<uint8_t>(VmOpcode::ConvertToInt32)) {
+            return false;
+        }
+        VmOpcode opcode = static_cast<VmOpcode>(*cursor++);
+        int32_t operands[3] = {};
+        for (uint32_t i = 0; i < GetOperandCount(opcode); ++i) {
+            if (!ReadVarint(cursor, end, operands[i])) {
+                return false;
+            }
+        }
+        if (!VmInstruction::FitsOperand1(operands[1]) || !VmInstruction::FitsOperand2(operands[2])) {
+            return false;
+        }
+        instruction = VmInstruction(opcode, operands[0], operands[1], operands[2]);
+    }
+    return cursor == end;
+}
+
 } // namespace
 
 BytecodeCache::BytecodeCache()
@@ -132,7 +232,12 @@ bool BytecodeCache::EnsureCacheDirectory() {
 
 std::wstring BytecodeCache::ComputeCachePath(const std::string& key) const {
     std::filesystem::path path(m_cacheDirectory);
+#ifdef CLRNET_VM_COMPACT_VALUES
+    // Register constants are stored as raw VmValue bytes, so each layout keeps its own files
+    path /= std::filesystem::path(key + ".compact.vmc");
+#else
     path /= std::filesystem::path(key + ".vmc");
+#endif
     return path.wstring();
 }
 
@@ -142,23 +247,43 @@ bool BytecodeCache::LoadFromDisk(const std::wstring& path, VmProgram& program) {
         return false;
     }
 
+    uint32_t magic = 0;
     uint32_t instructionCount = 0;
+    uint32_t codeSize = 0;
+    uint32_t wideOperandCount = 0;
     uint32_t callSiteCount = 0;
 
+    stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
     stream.read(reinterpret_cast<char*>(&program.localCount), sizeof(program.localCount));
     stream.read(reinterpret_cast<char*>(&program.argumentCount), sizeof(program.argumentCount));
     stream.read(reinterpret_cast<char*>(&instructionCount), sizeof(instructionCount));
-    stream.read(reinterpret_cast<char*>(&callSiteCount), sizeof(callSiteCount));
+    stream.read(reinterpret_cast<char*>(&codeSize), sizeof(codeSize));
 
+    // Every instruction takes at least its opcode byte, which bounds the count before allocating
+    if (!stream.good() || magic != CacheEntryMagic || instructionCount > codeSize) {
+        return false;
+    }
+
+    std::vector<uint8_t> code(codeSize);
+    stream.read(reinterpret_cast<char*>(code.data()), codeSize);
+    stream.read(reinterpret_cast<char*>(&wideOperandCount), sizeof(wideOperandCount));
     if (!stream.good()) {
         return false;
     }
 
     program.instructions.resize(instructionCount);
-    program.callSites.resize(callSiteCount);
+    if (!DecodeInstructions(code, program.instructions)) {
+        return false;
+    }
 
-    stream.read(reinterpret_cast<char*>(program.instructions.data()),
-                instructionCount * sizeof(VmInstruction));
+    program.wideOperands.resize(wideOperandCount);
+    stream.read(reinterpret_cast<char*>(program.wideOperands.data()), wideOperandCount * sizeof(uint64_t));
+    stream.read(reinterpret_cast<char*>(&callSiteCount), sizeof(callSiteCount));
+    if (!stream.good()) {
+        return false;
+    }
+
+    program.callSites.resize(callSiteCount);
     stream.read(reinterpret_cast<char*>(program.callSites.data()),
                 callSiteCount * sizeof(VmCallSite));
 
@@ -166,6 +291,96 @@ bool BytecodeCache::LoadFromDisk(const std::wstring& path, VmProgram& program) {
         return false;
     }
 
+    // Optional register tier section; files written without it simply end here
+    uint32_t registerCount = 0;
+    uint32_t registerInstructionCount = 0;
+    uint32_t registerConstantCount = 0;
+    stream.read(reinterpret_cast<char*>(&registerCount), sizeof(registerCount));
+    stream.read(reinterpret_cast<char*>(&registerInstructionCount), sizeof(registerInstructionCount));
+    stream.read(reinterpret_cast<char*>(&registerConstantCount), sizeof(registerConstantCount));
+    if (stream.good() && registerInstructionCount > 0) {
+        // The counts are checked against what is left of the file before anything is allocated
+        std::streamoff position = stream.tellg();
+        stream.seekg(0, std::ios::end);
+        uint64_t remaining = static_cast<uint64_t>(stream.tellg() - position);
+        stream.seekg(position);
+        if (static_cast<uint64_t>(registerInstructionCount) * sizeof(VmRegisterInstruction) +
+                static_cast<uint64_t>(registerConstantCount) * sizeof(VmValue) > remaining) {
+            return false;
+        }
+
+        program.registerInstructions.resize(registerInstructionCount);
+        program.registerConstants.resize(registerConstantCount);
+        stream.read(reinterpret_cast<char*>(program.registerInstructions.data()),
+                    registerInstructionCount * sizeof(VmRegisterInstruction));
+        stream.read(reinterpret_cast<char*>(program.registerConstants.data()),
+                    registerConstantCount * sizeof(VmValue));
+        if (!stream.good()) {
+            return false;
+        }
+
+        // The register tier indexes registers without bounds checks, so a file's register code is
+        // only kept once every index and constant in it has been checked
+        program.registerCount = registerCount;
+        if (!BytecodeCompiler::VerifyRegisters(program)) {
+            program.registerInstructions.clear();
+            program.registerConstants.clear();
+            program.registerCount = 0;
+        }
+    }
+
+    // Optional switch table section, written after the register section
+    uint32_t switchTargetCount = 0;
+    stream.read(reinterpret_cast<char*>(&switchTargetCount), sizeof(switchTargetCount));
+    if (stream.good() && switchTargetCount > 0) {
+        program.switchTargets.resize(switchTargetCount);
+        stream.read(reinterpret_cast<char*>(program.switchTargets.data()), switchTargetCount * sizeof(int32_t));
+        if (!stream.good()) {
+            return false;
+        }
+    }
+
+    // Optional local kinds section, present when the local signature was resolved at compile time
+    uint32_t localKindCount = 0;
+    stream.read(reinterpret_cast<char*>(&localKindCount), sizeof(localKindCount));
+    if (stream.good() && localKindCount > 0) {
+        if (localKindCount != program.localCount) {
+            return false;
+        }
+        program.localKinds.resize(localKindCount);
+        stream.read(reinterpret_cast<char*>(program.localKinds.data()), localKindCount * sizeof(VmValueKind));
+        if (!stream.good()) {
+            return false;
+        }
+        for (VmValueKind kind : program.localKinds) {
+            if (kind > VmValueKind::Null) {
+                return false;
+            }
+        }
+    }
+
+    // Inline caches hold process-local MethodTable* and code pointers, and program bindings hold
+    // handles from the process that wrote the file
+    for (VmCallSite& callSite : program.callSites) {
+        callSite.inlineCache.Reset();
+        if (callSite.kind == VmCallSite::TargetKind::Program) {
+            callSite.kind = VmCallSite::TargetKind::None;
+            callSite.data.managedTarget = nullptr;
+        }
+    }
+
+    // Cache files are not trusted to be well formed, so the unchecked path needs a fresh proof, and
+    // so do the element accesses a file claims are in range
+    for (VmInstruction& instruction : program.instructions) {
+        if (instruction.opcode == VmOpcode::LoadElementUnchecked) {
+            instruction.opcode = VmOpcode::LoadElement;
+        } else if (instruction.opcode == VmOpcode::StoreElementUnchecked) {
+            instruction.opcode = VmOpcode::StoreElement;
+        }
+    }
+    BytecodeCompiler::HoistBoundsChecks(program);
+    BytecodeCompiler::Verify(program);
+
     program.cacheKey = std::string(path.begin(), path.end());
     return true;
 }
@@ -176,18 +391,44 @@ void BytecodeCache::SaveToDisk(const std::wstring& path, const VmProgram& progra
         return;
     }
 
+    std::vector<uint8_t> code;
+    EncodeInstructions(program.instructions, code);
+
     uint32_t instructionCount = static_cast<uint32_t>(program.instructions.size());
+    uint32_t codeSize = static_cast<uint32_t>(code.size());
+    uint32_t wideOperandCount = static_cast<uint32_t>(program.wideOperands.size());
     uint32_t callSiteCount = static_cast<uint32_t>(program.callSites.size());
 
+    stream.write(reinterpret_cast<const char*>(&CacheEntryMagic), sizeof(CacheEntryMagic));
     stream.write(reinterpret_cast<const char*>(&program.localCount), sizeof(program.localCount));
     stream.write(reinterpret_cast<const char*>(&program.argumentCount), sizeof(program.argumentCount));
     stream.write(reinterpret_cast<const char*>(&instructionCount), sizeof(instructionCount));
+    stream.write(reinterpret_cast<const char*>(&codeSize), sizeof(codeSize));
+    stream.write(reinterpret_cast<const char*>(code.data()), codeSize);
+    stream.write(reinterpret_cast<const char*>(&wideOperandCount), sizeof(wideOperandCount));
+    stream.write(reinterpret_cast<const char*>(program.wideOperands.data()), wideOperandCount * sizeof(uint64_t));
     stream.write(reinterpret_cast<const char*>(&callSiteCount), sizeof(callSiteCount));
-
-    stream.write(reinterpret_cast<const char*>(program.instructions.data()),
-                 instructionCount * sizeof(VmInstruction));
     stream.write(reinterpret_cast<const char*>(program.callSites.data()),
                  callSiteCount * sizeof(VmCallSite));
+
+    uint32_t registerInstructionCount = static_cast<uint32_t>(program.registerInstructions.size());
+    uint32_t registerConstantCount = static_cast<uint32_t>(program.registerConstants.size());
+
+    stream.write(reinterpret_cast<const char*>(&program.registerCount), sizeof(program.registerCount));
+    stream.write(reinterpret_cast<const char*>(&registerInstructionCount), sizeof(registerInstructionCount));
+    stream.write(reinterpret_cast<const char*>(&registerConstantCount), sizeof(registerConstantCount));
+    stream.write(reinterpret_cast<const char*>(program.registerInstructions.data()),
+                 registerInstructionCount * sizeof(VmRegisterInstruction));
+    stream.write(reinterpret_cast<const char*>(program.registerConstants.data()),
+                 registerConstantCount * sizeof(VmValue));
+
+    uint32_t switchTargetCount = static_cast<uint32_t>(program.switchTargets.size());
+    stream.write(reinterpret_cast<const char*>(&switchTargetCount), sizeof(switchTargetCount));
+    stream.write(reinterpret_cast<const char*>(program.switchTargets.data()), switchTargetCount * sizeof(int32_t));
+
+    uint32_t localKindCount = static_cast<uint32_t>(program.localKinds.size());
+    stream.write(reinterpret_cast<const char*>(&localKindCount), sizeof(localKindCount));
+    stream.write(reinterpret_cast<const char*>(program.localKinds.data()), localKindCount * sizeof(VmValueKind));
 }
 
 std::string ComputeSha1(const void* data, size_t size) {
@@ -1,5 +1,6 @@
 #include "BytecodeCompiler.h"
 #include "BytecodeCache.h"
+#include "VmBytecodeFormat.h"
 
 #include "../core/SimpleJIT.h"
 
@@ -40,9 +41,12 @@ constexpr uint16_t IL_LDC_I4_8 = 0x1E;
 constexpr uint16_t IL_LDC_I4_S = 0x1F;
 constexpr uint16_t IL_LDC_I4 = 0x20;
 constexpr uint16_t IL_LDC_I8 = 0x21;
+constexpr uint16_t IL_LDC_R4 = 0x22;
+constexpr uint16_t IL_LDC_R8 = 0x23;
 constexpr uint16_t IL_LDNULL = 0x14;
 constexpr uint16_t IL_LDSTR = 0x72;
 constexpr uint16_t IL_CALL = 0x28;
+constexpr uint16_t IL_POP = 0x26;
 constexpr uint16_t IL_RET = 0x2A;
 constexpr uint16_t IL_BR_S = 0x2B;
 constexpr uint16_t IL_BRFALSE_S = 0x2C;
@@ -50,17 +54,34 @@ constexpr uint16_t IL_BRTRUE_S = 0x2D;
 constexpr uint16_t IL_BR = 0x38;
 constexpr uint16_t IL_BRFALSE = 0x39;
 constexpr uint16_t IL_BRTRUE = 0x3A;
+constexpr uint16_t IL_BEQ_S = 0x2E;    // beq.s .. blt.un.s, in ECMA order
+constexpr uint16_t IL_BLT_UN_S = 0x37;
+constexpr uint16_t IL_BEQ = 0x3B;      // beq .. blt.un, in ECMA order
+constexpr uint16_t IL_BLT_UN = 0x44;
+constexpr uint16_t IL_SWITCH = 0x45;
 constexpr uint16_t IL_ADD = 0x58;
 constexpr uint16_t IL_SUB = 0x59;
 constexpr uint16_t IL_MUL = 0x5A;
 constexpr uint16_t IL_DIV = 0x5B;
+constexpr uint16_t IL_CONV_I4 = 0x69;
 constexpr uint16_t IL_CALLVIRT = 0x6F;
 constexpr uint16_t IL_NEWOBJ = 0x73;
 constexpr uint16_t IL_CASTCLASS = 0x74;
 constexpr uint16_t IL_LDFLD = 0x7B;
 constexpr uint16_t IL_STFLD = 0x7D;
 constexpr uint16_t IL_BOX = 0x8C;
+constexpr uint16_t IL_NEWARR = 0x8D;
+constexpr uint16_t IL_LDLEN = 0x8E;
+constexpr uint16_t IL_LDELEM_I1 = 0x90;   // ldelem.i1 .. ldelem.ref, in ECMA order
+constexpr uint16_t IL_LDELEM_I = 0x97;
+constexpr uint16_t IL_LDELEM_REF = 0x9A;
+constexpr uint16_t IL_STELEM_I = 0x9B;
+constexpr uint16_t IL_STELEM_I1 = 0x9C;   // stelem.i1 .. stelem.ref, in ECMA order
+constexpr uint16_t IL_STELEM_REF = 0xA2;
 constexpr uint16_t IL_UNBOX_ANY = 0xA5;
+constexpr uint16_t IL_CEQ = 0xFE01;
+constexpr uint16_t IL_CGT = 0xFE02;
+constexpr uint16_t IL_CLT = 0xFE04;
 
 } // namespace
 
@@ -68,7 +89,481 @@ namespace CLRNet {
 namespace Phase1 {
 namespace VM {
 
-BytecodeCompiler::BytecodeCompiler() {
+namespace {
+
+bool IsBranchOpcode(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::Branch:
+    case VmOpcode::BranchIfTrue:
+    case VmOpcode::BranchIfFalse:
+    case VmOpcode::BranchIfEqual:
+    case VmOpcode::BranchIfNotEqual:
+    case VmOpcode::BranchIfGreaterThan:
+    case VmOpcode::BranchIfLessOrEqual:
+    case VmOpcode::BranchIfLessThan:
+    case VmOpcode::BranchIfGreaterOrEqual:
+    case VmOpcode::BranchIfGreaterOrEqualOrdered:
+    case VmOpcode::BranchIfLessOrEqualOrdered:
+    case VmOpcode::BranchIfGreaterThanUnsigned:
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+    case VmOpcode::BranchIfLessThanUnsigned:
+    case VmOpcode::BranchIfLessOrEqualUnsigned:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Conditional branches that pop two operands, in the order of the IL beq .. blt.un family
+const VmOpcode CompareBranchOpcodes[] = {
+    VmOpcode::BranchIfEqual,
+    VmOpcode::BranchIfGreaterOrEqualOrdered,
+    VmOpcode::BranchIfGreaterThan,
+    VmOpcode::BranchIfLessOrEqualOrdered,
+    VmOpcode::BranchIfLessThan,
+    VmOpcode::BranchIfNotEqual,
+    VmOpcode::BranchIfGreaterOrEqualUnsigned,
+    VmOpcode::BranchIfGreaterThanUnsigned,
+    VmOpcode::BranchIfLessOrEqualUnsigned,
+    VmOpcode::BranchIfLessThanUnsigned
+};
+
+// Element types of ldelem.i1 .. ldelem.ref; ldelem.i is rejected before the lookup
+const VmElementType LoadElementTypes[] = {
+    VmElementType::Int8,
+    VmElementType::UInt8,
+    VmElementType::Int16,
+    VmElementType::UInt16,
+    VmElementType::Int32,
+    VmElementType::UInt32,
+    VmElementType::Int64,
+    VmElementType::Int64,
+    VmElementType::Float,
+    VmElementType::Double,
+    VmElementType::Reference
+};
+
+// Element types of stelem.i1 .. stelem.ref
+const VmElementType StoreElementTypes[] = {
+    VmElementType::Int8,
+    VmElementType::Int16,
+    VmElementType::Int32,
+    VmElementType::Int64,
+    VmElementType::Float,
+    VmElementType::Double,
+    VmElementType::Reference
+};
+
+// Opcodes DecodeInstruction emits. Everything else is derived by the compiler's own passes, and some
+// of it (unchecked element access) is only safe because those passes proved it.
+bool IsContainerOpcode(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::AddLocalConstant:
+    case VmOpcode::ArithmeticLocals:
+    case VmOpcode::ReservedA:
+    case VmOpcode::ReservedB:
+    case VmOpcode::LoadElementUnchecked:
+    case VmOpcode::StoreElementUnchecked:
+        return false;
+    default:
+        return opcode < VmOpcode::AddI4 || opcode > VmOpcode::DivideR8;
+    }
+}
+
+// Switch over switchTargets[first, first + count); tables longer than op1 holds go through wideOperands
+VmInstruction SwitchInstruction(VmProgram& program, size_t first, uint32_t count) {
+    if (VmInstruction::FitsOperand1(count)) {
+        return VmInstruction(VmOpcode::Switch, static_cast<int32_t>(first), static_cast<int32_t>(count));
+    }
+    VmInstruction instruction(VmOpcode::Switch, static_cast<int32_t>(program.wideOperands.size()), -1);
+    program.wideOperands.push_back((static_cast<uint64_t>(first) << 32) | count);
+    return instruction;
+}
+
+bool IsArithmeticOpcode(VmOpcode opcode) {
+    return opcode == VmOpcode::Add || opcode == VmOpcode::Subtract ||
+           opcode == VmOpcode::Multiply || opcode == VmOpcode::Divide;
+}
+
+// Returns the fused compare-and-branch opcode, or Nop when the pair does not fuse
+VmOpcode FuseCompareBranch(VmOpcode compare, VmOpcode branch) {
+    bool onTrue = branch == VmOpcode::BranchIfTrue;
+    if (!onTrue && branch != VmOpcode::BranchIfFalse) {
+        return VmOpcode::Nop;
+    }
+
+    switch (compare) {
+    case VmOpcode::CompareEqual:
+        return onTrue ? VmOpcode::BranchIfEqual : VmOpcode::BranchIfNotEqual;
+    case VmOpcode::CompareGreaterThan:
+        return onTrue ? VmOpcode::BranchIfGreaterThan : VmOpcode::BranchIfLessOrEqual;
+    case VmOpcode::CompareLessThan:
+        return onTrue ? VmOpcode::BranchIfLessThan : VmOpcode::BranchIfGreaterOrEqual;
+    default:
+        return VmOpcode::Nop;
+    }
+}
+
+// Stack effect of an unfused instruction; false when the register tier cannot express it
+bool GetStackEffect(VmOpcode opcode, int32_t& pops, int32_t& pushes) {
+    switch (opcode) {
+    case VmOpcode::Nop:
+    case VmOpcode::Branch:
+        pops = 0; pushes = 0; return true;
+    case VmOpcode::LoadArgument:
+    case VmOpcode::LoadLocal:
+    case VmOpcode::LoadConstantI4:
+    case VmOpcode::LoadConstantI8:
+    case VmOpcode::LoadConstantR4:
+    case VmOpcode::LoadConstantR8:
+    case VmOpcode::LoadNull:
+        pops = 0; pushes = 1; return true;
+    case VmOpcode::LoadString:
+    case VmOpcode::ArithmeticLocals:
+        pops = 0; pushes = 1; return true;
+    case VmOpcode::StoreArgument:
+    case VmOpcode::StoreLocal:
+    case VmOpcode::BranchIfTrue:
+    case VmOpcode::BranchIfFalse:
+    case VmOpcode::Pop:
+    case VmOpcode::Switch:
+        pops = 1; pushes = 0; return true;
+    case VmOpcode::LoadField:
+    case VmOpcode::Box:
+    case VmOpcode::UnboxAny:
+    case VmOpcode::CastClass:
+    case VmOpcode::NewArray:
+    case VmOpcode::LoadLength:
+    case VmOpcode::ConvertToInt32:
+        pops = 1; pushes = 1; return true;
+    case VmOpcode::StoreField:
+    case VmOpcode::BranchIfEqual:
+    case VmOpcode::BranchIfNotEqual:
+    case VmOpcode::BranchIfGreaterThan:
+    case VmOpcode::BranchIfLessOrEqual:
+    case VmOpcode::BranchIfLessThan:
+    case VmOpcode::BranchIfGreaterOrEqual:
+    case VmOpcode::BranchIfGreaterOrEqualOrdered:
+    case VmOpcode::BranchIfLessOrEqualOrdered:
+    case VmOpcode::BranchIfGreaterThanUnsigned:
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+    case VmOpcode::BranchIfLessThanUnsigned:
+    case VmOpcode::BranchIfLessOrEqualUnsigned:
+        pops = 2; pushes = 0; return true;
+    case VmOpcode::Add:
+    case VmOpcode::Subtract:
+    case VmOpcode::Multiply:
+    case VmOpcode::Divide:
+    case VmOpcode::CompareEqual:
+    case VmOpcode::CompareNotEqual:
+    case VmOpcode::CompareGreaterThan:
+    case VmOpcode::CompareLessThan:
+    case VmOpcode::LoadElement:
+    case VmOpcode::LoadElementUnchecked:
+        pops = 2; pushes = 1; return true;
+    case VmOpcode::StoreElement:
+    case VmOpcode::StoreElementUnchecked:
+        pops = 3; pushes = 0; return true;
+    case VmOpcode::Return:
+    case VmOpcode::AddLocalConstant:
+        pops = 0; pushes = 0; return true;
+    default:
+        // Quickened arithmetic behaves like the generic opcode it replaced
+        if (opcode >= VmOpcode::AddI4 && opcode <= VmOpcode::DivideR8) {
+            pops = 2; pushes = 1; return true;
+        }
+        // A call's effect depends on its site's signature (GetCallStackEffect), which the register
+        // tier has no encoding for
+        return false;
+    }
+}
+
+// Stack effect of a call, from the signature resolved for its site; false when it wasn't resolved
+bool GetCallStackEffect(const VmProgram& program, const VmInstruction& instruction, int32_t& pops, int32_t& pushes) {
+    if (instruction.operand0 < 0 || static_cast<size_t>(instruction.operand0) >= program.callSites.size()) {
+        return false;
+    }
+    const VmCallSite& site = program.callSites[static_cast<size_t>(instruction.operand0)];
+    if (!site.signatureKnown || site.argumentCount > static_cast<uint32_t>(INT32_MAX)) {
+        return false;
+    }
+    pops = static_cast<int32_t>(site.argumentCount);
+    pushes = site.returnsValue ? 1 : 0;
+    return true;
+}
+
+bool IsCallOpcode(VmOpcode opcode) {
+    return opcode == VmOpcode::Call || opcode == VmOpcode::CallVirtual || opcode == VmOpcode::HostCall ||
+           opcode == VmOpcode::NewObject;
+}
+
+VmRegisterOpcode ToRegisterOpcode(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::Add: return VmRegisterOpcode::Add;
+    case VmOpcode::Subtract: return VmRegisterOpcode::Subtract;
+    case VmOpcode::Multiply: return VmRegisterOpcode::Multiply;
+    case VmOpcode::Divide: return VmRegisterOpcode::Divide;
+    case VmOpcode::CompareEqual: return VmRegisterOpcode::CompareEqual;
+    case VmOpcode::CompareNotEqual: return VmRegisterOpcode::CompareNotEqual;
+    case VmOpcode::CompareGreaterThan: return VmRegisterOpcode::CompareGreaterThan;
+    case VmOpcode::CompareLessThan: return VmRegisterOpcode::CompareLessThan;
+    default: return VmRegisterOpcode::Nop;
+    }
+}
+
+// Register-tier jump for a two-operand conditional branch; Nop for anything else
+VmRegisterOpcode ToRegisterJump(VmOpcode branch) {
+    switch (branch) {
+    case VmOpcode::BranchIfEqual: return VmRegisterOpcode::JumpIfEqual;
+    case VmOpcode::BranchIfNotEqual: return VmRegisterOpcode::JumpIfNotEqual;
+    case VmOpcode::BranchIfGreaterThan: return VmRegisterOpcode::JumpIfGreaterThan;
+    case VmOpcode::BranchIfLessOrEqual: return VmRegisterOpcode::JumpIfLessOrEqual;
+    case VmOpcode::BranchIfLessThan: return VmRegisterOpcode::JumpIfLessThan;
+    case VmOpcode::BranchIfGreaterOrEqual: return VmRegisterOpcode::JumpIfGreaterOrEqual;
+    case VmOpcode::BranchIfGreaterOrEqualOrdered: return VmRegisterOpcode::JumpIfGreaterOrEqualOrdered;
+    case VmOpcode::BranchIfLessOrEqualOrdered: return VmRegisterOpcode::JumpIfLessOrEqualOrdered;
+    case VmOpcode::BranchIfGreaterThanUnsigned: return VmRegisterOpcode::JumpIfGreaterThanUnsigned;
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned: return VmRegisterOpcode::JumpIfGreaterOrEqualUnsigned;
+    case VmOpcode::BranchIfLessThanUnsigned: return VmRegisterOpcode::JumpIfLessThanUnsigned;
+    case VmOpcode::BranchIfLessOrEqualUnsigned: return VmRegisterOpcode::JumpIfLessOrEqualUnsigned;
+    default: return VmRegisterOpcode::Nop;
+    }
+}
+
+// Mirrors FuseCompareBranch for the register encoding
+VmRegisterOpcode ToRegisterCompareJump(VmOpcode compare, VmOpcode branch) {
+    return ToRegisterJump(FuseCompareBranch(compare, branch));
+}
+
+// Nesting limit for signature types, so a hostile blob cannot exhaust the native stack
+const uint32_t MaxSignatureDepth = 64;
+
+// ECMA-335 II.23.2 compressed unsigned integer
+bool ReadCompressed(const uint8_t*& cursor, const uint8_t* end, uint32_t& value) {
+    if (cursor >= end) {
+        return false;
+    }
+    if ((cursor[0] & 0x80) == 0) {
+        value = cursor[0];
+        cursor += 1;
+    } else if ((cursor[0] & 0xC0) == 0x80 && end - cursor >= 2) {
+        value = (static_cast<uint32_t>(cursor[0] & 0x3F) << 8) | cursor[1];
+        cursor += 2;
+    } else if ((cursor[0] & 0xE0) == 0xC0 && end - cursor >= 4) {
+        value = (static_cast<uint32_t>(cursor[0] & 0x1F) << 24) | (static_cast<uint32_t>(cursor[1]) << 16) |
+                (static_cast<uint32_t>(cursor[2]) << 8) | cursor[3];
+        cursor += 4;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Reads one signature Type and reports the kind of its zero value: primitives map to their kind,
+// references to Null, byrefs to a null ManagedPointer, and value types, native ints, pointers
+// and generic parameters, which the VM has no zero for, to Uninitialized
+bool ReadSignatureType(const uint8_t*& cursor, const uint8_t* end, VmValueKind& kind, uint32_t depth) {
+    if (cursor >= end || depth > MaxSignatureDepth) {
+        return false;
+    }
+
+    uint8_t element = *cursor++;
+    uint32_t value = 0;
+    VmValueKind inner;
+    switch (element) {
+    case ELEMENT_TYPE_BOOLEAN:
+    case ELEMENT_TYPE_CHAR:
+    case ELEMENT_TYPE_I1:
+    case ELEMENT_TYPE_U1:
+    case ELEMENT_TYPE_I2:
+    case ELEMENT_TYPE_U2:
+    case ELEMENT_TYPE_I4:
+    case ELEMENT_TYPE_U4:
+        kind = VmValueKind::Int32;
+        return true;
+    case ELEMENT_TYPE_I8:
+    case ELEMENT_TYPE_U8:
+        kind = VmValueKind::Int64;
+        return true;
+    case ELEMENT_TYPE_R4:
+        kind = VmValueKind::Float;
+        return true;
+    case ELEMENT_TYPE_R8:
+        kind = VmValueKind::Double;
+        return true;
+    case ELEMENT_TYPE_STRING:
+    case ELEMENT_TYPE_OBJECT:
+        kind = VmValueKind::Null;
+        return true;
+    case ELEMENT_TYPE_VOID:
+    case ELEMENT_TYPE_I:
+    case ELEMENT_TYPE_U:
+    case ELEMENT_TYPE_TYPEDBYREF:
+        kind = VmValueKind::Uninitialized;
+        return true;
+    case ELEMENT_TYPE_CLASS:
+        kind = VmValueKind::Null;
+        return ReadCompressed(cursor, end, value);
+    case ELEMENT_TYPE_VALUETYPE:
+    case ELEMENT_TYPE_VAR:
+    case ELEMENT_TYPE_MVAR:
+        kind = VmValueKind::Uninitialized;
+        return ReadCompressed(cursor, end, value);
+    case ELEMENT_TYPE_SZARRAY:
+        kind = VmValueKind::Null;
+        return ReadSignatureType(cursor, end, inner, depth + 1);
+    case ELEMENT_TYPE_ARRAY: {
+        // Element type, rank, then the sizes and (signed, same width) lower bounds
+        uint32_t rank = 0;
+        uint32_t count = 0;
+        kind = VmValueKind::Null;
+        if (!ReadSignatureType(cursor, end, inner, depth + 1) || !ReadCompressed(cursor, end, rank)) {
+            return false;
+        }
+        for (int bounds = 0; bounds < 2; ++bounds) {
+            if (!ReadCompressed(cursor, end, count) || count > static_cast<size_t>(end - cursor)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!ReadCompressed(cursor, end, value)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    case ELEMENT_TYPE_GENERICINST: {
+        uint32_t count = 0;
+        if (cursor >= end) {
+            return false;
+        }
+        kind = *cursor++ == ELEMENT_TYPE_CLASS ? VmValueKind::Null : VmValueKind::Uninitialized;
+        if (!ReadCompressed(cursor, end, value) || !ReadCompressed(cursor, end, count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!ReadSignatureType(cursor, end, inner, depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case ELEMENT_TYPE_BYREF:
+        kind = VmValueKind::ManagedPointer;
+        return ReadSignatureType(cursor, end, inner, depth + 1);
+    case ELEMENT_TYPE_PTR:
+        kind = VmValueKind::Uninitialized;
+        return ReadSignatureType(cursor, end, inner, depth + 1);
+    case ELEMENT_TYPE_FNPTR: {
+        // Calling convention, optional generic arity, parameter count, return type, parameters
+        uint32_t count = 0;
+        kind = VmValueKind::Uninitialized;
+        if (cursor >= end) {
+            return false;
+        }
+        uint8_t callingConvention = *cursor++;
+        if ((callingConvention & IMAGE_CEE_CS_CALLCONV_GENERIC) && !ReadCompressed(cursor, end, value)) {
+            return false;
+        }
+        if (!ReadCompressed(cursor, end, count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i <= count; ++i) {
+            if (cursor < end && *cursor == ELEMENT_TYPE_SENTINEL) {
+                ++cursor;
+            }
+            if (!ReadSignatureType(cursor, end, inner, depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case ELEMENT_TYPE_CMOD_REQD:
+    case ELEMENT_TYPE_CMOD_OPT:
+        // Modifiers prefix the type they apply to
+        return ReadCompressed(cursor, end, value) && ReadSignatureType(cursor, end, kind, depth + 1);
+    case ELEMENT_TYPE_PINNED:
+        return ReadSignatureType(cursor, end, kind, depth + 1);
+    default:
+        return false;
+    }
+}
+
+// Decodes a LOCAL_SIG blob into the zero-value kinds of the method's locals
+bool DecodeLocalSignature(const uint8_t* signature, uint32_t length, std::vector<VmValueKind>& kinds) {
+    const uint8_t* cursor = signature;
+    const uint8_t* end = signature + length;
+    uint32_t count = 0;
+    if (length == 0 || *cursor++ != IMAGE_CEE_CS_CALLCONV_LOCAL_SIG || !ReadCompressed(cursor, end, count) ||
+        count > length) {
+        return false;
+    }
+
+    kinds.resize(count);
+    for (VmValueKind& kind : kinds) {
+        if (!ReadSignatureType(cursor, end, kind, 0)) {
+            kinds.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decodes a MethodDefSig or MethodRefSig (ECMA-335 II.23.2.1-2) into what a call to the method pops
+// and pushes. Parameters after a vararg sentinel are counted, since the call site pushes them too.
+bool DecodeCallSignature(const uint8_t* signature, uint32_t length, bool constructor, VmCallSignature& call) {
+    const uint8_t* cursor = signature;
+    const uint8_t* end = signature + length;
+    uint32_t value = 0;
+    uint32_t count = 0;
+    if (length == 0) {
+        return false;
+    }
+
+    uint8_t callingConvention = *cursor++;
+    if ((callingConvention & IMAGE_CEE_CS_CALLCONV_MASK) > IMAGE_CEE_CS_CALLCONV_VARARG) {
+        return false;
+    }
+    if ((callingConvention & IMAGE_CEE_CS_CALLCONV_GENERIC) && !ReadCompressed(cursor, end, value)) {
+        return false;
+    }
+    if (!ReadCompressed(cursor, end, count) || count > length) {
+        return false;
+    }
+
+    // The return type's custom modifiers come before VOID
+    while (cursor < end && (*cursor == ELEMENT_TYPE_CMOD_REQD || *cursor == ELEMENT_TYPE_CMOD_OPT)) {
+        ++cursor;
+        if (!ReadCompressed(cursor, end, value)) {
+            return false;
+        }
+    }
+    if (cursor >= end) {
+        return false;
+    }
+    bool returnsValue = *cursor != ELEMENT_TYPE_VOID;
+
+    // With EXPLICITTHIS the receiver is already the first declared parameter
+    bool hasThis = (callingConvention & IMAGE_CEE_CS_CALLCONV_HASTHIS) &&
+                   !(callingConvention & IMAGE_CEE_CS_CALLCONV_EXPLICITTHIS);
+    if (constructor) {
+        // newobj allocates the receiver and pushes it
+        if (!hasThis || returnsValue) {
+            return false;
+        }
+        call.argumentCount = count;
+        call.returnsValue = 1;
+        return true;
+    }
+    call.argumentCount = count + (hasThis ? 1 : 0);
+    call.returnsValue = returnsValue ? 1 : 0;
+    return true;
+}
+
+} // namespace
+
+BytecodeCompiler::BytecodeCompiler()
+    : m_emitRegisterCode(false) {
 }
 
 BytecodeCompiler::~BytecodeCompiler() {
@@ -81,7 +576,69 @@ bool BytecodeCompiler::Initialize() {
 void BytecodeCompiler::Shutdown() {
 }
 
-std::shared_ptr<VmProgram> BytecodeCompiler::Compile(const void* ilCode, size_t ilSize, const std::string& cacheKey) {
+bool BytecodeCompiler::ResolveLocalSignature(const void* ilCode, size_t ilSize, const VmHostCallbacks* host,
+                                             std::vector<uint8_t>& signature) {
+    signature.clear();
+    MethodHeader header{};
+    if (!ilCode || !host || !host->localSignatureCallback ||
+        !ParseMethodHeader(static_cast<const uint8_t*>(ilCode), ilSize, header) || header.localVarSigTok == 0) {
+        return false;
+    }
+
+    // The blob only has to stay valid for the callback, so it is copied out
+    const uint8_t* data = nullptr;
+    uint32_t length = 0;
+    if (!host->localSignatureCallback(header.localVarSigTok, &data, &length, host->userContext) || !data) {
+        return false;
+    }
+    signature.assign(data, data + length);
+    return true;
+}
+
+bool BytecodeCompiler::ResolveCallSignatures(const void* ilCode, size_t ilSize, const VmHostCallbacks* host,
+                                             std::vector<VmCallSignature>& signatures) {
+    signatures.clear();
+    MethodHeader header{};
+    if (!ilCode || !host || !host->methodSignatureCallback ||
+        !ParseMethodHeader(static_cast<const uint8_t*>(ilCode), ilSize, header)) {
+        return false;
+    }
+
+    // Decoding is the only way to find the call tokens; the passes are left for Compile
+    VmProgram scratch;
+    size_t offset = 0;
+    while (offset < header.codeSize) {
+        if (!DecodeInstruction(header.code, header.codeSize, offset, scratch)) {
+            return false;
+        }
+    }
+    if (scratch.callSites.empty()) {
+        return false;
+    }
+
+    std::vector<bool> constructors(scratch.callSites.size(), false);
+    for (const VmInstruction& instruction : scratch.instructions) {
+        if (instruction.opcode == VmOpcode::NewObject) {
+            constructors[static_cast<size_t>(instruction.operand0)] = true;
+        }
+    }
+
+    signatures.resize(scratch.callSites.size());
+    for (size_t index = 0; index < scratch.callSites.size(); ++index) {
+        const uint8_t* data = nullptr;
+        uint32_t length = 0;
+        if (!host->methodSignatureCallback(scratch.callSites[index].metadataToken, &data, &length, host->userContext) ||
+            !data || !DecodeCallSignature(data, length, constructors[index], signatures[index])) {
+            signatures.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<VmProgram> BytecodeCompiler::Compile(const void* ilCode, size_t ilSize, const std::string& cacheKey,
+                                                      const std::vector<uint8_t>* localSignature,
+                                                      const std::vector<VmCallSignature>* callSignatures) {
     if (!ilCode || ilSize == 0) {
         return nullptr;
     }
@@ -97,7 +654,14 @@ std::shared_ptr<VmProgram> BytecodeCompiler::Compile(const void* ilCode, size_t
     program->argumentCount = 0;
     program->localCount = 0;
 
-    if (!DecodeIL(header, *program)) {
+    // With the local signature the frame size is exact; without it, it is inferred from the
+    // highest local the IL touches
+    if (localSignature &&
+        DecodeLocalSignature(localSignature->data(), static_cast<uint32_t>(localSignature->size()), program->localKinds)) {
+        program->localCount = static_cast<uint32_t>(program->localKinds.size());
+    }
+
+    if (!DecodeIL(header, *program, callSignatures)) {
         return nullptr;
     }
 
@@ -135,7 +699,8 @@ bool BytecodeCompiler::ParseMethodHeader(const uint8_t* il, size_t size, MethodH
     return size >= (fat->Size * 4 + header.codeSize);
 }
 
-bool BytecodeCompiler::DecodeIL(const MethodHeader& header, VmProgram& program) {
+bool BytecodeCompiler::DecodeIL(const MethodHeader& header, VmProgram& program,
+                                const std::vector<VmCallSignature>* callSignatures) {
     size_t offset = 0;
     std::vector<size_t> offsetToInstruction(header.codeSize + 1, SIZE_MAX);
 
@@ -163,6 +728,1050 @@ bool BytecodeCompiler::DecodeIL(const MethodHeader& header, VmProgram& program)
     }
 
     program.branchFixups.clear();
+
+    // Switch tables were decoded as IL offsets
+    for (int32_t& target : program.switchTargets) {
+        if (target < 0 || static_cast<size_t>(target) >= offsetToInstruction.size() ||
+            offsetToInstruction[static_cast<size_t>(target)] == SIZE_MAX) {
+            return false;
+        }
+        target = static_cast<int32_t>(offsetToInstruction[static_cast<size_t>(target)]);
+    }
+
+    // IL may not touch a local its signature doesn't declare
+    if (!program.localKinds.empty() && program.localCount > program.localKinds.size()) {
+        return false;
+    }
+
+    // Signatures resolved for this IL, one per call site in decode order
+    if (callSignatures && callSignatures->size() == program.callSites.size()) {
+        for (size_t index = 0; index < program.callSites.size(); ++index) {
+            VmCallSite& callSite = program.callSites[index];
+            callSite.argumentCount = (*callSignatures)[index].argumentCount;
+            callSite.returnsValue = (*callSignatures)[index].returnsValue != 0;
+            callSite.signatureKnown = true;
+        }
+    }
+
+    Lower(program);
+    return true;
+}
+
+std::shared_ptr<VmProgram> BytecodeCompiler::Load(const void* bytecode, size_t size, const std::string& cacheKey,
+                                                   const wchar_t*& failureReason) {
+    failureReason = nullptr;
+    auto reject = [&](const wchar_t* reason) {
+        failureReason = reason;
+        return nullptr;
+    };
+
+    VmBytecodeHeader header;
+    if (!bytecode || size < sizeof(header)) {
+        return reject(L"Bytecode container is truncated");
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(bytecode);
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != VmBytecodeMagic) {
+        return reject(L"Not a VM bytecode container");
+    }
+    if (header.majorVersion != VmBytecodeMajorVersion) {
+        return reject(L"Unsupported VM bytecode container version");
+    }
+    if (header.headerSize < sizeof(header) || header.flags != 0) {
+        return reject(L"Malformed VM bytecode container header");
+    }
+
+    // 64-bit arithmetic, so hostile counts cannot wrap around the size check
+    uint64_t instructionBytes = static_cast<uint64_t>(header.instructionCount) * sizeof(VmBytecodeInstruction);
+    uint64_t callSiteBytes = static_cast<uint64_t>(header.callSiteCount) * sizeof(VmBytecodeCallSite);
+    uint64_t switchBytes = static_cast<uint64_t>(header.switchTargetCount) * sizeof(int32_t);
+    uint64_t end = header.headerSize + instructionBytes + callSiteBytes + switchBytes;
+    if (end > size || (end < size && header.minorVersion <= VmBytecodeMinorVersion)) {
+        return reject(L"Bytecode container size does not match its sections");
+    }
+    if (header.instructionCount == 0) {
+        return reject(L"Bytecode container has no instructions");
+    }
+
+    auto program = std::make_shared<VmProgram>();
+    program->cacheKey = cacheKey;
+    program->argumentCount = header.argumentCount;
+    program->localCount = header.localCount;
+
+    const uint8_t* cursor = data + header.headerSize;
+    program->instructions.resize(header.instructionCount);
+    for (VmInstruction& instruction : program->instructions) {
+        VmBytecodeInstruction encoded;
+        memcpy(&encoded, cursor, sizeof(encoded));
+        cursor += sizeof(encoded);
+        if (encoded.reserved[0] != 0 || encoded.reserved[1] != 0 || encoded.reserved[2] != 0 ||
+            encoded.opcode > static_cast<uint8_t>(VmOpcode::ConvertToInt32) ||
+            !IsContainerOpcode(static_cast<VmOpcode>(encoded.opcode))) {
+            return reject(L"Bytecode container uses an opcode it may not contain");
+        }
+
+        // Containers spell every operand out in full; repack the ones VmInstruction keeps elsewhere
+        VmOpcode opcode = static_cast<VmOpcode>(encoded.opcode);
+        if (opcode == VmOpcode::LoadConstantI8 || opcode == VmOpcode::LoadConstantR8) {
+            uint64_t bits = (static_cast<uint64_t>(static_cast<uint32_t>(encoded.operand1)) << 32) |
+                            static_cast<uint32_t>(encoded.operand0);
+            instruction = VmInstruction(opcode, static_cast<int32_t>(program->wideOperands.size()));
+            program->wideOperands.push_back(bits);
+        } else if (opcode == VmOpcode::Switch) {
+            if (encoded.operand0 < 0 || encoded.operand1 < 0) {
+                return reject(L"Bytecode container has an operand out of range");
+            }
+            instruction = SwitchInstruction(*program, static_cast<size_t>(encoded.operand0),
+                                            static_cast<uint32_t>(encoded.operand1));
+        } else {
+            instruction = VmInstruction(opcode, encoded.operand0);
+        }
+    }
+
+    program->callSites.resize(header.callSiteCount);
+    for (VmCallSite& callSite : program->callSites) {
+        VmBytecodeCallSite encoded;
+        memcpy(&encoded, cursor, sizeof(encoded));
+        cursor += sizeof(encoded);
+        callSite.metadataToken = encoded.metadataToken;
+        callSite.argumentCount = encoded.argumentCount;
+    }
+
+    program->switchTargets.resize(header.switchTargetCount);
+    if (header.switchTargetCount > 0) {
+        memcpy(program->switchTargets.data(), cursor, static_cast<size_t>(switchBytes));
+    }
+
+    // Operands the interpreter would otherwise only catch at run time, or not at all
+    size_t instructionCount = program->instructions.size();
+    auto targetInRange = [&](int32_t target) {
+        return target >= 0 && static_cast<size_t>(target) < instructionCount;
+    };
+    for (int32_t target : program->switchTargets) {
+        if (!targetInRange(target)) {
+            return reject(L"Bytecode container has a switch target out of range");
+        }
+    }
+    for (const VmInstruction& instruction : program->instructions) {
+        bool valid = true;
+        switch (instruction.opcode) {
+        case VmOpcode::LoadArgument:
+        case VmOpcode::StoreArgument:
+            valid = instruction.operand0 >= 0 && static_cast<uint32_t>(instruction.operand0) < program->argumentCount;
+            break;
+        case VmOpcode::LoadLocal:
+        case VmOpcode::StoreLocal:
+            valid = instruction.operand0 >= 0 && static_cast<uint32_t>(instruction.operand0) < program->localCount;
+            break;
+        case VmOpcode::Call:
+        case VmOpcode::CallVirtual:
+        case VmOpcode::HostCall:
+        case VmOpcode::NewObject:
+            valid = instruction.operand0 >= 0 && static_cast<size_t>(instruction.operand0) < program->callSites.size();
+            break;
+        case VmOpcode::Switch: {
+            size_t first = 0;
+            size_t cases = 0;
+            valid = program->GetSwitchTable(instruction, first, cases);
+            break;
+        }
+        case VmOpcode::LoadElement:
+        case VmOpcode::StoreElement:
+            valid = instruction.operand0 >= 0 &&
+                    instruction.operand0 <= static_cast<int32_t>(VmElementType::Reference);
+            break;
+        default:
+            valid = !IsBranchOpcode(instruction.opcode) || targetInRange(instruction.operand0);
+            break;
+        }
+        if (!valid) {
+            return reject(L"Bytecode container has an operand out of range");
+        }
+    }
+
+    Lower(*program);
+    return program;
+}
+
+// Passes shared by every front end, run over the plain stack encoding
+void BytecodeCompiler::Lower(VmProgram& program) {
+    EliminateBoxing(program);
+    HoistBoundsChecks(program);
+
+    // The register translation reads the plain stack encoding, so it runs before fusion
+    if (m_emitRegisterCode && !TranslateToRegisters(program)) {
+        program.registerInstructions.clear();
+        program.registerConstants.clear();
+        program.registerCount = 0;
+    }
+
+    FuseSuperinstructions(program);
+
+    // Programs that fail verification are still valid; they just keep the checked interpreter
+    Verify(program);
+}
+
+void BytecodeCompiler::EliminateBoxing(VmProgram& program) {
+    std::vector<VmInstruction>& code = program.instructions;
+    size_t count = code.size();
+
+    std::vector<bool> isBranchTarget(count, false);
+    for (const VmInstruction& instruction : code) {
+        if (IsBranchOpcode(instruction.opcode) && instruction.operand0 >= 0 &&
+            static_cast<size_t>(instruction.operand0) < count) {
+            isBranchTarget[instruction.operand0] = true;
+        }
+    }
+    for (int32_t target : program.switchTargets) {
+        isBranchTarget[target] = true;
+    }
+
+    // Provenance of one evaluation stack slot within the current basic block. A slot popped
+    // from an empty model has unknown provenance, so it never matches anything.
+    struct Slot {
+        size_t producer;
+        size_t box;        // index of the Box that pushed the slot, or SIZE_MAX
+        bool primitive;    // holds a number (constant, arithmetic or comparison result)
+    };
+    const Slot Unknown = { SIZE_MAX, SIZE_MAX, false };
+
+    std::vector<Slot> slots;
+    std::vector<bool> removed(count, false);
+    bool changed = false;
+
+    auto pop = [&]() {
+        if (slots.empty()) {
+            return Unknown;
+        }
+        Slot slot = slots.back();
+        slots.pop_back();
+        return slot;
+    };
+
+    for (size_t index = 0; index < count; ++index) {
+        if (isBranchTarget[index]) {
+            slots.clear();
+        }
+
+        VmInstruction& instruction = code[index];
+        int32_t pops = 0;
+        int32_t pushes = 0;
+        if (!GetStackEffect(instruction.opcode, pops, pushes)) {
+            // Calls have a dynamic stack effect; forget everything rather than guess
+            slots.clear();
+            continue;
+        }
+
+        switch (instruction.opcode) {
+        case VmOpcode::Box: {
+            Slot boxed = pop();
+            slots.push_back({ index, index, boxed.primitive });
+            continue;
+        }
+        case VmOpcode::UnboxAny: {
+            // box T; ... unbox.any T hands back the value that was boxed
+            Slot boxed = pop();
+            if (boxed.box != SIZE_MAX && code[boxed.box].operand0 == instruction.operand0) {
+                removed[boxed.box] = true;
+                removed[index] = true;
+                changed = true;
+                slots.push_back({ index, SIZE_MAX, boxed.primitive });
+            } else {
+                slots.push_back({ index, SIZE_MAX, false });
+            }
+            continue;
+        }
+        case VmOpcode::BranchIfTrue:
+        case VmOpcode::BranchIfFalse: {
+            // A boxed number is never null: brtrue always jumps and brfalse never does
+            Slot condition = pop();
+            if (condition.box != SIZE_MAX && condition.primitive) {
+                code[condition.box] = VmInstruction(VmOpcode::Pop);
+                if (instruction.opcode == VmOpcode::BranchIfTrue) {
+                    instruction = VmInstruction(VmOpcode::Branch, instruction.operand0);
+                } else {
+                    removed[index] = true;
+                }
+                changed = true;
+            }
+            slots.clear();
+            continue;
+        }
+        case VmOpcode::CompareEqual: {
+            // box T; ldnull; ceq on a boxed number is always false
+            Slot right = pop();
+            Slot left = pop();
+            if (left.box != SIZE_MAX && left.primitive && right.producer != SIZE_MAX &&
+                code[right.producer].opcode == VmOpcode::LoadNull) {
+                code[left.box] = VmInstruction(VmOpcode::Pop);
+                removed[right.producer] = true;
+                instruction = VmInstruction(VmOpcode::LoadConstantI4, 0);
+                changed = true;
+            }
+            slots.push_back({ index, SIZE_MAX, true });
+            continue;
+        }
+        default:
+            break;
+        }
+
+        for (int32_t i = 0; i < pops; ++i) {
+            pop();
+        }
+        bool primitive = instruction.opcode == VmOpcode::LoadConstantI4 ||
+                         instruction.opcode == VmOpcode::LoadConstantI8 ||
+                         instruction.opcode == VmOpcode::LoadConstantR4 ||
+                         instruction.opcode == VmOpcode::LoadConstantR8 ||
+                         IsArithmeticOpcode(instruction.opcode) ||
+                         instruction.opcode == VmOpcode::CompareNotEqual ||
+                         instruction.opcode == VmOpcode::CompareGreaterThan ||
+                         instruction.opcode == VmOpcode::CompareLessThan;
+        for (int32_t i = 0; i < pushes; ++i) {
+            slots.push_back({ index, SIZE_MAX, primitive });
+        }
+        if (IsBranchOpcode(instruction.opcode) || instruction.opcode == VmOpcode::Switch ||
+            instruction.opcode == VmOpcode::Return) {
+            slots.clear();
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    // Drop the removed instructions; a branch to one of them lands on the next survivor
+    std::vector<VmInstruction> kept;
+    kept.reserve(count);
+    std::vector<int32_t> remap(count + 1, 0);
+    for (size_t index = 0; index < count; ++index) {
+        remap[index] = static_cast<int32_t>(kept.size());
+        if (!removed[index]) {
+            kept.push_back(code[index]);
+        }
+    }
+    remap[count] = static_cast<int32_t>(kept.size());
+
+    for (VmInstruction& instruction : kept) {
+        if (IsBranchOpcode(instruction.opcode) && instruction.operand0 >= 0 &&
+            static_cast<size_t>(instruction.operand0) <= count) {
+            instruction.operand0 = remap[instruction.operand0];
+        }
+    }
+    for (int32_t& target : program.switchTargets) {
+        target = remap[target];
+    }
+
+    code.swap(kept);
+}
+
+void BytecodeCompiler::HoistBoundsChecks(VmProgram& program) {
+    std::vector<VmInstruction>& code = program.instructions;
+    size_t count = code.size();
+
+    // Branches and switch entries arriving at each instruction
+    std::vector<std::vector<size_t>> sources(count);
+    for (size_t index = 0; index < count; ++index) {
+        const VmInstruction& instruction = code[index];
+        if (IsBranchOpcode(instruction.opcode) && instruction.operand0 >= 0 &&
+            static_cast<size_t>(instruction.operand0) < count) {
+            sources[instruction.operand0].push_back(index);
+        }
+        size_t first = 0;
+        size_t cases = 0;
+        if (instruction.opcode == VmOpcode::Switch && program.GetSwitchTable(instruction, first, cases)) {
+            for (size_t i = 0; i < cases; ++i) {
+                int32_t target = program.switchTargets[first + i];
+                if (target >= 0 && static_cast<size_t>(target) < count) {
+                    sources[target].push_back(index);
+                }
+            }
+        }
+    }
+
+    auto is = [&](size_t index, VmOpcode opcode, int32_t operand) {
+        return code[index].opcode == opcode && code[index].operand0 == operand;
+    };
+
+    for (size_t latch = 0; latch < count; ++latch) {
+        // COND: ldloc i; ldloc|ldarg a; ldlen; [conv.i4]; blt|blt.un BODY
+        VmOpcode latchOpcode = code[latch].opcode;
+        if ((latchOpcode != VmOpcode::BranchIfLessThan && latchOpcode != VmOpcode::BranchIfLessThanUnsigned) ||
+            code[latch].operand0 < 0 || static_cast<size_t>(code[latch].operand0) >= latch) {
+            continue;
+        }
+        size_t body = static_cast<size_t>(code[latch].operand0);
+        size_t length = latch - 1;
+        if (code[length].opcode == VmOpcode::ConvertToInt32 && length > 0) {
+            --length;
+        }
+        if (length < body + 2 || code[length].opcode != VmOpcode::LoadLength) {
+            continue;
+        }
+        const VmInstruction arrayLoad = code[length - 1];
+        size_t condition = length - 2;
+        if ((arrayLoad.opcode != VmOpcode::LoadLocal && arrayLoad.opcode != VmOpcode::LoadArgument) ||
+            code[condition].opcode != VmOpcode::LoadLocal) {
+            continue;
+        }
+        int32_t counter = code[condition].operand0;
+        if (arrayLoad.opcode == VmOpcode::LoadLocal && arrayLoad.operand0 == counter) {
+            continue;
+        }
+
+        // i += 1 right before COND, plain or already fused
+        size_t increment = SIZE_MAX;
+        if (condition >= body + 1 && code[condition - 1].opcode == VmOpcode::AddLocalConstant &&
+            code[condition - 1].operand0 == counter && code[condition - 1].operand1 == 1 &&
+            code[condition - 1].operand2 == counter) {
+            increment = condition - 1;
+        } else if (condition >= body + 4 && is(condition - 4, VmOpcode::LoadLocal, counter) &&
+                   is(condition - 3, VmOpcode::LoadConstantI4, 1) && code[condition - 2].opcode == VmOpcode::Add &&
+                   is(condition - 1, VmOpcode::StoreLocal, counter)) {
+            increment = condition - 4;
+        }
+        if (increment == SIZE_MAX) {
+            continue;
+        }
+
+        // Entry: ldc.i4 c (c >= 0); stloc i; br COND
+        if (body < 3 || !is(body - 1, VmOpcode::Branch, static_cast<int32_t>(condition)) ||
+            !is(body - 2, VmOpcode::StoreLocal, counter) || code[body - 3].opcode != VmOpcode::LoadConstantI4 ||
+            code[body - 3].operand0 < 0) {
+            continue;
+        }
+
+        // Control reaches the body only from the loop itself, and COND only from the entry branch and
+        // the body; nothing may land inside the initialisation, the increment or the condition
+        bool closed = true;
+        for (size_t index = body - 2; index <= latch && closed; ++index) {
+            for (size_t source : sources[index]) {
+                bool fromLoop = source >= body && source <= latch;
+                bool allowed = index == condition ? fromLoop || source == body - 1
+                                                  : index >= body && index <= increment && fromLoop;
+                if (!allowed) {
+                    closed = false;
+                    break;
+                }
+            }
+        }
+        if (!closed) {
+            continue;
+        }
+
+        // Neither the counter nor the array may be stored inside the body
+        bool stable = true;
+        for (size_t index = body; index < increment && stable; ++index) {
+            const VmInstruction& instruction = code[index];
+            bool storesLocal = instruction.opcode == VmOpcode::StoreLocal ||
+                               instruction.opcode == VmOpcode::AddLocalConstant;
+            int32_t stored = instruction.opcode == VmOpcode::AddLocalConstant ? instruction.operand2 : instruction.operand0;
+            if (storesLocal && stored == counter) {
+                stable = false;
+            } else if (arrayLoad.opcode == VmOpcode::LoadLocal ? storesLocal && stored == arrayLoad.operand0
+                                                               : is(index, VmOpcode::StoreArgument, arrayLoad.operand0)) {
+                stable = false;
+            }
+        }
+        if (!stable) {
+            continue;
+        }
+
+        // Each a[i] pair in the body proves the element access that consumes it
+        for (size_t pair = body; pair + 1 < increment; ++pair) {
+            if (!is(pair, arrayLoad.opcode, arrayLoad.operand0) || !is(pair + 1, VmOpcode::LoadLocal, counter) ||
+                !sources[pair + 1].empty()) {
+                continue;
+            }
+            int32_t depth = 2;
+            for (size_t index = pair + 2; index < increment && sources[index].empty(); ++index) {
+                VmOpcode opcode = code[index].opcode;
+                int32_t pops = 0;
+                int32_t pushes = 0;
+                if (IsBranchOpcode(opcode) || opcode == VmOpcode::Switch || opcode == VmOpcode::Return ||
+                    !GetStackEffect(opcode, pops, pushes)) {
+                    break;
+                }
+                if (depth - pops < 2) {
+                    if (opcode == VmOpcode::LoadElement && depth == 2) {
+                        code[index].opcode = VmOpcode::LoadElementUnchecked;
+                    } else if (opcode == VmOpcode::StoreElement && depth == 3) {
+                        code[index].opcode = VmOpcode::StoreElementUnchecked;
+                    }
+                    break;
+                }
+                depth += pushes - pops;
+            }
+        }
+    }
+}
+
+void BytecodeCompiler::FuseSuperinstructions(VmProgram& program) {
+    const std::vector<VmInstruction>& source = program.instructions;
+    size_t count = source.size();
+
+    std::vector<bool> isBranchTarget(count, false);
+    for (const VmInstruction& instruction : source) {
+        if (IsBranchOpcode(instruction.opcode) && instruction.operand0 >= 0 &&
+            static_cast<size_t>(instruction.operand0) < count) {
+            isBranchTarget[instruction.operand0] = true;
+        }
+    }
+    for (int32_t target : program.switchTargets) {
+        isBranchTarget[target] = true;
+    }
+
+    // A sequence can only collapse when no branch lands inside it
+    auto canFuse = [&](size_t start, size_t length) {
+        if (start + length > count) {
+            return false;
+        }
+        for (size_t i = start + 1; i < start + length; ++i) {
+            if (isBranchTarget[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // The constant an ldloc; ldc.i4; add|sub; stloc sequence at `start` adds to the local
+    auto addend = [&](size_t start) {
+        int64_t constant = source[start + 1].operand0;
+        return source[start + 2].opcode == VmOpcode::Subtract ? -constant : constant;
+    };
+
+    std::vector<VmInstruction> fused;
+    fused.reserve(count);
+    std::vector<int32_t> remap(count + 1, 0);
+
+    size_t index = 0;
+    while (index < count) {
+        const VmInstruction& first = source[index];
+        VmInstruction emitted = first;
+        size_t consumed = 1;
+
+        // Fused operands must fit the narrow op1/op2 fields; wider ones keep the plain sequence
+        if (first.opcode == VmOpcode::LoadLocal && canFuse(index, 4) &&
+            source[index + 1].opcode == VmOpcode::LoadConstantI4 &&
+            (source[index + 2].opcode == VmOpcode::Add || source[index + 2].opcode == VmOpcode::Subtract) &&
+            source[index + 3].opcode == VmOpcode::StoreLocal &&
+            VmInstruction::FitsOperand1(addend(index)) && VmInstruction::FitsOperand2(source[index + 3].operand0)) {
+            // ldloc a; ldc.i4 c; add|sub; stloc b
+            emitted = VmInstruction(VmOpcode::AddLocalConstant, first.operand0, static_cast<int32_t>(addend(index)),
+                                    source[index + 3].operand0);
+            consumed = 4;
+        } else if (first.opcode == VmOpcode::LoadLocal && canFuse(index, 3) &&
+                   source[index + 1].opcode == VmOpcode::LoadLocal &&
+                   VmInstruction::FitsOperand1(source[index + 1].operand0) &&
+                   IsArithmeticOpcode(source[index + 2].opcode)) {
+            // ldloc a; ldloc b; add|sub|mul|div
+            emitted = VmInstruction(VmOpcode::ArithmeticLocals, first.operand0, source[index + 1].operand0,
+                                    static_cast<int32_t>(source[index + 2].opcode));
+            consumed = 3;
+        } else if (canFuse(index, 2)) {
+            // ceq|cgt|clt; brtrue|brfalse
+            VmOpcode branch = FuseCompareBranch(first.opcode, source[index + 1].opcode);
+            if (branch != VmOpcode::Nop) {
+                emitted = VmInstruction(branch, source[index + 1].operand0);
+                consumed = 2;
+            }
+        }
+
+        for (size_t i = 0; i < consumed; ++i) {
+            remap[index + i] = static_cast<int32_t>(fused.size());
+        }
+        fused.push_back(emitted);
+        index += consumed;
+    }
+    remap[count] = static_cast<int32_t>(fused.size());
+
+    for (VmInstruction& instruction : fused) {
+        if (IsBranchOpcode(instruction.opcode) && instruction.operand0 >= 0 &&
+            static_cast<size_t>(instruction.operand0) <= count) {
+            instruction.operand0 = remap[instruction.operand0];
+        }
+    }
+    for (int32_t& target : program.switchTargets) {
+        target = remap[target];
+    }
+
+    program.instructions.swap(fused);
+}
+
+bool BytecodeCompiler::ComputeStackDepths(const VmProgram& program, std::vector<int32_t>& depths, int32_t& maxDepth) {
+    const std::vector<VmInstruction>& code = program.instructions;
+    depths.assign(code.size(), -1);
+    maxDepth = 0;
+    if (code.empty()) {
+        return true;
+    }
+
+    std::vector<size_t> worklist;
+    depths[0] = 0;
+    worklist.push_back(0);
+
+    auto propagate = [&](size_t target, int32_t depth) {
+        if (target >= code.size()) {
+            return false;
+        }
+        if (depths[target] < 0) {
+            depths[target] = depth;
+            worklist.push_back(target);
+            return true;
+        }
+        // Every path into an instruction must agree on the stack height
+        return depths[target] == depth;
+    };
+
+    while (!worklist.empty()) {
+        size_t index = worklist.back();
+        worklist.pop_back();
+
+        const VmInstruction& instruction = code[index];
+        int32_t pops = 0;
+        int32_t pushes = 0;
+        bool known = IsCallOpcode(instruction.opcode) ? GetCallStackEffect(program, instruction, pops, pushes)
+                                                      : GetStackEffect(instruction.opcode, pops, pushes);
+        if (!known) {
+            return false;
+        }
+
+        int32_t depth = depths[index];
+        if (depth < pops) {
+            return false;
+        }
+        depth = depth - pops + pushes;
+        if (depth > maxDepth) {
+            maxDepth = depth;
+        }
+
+        if (instruction.opcode == VmOpcode::Return) {
+            continue;
+        }
+        if (IsBranchOpcode(instruction.opcode) &&
+            (instruction.operand0 < 0 || !propagate(static_cast<size_t>(instruction.operand0), depth))) {
+            return false;
+        }
+        if (instruction.opcode == VmOpcode::Switch) {
+            size_t first = 0;
+            size_t cases = 0;
+            if (!program.GetSwitchTable(instruction, first, cases)) {
+                return false;
+            }
+            for (size_t i = 0; i < cases; ++i) {
+                int32_t target = program.switchTargets[first + i];
+                if (target < 0 || !propagate(static_cast<size_t>(target), depth)) {
+                    return false;
+                }
+            }
+        }
+        if (instruction.opcode != VmOpcode::Branch && index + 1 < code.size() && !propagate(index + 1, depth)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BytecodeCompiler::Verify(VmProgram& program) {
+    program.verified = false;
+    program.maxStackDepth = 0;
+
+    auto localInRange = [&](int32_t index) {
+        return index >= 0 && static_cast<uint32_t>(index) < program.localCount;
+    };
+
+    for (const VmInstruction& instruction : program.instructions) {
+        switch (instruction.opcode) {
+        case VmOpcode::LoadArgument:
+        case VmOpcode::StoreArgument:
+            if (instruction.operand0 < 0 || static_cast<uint32_t>(instruction.operand0) >= program.argumentCount) {
+                return false;
+            }
+            break;
+        case VmOpcode::LoadLocal:
+        case VmOpcode::StoreLocal:
+            if (!localInRange(instruction.operand0)) {
+                return false;
+            }
+            break;
+        case VmOpcode::AddLocalConstant:
+            if (!localInRange(instruction.operand0) || !localInRange(instruction.operand2)) {
+                return false;
+            }
+            break;
+        case VmOpcode::ArithmeticLocals:
+            if (!localInRange(instruction.operand0) || !localInRange(instruction.operand1) ||
+                !IsArithmeticOpcode(static_cast<VmOpcode>(instruction.operand2))) {
+                return false;
+            }
+            break;
+        case VmOpcode::LoadConstantI8:
+        case VmOpcode::LoadConstantR8:
+            if (instruction.operand0 < 0 || static_cast<size_t>(instruction.operand0) >= program.wideOperands.size()) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Also rejects out-of-range branch targets, underflow and inconsistent heights at merge points
+    std::vector<int32_t> depths;
+    int32_t maxDepth = 0;
+    if (!ComputeStackDepths(program, depths, maxDepth)) {
+        return false;
+    }
+
+    program.maxStackDepth = static_cast<uint32_t>(maxDepth);
+    program.verified = true;
+    return true;
+}
+
+bool BytecodeCompiler::VerifyRegisters(VmProgram& program) {
+    const std::vector<VmRegisterInstruction>& code = program.registerInstructions;
+    uint64_t fixedRegisters = static_cast<uint64_t>(program.argumentCount) + program.localCount +
+                              program.registerConstants.size();
+    if (code.empty() || program.registerCount < fixedRegisters) {
+        return false;
+    }
+
+    auto registerInRange = [&](int32_t index) {
+        return index >= 0 && static_cast<uint32_t>(index) < program.registerCount;
+    };
+    // Jumping to the end of the code returns nothing, like falling off it
+    auto targetInRange = [&](int32_t target) {
+        return target >= 0 && static_cast<size_t>(target) <= code.size();
+    };
+
+    for (const VmRegisterInstruction& instruction : code) {
+        bool valid = false;
+        switch (instruction.opcode) {
+        case VmRegisterOpcode::Nop:
+            valid = true;
+            break;
+        case VmRegisterOpcode::Move:
+            valid = registerInRange(instruction.a) && registerInRange(instruction.b);
+            break;
+        case VmRegisterOpcode::Add:
+        case VmRegisterOpcode::Subtract:
+        case VmRegisterOpcode::Multiply:
+        case VmRegisterOpcode::Divide:
+        case VmRegisterOpcode::CompareEqual:
+        case VmRegisterOpcode::CompareNotEqual:
+        case VmRegisterOpcode::CompareGreaterThan:
+        case VmRegisterOpcode::CompareLessThan:
+            valid = registerInRange(instruction.a) && registerInRange(instruction.b) && registerInRange(instruction.c);
+            break;
+        case VmRegisterOpcode::Jump:
+            valid = targetInRange(instruction.a);
+            break;
+        case VmRegisterOpcode::JumpIfTrue:
+        case VmRegisterOpcode::JumpIfFalse:
+            valid = targetInRange(instruction.a) && registerInRange(instruction.b);
+            break;
+        case VmRegisterOpcode::JumpIfEqual:
+        case VmRegisterOpcode::JumpIfNotEqual:
+        case VmRegisterOpcode::JumpIfGreaterThan:
+        case VmRegisterOpcode::JumpIfLessOrEqual:
+        case VmRegisterOpcode::JumpIfLessThan:
+        case VmRegisterOpcode::JumpIfGreaterOrEqual:
+        case VmRegisterOpcode::JumpIfGreaterOrEqualOrdered:
+        case VmRegisterOpcode::JumpIfLessOrEqualOrdered:
+        case VmRegisterOpcode::JumpIfGreaterThanUnsigned:
+        case VmRegisterOpcode::JumpIfGreaterOrEqualUnsigned:
+        case VmRegisterOpcode::JumpIfLessThanUnsigned:
+        case VmRegisterOpcode::JumpIfLessOrEqualUnsigned:
+            valid = targetInRange(instruction.a) && registerInRange(instruction.b) && registerInRange(instruction.c);
+            break;
+        case VmRegisterOpcode::Return:
+            valid = instruction.a < 0 || registerInRange(instruction.a);
+            break;
+        }
+        if (!valid) {
+            return false;
+        }
+    }
+
+    // The translation only makes constants out of ldc and ldnull; rebuilding them from their kind
+    // drops any payload bits a reference would need
+    for (VmValue& constant : program.registerConstants) {
+        switch (constant.GetKind()) {
+        case VmValue::Kind::Int32: constant = VmValue(constant.GetInt32()); break;
+        case VmValue::Kind::Int64: constant = VmValue(constant.GetInt64()); break;
+        case VmValue::Kind::Float: constant = VmValue(constant.GetFloat()); break;
+        case VmValue::Kind::Double: constant = VmValue(constant.GetDouble()); break;
+        case VmValue::Kind::Null: constant = VmValue(nullptr, VmValue::Kind::Null); break;
+        default: return false;
+        }
+    }
+    return true;
+}
+
+bool BytecodeCompiler::TranslateToRegisters(VmProgram& program) {
+    const std::vector<VmInstruction>& code = program.instructions;
+
+    std::vector<int32_t> depths;
+    int32_t maxDepth = 0;
+    if (!ComputeStackDepths(program, depths, maxDepth)) {
+        return false;
+    }
+
+    std::vector<bool> isLabel(code.size(), false);
+    for (const VmInstruction& instruction : code) {
+        if (IsBranchOpcode(instruction.opcode)) {
+            isLabel[instruction.operand0] = true;
+        }
+    }
+
+    const int32_t localBase = static_cast<int32_t>(program.argumentCount);
+    const int32_t slotBase = localBase + static_cast<int32_t>(program.localCount);
+    const int32_t constantBase = slotBase + maxDepth;
+
+    std::vector<VmRegisterInstruction> output;
+    std::vector<VmValue> constants;
+    std::vector<size_t> startIndex(code.size() + 1, 0);
+
+    // Symbolic evaluation stack: each entry names the register currently holding that slot's value.
+    // Loads only push a register name; values are copied into their canonical slot register
+    // ("materialised") at block boundaries or before the register they name is overwritten.
+    std::vector<int32_t> symbolic;
+    size_t pendingIndex = SIZE_MAX; // last instruction whose temp destination may be retargeted by a store
+
+    auto slotRegister = [&](size_t depth) {
+        return slotBase + static_cast<int32_t>(depth);
+    };
+
+    auto materialize = [&](size_t depth) {
+        if (symbolic[depth] != slotRegister(depth)) {
+            output.emplace_back(VmRegisterOpcode::Move, slotRegister(depth), symbolic[depth]);
+            symbolic[depth] = slotRegister(depth);
+        }
+    };
+
+    auto materializeAll = [&]() {
+        for (size_t depth = 0; depth < symbolic.size(); ++depth) {
+            materialize(depth);
+        }
+    };
+
+    auto materializeReferences = [&](int32_t reg) {
+        for (size_t depth = 0; depth < symbolic.size(); ++depth) {
+            if (symbolic[depth] == reg && reg != slotRegister(depth)) {
+                materialize(depth);
+            }
+        }
+    };
+
+    auto constantRegister = [&](const VmValue& value) {
+        for (size_t i = 0; i < constants.size(); ++i) {
+            if (constants[i].GetKind() == value.GetKind() && constants[i].GetRawBits() == value.GetRawBits()) {
+                return constantBase + static_cast<int32_t>(i);
+            }
+        }
+        constants.push_back(value);
+        return constantBase + static_cast<int32_t>(constants.size() - 1);
+    };
+
+    auto store = [&](int32_t target) {
+        int32_t value = symbolic.back();
+        symbolic.pop_back();
+
+        size_t before = output.size();
+        materializeReferences(target);
+        if (output.size() == before && pendingIndex != SIZE_MAX && pendingIndex + 1 == output.size() &&
+            output[pendingIndex].a == value && value == slotRegister(symbolic.size())) {
+            // add tmp, x, y; move local, tmp  ->  add local, x, y
+            output[pendingIndex].a = target;
+        } else {
+            output.emplace_back(VmRegisterOpcode::Move, target, value);
+        }
+        pendingIndex = SIZE_MAX;
+    };
+
+    bool fallsThrough = false;
+    for (size_t index = 0; index < code.size(); ++index) {
+        startIndex[index] = output.size();
+        if (depths[index] < 0) {
+            fallsThrough = false;
+            continue; // unreachable
+        }
+
+        if (isLabel[index] || !fallsThrough) {
+            symbolic.clear();
+            for (int32_t depth = 0; depth < depths[index]; ++depth) {
+                symbolic.push_back(slotRegister(depth));
+            }
+            pendingIndex = SIZE_MAX;
+        }
+
+        const VmInstruction& instruction = code[index];
+        fallsThrough = true;
+
+        switch (instruction.opcode) {
+        case VmOpcode::Nop:
+            break;
+        case VmOpcode::LoadArgument:
+            symbolic.push_back(instruction.operand0);
+            break;
+        case VmOpcode::LoadLocal:
+            symbolic.push_back(localBase + instruction.operand0);
+            break;
+        case VmOpcode::LoadConstantI4:
+            symbolic.push_back(constantRegister(VmValue(instruction.operand0)));
+            break;
+        case VmOpcode::LoadConstantI8: {
+            int64_t value = static_cast<int64_t>(program.wideOperands[instruction.operand0]);
+            if (!VmValue::CanHoldInt64(value)) {
+                // Leave it to the stack interpreter, which fails the execution with a reason
+                return false;
+            }
+            symbolic.push_back(constantRegister(VmValue(value)));
+            break;
+        }
+        case VmOpcode::LoadConstantR4: {
+            float value = 0.0f;
+            std::memcpy(&value, &instruction.operand0, sizeof(float));
+            symbolic.push_back(constantRegister(VmValue(value)));
+            break;
+        }
+        case VmOpcode::LoadConstantR8: {
+            uint64_t bits = program.wideOperands[instruction.operand0];
+            double value = 0.0;
+            std::memcpy(&value, &bits, sizeof(double));
+            symbolic.push_back(constantRegister(VmValue(value)));
+            break;
+        }
+        case VmOpcode::LoadNull:
+            symbolic.push_back(constantRegister(VmValue(nullptr, VmValue::Kind::Null)));
+            break;
+        case VmOpcode::StoreArgument:
+            store(instruction.operand0);
+            break;
+        case VmOpcode::StoreLocal:
+            store(localBase + instruction.operand0);
+            break;
+        case VmOpcode::Add:
+        case VmOpcode::Subtract:
+        case VmOpcode::Multiply:
+        case VmOpcode::Divide:
+        case VmOpcode::CompareEqual:
+        case VmOpcode::CompareNotEqual:
+        case VmOpcode::CompareGreaterThan:
+        case VmOpcode::CompareLessThan: {
+            int32_t right = symbolic.back();
+            symbolic.pop_back();
+            int32_t left = symbolic.back();
+            symbolic.pop_back();
+
+            VmRegisterOpcode jump = VmRegisterOpcode::Nop;
+            if (index + 1 < code.size() && !isLabel[index + 1]) {
+                jump = ToRegisterCompareJump(instruction.opcode, code[index + 1].opcode);
+            }
+
+            if (jump != VmRegisterOpcode::Nop) {
+                // cmp; brtrue/brfalse collapses into a single conditional jump
+                materializeAll();
+                output.emplace_back(jump, code[index + 1].operand0, left, right);
+                startIndex[++index] = output.size() - 1;
+                pendingIndex = SIZE_MAX;
+                break;
+            }
+
+            int32_t destination = slotRegister(symbolic.size());
+            output.emplace_back(ToRegisterOpcode(instruction.opcode), destination, left, right);
+            symbolic.push_back(destination);
+            pendingIndex = output.size() - 1;
+            break;
+        }
+        case VmOpcode::Pop:
+            symbolic.pop_back();
+            pendingIndex = SIZE_MAX;
+            break;
+        case VmOpcode::Branch:
+            materializeAll();
+            output.emplace_back(VmRegisterOpcode::Jump, instruction.operand0);
+            fallsThrough = false;
+            break;
+        case VmOpcode::BranchIfTrue:
+        case VmOpcode::BranchIfFalse: {
+            int32_t condition = symbolic.back();
+            symbolic.pop_back();
+            materializeAll();
+            output.emplace_back(instruction.opcode == VmOpcode::BranchIfTrue ? VmRegisterOpcode::JumpIfTrue
+                                                                              : VmRegisterOpcode::JumpIfFalse,
+                                instruction.operand0, condition);
+            break;
+        }
+        case VmOpcode::BranchIfEqual:
+        case VmOpcode::BranchIfNotEqual:
+        case VmOpcode::BranchIfGreaterThan:
+        case VmOpcode::BranchIfLessOrEqual:
+        case VmOpcode::BranchIfLessThan:
+        case VmOpcode::BranchIfGreaterOrEqual:
+        case VmOpcode::BranchIfGreaterOrEqualOrdered:
+        case VmOpcode::BranchIfLessOrEqualOrdered:
+        case VmOpcode::BranchIfGreaterThanUnsigned:
+        case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+        case VmOpcode::BranchIfLessThanUnsigned:
+        case VmOpcode::BranchIfLessOrEqualUnsigned: {
+            // Decoded straight from IL beq .. blt.un
+            int32_t right = symbolic.back();
+            symbolic.pop_back();
+            int32_t left = symbolic.back();
+            symbolic.pop_back();
+            materializeAll();
+            output.emplace_back(ToRegisterJump(instruction.opcode), instruction.operand0, left, right);
+            pendingIndex = SIZE_MAX;
+            break;
+        }
+        case VmOpcode::Return:
+            output.emplace_back(VmRegisterOpcode::Return, symbolic.empty() ? -1 : symbolic.back());
+            fallsThrough = false;
+            break;
+        default:
+            return false;
+        }
+
+        if (fallsThrough && index + 1 < code.size() && isLabel[index + 1]) {
+            materializeAll();
+            pendingIndex = SIZE_MAX;
+        }
+    }
+
+    if (fallsThrough) {
+        // Running off the end returns the top of the stack, matching the stack interpreter
+        output.emplace_back(VmRegisterOpcode::Return, symbolic.empty() ? -1 : symbolic.back());
+    }
+
+    for (VmRegisterInstruction& instruction : output) {
+        switch (instruction.opcode) {
+        case VmRegisterOpcode::Jump:
+        case VmRegisterOpcode::JumpIfTrue:
+        case VmRegisterOpcode::JumpIfFalse:
+        case VmRegisterOpcode::JumpIfEqual:
+        case VmRegisterOpcode::JumpIfNotEqual:
+        case VmRegisterOpcode::JumpIfGreaterThan:
+        case VmRegisterOpcode::JumpIfLessOrEqual:
+        case VmRegisterOpcode::JumpIfLessThan:
+        case VmRegisterOpcode::JumpIfGreaterOrEqual:
+        case VmRegisterOpcode::JumpIfGreaterOrEqualOrdered:
+        case VmRegisterOpcode::JumpIfLessOrEqualOrdered:
+        case VmRegisterOpcode::JumpIfGreaterThanUnsigned:
+        case VmRegisterOpcode::JumpIfGreaterOrEqualUnsigned:
+        case VmRegisterOpcode::JumpIfLessThanUnsigned:
+        case VmRegisterOpcode::JumpIfLessOrEqualUnsigned:
+            instruction.a = static_cast<int32_t>(startIndex[instruction.a]);
+            break;
+        default:
+            break;
+        }
+    }
+
+    program.registerInstructions.swap(output);
+    program.registerConstants.swap(constants);
+    program.registerCount = static_cast<uint32_t>(constantBase) + static_cast<uint32_t>(program.registerConstants.size());
     return true;
 }
 
@@ -291,9 +1900,24 @@ bool BytecodeCompiler::DecodeInstruction(const uint8_t* il, size_t ilSize, size_
         int64_t value = 0;
         std::memcpy(&value, il + offset, sizeof(int64_t));
         offset += 8;
-        program.instructions.emplace_back(VmOpcode::LoadConstantI8,
-                                           static_cast<int32_t>(value & 0xFFFFFFFF),
-                                           static_cast<int32_t>((value >> 32) & 0xFFFFFFFF));
+        program.instructions.emplace_back(VmOpcode::LoadConstantI8, static_cast<int32_t>(program.wideOperands.size()));
+        program.wideOperands.push_back(static_cast<uint64_t>(value));
+        break;
+    }
+    case IL_LDC_R4: {
+        program.instructions.emplace_back(VmOpcode::LoadConstantR4, ReadInt32(il, ilSize, offset));
+        offset += 4;
+        break;
+    }
+    case IL_LDC_R8: {
+        if (offset + 8 > ilSize) {
+            return false;
+        }
+        int64_t bits = 0;
+        std::memcpy(&bits, il + offset, sizeof(int64_t));
+        offset += 8;
+        program.instructions.emplace_back(VmOpcode::LoadConstantR8, static_cast<int32_t>(program.wideOperands.size()));
+        program.wideOperands.push_back(static_cast<uint64_t>(bits));
         break;
     }
     case IL_ADD:
@@ -308,6 +1932,18 @@ bool BytecodeCompiler::DecodeInstruction(const uint8_t* il, size_t ilSize, size_
     case IL_DIV:
         program.instructions.emplace_back(VmOpcode::Divide);
         break;
+    case IL_CONV_I4:
+        program.instructions.emplace_back(VmOpcode::ConvertToInt32);
+        break;
+    case IL_CEQ:
+        program.instructions.emplace_back(VmOpcode::CompareEqual);
+        break;
+    case IL_CGT:
+        program.instructions.emplace_back(VmOpcode::CompareGreaterThan);
+        break;
+    case IL_CLT:
+        program.instructions.emplace_back(VmOpcode::CompareLessThan);
+        break;
     case IL_BR_S: {
         int8_t delta = ReadInt8(il, ilSize, offset);
         offset += 1;
@@ -362,6 +1998,45 @@ bool BytecodeCompiler::DecodeInstruction(const uint8_t* il, size_t ilSize, size_
         program.branchFixups.emplace_back(index, target);
         break;
     }
+    case IL_BEQ_S: case IL_BEQ_S + 1: case IL_BEQ_S + 2: case IL_BEQ_S + 3: case IL_BEQ_S + 4:
+    case IL_BEQ_S + 5: case IL_BEQ_S + 6: case IL_BEQ_S + 7: case IL_BEQ_S + 8: case IL_BLT_UN_S: {
+        int8_t delta = ReadInt8(il, ilSize, offset);
+        offset += 1;
+        int32_t target = static_cast<int32_t>(offset) + delta;
+        size_t index = program.instructions.size();
+        program.instructions.emplace_back(CompareBranchOpcodes[fullOpcode - IL_BEQ_S]);
+        program.branchFixups.emplace_back(index, target);
+        break;
+    }
+    case IL_BEQ: case IL_BEQ + 1: case IL_BEQ + 2: case IL_BEQ + 3: case IL_BEQ + 4:
+    case IL_BEQ + 5: case IL_BEQ + 6: case IL_BEQ + 7: case IL_BEQ + 8: case IL_BLT_UN: {
+        int32_t delta = ReadInt32(il, ilSize, offset);
+        offset += 4;
+        int32_t target = static_cast<int32_t>(offset) + delta;
+        size_t index = program.instructions.size();
+        program.instructions.emplace_back(CompareBranchOpcodes[fullOpcode - IL_BEQ]);
+        program.branchFixups.emplace_back(index, target);
+        break;
+    }
+    case IL_SWITCH: {
+        // switch N, then N rel32 targets measured from the end of the instruction
+        if (offset + 4 > ilSize) {
+            return false;
+        }
+        uint32_t count = static_cast<uint32_t>(ReadInt32(il, ilSize, offset));
+        offset += 4;
+        if (count > (ilSize - offset) / 4) {
+            return false;
+        }
+        int32_t next = static_cast<int32_t>(offset + static_cast<size_t>(count) * 4);
+        size_t first = program.switchTargets.size();
+        for (uint32_t i = 0; i < count; ++i) {
+            program.switchTargets.push_back(next + ReadInt32(il, ilSize, offset));
+            offset += 4;
+        }
+        program.instructions.push_back(SwitchInstruction(program, first, count));
+        break;
+    }
     case IL_CALL:
     case IL_CALLVIRT: {
         uint32_t token = static_cast<uint32_t>(ReadInt32(il, ilSize, offset));
@@ -413,6 +2088,31 @@ bool BytecodeCompiler::DecodeInstruction(const uint8_t* il, size_t ilSize, size_
     case IL_LDNULL:
         program.instructions.emplace_back(VmOpcode::LoadNull);
         break;
+    case IL_NEWARR:
+        program.instructions.emplace_back(VmOpcode::NewArray, ReadInt32(il, ilSize, offset));
+        offset += 4;
+        break;
+    case IL_LDLEN:
+        program.instructions.emplace_back(VmOpcode::LoadLength);
+        break;
+    case IL_LDELEM_I:
+    case IL_STELEM_I:
+        // Native-int elements have no VmValue kind to load or store
+        return false;
+    case IL_LDELEM_I1: case IL_LDELEM_I1 + 1: case IL_LDELEM_I1 + 2: case IL_LDELEM_I1 + 3:
+    case IL_LDELEM_I1 + 4: case IL_LDELEM_I1 + 5: case IL_LDELEM_I1 + 6: case IL_LDELEM_I1 + 8:
+    case IL_LDELEM_I1 + 9: case IL_LDELEM_REF:
+        program.instructions.emplace_back(VmOpcode::LoadElement,
+                                           static_cast<int32_t>(LoadElementTypes[fullOpcode - IL_LDELEM_I1]));
+        break;
+    case IL_STELEM_I1: case IL_STELEM_I1 + 1: case IL_STELEM_I1 + 2: case IL_STELEM_I1 + 3:
+    case IL_STELEM_I1 + 4: case IL_STELEM_I1 + 5: case IL_STELEM_REF:
+        program.instructions.emplace_back(VmOpcode::StoreElement,
+                                           static_cast<int32_t>(StoreElementTypes[fullOpcode - IL_STELEM_I1]));
+        break;
+    case IL_POP:
+        program.instructions.emplace_back(VmOpcode::Pop);
+        break;
     case IL_RET:
         program.instructions.emplace_back(VmOpcode::Return);
         break;
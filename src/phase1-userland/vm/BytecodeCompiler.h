@@ -16,6 +16,12 @@ namespace VM {
 struct VmProgram;
 struct VmInstruction;
 
+// What one call site pops and pushes, decoded from its target's signature
+struct VmCallSignature {
+    uint32_t argumentCount;       // Including `this`; newobj pops only the declared parameters
+    uint32_t returnsValue;        // 1 when the call pushes a value; newobj always does
+};
+
 // Parses MSIL and emits CLRNET VM bytecode
 class BytecodeCompiler {
 public:
@@ -25,7 +31,47 @@ public:
     bool Initialize();
     void Shutdown();
 
-    std::shared_ptr<VmProgram> Compile(const void* ilCode, size_t ilSize, const std::string& cacheKey);
+    // Fetches the method's local signature blob through host->localSignatureCallback. False when the
+    // method has none or the host doesn't resolve it.
+    bool ResolveLocalSignature(const void* ilCode, size_t ilSize, const VmHostCallbacks* host,
+                               std::vector<uint8_t>& signature);
+
+    // Decodes the signature of every call, callvirt and newobj target, in call-site order, through
+    // host->methodSignatureCallback. False when the method has no calls or the host doesn't resolve
+    // all of them.
+    bool ResolveCallSignatures(const void* ilCode, size_t ilSize, const VmHostCallbacks* host,
+                               std::vector<VmCallSignature>& signatures);
+
+    // With a local signature (see ResolveLocalSignature) the program gets exact, typed locals;
+    // without one they are inferred from the highest local the IL touches. With call signatures
+    // (see ResolveCallSignatures) programs that call can be verified.
+    std::shared_ptr<VmProgram> Compile(const void* ilCode, size_t ilSize, const std::string& cacheKey,
+                                       const std::vector<uint8_t>* localSignature = nullptr,
+                                       const std::vector<VmCallSignature>* callSignatures = nullptr);
+
+    // Loads a VmBytecodeFormat container and runs it through the same passes as compiled IL.
+    // Returns nullptr and sets failureReason when the container is malformed.
+    std::shared_ptr<VmProgram> Load(const void* bytecode, size_t size, const std::string& cacheKey,
+                                    const wchar_t*& failureReason);
+
+    // Also emit the register encoding for programs the register tier can run
+    void SetEmitRegisterCode(bool enable) { m_emitRegisterCode = enable; }
+    bool EmitsRegisterCode() const { return m_emitRegisterCode; }
+
+    // Checks index ranges, branch targets and stack heights; sets program.verified on success
+    static bool Verify(VmProgram& program);
+
+    // Checks register indices, jump targets and constant kinds of the register encoding, for code
+    // the cache reads back from disk; false means the program should drop its register code
+    static bool VerifyRegisters(VmProgram& program);
+
+    // Marks element accesses in canonical `for (i = 0; i < a.Length; i++)` loops over a[i] as proven
+    // in range, so they skip the bounds check the loop condition already made. Runs on plain or fused
+    // bytecode, and the cache reruns it instead of trusting the unchecked opcodes in a file.
+    static void HoistBoundsChecks(VmProgram& program);
+
+    // Stack height on entry to each instruction (-1 when unreachable); false if heights disagree
+    static bool ComputeStackDepths(const VmProgram& program, std::vector<int32_t>& depths, int32_t& maxDepth);
 
 private:
     struct MethodHeader {
@@ -38,11 +84,18 @@ private:
     };
 
     bool ParseMethodHeader(const uint8_t* il, size_t size, MethodHeader& header);
-    bool DecodeIL(const MethodHeader& header, VmProgram& program);
+    bool DecodeIL(const MethodHeader& header, VmProgram& program,
+                  const std::vector<VmCallSignature>* callSignatures = nullptr);
     bool DecodeInstruction(const uint8_t* il, size_t ilSize, size_t& offset, VmProgram& program);
+    void Lower(VmProgram& program);
+    void EliminateBoxing(VmProgram& program);
+    void FuseSuperinstructions(VmProgram& program);
+    bool TranslateToRegisters(VmProgram& program);
     int32_t ReadInt32(const uint8_t* il, size_t size, size_t offset);
     int16_t ReadInt16(const uint8_t* il, size_t size, size_t offset);
     int8_t ReadInt8(const uint8_t* il, size_t size, size_t offset);
+
+    bool m_emitRegisterCode;
 };
 
 } // namespace VM
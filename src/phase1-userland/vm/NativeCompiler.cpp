@@ -0,0 +1,817 @@
+#include "NativeCompiler.h"
+#include "BytecodeCompiler.h"
+
+#include <cstring>
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+namespace {
+
+// The emitted code follows the Windows x64 calling convention and reads and writes the wide VmValue
+// layout directly, so other targets and compact builds stay interpreted
+#if defined(_WIN32) && (defined(_M_X64) || defined(__x86_64__)) && !defined(CLRNET_VM_COMPACT_VALUES)
+#define CLRNET_VM_NATIVE_X64 1
+#endif
+
+const size_t NativeCodeCacheSize = 1024 * 1024;
+const uint32_t MaxNativeVariables = 64;
+
+enum X64Register : uint8_t {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+enum X64Condition : uint8_t {
+    CondBelow = 0x2,
+    CondAboveOrEqual = 0x3,
+    CondEqual = 0x4,
+    CondNotEqual = 0x5,
+    CondBelowOrEqual = 0x6,
+    CondAbove = 0x7,
+    CondLess = 0xC,
+    CondGreaterOrEqual = 0xD,
+    CondLessOrEqual = 0xE,
+    CondGreater = 0xF
+};
+
+// Evaluation stack slot i lives in SlotRegisters[i]; all of them are caller-saved or saved by the prologue
+const X64Register SlotRegisters[] = { RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11 };
+const uint32_t SlotRegisterCount = sizeof(SlotRegisters) / sizeof(SlotRegisters[0]);
+const X64Register ScratchRegister = RBX;
+const X64Register ArgumentsBase = R13;
+const X64Register LocalsBase = R14;
+const X64Register ResultBase = R15;
+
+#ifdef CLRNET_VM_NATIVE_X64
+const int32_t KindOffset = static_cast<int32_t>(offsetof(VmValue, kind));
+const int32_t DataOffset = static_cast<int32_t>(offsetof(VmValue, data));
+#endif
+
+// Minimal x86-64 encoder covering the instruction forms the backend emits
+class X64Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    size_t Position() const { return code.size(); }
+
+    void Byte(uint8_t value) { code.push_back(value); }
+
+    void Int32(int32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, sizeof(bytes));
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+
+    void Rex(bool wide, uint8_t reg, uint8_t base, bool force = false) {
+        uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+        if (rex != 0x40 || force) {
+            Byte(rex);
+        }
+    }
+
+    // [base + disp32]; callers never use RSP/R12 as a base, so no SIB byte is needed
+    void MemoryOperand(uint8_t reg, uint8_t base, int32_t displacement) {
+        Byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+        Int32(displacement);
+    }
+
+    void RegisterOperand(uint8_t reg, uint8_t rm) {
+        Byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    void Push(X64Register reg) {
+        Rex(false, 0, reg);
+        Byte(static_cast<uint8_t>(0x50 | (reg & 7)));
+    }
+
+    void Pop(X64Register reg) {
+        Rex(false, 0, reg);
+        Byte(static_cast<uint8_t>(0x58 | (reg & 7)));
+    }
+
+    void Move64(X64Register destination, X64Register source) {
+        Rex(true, source, destination);
+        Byte(0x89);
+        RegisterOperand(source, destination);
+    }
+
+    void Load32(X64Register destination, X64Register base, int32_t displacement) {
+        Rex(false, destination, base);
+        Byte(0x8B);
+        MemoryOperand(destination, base, displacement);
+    }
+
+    void Store64(X64Register base, int32_t displacement, X64Register source) {
+        Rex(true, source, base);
+        Byte(0x89);
+        MemoryOperand(source, base, displacement);
+    }
+
+    void StoreByte(X64Register base, int32_t displacement, uint8_t value) {
+        Rex(false, 0, base);
+        Byte(0xC6);
+        MemoryOperand(0, base, displacement);
+        Byte(value);
+    }
+
+    void CompareByte(X64Register base, int32_t displacement, uint8_t value) {
+        Rex(false, 0, base);
+        Byte(0x80);
+        MemoryOperand(7, base, displacement);
+        Byte(value);
+    }
+
+    void MoveImmediate(X64Register destination, int32_t value) {
+        Rex(false, 0, destination);
+        Byte(static_cast<uint8_t>(0xB8 | (destination & 7)));
+        Int32(value);
+    }
+
+    // add/sub/cmp/test/xor r/m32, r32 (opcode selects the operation)
+    void Alu(uint8_t opcode, X64Register destination, X64Register source) {
+        Rex(false, source, destination);
+        Byte(opcode);
+        RegisterOperand(source, destination);
+    }
+
+    void Add(X64Register destination, X64Register source) { Alu(0x01, destination, source); }
+    void Subtract(X64Register destination, X64Register source) { Alu(0x29, destination, source); }
+    void Compare(X64Register left, X64Register right) { Alu(0x39, left, right); }
+    void Test(X64Register left, X64Register right) { Alu(0x85, left, right); }
+    void Xor(X64Register destination, X64Register source) { Alu(0x31, destination, source); }
+
+    void Multiply(X64Register destination, X64Register source) {
+        Rex(false, destination, source);
+        Byte(0x0F);
+        Byte(0xAF);
+        RegisterOperand(destination, source);
+    }
+
+    void AddImmediate(X64Register destination, int32_t value) {
+        Rex(false, 0, destination);
+        Byte(0x81);
+        RegisterOperand(0, destination);
+        Int32(value);
+    }
+
+    // setcc r8 followed by movzx r32, r8; SIL/DIL need an empty REX prefix
+    void SetCondition(X64Condition condition, X64Register destination) {
+        Rex(false, 0, destination, destination >= RSP);
+        Byte(0x0F);
+        Byte(static_cast<uint8_t>(0x90 | condition));
+        RegisterOperand(0, destination);
+
+        Rex(false, destination, destination, destination >= RSP);
+        Byte(0x0F);
+        Byte(0xB6);
+        RegisterOperand(destination, destination);
+    }
+
+    // Returns the offset of the rel32 field so it can be patched once the target is known
+    size_t Jump() {
+        Byte(0xE9);
+        Int32(0);
+        return Position() - 4;
+    }
+
+    size_t JumpIf(X64Condition condition) {
+        Byte(0x0F);
+        Byte(static_cast<uint8_t>(0x80 | condition));
+        Int32(0);
+        return Position() - 4;
+    }
+
+    void Patch(size_t fixup, size_t target) {
+        int32_t relative = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(fixup + 4));
+        std::memcpy(&code[fixup], &relative, sizeof(relative));
+    }
+
+    void Return() { Byte(0xC3); }
+};
+
+// Generic form of an opcode the backend treats identically to its quickened Int32 variant
+VmOpcode NormalizeOpcode(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::AddI4: return VmOpcode::Add;
+    case VmOpcode::SubtractI4: return VmOpcode::Subtract;
+    case VmOpcode::MultiplyI4: return VmOpcode::Multiply;
+    default: return opcode;
+    }
+}
+
+bool IsSupportedOpcode(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::Nop:
+    case VmOpcode::LoadArgument:
+    case VmOpcode::LoadLocal:
+    case VmOpcode::StoreArgument:
+    case VmOpcode::StoreLocal:
+    case VmOpcode::LoadConstantI4:
+    case VmOpcode::Add:
+    case VmOpcode::Subtract:
+    case VmOpcode::Multiply:
+    case VmOpcode::CompareEqual:
+    case VmOpcode::CompareNotEqual:
+    case VmOpcode::CompareGreaterThan:
+    case VmOpcode::CompareLessThan:
+    case VmOpcode::Branch:
+    case VmOpcode::BranchIfTrue:
+    case VmOpcode::BranchIfFalse:
+    case VmOpcode::BranchIfEqual:
+    case VmOpcode::BranchIfNotEqual:
+    case VmOpcode::BranchIfGreaterThan:
+    case VmOpcode::BranchIfLessOrEqual:
+    case VmOpcode::BranchIfLessThan:
+    case VmOpcode::BranchIfGreaterOrEqual:
+    case VmOpcode::BranchIfGreaterOrEqualOrdered:
+    case VmOpcode::BranchIfLessOrEqualOrdered:
+    case VmOpcode::BranchIfGreaterThanUnsigned:
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+    case VmOpcode::BranchIfLessThanUnsigned:
+    case VmOpcode::BranchIfLessOrEqualUnsigned:
+    case VmOpcode::AddLocalConstant:
+    case VmOpcode::ArithmeticLocals:
+    case VmOpcode::Return:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsBranch(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::Branch:
+    case VmOpcode::BranchIfTrue:
+    case VmOpcode::BranchIfFalse:
+    case VmOpcode::BranchIfEqual:
+    case VmOpcode::BranchIfNotEqual:
+    case VmOpcode::BranchIfGreaterThan:
+    case VmOpcode::BranchIfLessOrEqual:
+    case VmOpcode::BranchIfLessThan:
+    case VmOpcode::BranchIfGreaterOrEqual:
+    case VmOpcode::BranchIfGreaterOrEqualOrdered:
+    case VmOpcode::BranchIfLessOrEqualOrdered:
+    case VmOpcode::BranchIfGreaterThanUnsigned:
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+    case VmOpcode::BranchIfLessThanUnsigned:
+    case VmOpcode::BranchIfLessOrEqualUnsigned:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Operands are always Int32 here, so the ordered forms match the signed ones
+X64Condition BranchCondition(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::BranchIfEqual: return CondEqual;
+    case VmOpcode::BranchIfNotEqual: return CondNotEqual;
+    case VmOpcode::BranchIfGreaterThan: return CondGreater;
+    case VmOpcode::BranchIfLessOrEqual:
+    case VmOpcode::BranchIfLessOrEqualOrdered: return CondLessOrEqual;
+    case VmOpcode::BranchIfLessThan: return CondLess;
+    case VmOpcode::BranchIfGreaterThanUnsigned: return CondAbove;
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned: return CondAboveOrEqual;
+    case VmOpcode::BranchIfLessThanUnsigned: return CondBelow;
+    case VmOpcode::BranchIfLessOrEqualUnsigned: return CondBelowOrEqual;
+    default: return CondGreaterOrEqual;
+    }
+}
+
+X64Condition CompareCondition(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::CompareEqual: return CondEqual;
+    case VmOpcode::CompareNotEqual: return CondNotEqual;
+    case VmOpcode::CompareGreaterThan: return CondGreater;
+    default: return CondLess;
+    }
+}
+
+// Arguments occupy variable indices [0, argumentCount), locals follow
+uint32_t ArgumentVariable(const VmProgram&, int32_t index) {
+    return static_cast<uint32_t>(index);
+}
+
+uint32_t LocalVariable(const VmProgram& program, int32_t index) {
+    return program.argumentCount + static_cast<uint32_t>(index);
+}
+
+// Variables an instruction reads and writes, as bit masks over the argument+local index space
+void GetVariableUse(const VmProgram& program, const VmInstruction& instruction, uint64_t& reads, uint64_t& writes) {
+    reads = 0;
+    writes = 0;
+    switch (instruction.opcode) {
+    case VmOpcode::LoadArgument:
+        reads = 1ull << ArgumentVariable(program, instruction.operand0);
+        break;
+    case VmOpcode::StoreArgument:
+        writes = 1ull << ArgumentVariable(program, instruction.operand0);
+        break;
+    case VmOpcode::LoadLocal:
+        reads = 1ull << LocalVariable(program, instruction.operand0);
+        break;
+    case VmOpcode::StoreLocal:
+        writes = 1ull << LocalVariable(program, instruction.operand0);
+        break;
+    case VmOpcode::AddLocalConstant:
+        reads = 1ull << LocalVariable(program, instruction.operand0);
+        writes = 1ull << LocalVariable(program, instruction.operand2);
+        break;
+    case VmOpcode::ArithmeticLocals:
+        reads = (1ull << LocalVariable(program, instruction.operand0)) |
+                (1ull << LocalVariable(program, instruction.operand1));
+        break;
+    default:
+        break;
+    }
+}
+
+// Every value the compiled code produces is Int32, so a variable only needs an entry guard when
+// some path reads it before the program stores to it (definite assignment over the CFG).
+uint64_t ComputeEntryGuards(const VmProgram& program, const std::vector<int32_t>& depths) {
+    const std::vector<VmInstruction>& code = program.instructions;
+    std::vector<uint64_t> assigned(code.size(), ~0ull);
+    std::vector<bool> visited(code.size(), false);
+    std::vector<size_t> worklist;
+
+    auto flow = [&](size_t target, uint64_t state) {
+        if (target >= code.size()) {
+            return;
+        }
+        uint64_t merged = visited[target] ? (assigned[target] & state) : state;
+        if (!visited[target] || merged != assigned[target]) {
+            visited[target] = true;
+            assigned[target] = merged;
+            worklist.push_back(target);
+        }
+    };
+
+    if (!code.empty()) {
+        flow(0, 0);
+    }
+
+    while (!worklist.empty()) {
+        size_t index = worklist.back();
+        worklist.pop_back();
+
+        const VmInstruction& instruction = code[index];
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        GetVariableUse(program, instruction, reads, writes);
+        uint64_t state = assigned[index] | writes;
+
+        if (instruction.opcode == VmOpcode::Return) {
+            continue;
+        }
+        if (IsBranch(instruction.opcode)) {
+            flow(static_cast<size_t>(instruction.operand0), state);
+        }
+        if (instruction.opcode != VmOpcode::Branch) {
+            flow(index + 1, state);
+        }
+    }
+
+    uint64_t guards = 0;
+    for (size_t index = 0; index < code.size(); ++index) {
+        if (depths[index] < 0 || !visited[index]) {
+            continue;
+        }
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        GetVariableUse(program, code[index], reads, writes);
+        guards |= reads & ~assigned[index];
+    }
+    return guards;
+}
+
+} // namespace
+
+NativeCompiler::NativeCompiler()
+    : m_worker(nullptr)
+    , m_initialized(false)
+    , m_stopping(false)
+    , m_codeCache(nullptr)
+    , m_codeCacheSize(0)
+    , m_codeCacheUsed(0)
+    , m_pageSize(0)
+    , m_compiled(0)
+    , m_rejected(0) {
+    InitializeCriticalSection(&m_lock);
+    InitializeConditionVariable(&m_wake);
+}
+
+NativeCompiler::~NativeCompiler() {
+    Shutdown();
+    DeleteCriticalSection(&m_lock);
+}
+
+bool NativeCompiler::Initialize() {
+    EnterCriticalSection(&m_lock);
+    if (m_initialized) {
+        LeaveCriticalSection(&m_lock);
+        return true;
+    }
+
+#ifdef CLRNET_VM_NATIVE_X64
+    // Code is written while its pages are read-write and made execute-read before it is published,
+    // so no page of the cache is ever writable and executable at once
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+    m_pageSize = system.dwPageSize;
+    m_codeCache = static_cast<uint8_t*>(VirtualAlloc(nullptr, NativeCodeCacheSize, MEM_COMMIT | MEM_RESERVE,
+                                                     PAGE_READWRITE));
+    if (m_codeCache) {
+        m_codeCacheSize = NativeCodeCacheSize;
+    }
+#endif
+    m_codeCacheUsed = 0;
+    m_stopping = false;
+
+    // Without a backend the worker still drains the queue, marking every program as rejected
+    m_worker = CreateThread(nullptr, 0, WorkerThreadProc, this, 0, nullptr);
+    if (!m_worker) {
+        if (m_codeCache) {
+            VirtualFree(m_codeCache, 0, MEM_RELEASE);
+            m_codeCache = nullptr;
+            m_codeCacheSize = 0;
+        }
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    m_initialized = true;
+    LeaveCriticalSection(&m_lock);
+    return true;
+}
+
+void NativeCompiler::Shutdown() {
+    EnterCriticalSection(&m_lock);
+    if (!m_initialized) {
+        LeaveCriticalSection(&m_lock);
+        return;
+    }
+    m_stopping = true;
+    WakeAllConditionVariable(&m_wake);
+    HANDLE worker = m_worker;
+    m_worker = nullptr;
+    LeaveCriticalSection(&m_lock);
+
+    if (worker) {
+        WaitForSingleObject(worker, INFINITE);
+        CloseHandle(worker);
+    }
+
+    EnterCriticalSection(&m_lock);
+    for (const std::shared_ptr<VmProgram>& program : m_queue) {
+        program->tier.stage.store(VmTierState::Stage::Interpreted, std::memory_order_relaxed);
+    }
+    m_queue.clear();
+
+    // Programs can outlive the compiler, so detach them from the code cache before it goes away
+    for (const std::weak_ptr<VmProgram>& published : m_published) {
+        if (std::shared_ptr<VmProgram> program = published.lock()) {
+            program->tier.entry.store(nullptr, std::memory_order_release);
+            program->tier.stage.store(VmTierState::Stage::Interpreted, std::memory_order_relaxed);
+        }
+    }
+    m_published.clear();
+
+    if (m_codeCache) {
+        VirtualFree(m_codeCache, 0, MEM_RELEASE);
+        m_codeCache = nullptr;
+    }
+    m_codeCacheSize = 0;
+    m_codeCacheUsed = 0;
+    m_initialized = false;
+    LeaveCriticalSection(&m_lock);
+}
+
+void NativeCompiler::Enqueue(const std::shared_ptr<VmProgram>& program) {
+    EnterCriticalSection(&m_lock);
+    if (!m_initialized || m_stopping) {
+        program->tier.stage.store(VmTierState::Stage::Interpreted, std::memory_order_relaxed);
+        LeaveCriticalSection(&m_lock);
+        return;
+    }
+    m_queue.push_back(program);
+    WakeConditionVariable(&m_wake);
+    LeaveCriticalSection(&m_lock);
+}
+
+DWORD WINAPI NativeCompiler::WorkerThreadProc(LPVOID parameter) {
+    static_cast<NativeCompiler*>(parameter)->ProcessQueue();
+    return 0;
+}
+
+void NativeCompiler::ProcessQueue() {
+    EnterCriticalSection(&m_lock);
+    for (;;) {
+        while (m_queue.empty() && !m_stopping) {
+            SleepConditionVariableCS(&m_wake, &m_lock, INFINITE);
+        }
+        if (m_stopping) {
+            break;
+        }
+
+        std::shared_ptr<VmProgram> program = m_queue.front();
+        m_queue.pop_front();
+        LeaveCriticalSection(&m_lock);
+
+        VmNativeEntry entry = Compile(*program);
+
+        EnterCriticalSection(&m_lock);
+        if (entry) {
+            m_published.push_back(program);
+            program->tier.entry.store(entry, std::memory_order_release);
+            program->tier.stage.store(VmTierState::Stage::Native, std::memory_order_relaxed);
+        } else {
+            program->tier.stage.store(VmTierState::Stage::Rejected, std::memory_order_relaxed);
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void* NativeCompiler::AllocateCode(size_t size) {
+    EnterCriticalSection(&m_lock);
+    void* memory = nullptr;
+    // Whole pages per program: a page turns execute-read once its code is written and never
+    // becomes writable again
+    size_t aligned = (size + m_pageSize - 1) & ~(m_pageSize - 1);
+    if (m_codeCache && m_codeCacheUsed + aligned <= m_codeCacheSize) {
+        memory = m_codeCache + m_codeCacheUsed;
+        m_codeCacheUsed += aligned;
+    }
+    LeaveCriticalSection(&m_lock);
+    return memory;
+}
+
+VmNativeEntry NativeCompiler::Compile(const VmProgram& program) {
+#ifdef CLRNET_VM_NATIVE_X64
+    // Snapshot the instruction stream; interpreters may be quickening opcodes concurrently
+    VmProgram snapshot;
+    snapshot.argumentCount = program.argumentCount;
+    snapshot.localCount = program.localCount;
+    snapshot.instructions.reserve(program.instructions.size());
+    for (const VmInstruction& instruction : program.instructions) {
+        VmInstruction copy = instruction;
+        copy.opcode = NormalizeOpcode(
+            std::atomic_ref<VmOpcode>(const_cast<VmOpcode&>(instruction.opcode)).load(std::memory_order_relaxed));
+        snapshot.instructions.push_back(copy);
+    }
+
+    auto reject = [&]() -> VmNativeEntry {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    };
+
+    if (!program.verified || snapshot.argumentCount + snapshot.localCount > MaxNativeVariables) {
+        return reject();
+    }
+
+    for (const VmInstruction& instruction : snapshot.instructions) {
+        if (!IsSupportedOpcode(instruction.opcode)) {
+            return reject();
+        }
+        // Division can fault mid-method, which the compiled code has no way to hand back to the interpreter
+        if (instruction.opcode == VmOpcode::ArithmeticLocals &&
+            static_cast<VmOpcode>(instruction.operand2) == VmOpcode::Divide) {
+            return reject();
+        }
+    }
+
+    std::vector<int32_t> depths;
+    int32_t maxDepth = 0;
+    if (!BytecodeCompiler::ComputeStackDepths(snapshot, depths, maxDepth) ||
+        static_cast<uint32_t>(maxDepth) > SlotRegisterCount) {
+        return reject();
+    }
+
+    const std::vector<VmInstruction>& code = snapshot.instructions;
+    X64Emitter emitter;
+    std::vector<size_t> labels(code.size(), 0);
+    std::vector<std::pair<size_t, size_t>> branchFixups; // rel32 offset, instruction index
+    std::vector<size_t> doneFixups;
+    std::vector<size_t> bailFixups;
+
+    auto variableAddress = [&](uint32_t variable, X64Register& base) {
+        if (variable < snapshot.argumentCount) {
+            base = ArgumentsBase;
+            return static_cast<int32_t>(variable * sizeof(VmValue));
+        }
+        base = LocalsBase;
+        return static_cast<int32_t>((variable - snapshot.argumentCount) * sizeof(VmValue));
+    };
+
+    auto loadVariable = [&](X64Register destination, uint32_t variable) {
+        X64Register base;
+        int32_t offset = variableAddress(variable, base);
+        emitter.Load32(destination, base, offset + DataOffset);
+    };
+
+    // Stores mirror VmValue(int32_t): kind Int32 with the upper data bits zero (32-bit ops zero-extend)
+    auto storeVariable = [&](uint32_t variable, X64Register source) {
+        X64Register base;
+        int32_t offset = variableAddress(variable, base);
+        emitter.StoreByte(base, offset + KindOffset, static_cast<uint8_t>(VmValue::Kind::Int32));
+        emitter.Store64(base, offset + DataOffset, source);
+    };
+
+    auto storeResult = [&](int32_t depth) {
+        if (depth > 0) {
+            emitter.StoreByte(ResultBase, KindOffset, static_cast<uint8_t>(VmValue::Kind::Int32));
+            emitter.Store64(ResultBase, DataOffset, SlotRegisters[depth - 1]);
+        }
+        doneFixups.push_back(emitter.Jump());
+    };
+
+    auto arithmetic = [&](VmOpcode opcode, X64Register destination, X64Register source) {
+        switch (opcode) {
+        case VmOpcode::Add: emitter.Add(destination, source); break;
+        case VmOpcode::Subtract: emitter.Subtract(destination, source); break;
+        default: emitter.Multiply(destination, source); break;
+        }
+    };
+
+    // Prologue: save the callee-saved registers we use and move the incoming pointers (RCX, RDX, R8)
+    // into them
+    emitter.Push(RBX);
+    emitter.Push(RSI);
+    emitter.Push(RDI);
+    emitter.Push(R13);
+    emitter.Push(R14);
+    emitter.Push(R15);
+    emitter.Move64(ArgumentsBase, RCX);
+    emitter.Move64(LocalsBase, RDX);
+    emitter.Move64(ResultBase, R8);
+
+    uint64_t guards = ComputeEntryGuards(snapshot, depths);
+    for (uint32_t variable = 0; variable < snapshot.argumentCount + snapshot.localCount; ++variable) {
+        if (guards & (1ull << variable)) {
+            X64Register base;
+            int32_t offset = variableAddress(variable, base);
+            emitter.CompareByte(base, offset + KindOffset, static_cast<uint8_t>(VmValue::Kind::Int32));
+            bailFixups.push_back(emitter.JumpIf(CondNotEqual));
+        }
+    }
+
+    bool fallsThrough = false;
+    int32_t exitDepth = 0;
+    for (size_t index = 0; index < code.size(); ++index) {
+        labels[index] = emitter.Position();
+        int32_t depth = depths[index];
+        if (depth < 0) {
+            continue;
+        }
+
+        const VmInstruction& instruction = code[index];
+        fallsThrough = true;
+
+        int32_t pops = 0;
+        int32_t pushes = 0;
+        switch (instruction.opcode) {
+        case VmOpcode::Nop:
+            break;
+        case VmOpcode::LoadArgument:
+            loadVariable(SlotRegisters[depth], ArgumentVariable(snapshot, instruction.operand0));
+            pushes = 1;
+            break;
+        case VmOpcode::LoadLocal:
+            loadVariable(SlotRegisters[depth], LocalVariable(snapshot, instruction.operand0));
+            pushes = 1;
+            break;
+        case VmOpcode::StoreArgument:
+            storeVariable(ArgumentVariable(snapshot, instruction.operand0), SlotRegisters[depth - 1]);
+            pops = 1;
+            break;
+        case VmOpcode::StoreLocal:
+            storeVariable(LocalVariable(snapshot, instruction.operand0), SlotRegisters[depth - 1]);
+            pops = 1;
+            break;
+        case VmOpcode::LoadConstantI4:
+            emitter.MoveImmediate(SlotRegisters[depth], instruction.operand0);
+            pushes = 1;
+            break;
+        case VmOpcode::Add:
+        case VmOpcode::Subtract:
+        case VmOpcode::Multiply:
+            arithmetic(instruction.opcode, SlotRegisters[depth - 2], SlotRegisters[depth - 1]);
+            pops = 2;
+            pushes = 1;
+            break;
+        case VmOpcode::CompareEqual:
+        case VmOpcode::CompareNotEqual:
+        case VmOpcode::CompareGreaterThan:
+        case VmOpcode::CompareLessThan:
+            emitter.Compare(SlotRegisters[depth - 2], SlotRegisters[depth - 1]);
+            emitter.SetCondition(CompareCondition(instruction.opcode), SlotRegisters[depth - 2]);
+            pops = 2;
+            pushes = 1;
+            break;
+        case VmOpcode::Branch:
+            branchFixups.emplace_back(emitter.Jump(), static_cast<size_t>(instruction.operand0));
+            fallsThrough = false;
+            break;
+        case VmOpcode::BranchIfTrue:
+        case VmOpcode::BranchIfFalse:
+            emitter.Test(SlotRegisters[depth - 1], SlotRegisters[depth - 1]);
+            branchFixups.emplace_back(
+                emitter.JumpIf(instruction.opcode == VmOpcode::BranchIfTrue ? CondNotEqual : CondEqual),
+                static_cast<size_t>(instruction.operand0));
+            pops = 1;
+            break;
+        case VmOpcode::BranchIfEqual:
+        case VmOpcode::BranchIfNotEqual:
+        case VmOpcode::BranchIfGreaterThan:
+        case VmOpcode::BranchIfLessOrEqual:
+        case VmOpcode::BranchIfLessThan:
+        case VmOpcode::BranchIfGreaterOrEqual:
+        case VmOpcode::BranchIfGreaterOrEqualOrdered:
+        case VmOpcode::BranchIfLessOrEqualOrdered:
+        case VmOpcode::BranchIfGreaterThanUnsigned:
+        case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+        case VmOpcode::BranchIfLessThanUnsigned:
+        case VmOpcode::BranchIfLessOrEqualUnsigned:
+            emitter.Compare(SlotRegisters[depth - 2], SlotRegisters[depth - 1]);
+            branchFixups.emplace_back(emitter.JumpIf(BranchCondition(instruction.opcode)),
+                                      static_cast<size_t>(instruction.operand0));
+            pops = 2;
+            break;
+        case VmOpcode::AddLocalConstant:
+            loadVariable(ScratchRegister, LocalVariable(snapshot, instruction.operand0));
+            emitter.AddImmediate(ScratchRegister, instruction.operand1);
+            storeVariable(LocalVariable(snapshot, instruction.operand2), ScratchRegister);
+            break;
+        case VmOpcode::ArithmeticLocals:
+            loadVariable(SlotRegisters[depth], LocalVariable(snapshot, instruction.operand0));
+            loadVariable(ScratchRegister, LocalVariable(snapshot, instruction.operand1));
+            arithmetic(static_cast<VmOpcode>(instruction.operand2), SlotRegisters[depth], ScratchRegister);
+            pushes = 1;
+            break;
+        case VmOpcode::Return:
+            storeResult(depth);
+            fallsThrough = false;
+            break;
+        default:
+            return reject();
+        }
+
+        exitDepth = depth - pops + pushes;
+    }
+
+    // Running off the end returns whatever is left on top of the stack, as the interpreter does
+    if (fallsThrough) {
+        storeResult(exitDepth);
+    }
+
+    size_t done = emitter.Position();
+    emitter.MoveImmediate(RAX, 1);
+    size_t skipBail = emitter.Jump();
+
+    size_t bail = emitter.Position();
+    emitter.Xor(RAX, RAX);
+
+    size_t epilogue = emitter.Position();
+    emitter.Pop(R15);
+    emitter.Pop(R14);
+    emitter.Pop(R13);
+    emitter.Pop(RDI);
+    emitter.Pop(RSI);
+    emitter.Pop(RBX);
+    emitter.Return();
+
+    for (const std::pair<size_t, size_t>& fixup : branchFixups) {
+        emitter.Patch(fixup.first, labels[fixup.second]);
+    }
+    for (size_t fixup : doneFixups) {
+        emitter.Patch(fixup, done);
+    }
+    for (size_t fixup : bailFixups) {
+        emitter.Patch(fixup, bail);
+    }
+    emitter.Patch(skipBail, epilogue);
+
+    void* memory = AllocateCode(emitter.code.size());
+    if (!memory) {
+        return reject();
+    }
+    std::memcpy(memory, emitter.code.data(), emitter.code.size());
+    DWORD previousProtection = 0;
+    if (!VirtualProtect(memory, emitter.code.size(), PAGE_EXECUTE_READ, &previousProtection)) {
+        return reject();
+    }
+    FlushInstructionCache(GetCurrentProcess(), memory, emitter.code.size());
+
+    m_compiled.fetch_add(1, std::memory_order_relaxed);
+    return reinterpret_cast<VmNativeEntry>(memory);
+#else
+    (void)program;
+    m_rejected.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+#endif
+}
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
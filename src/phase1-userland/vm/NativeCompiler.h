@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef CLRNET_VM_NATIVE_COMPILER_H
+#define CLRNET_VM_NATIVE_COMPILER_H
+
+#include <windows.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "VirtualMachine.h"
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+// Compiles hot VM programs to Windows x64 machine code on a background thread.
+// The backend covers verified programs whose values are all Int32; anything else stays interpreted.
+class NativeCompiler {
+public:
+    NativeCompiler();
+    ~NativeCompiler();
+
+    bool Initialize();
+    void Shutdown();
+
+    // Queue a program whose tier stage has already been moved to Queued
+    void Enqueue(const std::shared_ptr<VmProgram>& program);
+
+    // Compile synchronously; returns nullptr when the program uses anything the backend does not support
+    VmNativeEntry Compile(const VmProgram& program);
+
+    uint64_t GetCompiledCount() const { return m_compiled.load(std::memory_order_relaxed); }
+    uint64_t GetRejectedCount() const { return m_rejected.load(std::memory_order_relaxed); }
+
+private:
+    static DWORD WINAPI WorkerThreadProc(LPVOID parameter);
+    void ProcessQueue();
+    void* AllocateCode(size_t size);
+
+    CRITICAL_SECTION m_lock;
+    CONDITION_VARIABLE m_wake;
+    HANDLE m_worker;
+    bool m_initialized;
+    bool m_stopping;
+    std::deque<std::shared_ptr<VmProgram>> m_queue;
+
+    // Programs holding entry points into the code cache; cleared before the cache is freed
+    std::vector<std::weak_ptr<VmProgram>> m_published;
+
+    uint8_t* m_codeCache;
+    size_t m_codeCacheSize;
+    size_t m_codeCacheUsed;
+    size_t m_pageSize;          // Allocation granularity of the code cache
+
+    std::atomic<uint64_t> m_compiled;
+    std::atomic<uint64_t> m_rejected;
+};
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
+
+#endif // CLRNET_VM_NATIVE_COMPILER_H
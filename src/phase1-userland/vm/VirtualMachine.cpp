@@ -1,8 +1,22 @@
 #include "VirtualMachine.h"
 #include "BytecodeCache.h"
 #include "BytecodeCompiler.h"
+#include "NativeCompiler.h"
+#include "VmHandleTable.h"
+#include "VmWorkerPool.h"
+#include "VmProfiler.h"
+
+#include "../core/GarbageCollector.h"
+#include "../core/RuntimeTypes.h"
+#include "../core/StringInternTable.h"
+#include "../core/TypeSystem.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <optional>
 #include <sstream>
 #include <vector>
 
@@ -10,6 +24,30 @@ namespace CLRNet {
 namespace Phase1 {
 namespace VM {
 
+// Memory one execution holds, charged against its budget through `account`. The account covers the
+// execution's frames and evaluation stack plus every GC object allocated on its thread while it
+// runs, host callbacks included. Arrays it allocated stay pinned until it finishes, since the
+// collector cannot see the VM's stack and locals.
+struct VmExecutionMemory {
+    std::vector<void*> arrays;
+    GCAllocationScope account;
+    size_t stackSlots;           // Evaluation stack slots charged so far; the stack is charged at its high-water mark
+
+    VmExecutionMemory()
+        : stackSlots(0) {}
+
+    void Release() {
+        if (g_garbageCollector) {
+            for (void* array : arrays) {
+                g_garbageCollector->UnpinObject(array);
+            }
+        }
+        arrays.clear();
+        account = GCAllocationScope();
+        stackSlots = 0;
+    }
+};
+
 namespace {
 
 uint64_t GetCurrentTicks() {
@@ -22,58 +60,824 @@ void LogMessage(const VmHostCallbacks& callbacks, const std::wstring& message) {
     }
 }
 
-bool EnsureStackMemory(const VmExecutionContext& context, const std::vector<VmValue>& stack) {
-    if (context.memoryBudgetBytes == 0) {
+// Bytes an interpreted frame holds once its evaluation stack reaches `stackSlots`
+size_t FrameBytes(const VmFrame& frame, size_t stackSlots) {
+    return (static_cast<size_t>(frame.argumentCount) + frame.localCount + stackSlots) * sizeof(VmValue);
+}
+
+// Charges the stack up to `slots` if it has grown past what is already charged
+bool ChargeStack(VmExecutionMemory& memory, size_t slots) {
+    if (slots <= memory.stackSlots) {
         return true;
     }
+    if (!memory.account.TryCharge((slots - memory.stackSlots) * sizeof(VmValue))) {
+        return false;
+    }
+    memory.stackSlots = slots;
+    return true;
+}
 
-    size_t estimated = stack.size() * sizeof(VmValue);
-    return estimated <= context.memoryBudgetBytes;
+// Starts an execution's account: the budget becomes its limit, and the caller's arguments and
+// locals plus `slots` working slots are charged to it
+bool OpenAccount(VmExecutionMemory& memory, const VmFrame& frame, size_t slots) {
+    if (frame.memoryBudgetBytes != 0) {
+        memory.account.limit = frame.memoryBudgetBytes;
+    }
+    return memory.account.TryCharge(FrameBytes(frame, 0)) && ChargeStack(memory, slots);
 }
 
-thread_local std::wstring g_lastVmFailure;
+// Makes an execution's account the thread's GC allocation scope for as long as it runs
+class AllocationScopeGuard {
+public:
+    explicit AllocationScopeGuard(GCAllocationScope& account)
+        : m_previous(GarbageCollector::SetAllocationScope(&account)) {}
+
+    ~AllocationScopeGuard() {
+        GarbageCollector::SetAllocationScope(m_previous);
+    }
+
+    AllocationScopeGuard(const AllocationScopeGuard&) = delete;
+    AllocationScopeGuard& operator=(const AllocationScopeGuard&) = delete;
+
+private:
+    GCAllocationScope* m_previous;
+};
+
+// Zero value of a declared local kind; locals without a resolved signature start Uninitialized
+VmValue ZeroValue(VmValue::Kind kind) {
+    switch (kind) {
+    case VmValue::Kind::Int32:
+        return VmValue(int32_t(0));
+    case VmValue::Kind::Int64:
+        return VmValue(int64_t(0));
+    case VmValue::Kind::Float:
+        return VmValue(0.0f);
+    case VmValue::Kind::Double:
+        return VmValue(0.0);
+    case VmValue::Kind::Object:
+    case VmValue::Kind::Null:
+        return VmValue(nullptr, VmValue::Kind::Null);
+    case VmValue::Kind::ManagedPointer:
+        return VmValue(nullptr, VmValue::Kind::ManagedPointer);
+    default:
+        return VmValue();
+    }
+}
+
+// Sets locals [first, end) of a frame the VM allocated to the zeros of their declared kinds
+void ClearLocals(const VmProgram& program, VmValue* locals, size_t first, size_t end) {
+    size_t typed = std::min(end, program.localKinds.size());
+    for (size_t index = first; index < typed; ++index) {
+        locals[index] = ZeroValue(program.localKinds[index]);
+    }
+}
+
+// Caller state saved when the interpreter enters a program bound to a call site
+struct VmDirectCall {
+    // valuesOffset for the outermost frame, whose arrays belong to the caller of Execute
+    static const size_t CallerArrays = static_cast<size_t>(-1);
+
+    const VmProgram* program;
+    VmFrame frame;
+    size_t valuesOffset;          // Start of the frame's arguments and locals in calleeValues
+    uint32_t returnAddress;
+};
+
+// Deep enough for ordinary recursion; runaway recursion fails instead of exhausting memory
+const size_t MaxDirectCallDepth = 1024;
+
+// Reusable buffers for one execution. Executions nest on a thread when a host callback re-enters
+// the VM, so every nesting level leases its own storage from the thread's arena.
+struct VmFrameStorage {
+    std::vector<VmValue> stack;
+    std::vector<VmValue> registers;
+    std::vector<VmValue> arguments;
+    std::vector<VmValue> locals;
+    std::vector<VmDirectCall> calls;
+    std::vector<VmValue> calleeValues;   // Arguments then locals of every directly called frame
+    VmExecutionMemory memory;
+};
+
+// std::deque keeps outer levels at stable addresses while deeper levels are appended
+thread_local std::deque<VmFrameStorage> t_frameArena;
+thread_local size_t t_frameDepth = 0;
+
+class FrameLease {
+public:
+    FrameLease() {
+        if (t_frameDepth == t_frameArena.size()) {
+            t_frameArena.emplace_back();
+        }
+        m_storage = &t_frameArena[t_frameDepth++];
+    }
+
+    ~FrameLease() {
+        m_storage->memory.Release();
+        --t_frameDepth;
+    }
+
+    FrameLease(const FrameLease&) = delete;
+    FrameLease& operator=(const FrameLease&) = delete;
+
+    VmFrameStorage& Storage() { return *m_storage; }
+
+private:
+    VmFrameStorage* m_storage;
+};
+
+// Integer arithmetic with IL wrap-around semantics
+template <typename SignedT, typename UnsignedT>
+bool ComputeInteger(VmOpcode opcode, SignedT left, SignedT right, SignedT& computed, const wchar_t*& failure) {
+    UnsignedT a = static_cast<UnsignedT>(left);
+    UnsignedT b = static_cast<UnsignedT>(right);
+    switch (opcode) {
+    case VmOpcode::Add: computed = static_cast<SignedT>(a + b); return true;
+    case VmOpcode::Subtract: computed = static_cast<SignedT>(a - b); return true;
+    case VmOpcode::Multiply: computed = static_cast<SignedT>(a * b); return true;
+    case VmOpcode::Divide:
+        if (right == 0) {
+            failure = L"Division by zero";
+            return false;
+        }
+        if (left == std::numeric_limits<SignedT>::min() && right == -1) {
+            failure = L"Arithmetic overflow";
+            return false;
+        }
+        computed = left / right;
+        return true;
+    default:
+        failure = L"Unsupported arithmetic opcode";
+        return false;
+    }
+}
+
+bool ComputeInt32(VmOpcode opcode, int32_t left, int32_t right, int32_t& computed, const wchar_t*& failure) {
+    return ComputeInteger<int32_t, uint32_t>(opcode, left, right, computed, failure);
+}
+
+bool ComputeInt64(VmOpcode opcode, int64_t left, int64_t right, int64_t& computed, const wchar_t*& failure) {
+    return ComputeInteger<int64_t, uint64_t>(opcode, left, right, computed, failure);
+}
+
+// IEEE arithmetic; division by zero yields infinity or NaN rather than failing
+template <typename FloatT>
+FloatT ComputeFloating(VmOpcode opcode, FloatT left, FloatT right) {
+    switch (opcode) {
+    case VmOpcode::Add: return left + right;
+    case VmOpcode::Subtract: return left - right;
+    case VmOpcode::Multiply: return left * right;
+    default: return left / right;
+    }
+}
+
+int64_t AsInt64(const VmValue& value) {
+    return value.GetKind() == VmValue::Kind::Int32 ? value.GetInt32() : value.GetInt64();
+}
+
+double AsDouble(const VmValue& value) {
+    return value.GetKind() == VmValue::Kind::Float ? value.GetFloat() : value.GetDouble();
+}
+
+// Compact values hold 48-bit integers, so a wider Int64 result fails the execution instead of wrapping
+bool BoxInt64(int64_t value, VmValue& boxed, const wchar_t*& failure) {
+    if (!VmValue::CanHoldInt64(value)) {
+        failure = L"Int64 value exceeds the compact VmValue range";
+        return false;
+    }
+    boxed = VmValue(value);
+    return true;
+}
+
+// Truthiness for brtrue/brfalse: any non-zero number or non-null reference
+bool IsTruthy(const VmValue& condition) {
+    switch (condition.GetKind()) {
+    case VmValue::Kind::Int32: return condition.GetInt32() != 0;
+    case VmValue::Kind::Int64: return condition.GetInt64() != 0;
+    case VmValue::Kind::Float: return condition.GetFloat() != 0.0f;
+    case VmValue::Kind::Double: return condition.GetDouble() != 0.0;
+    case VmValue::Kind::Object:
+    case VmValue::Kind::ManagedPointer: return condition.GetObject() != nullptr;
+    default: return false;
+    }
+}
+
+// Kind a binary numeric operation evaluates in, or Uninitialized when the operands do not combine.
+// Int32 widens into Int64 and Float into Double; integers never mix with floating point.
+VmValue::Kind GetNumericKind(VmValue::Kind left, VmValue::Kind right) {
+    auto isInteger = [](VmValue::Kind kind) { return kind == VmValue::Kind::Int32 || kind == VmValue::Kind::Int64; };
+    auto isFloating = [](VmValue::Kind kind) { return kind == VmValue::Kind::Float || kind == VmValue::Kind::Double; };
+
+    if (isInteger(left) && isInteger(right)) {
+        return (left == VmValue::Kind::Int64 || right == VmValue::Kind::Int64) ? VmValue::Kind::Int64 : VmValue::Kind::Int32;
+    }
+    if (isFloating(left) && isFloating(right)) {
+        return (left == VmValue::Kind::Double || right == VmValue::Kind::Double) ? VmValue::Kind::Double : VmValue::Kind::Float;
+    }
+    return VmValue::Kind::Uninitialized;
+}
+
+// Arithmetic over VmValues; kinds are validated here so every interpreter path shares the rules
+bool ComputeArithmetic(VmOpcode opcode, const VmValue& left, const VmValue& right, VmValue& computed,
+                       const wchar_t*& failure) {
+    switch (GetNumericKind(left.GetKind(), right.GetKind())) {
+    case VmValue::Kind::Int32: {
+        int32_t value = 0;
+        if (!ComputeInt32(opcode, left.GetInt32(), right.GetInt32(), value, failure)) {
+            return false;
+        }
+        computed = VmValue(value);
+        return true;
+    }
+    case VmValue::Kind::Int64: {
+        int64_t value = 0;
+        if (!ComputeInt64(opcode, AsInt64(left), AsInt64(right), value, failure)) {
+            return false;
+        }
+        return BoxInt64(value, computed, failure);
+    }
+    case VmValue::Kind::Float:
+        computed = VmValue(ComputeFloating<float>(opcode, left.GetFloat(), right.GetFloat()));
+        return true;
+    case VmValue::Kind::Double:
+        computed = VmValue(ComputeFloating<double>(opcode, AsDouble(left), AsDouble(right)));
+        return true;
+    default:
+        failure = L"Arithmetic operands have incompatible kinds";
+        return false;
+    }
+}
+
+// Type-specialised opcode for a generic arithmetic opcode, or the generic one when the
+// operands are mixed-width and therefore not worth guarding on
+VmOpcode SpecializeArithmetic(VmOpcode generic, VmValue::Kind left, VmValue::Kind right) {
+    if (left != right) {
+        return generic;
+    }
+
+    int row = 0;
+    switch (left) {
+    case VmValue::Kind::Int32: row = 0; break;
+    case VmValue::Kind::Int64: row = 1; break;
+    case VmValue::Kind::Float: row = 2; break;
+    case VmValue::Kind::Double: row = 3; break;
+    default: return generic;
+    }
+
+    int column = static_cast<int>(generic) - static_cast<int>(VmOpcode::Add);
+    return static_cast<VmOpcode>(static_cast<int>(VmOpcode::AddI4) + row * 4 + column);
+}
+
+VmOpcode GeneralizeArithmetic(VmOpcode specialized) {
+    int column = (static_cast<int>(specialized) - static_cast<int>(VmOpcode::AddI4)) % 4;
+    return static_cast<VmOpcode>(static_cast<int>(VmOpcode::Add) + column);
+}
+
+// Quickening rewrites opcodes of shared programs in place, so opcode reads and writes are atomic
+VmOpcode LoadOpcode(const VmInstruction& instruction) {
+    return std::atomic_ref<VmOpcode>(const_cast<VmOpcode&>(instruction.opcode)).load(std::memory_order_relaxed);
+}
+
+void StoreOpcode(const VmInstruction& instruction, VmOpcode opcode) {
+    std::atomic_ref<VmOpcode>(const_cast<VmOpcode&>(instruction.opcode)).store(opcode, std::memory_order_relaxed);
+}
+
+// Whether a call site has a single target: at least one `call` uses it (or a HostCall, when
+// allowed) and no callvirt or newobj does
+bool HasSingleTarget(const VmProgram& program, uint32_t callSiteIndex, bool allowHostCall) {
+    bool isCall = false;
+    for (const VmInstruction& instruction : program.instructions) {
+        if (static_cast<uint32_t>(instruction.operand0) != callSiteIndex) {
+            continue;
+        }
+        VmOpcode opcode = LoadOpcode(instruction);
+        if (opcode == VmOpcode::CallVirtual || opcode == VmOpcode::NewObject ||
+            (opcode == VmOpcode::HostCall && !allowHostCall)) {
+            return false;
+        }
+        isCall = isCall || opcode == VmOpcode::Call || opcode == VmOpcode::HostCall;
+    }
+    return isCall;
+}
+
+void BindHostTarget(VmCallSite& callSite, const VmHostFunction& function) {
+    callSite.kind = VmCallSite::TargetKind::Host;
+    callSite.data.hostTarget.kind = function.kind;
+    callSite.data.hostTarget.identifier = function.identifier;
+    callSite.data.hostTarget.callback = function.function;
+    callSite.argumentCount = function.argumentCount;
+}
+
+// Pushes what a call returned. A site whose signature was resolved pushes exactly what the signature
+// says, which is what the verifier assumed: a value a void call returns is dropped, and a missing one
+// fails the call.
+bool PushCallResult(const VmCallSite& callSite, bool hasValue, const VmValue& value, std::vector<VmValue>& stack) {
+    if (callSite.signatureKnown) {
+        if (callSite.returnsValue && !hasValue) {
+            return false;
+        }
+        hasValue = callSite.returnsValue;
+    }
+    if (hasValue) {
+        stack.push_back(value);
+    }
+    return true;
+}
+
+// A site whose signature was resolved at compile time only takes targets of the same arity
+bool MatchesSignature(const VmCallSite& callSite, uint32_t argumentCount) {
+    return !callSite.signatureKnown || callSite.argumentCount == argumentCount;
+}
+
+bool IsDirectFieldKind(VmValue::Kind kind) {
+    switch (kind) {
+    case VmValue::Kind::Int32:
+    case VmValue::Kind::Int64:
+    case VmValue::Kind::Float:
+    case VmValue::Kind::Double:
+    case VmValue::Kind::Object:
+    case VmValue::Kind::ManagedPointer:
+        return true;
+    default:
+        return false;
+    }
+}
+
+VmValue ReadField(const uint8_t* address, VmValue::Kind kind) {
+    switch (kind) {
+    case VmValue::Kind::Int32: {
+        int32_t value;
+        std::memcpy(&value, address, sizeof(value));
+        return VmValue(value);
+    }
+    case VmValue::Kind::Int64: {
+        int64_t value;
+        std::memcpy(&value, address, sizeof(value));
+        return VmValue(value);
+    }
+    case VmValue::Kind::Float: {
+        float value;
+        std::memcpy(&value, address, sizeof(value));
+        return VmValue(value);
+    }
+    case VmValue::Kind::Double: {
+        double value;
+        std::memcpy(&value, address, sizeof(value));
+        return VmValue(value);
+    }
+    default: {
+        void* value;
+        std::memcpy(&value, address, sizeof(value));
+        return VmValue(value, kind);
+    }
+    }
+}
+
+// IL stores to a field of exactly the field's type; a null reference may go into any reference field
+bool WriteField(uint8_t* address, VmValue::Kind kind, const VmValue& value) {
+    VmValue::Kind valueKind = value.GetKind();
+    switch (kind) {
+    case VmValue::Kind::Int32: {
+        if (valueKind != VmValue::Kind::Int32) {
+            return false;
+        }
+        int32_t field = value.GetInt32();
+        std::memcpy(address, &field, sizeof(field));
+        return true;
+    }
+    case VmValue::Kind::Int64: {
+        if (valueKind != VmValue::Kind::Int64) {
+            return false;
+        }
+        int64_t field = value.GetInt64();
+        std::memcpy(address, &field, sizeof(field));
+        return true;
+    }
+    case VmValue::Kind::Float: {
+        if (valueKind != VmValue::Kind::Float) {
+            return false;
+        }
+        float field = value.GetFloat();
+        std::memcpy(address, &field, sizeof(field));
+        return true;
+    }
+    case VmValue::Kind::Double: {
+        if (valueKind != VmValue::Kind::Double) {
+            return false;
+        }
+        double field = value.GetDouble();
+        std::memcpy(address, &field, sizeof(field));
+        return true;
+    }
+    default: {
+        if (valueKind != VmValue::Kind::Object && valueKind != VmValue::Kind::ManagedPointer &&
+            valueKind != VmValue::Kind::Null) {
+            return false;
+        }
+        void* pointer = value.GetObject();
+        std::memcpy(address, &pointer, sizeof(pointer));
+        return true;
+    }
+    }
+}
+
+// VM arrays keep every element in an 8-byte slot, whatever their element type
+const size_t ArraySlotSize = sizeof(uint64_t);
+
+// Stands in for the method table of every VM array; only its address matters
+const uint8_t VmArrayMethodTable = 0;
+
+// A VM array: the method table word where ObjectHeader keeps it, then the length and the slots.
+// Arrays are told apart from host objects by that word, which no host object can point at
+// VmArrayMethodTable.
+struct VmArrayHeader {
+    const void* methodTable;
+    size_t length;
+
+    uint64_t* GetElements() { return reinterpret_cast<uint64_t*>(this + 1); }
+};
+
+// Allocates a zeroed VM array from the collector, charged to the calling thread's allocation scope
+VmArrayHeader* AllocateVmArray(size_t count) {
+    if (!g_garbageCollector || count > (static_cast<size_t>(-1) - sizeof(VmArrayHeader)) / ArraySlotSize) {
+        return nullptr;
+    }
+    VmArrayHeader* array = static_cast<VmArrayHeader*>(g_garbageCollector->AllocateObject(sizeof(VmArrayHeader) + count * ArraySlotSize));
+    if (!array) {
+        return nullptr;
+    }
+    array->methodTable = &VmArrayMethodTable;
+    array->length = count;
+    std::memset(array->GetElements(), 0, count * ArraySlotSize);
+    return array;
+}
+
+// The header of a VM array, or nullptr for null and non-array references
+VmArrayHeader* AsVmArray(const VmValue& reference) {
+    if (reference.GetKind() != VmValue::Kind::Object || !reference.GetObject()) {
+        return nullptr;
+    }
+    VmArrayHeader* array = static_cast<VmArrayHeader*>(reference.GetObject());
+    return array->methodTable == &VmArrayMethodTable ? array : nullptr;
+}
+
+// Reads a slot the way ldelem.<type> does: small integers widen to Int32 with their own signedness.
+// An Int64 too wide for the compact layout reads back uninitialized.
+VmValue ReadElement(uint64_t slot, VmElementType type) {
+    switch (type) {
+    case VmElementType::Int8: return VmValue(static_cast<int32_t>(static_cast<int8_t>(slot)));
+    case VmElementType::UInt8: return VmValue(static_cast<int32_t>(static_cast<uint8_t>(slot)));
+    case VmElementType::Int16: return VmValue(static_cast<int32_t>(static_cast<int16_t>(slot)));
+    case VmElementType::UInt16: return VmValue(static_cast<int32_t>(static_cast<uint16_t>(slot)));
+    case VmElementType::Int32:
+    case VmElementType::UInt32: return VmValue(static_cast<int32_t>(static_cast<uint32_t>(slot)));
+    case VmElementType::Int64: return VmValue(static_cast<int64_t>(slot));
+    case VmElementType::Float: {
+        uint32_t bits = static_cast<uint32_t>(slot);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return VmValue(value);
+    }
+    case VmElementType::Double: {
+        double value;
+        std::memcpy(&value, &slot, sizeof(value));
+        return VmValue(value);
+    }
+    default: {
+        void* value = reinterpret_cast<void*>(static_cast<uintptr_t>(slot));
+        return value ? VmValue(value) : VmValue(nullptr, VmValue::Kind::Null);
+    }
+    }
+}
+
+// Writes a slot the way stelem.<type> does: integers are truncated to the element width on the way
+// in, and floating-point values convert between Float and Double as needed
+bool WriteElement(uint64_t& slot, VmElementType type, const VmValue& value) {
+    VmValue::Kind kind = value.GetKind();
+    switch (type) {
+    case VmElementType::Int8:
+    case VmElementType::UInt8:
+    case VmElementType::Int16:
+    case VmElementType::UInt16:
+    case VmElementType::Int32:
+    case VmElementType::UInt32: {
+        if (kind != VmValue::Kind::Int32) {
+            return false;
+        }
+        int32_t element = value.GetInt32();
+        if (type == VmElementType::Int8 || type == VmElementType::UInt8) {
+            element = static_cast<int8_t>(element);
+        } else if (type == VmElementType::Int16 || type == VmElementType::UInt16) {
+            element = static_cast<int16_t>(element);
+        }
+        slot = static_cast<uint64_t>(static_cast<int64_t>(element));
+        return true;
+    }
+    case VmElementType::Int64:
+        if (kind != VmValue::Kind::Int64) {
+            return false;
+        }
+        slot = static_cast<uint64_t>(value.GetInt64());
+        return true;
+    case VmElementType::Float:
+    case VmElementType::Double: {
+        if (kind != VmValue::Kind::Float && kind != VmValue::Kind::Double) {
+            return false;
+        }
+        double element = kind == VmValue::Kind::Float ? value.GetFloat() : value.GetDouble();
+        if (type == VmElementType::Float) {
+            float narrowed = static_cast<float>(element);
+            uint32_t bits;
+            std::memcpy(&bits, &narrowed, sizeof(bits));
+            slot = bits;
+        } else {
+            std::memcpy(&slot, &element, sizeof(slot));
+        }
+        return true;
+    }
+    default: {
+        if (kind != VmValue::Kind::Object && kind != VmValue::Kind::ManagedPointer && kind != VmValue::Kind::Null) {
+            return false;
+        }
+        slot = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value.GetObject()));
+        return true;
+    }
+    }
+}
+
+// Guard failures tolerated before an arithmetic site stays generic for good
+constexpr int32_t MaxArithmeticDeoptimizations = 4;
+
+// Evaluates ceq/cgt/clt; returns false when the operand kinds cannot be compared.
+// Floating-point comparisons involving NaN are false, as for IL ceq/cgt/clt.
+bool CompareValues(VmOpcode comparison, const VmValue& left, const VmValue& right, bool& outcome) {
+    auto isReference = [](VmValue::Kind kind) {
+        return kind == VmValue::Kind::Object || kind == VmValue::Kind::ManagedPointer || kind == VmValue::Kind::Null;
+    };
+
+    auto compare = [&](auto a, auto b) {
+        switch (comparison) {
+        case VmOpcode::CompareEqual: outcome = a == b; return true;
+        case VmOpcode::CompareNotEqual: outcome = a != b; return true;
+        case VmOpcode::CompareGreaterThan: outcome = a > b; return true;
+        case VmOpcode::CompareLessThan: outcome = a < b; return true;
+        default: return false;
+        }
+    };
 
-VmExecutionContext ConvertContext(const VmExecutionContextNative& native) {
-    VmExecutionContext context;
-    if (native.arguments && native.argumentCount) {
-        context.arguments.assign(native.arguments, native.arguments + native.argumentCount);
+    switch (GetNumericKind(left.GetKind(), right.GetKind())) {
+    case VmValue::Kind::Int32:
+        return compare(left.GetInt32(), right.GetInt32());
+    case VmValue::Kind::Int64:
+        return compare(AsInt64(left), AsInt64(right));
+    case VmValue::Kind::Float:
+    case VmValue::Kind::Double:
+        return compare(AsDouble(left), AsDouble(right));
+    default:
+        break;
     }
-    if (native.locals && native.localCount) {
-        context.locals.assign(native.locals, native.locals + native.localCount);
+
+    if (isReference(left.GetKind()) && isReference(right.GetKind())) {
+        void* a = left.GetObject();
+        void* b = right.GetObject();
+        switch (comparison) {
+        case VmOpcode::CompareEqual: outcome = a == b; return true;
+        case VmOpcode::CompareNotEqual: outcome = a != b; return true;
+        default: return false;
+        }
     }
-    context.timeBudgetTicks = native.timeBudgetTicks;
-    context.memoryBudgetBytes = native.memoryBudgetBytes;
-    if (native.sandboxNamespace) {
-        context.sandboxNamespace = native.sandboxNamespace;
+
+    return false;
+}
+
+// Splits a fused compare-and-branch opcode into its comparison and the outcome that takes the branch
+void DecomposeCompareBranch(VmOpcode opcode, VmOpcode& comparison, bool& branchWhen) {
+    switch (opcode) {
+    case VmOpcode::BranchIfEqual: comparison = VmOpcode::CompareEqual; branchWhen = true; break;
+    case VmOpcode::BranchIfNotEqual: comparison = VmOpcode::CompareEqual; branchWhen = false; break;
+    case VmOpcode::BranchIfGreaterThan: comparison = VmOpcode::CompareGreaterThan; branchWhen = true; break;
+    case VmOpcode::BranchIfLessOrEqual: comparison = VmOpcode::CompareGreaterThan; branchWhen = false; break;
+    case VmOpcode::BranchIfLessThan: comparison = VmOpcode::CompareLessThan; branchWhen = true; break;
+    case VmOpcode::BranchIfGreaterOrEqual: comparison = VmOpcode::CompareLessThan; branchWhen = false; break;
+    default: comparison = VmOpcode::Nop; branchWhen = false; break;
     }
-    context.userData = native.userData;
-    return context;
 }
 
-void CopyContextBack(const VmExecutionContext& context, VmExecutionContextNative& native) {
-    if (native.arguments && native.argumentCount) {
-        size_t count = std::min(static_cast<size_t>(native.argumentCount), context.arguments.size());
-        std::copy_n(context.arguments.begin(), count, native.arguments);
+// Evaluates any two-operand conditional branch. The ceq/cgt/clt fusions defer to CompareValues;
+// bge/ble and the .un forms compare directly, since IL defines them per operand type.
+bool EvaluateBranch(VmOpcode branch, const VmValue& left, const VmValue& right, bool& taken) {
+    VmOpcode comparison = VmOpcode::Nop;
+    bool branchWhen = false;
+    DecomposeCompareBranch(branch, comparison, branchWhen);
+    if (comparison != VmOpcode::Nop) {
+        bool outcome = false;
+        if (!CompareValues(comparison, left, right, outcome)) {
+            return false;
+        }
+        taken = outcome == branchWhen;
+        return true;
+    }
+
+    bool isUnsigned = branch != VmOpcode::BranchIfGreaterOrEqualOrdered && branch != VmOpcode::BranchIfLessOrEqualOrdered;
+    auto relate = [&](auto a, auto b) {
+        switch (branch) {
+        case VmOpcode::BranchIfGreaterOrEqualOrdered:
+        case VmOpcode::BranchIfGreaterOrEqualUnsigned: taken = a >= b; return true;
+        case VmOpcode::BranchIfLessOrEqualOrdered:
+        case VmOpcode::BranchIfLessOrEqualUnsigned: taken = a <= b; return true;
+        case VmOpcode::BranchIfGreaterThanUnsigned: taken = a > b; return true;
+        case VmOpcode::BranchIfLessThanUnsigned: taken = a < b; return true;
+        default: return false;
+        }
+    };
+
+    switch (GetNumericKind(left.GetKind(), right.GetKind())) {
+    case VmValue::Kind::Int32:
+        return isUnsigned ? relate(static_cast<uint32_t>(left.GetInt32()), static_cast<uint32_t>(right.GetInt32()))
+                          : relate(left.GetInt32(), right.GetInt32());
+    case VmValue::Kind::Int64:
+        return isUnsigned ? relate(static_cast<uint64_t>(AsInt64(left)), static_cast<uint64_t>(AsInt64(right)))
+                          : relate(AsInt64(left), AsInt64(right));
+    case VmValue::Kind::Float:
+    case VmValue::Kind::Double: {
+        double a = AsDouble(left);
+        double b = AsDouble(right);
+        if (a != a || b != b) {
+            taken = isUnsigned;
+            return true;
+        }
+        return relate(a, b);
+    }
+    default:
+        break;
+    }
+
+    auto isReference = [](VmValue::Kind kind) {
+        return kind == VmValue::Kind::Object || kind == VmValue::Kind::ManagedPointer || kind == VmValue::Kind::Null;
+    };
+    if (isUnsigned && isReference(left.GetKind()) && isReference(right.GetKind())) {
+        return relate(reinterpret_cast<uintptr_t>(left.GetObject()), reinterpret_cast<uintptr_t>(right.GetObject()));
     }
-    if (native.locals && native.localCount) {
-        size_t count = std::min(static_cast<size_t>(native.localCount), context.locals.size());
-        std::copy_n(context.locals.begin(), count, native.locals);
+    return false;
+}
+
+// Fused branch with the same semantics as a register-tier conditional jump
+VmOpcode ToBranchOpcode(VmRegisterOpcode jump) {
+    switch (jump) {
+    case VmRegisterOpcode::JumpIfEqual: return VmOpcode::BranchIfEqual;
+    case VmRegisterOpcode::JumpIfNotEqual: return VmOpcode::BranchIfNotEqual;
+    case VmRegisterOpcode::JumpIfGreaterThan: return VmOpcode::BranchIfGreaterThan;
+    case VmRegisterOpcode::JumpIfLessOrEqual: return VmOpcode::BranchIfLessOrEqual;
+    case VmRegisterOpcode::JumpIfLessThan: return VmOpcode::BranchIfLessThan;
+    case VmRegisterOpcode::JumpIfGreaterOrEqual: return VmOpcode::BranchIfGreaterOrEqual;
+    case VmRegisterOpcode::JumpIfGreaterOrEqualOrdered: return VmOpcode::BranchIfGreaterOrEqualOrdered;
+    case VmRegisterOpcode::JumpIfLessOrEqualOrdered: return VmOpcode::BranchIfLessOrEqualOrdered;
+    case VmRegisterOpcode::JumpIfGreaterThanUnsigned: return VmOpcode::BranchIfGreaterThanUnsigned;
+    case VmRegisterOpcode::JumpIfGreaterOrEqualUnsigned: return VmOpcode::BranchIfGreaterOrEqualUnsigned;
+    case VmRegisterOpcode::JumpIfLessThanUnsigned: return VmOpcode::BranchIfLessThanUnsigned;
+    case VmRegisterOpcode::JumpIfLessOrEqualUnsigned: return VmOpcode::BranchIfLessOrEqualUnsigned;
+    default: return VmOpcode::Nop;
     }
 }
 
+thread_local std::wstring g_lastVmFailure;
+
 void ConvertResult(const VmExecutionResult& source, VmExecutionResultNative& dest) {
     dest.success = source.success ? TRUE : FALSE;
     dest.stepsExecuted = source.stepsExecuted;
     dest.returnValue = source.returnValue;
     g_lastVmFailure = source.failureReason;
     dest.failureReason = g_lastVmFailure.empty() ? nullptr : g_lastVmFailure.c_str();
+    dest.continuation = source.continuation;
+}
+
+// Bytecode cache and native tier shared by every ILVirtualMachine in the process. Both only ever
+// hold immutable programs, so instances share them without coordinating; whichever instance shuts
+// down last destroys them.
+struct VmProgramStore {
+    CRITICAL_SECTION lock;
+    std::weak_ptr<BytecodeCache> cache;
+    std::weak_ptr<NativeCompiler> nativeCompiler;
+
+    VmProgramStore() {
+        InitializeCriticalSection(&lock);
+    }
+
+    ~VmProgramStore() {
+        DeleteCriticalSection(&lock);
+    }
+};
+
+VmProgramStore& ProgramStore() {
+    static VmProgramStore store;
+    return store;
+}
+
+// Key a program is stored under in the shared program store. Instances differ in what they compile
+// besides the code, so the register encoding and the host's local and call signatures are part of
+// the key; with none of them it is the plain key, which keeps existing cache files valid.
+std::string ProgramStoreKey(const std::string& key, bool registerCode, const std::vector<uint8_t>* localSignature,
+                            const std::vector<VmCallSignature>* callSignatures) {
+    if (key.empty()) {
+        return key;
+    }
+    std::string storeKey = key;
+    if (registerCode) {
+        storeKey += "#registers";
+    }
+    if (localSignature) {
+        storeKey += "#locals:" + ComputeSha1(localSignature->data(), localSignature->size());
+    }
+    if (callSignatures) {
+        storeKey += "#calls:" + ComputeSha1(callSignatures->data(), callSignatures->size() * sizeof(VmCallSignature));
+    }
+    return storeKey;
+}
+
+// nativeCompiler comes back null when the native tier cannot start
+bool AcquireProgramStore(std::shared_ptr<BytecodeCache>& cache, std::shared_ptr<NativeCompiler>& nativeCompiler) {
+    VmProgramStore& store = ProgramStore();
+    EnterCriticalSection(&store.lock);
+
+    cache = store.cache.lock();
+    if (!cache) {
+        cache = std::make_shared<BytecodeCache>();
+        if (!cache->Initialize()) {
+            cache.reset();
+            LeaveCriticalSection(&store.lock);
+            return false;
+        }
+        store.cache = cache;
+    }
+
+    // The native tier is optional; without it hot programs simply stay interpreted
+    nativeCompiler = store.nativeCompiler.lock();
+    if (!nativeCompiler) {
+        nativeCompiler = std::make_shared<NativeCompiler>();
+        if (nativeCompiler->Initialize()) {
+            store.nativeCompiler = nativeCompiler;
+        } else {
+            nativeCompiler.reset();
+        }
+    }
+
+    LeaveCriticalSection(&store.lock);
+    return true;
 }
 
 } // namespace
 
+VmBindingTable::VmBindingTable(const VmProgram& program)
+    : callSites(program.callSites)
+    , programTargets(false) {
+    for (const VmInstruction& instruction : program.instructions) {
+        VmOpcode opcode = LoadOpcode(instruction);
+        if ((opcode == VmOpcode::LoadField || opcode == VmOpcode::StoreField) && fieldSites.empty()) {
+            fieldSites.resize(program.instructions.size());
+        } else if (opcode == VmOpcode::LoadString && literalSites.empty()) {
+            literalSites.resize(program.instructions.size());
+        }
+    }
+}
+
+// Interpreter state captured when a host call returns VmCallStatus::Pending. The continuation owns
+// copies of the arguments and locals, since the caller's arrays are gone by the time it resumes.
+struct VmContinuation {
+    std::shared_ptr<VmProgram> program;
+    std::shared_ptr<VmBindingTable> bindings;   // The handle's table as of the suspend
+    std::vector<VmValue> stack;
+    std::vector<VmValue> arguments;
+    std::vector<VmValue> locals;
+    uint32_t instructionPointer;
+    uint32_t stepsExecuted;
+    uint64_t timeBudgetTicks;    // What was left of the budget; time spent pending is not charged
+    size_t memoryBudgetBytes;
+    VmExecutionMemory memory;    // Taken over from the suspended execution and handed back on resume
+
+    VmContinuation()
+        : instructionPointer(0)
+        , stepsExecuted(0)
+        , timeBudgetTicks(0)
+        , memoryBudgetBytes(0) {}
+
+    ~VmContinuation() {
+        memory.Release();
+    }
+};
+
 ILVirtualMachine::ILVirtualMachine()
-    : m_initialized(false) {
+    : m_initialized(false)
+    , m_nextContinuation(0)
+    , m_inlineCacheHits(0)
+    , m_inlineCacheMisses(0)
+    , m_megamorphicDispatches(0)
+    , m_nativeExecutions(0)
+    , m_nativeGuardFailures(0)
+    , m_stringLiteralLookups(0)
+    , m_stringLiteralHits(0)
+    , m_fieldLayouts(nullptr) {
     InitializeCriticalSection(&m_lock);
+    m_profiler = std::make_unique<VmProfiler>();
+    m_handles = std::make_unique<VmHandleTable>();
 }
 
 ILVirtualMachine::~ILVirtualMachine() {
@@ -90,9 +894,9 @@ bool ILVirtualMachine::Initialize() {
     }
 
     m_compiler = std::make_unique<BytecodeCompiler>();
-    m_cache = std::make_unique<BytecodeCache>();
+    m_compiler->SetEmitRegisterCode(m_options.enableRegisterTier != FALSE);
 
-    if (!m_compiler->Initialize() || !m_cache->Initialize()) {
+    if (!m_compiler->Initialize() || !AcquireProgramStore(m_cache, m_nativeCompiler)) {
         m_compiler.reset();
         m_cache.reset();
         LeaveCriticalSection(&m_lock);
@@ -114,14 +918,17 @@ void ILVirtualMachine::Shutdown() {
     if (m_compiler) {
         m_compiler->Shutdown();
     }
-    if (m_cache) {
-        m_cache->Flush();
-        m_cache->Shutdown();
+    if (m_workerPool) {
+        m_workerPool->Shutdown();
     }
 
+    m_workerPool.reset();
+    m_continuations.clear();
+    // The program store shuts down with the last instance holding it
+    m_nativeCompiler.reset();
     m_cache.reset();
     m_compiler.reset();
-    m_livePrograms.clear();
+    m_handles->Clear();
     m_initialized = false;
     LeaveCriticalSection(&m_lock);
 }
@@ -136,94 +943,667 @@ std::shared_ptr<VmProgram> ILVirtualMachine::Compile(const void* ilCode, size_t
         effectiveKey = ComputeSha1(ilCode, ilSize);
     }
 
+    // Resolved before the lookup, since the signatures this instance's host returns are part of the key
+    std::vector<uint8_t> localSignature;
+    bool hasSignature = m_compiler->ResolveLocalSignature(ilCode, ilSize, &m_hostCallbacks, localSignature);
+    std::vector<VmCallSignature> callSignatures;
+    bool hasCallSignatures = m_compiler->ResolveCallSignatures(ilCode, ilSize, &m_hostCallbacks, callSignatures);
+    std::string storeKey = ProgramStoreKey(effectiveKey, m_compiler->EmitsRegisterCode(), hasSignature ? &localSignature : nullptr,
+                                           hasCallSignatures ? &callSignatures : nullptr);
+
     std::shared_ptr<VmProgram> program;
 
-    if (!effectiveKey.empty()) {
-        program = m_cache->Get(effectiveKey);
+    if (!storeKey.empty()) {
+        program = m_cache->Get(storeKey);
         if (program) {
-            EnterCriticalSection(&m_lock);
-            m_livePrograms[program.get()] = program;
-            LeaveCriticalSection(&m_lock);
             return program;
         }
     }
 
-    program = m_compiler->Compile(ilCode, ilSize, effectiveKey);
+    program = m_compiler->Compile(ilCode, ilSize, effectiveKey, hasSignature ? &localSignature : nullptr,
+                                  hasCallSignatures ? &callSignatures : nullptr);
     if (!program) {
         return nullptr;
     }
 
-    if (!effectiveKey.empty()) {
-        m_cache->Put(effectiveKey, *program);
+    if (!storeKey.empty()) {
+        m_cache->Put(storeKey, *program);
     }
 
-    EnterCriticalSection(&m_lock);
-    m_livePrograms[program.get()] = program;
-    LeaveCriticalSection(&m_lock);
-
     return program;
 }
 
+void* ILVirtualMachine::CompileHandle(const void* ilCode, size_t ilSize, const std::string& cacheKey) {
+    std::shared_ptr<VmProgram> program = Compile(ilCode, ilSize, cacheKey);
+    if (!program) {
+        return nullptr;
+    }
+    return RegisterHandle(program);
+}
+
+std::shared_ptr<VmProgram> ILVirtualMachine::LoadBytecode(const void* bytecode, size_t size, const std::string& cacheKey) {
+    if (!m_initialized || !bytecode || size == 0) {
+        return nullptr;
+    }
+
+    std::string effectiveKey = cacheKey;
+    if (effectiveKey.empty()) {
+        effectiveKey = ComputeSha1(bytecode, size);
+    }
+
+    std::string storeKey = ProgramStoreKey(effectiveKey, m_compiler->EmitsRegisterCode(), nullptr, nullptr);
+    if (!storeKey.empty()) {
+        if (std::shared_ptr<VmProgram> cached = m_cache->Get(storeKey)) {
+            return cached;
+        }
+    }
+
+    const wchar_t* failureReason = nullptr;
+    std::shared_ptr<VmProgram> program = m_compiler->Load(bytecode, size, effectiveKey, failureReason);
+    if (!program) {
+        LogMessage(m_hostCallbacks, failureReason);
+        return nullptr;
+    }
+
+    if (!storeKey.empty()) {
+        m_cache->Put(storeKey, *program);
+    }
+
+    return program;
+}
+
+void* ILVirtualMachine::LoadBytecodeHandle(const void* bytecode, size_t size, const std::string& cacheKey) {
+    std::shared_ptr<VmProgram> program = LoadBytecode(bytecode, size, cacheKey);
+    if (!program) {
+        return nullptr;
+    }
+    return RegisterHandle(program);
+}
+
+void* ILVirtualMachine::RegisterHandle(const std::shared_ptr<VmProgram>& program) {
+    // Plain calls whose token has a registered host function start out bound to it
+    std::shared_ptr<VmBindingTable> bindings;
+    EnterCriticalSection(&m_lock);
+    if (!m_hostFunctionTokens.empty()) {
+        for (uint32_t index = 0; index < program->callSites.size(); ++index) {
+            auto token = m_hostFunctionTokens.find(program->callSites[index].metadataToken);
+            if (token == m_hostFunctionTokens.end() || !HasSingleTarget(*program, index, true) ||
+                !MatchesSignature(program->callSites[index], m_hostFunctions[token->second].argumentCount)) {
+                continue;
+            }
+            if (!bindings) {
+                bindings = std::make_shared<VmBindingTable>(*program);
+            }
+            BindHostTarget(bindings->callSites[index], m_hostFunctions[token->second]);
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+
+    return m_handles->Register(program, bindings);
+}
+
 bool ILVirtualMachine::Execute(const VmProgram& program, VmExecutionContext& context, VmExecutionResult& result) {
+    return ExecuteContext(program, nullptr, nullptr, context, result);
+}
+
+bool ILVirtualMachine::ExecuteContext(const VmProgram& program, void* handle, VmBindingTable* bindings,
+                                      VmExecutionContext& context, VmExecutionResult& result) {
     if (!m_initialized) {
         result.success = false;
         result.failureReason = L"VM not initialized";
         return false;
     }
 
-    std::vector<VmValue> locals = context.locals;
-    if (locals.size() < program.localCount) {
-        locals.resize(program.localCount);
-    }
-
     if (context.arguments.size() < program.argumentCount) {
         context.arguments.resize(program.argumentCount);
     }
+    if (context.locals.size() < program.localCount) {
+        size_t provided = context.locals.size();
+        context.locals.resize(program.localCount);
+        ClearLocals(program, context.locals.data(), provided, program.localCount);
+    }
 
-    std::vector<VmValue> stack;
-    stack.reserve(program.instructions.size());
+    VmFrame frame;
+    frame.arguments = context.arguments.data();
+    frame.argumentCount = static_cast<uint32_t>(context.arguments.size());
+    frame.locals = context.locals.data();
+    frame.localCount = static_cast<uint32_t>(context.locals.size());
+    frame.timeBudgetTicks = context.timeBudgetTicks;
+    frame.memoryBudgetBytes = context.memoryBudgetBytes;
+    frame.programHandle = handle;
+    frame.bindings = bindings;
+    frame.hostArgumentCount = frame.argumentCount;
+    frame.hostLocalCount = frame.localCount;
+
+    return ExecuteFrame(program, frame, result);
+}
+
+bool ILVirtualMachine::ExecuteFrame(const VmProgram& program, VmFrame& frame, VmExecutionResult& result) {
+    VmProfiler* profiler = ActiveProfiler();
+    if (!profiler) {
+        return DispatchFrame(program, frame, result);
+    }
+
+    uint64_t start = VmReadCycleCounter();
+    bool success = DispatchFrame(program, frame, result);
+    profiler->RecordInvocation(program, VmReadCycleCounter() - start);
+    return success;
+}
+
+bool ILVirtualMachine::DispatchFrame(const VmProgram& program, VmFrame& frame, VmExecutionResult& result) {
+    // Compiled code has no budget checks of its own: skip it under a time budget, and charge it the
+    // account the unchecked interpreter opens, so it runs only when the interpreter could
+    VmNativeEntry entry = program.tier.entry.load(std::memory_order_acquire);
+    if (entry && frame.timeBudgetTicks == 0) {
+        FrameLease lease;
+        VmExecutionMemory& memory = lease.Storage().memory;
+        if (OpenAccount(memory, frame, program.maxStackDepth)) {
+            AllocationScopeGuard allocationScope(memory.account);
+            VmValue returnValue;
+            if (entry(frame.arguments, frame.locals, &returnValue)) {
+                m_nativeExecutions.fetch_add(1, std::memory_order_relaxed);
+                result.stepsExecuted = 0;
+                result.returnValue = returnValue.GetKind() == VmValue::Kind::Uninitialized ? nullptr : returnValue.GetPayload();
+                result.success = true;
+                return true;
+            }
+            m_nativeGuardFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (m_options.enableRegisterTier && !program.registerInstructions.empty()) {
+        return ExecuteRegisters(program, frame, result);
+    }
+
+    // The verifier bounds the stack height, so the whole stack can be charged once up front. Calls
+    // bound to other programs are entered by the checked loop only.
+    if (program.verified && !(frame.bindings && frame.bindings->programTargets) &&
+        (frame.memoryBudgetBytes == 0 || FrameBytes(frame, program.maxStackDepth) <= frame.memoryBudgetBytes)) {
+        return Interpret<false>(program, frame, result);
+    }
+
+    return Interpret<true>(program, frame, result);
+}
+
+template <bool Checked>
+bool ILVirtualMachine::Interpret(const VmProgram& entryProgram, VmFrame& entryFrame, VmExecutionResult& result,
+                                 VmContinuation* resumeFrom) {
+    FrameLease lease;
+    VmFrameStorage& storage = lease.Storage();
+    std::vector<VmValue>& stack = storage.stack;
+    std::vector<VmDirectCall>& calls = storage.calls;
+    std::vector<VmValue>& calleeValues = storage.calleeValues;
+    stack.clear();
+    stack.reserve(Checked ? entryProgram.instructions.size() : entryProgram.maxStackDepth);
+    calls.clear();
+    calleeValues.clear();
 
     uint64_t startTicks = GetCurrentTicks();
     result.stepsExecuted = 0;
     result.returnValue = nullptr;
 
+    // The running method; direct calls swap these and push the caller onto `calls`
+    const VmProgram* program = &entryProgram;
+    VmFrame frame = entryFrame;
+    frame.stackBase = 0;
+    frame.memory = &storage.memory;
+    size_t valuesOffset = VmDirectCall::CallerArrays;
+
+    // Bound callees are looked up by handle, which needs a guard when the caller didn't take one
+    std::optional<VmHandleTable::ReadGuard> calleeGuard;
+
+    VmProfiler* profiler = ActiveProfiler();
     uint32_t instructionPointer = 0;
-    while (instructionPointer < program.instructions.size()) {
-        if (context.timeBudgetTicks > 0) {
-            uint64_t elapsed = GetCurrentTicks() - startTicks;
-            if (elapsed > context.timeBudgetTicks) {
-                result.success = false;
-                result.failureReason = L"VM execution exceeded time budget";
-                LogMessage(m_hostCallbacks, result.failureReason);
+    uint32_t backedges = 0;
+
+    auto fail = [&](const wchar_t* reason) {
+        if (profiler) {
+            profiler->FlushThreadCounters();
+        }
+        result.success = false;
+        result.failureReason = reason;
+        LogMessage(m_hostCallbacks, result.failureReason);
+        return false;
+    };
+
+    // A resumed execution keeps the account it suspended with, which already covers its frame
+    VmExecutionMemory& memory = storage.memory;
+    if (resumeFrom) {
+        stack.insert(stack.end(), resumeFrom->stack.begin(), resumeFrom->stack.end());
+        instructionPointer = resumeFrom->instructionPointer;
+        result.stepsExecuted = resumeFrom->stepsExecuted;
+        std::swap(memory, resumeFrom->memory);
+    } else if (!OpenAccount(memory, frame, 0)) {
+        return fail(L"VM execution exceeded memory budget");
+    }
+    if (!Checked && !ChargeStack(memory, entryProgram.maxStackDepth)) {
+        return fail(L"VM execution exceeded memory budget");
+    }
+    AllocationScopeGuard allocationScope(memory.account);
+
+    for (;;) {
+        while (instructionPointer < program->instructions.size()) {
+            if (frame.timeBudgetTicks > 0) {
+                uint64_t elapsed = GetCurrentTicks() - startTicks;
+                if (elapsed > frame.timeBudgetTicks) {
+                    return fail(L"VM execution exceeded time budget");
+                }
+            }
+
+            if (Checked && stack.size() > memory.stackSlots && !ChargeStack(memory, stack.size())) {
+                return fail(L"VM execution exceeded memory budget");
+            }
+
+            const VmInstruction& instruction = program->instructions[instructionPointer];
+            uint32_t previousInstruction = instructionPointer;
+
+            // Calls bound to another VM program stay in this loop instead of going through the host
+            const VmCallSite* directSite = nullptr;
+            // (a handle whose table binds one always runs the checked loop; see DispatchFrame)
+            if (Checked && frame.bindings && LoadOpcode(instruction) == VmOpcode::Call && instruction.operand0 >= 0 &&
+                static_cast<size_t>(instruction.operand0) < frame.bindings->callSites.size() &&
+                frame.bindings->callSites[instruction.operand0].kind == VmCallSite::TargetKind::Program) {
+                directSite = &frame.bindings->callSites[instruction.operand0];
+            }
+
+            if (directSite) {
+                if (!calleeGuard) {
+                    calleeGuard.emplace(*m_handles);
+                }
+                VmBindingTable* calleeBindings = nullptr;
+                const VmProgram* callee = m_handles->Find(directSite->data.programHandle, &calleeBindings);
+                if (!callee) {
+                    return fail(L"Bound callee program handle not registered");
+                }
+                if (calls.size() >= MaxDirectCallDepth) {
+                    return fail(L"VM call depth exceeded");
+                }
+
+                // The site's arity, which covers every argument the callee reads (BindCallSite checks)
+                uint32_t argumentCount = directSite->argumentCount;
+                if (stack.size() - frame.stackBase < argumentCount) {
+                    return fail(L"VM stack underflow");
+                }
+
+                // The callee's arguments and locals are charged until it returns
+                size_t calleeOffset = calleeValues.size();
+                size_t frameSize = static_cast<size_t>(argumentCount) + callee->localCount;
+                if (!memory.account.TryCharge(frameSize * sizeof(VmValue))) {
+                    return fail(L"VM execution exceeded memory budget");
+                }
+
+                VmDirectCall call;
+                call.program = program;
+                call.frame = frame;
+                call.valuesOffset = valuesOffset;
+                call.returnAddress = instructionPointer + 1;
+                calls.push_back(call);
+
+                // Arguments move off the evaluation stack into the callee's frame; locals start as
+                // the zeros of their declared kinds
+                calleeValues.resize(calleeOffset + frameSize);
+                std::copy(stack.end() - argumentCount, stack.end(), calleeValues.begin() + calleeOffset);
+                ClearLocals(*callee, calleeValues.data() + calleeOffset + argumentCount, 0, callee->localCount);
+                stack.resize(stack.size() - argumentCount);
+
+                program->tier.backedges.fetch_add(backedges, std::memory_order_relaxed);
+                backedges = 0;
+
+                program = callee;
+                valuesOffset = calleeOffset;
+                frame.arguments = calleeValues.data() + calleeOffset;
+                frame.argumentCount = argumentCount;
+                frame.locals = frame.arguments + argumentCount;
+                frame.localCount = callee->localCount;
+                frame.programHandle = directSite->data.programHandle;
+                frame.bindings = calleeBindings;
+                frame.stackBase = static_cast<uint32_t>(stack.size());
+
+                if (profiler) {
+                    profiler->RecordOpcode(VmOpcode::Call, 0);
+                }
+                result.stepsExecuted++;
+                instructionPointer = 0;
+                continue;
+            }
+
+            // Read the opcode before executing; quickening may rewrite it in place
+            VmOpcode profiledOpcode = VmOpcode::Nop;
+            bool sampled = false;
+            uint64_t sampleStart = 0;
+            if (profiler) {
+                profiledOpcode = LoadOpcode(instruction);
+                sampled = profiler->ShouldSample();
+                sampleStart = sampled ? VmReadCycleCounter() : 0;
+            }
+
+            if (!ExecuteInstruction<Checked>(instruction, *program, stack, frame, result, instructionPointer)) {
+                if (profiler) {
+                    profiler->FlushThreadCounters();
+                }
+                if (result.suspended && !calls.empty()) {
+                    // Continuations capture a single frame
+                    result.suspended = false;
+                    return fail(L"Host call cannot suspend inside a direct call");
+                }
+                if (result.suspended) {
+                    program->tier.backedges.fetch_add(backedges, std::memory_order_relaxed);
+                    result.stepsExecuted++;
+                    return Suspend(*program, frame, stack, instructionPointer + 1, GetCurrentTicks() - startTicks,
+                                   resumeFrom, result);
+                }
+                // A host callback that failed because one of its allocations ran over the budget
+                // reports its own reason; the budget is what the host needs to hear about
+                if (memory.account.exceeded && result.failureReason != L"VM execution exceeded memory budget") {
+                    return fail(L"VM execution exceeded memory budget");
+                }
                 return false;
             }
+
+            if (profiler) {
+                profiler->RecordOpcode(profiledOpcode, sampled ? VmReadCycleCounter() - sampleStart : 0);
+            }
+
+            result.stepsExecuted++;
+
+            if (instructionPointer == previousInstruction) {
+                instructionPointer++;
+            } else if (instructionPointer < previousInstruction) {
+                ++backedges;
+            }
         }
 
-        if (!EnsureStackMemory(context, stack)) {
-            result.success = false;
-            result.failureReason = L"VM execution exceeded memory budget";
-            LogMessage(m_hostCallbacks, result.failureReason);
-            return false;
+        program->tier.backedges.fetch_add(backedges, std::memory_order_relaxed);
+        backedges = 0;
+
+        if (calls.empty()) {
+            break;
         }
 
-        const VmInstruction& instruction = program.instructions[instructionPointer];
-        uint32_t previousInstruction = instructionPointer;
-        if (!ExecuteInstruction(instruction, program, stack, locals, context, result, instructionPointer)) {
-            return false;
+        // Return from a direct call: the callee's value, if any, replaces its part of the stack
+        bool hasValue = stack.size() > frame.stackBase;
+        VmValue returned = hasValue ? stack.back() : VmValue();
+        stack.resize(frame.stackBase);
+        memory.account.Release((calleeValues.size() - valuesOffset) * sizeof(VmValue));
+        calleeValues.resize(valuesOffset);
+
+        const VmDirectCall& caller = calls.back();
+        program = caller.program;
+        frame = caller.frame;
+        valuesOffset = caller.valuesOffset;
+        instructionPointer = caller.returnAddress;
+        if (valuesOffset != VmDirectCall::CallerArrays) {
+            // Deeper calls may have grown the buffer, so the caller's pointers are rebuilt
+            frame.arguments = calleeValues.data() + valuesOffset;
+            frame.locals = frame.arguments + frame.argumentCount;
         }
+        calls.pop_back();
+        result.returnValue = nullptr;
 
-        result.stepsExecuted++;
+        // The caller's site decides what the call pushes, as it does for host calls
+        const VmInstruction& callInstruction = program->instructions[instructionPointer - 1];
+        if (!PushCallResult(frame.bindings->callSites[callInstruction.operand0], hasValue, returned, stack)) {
+            return fail(L"Bound callee program returned no value");
+        }
+    }
 
-        if (instructionPointer == previousInstruction) {
-            instructionPointer++;
+    // Arrays are unpinned when the execution ends, so none may reach the host through the return
+    // value or the caller's arguments and locals
+    if (!memory.arrays.empty()) {
+        auto isArray = [](const VmValue& value) { return AsVmArray(value) != nullptr; };
+        if ((!stack.empty() && isArray(stack.back())) ||
+            std::any_of(frame.arguments, frame.arguments + frame.hostArgumentCount, isArray) ||
+            std::any_of(frame.locals, frame.locals + frame.hostLocalCount, isArray)) {
+            return fail(L"VM arrays cannot outlive the execution that allocated them");
         }
     }
 
+    if (profiler) {
+        profiler->FlushThreadCounters();
+    }
+
     if (!stack.empty()) {
-        result.returnValue = stack.back().data.object;
+        result.returnValue = stack.back().GetPayload();
+    }
+
+    result.success = true;
+    return true;
+}
+
+bool ILVirtualMachine::Suspend(const VmProgram& program, const VmFrame& frame, const std::vector<VmValue>& stack,
+                               uint32_t resumeInstruction, uint64_t elapsedTicks, const VmContinuation* resumedFrom,
+                               VmExecutionResult& result) {
+    result.success = false;
+    result.continuation = nullptr;
+
+    // Take owning references to what this execution runs with, since the handle may be released or
+    // rebound while the call is pending. Looking the handle up again could find other bindings.
+    std::shared_ptr<VmProgram> owner;
+    std::shared_ptr<VmBindingTable> bindingsOwner;
+    if (resumedFrom || frame.programHandle) {
+        owner = std::const_pointer_cast<VmProgram>(program.weak_from_this().lock());
+        if (frame.bindings) {
+            bindingsOwner = frame.bindings->weak_from_this().lock();
+        }
+    }
+    if (!owner || !bindingsOwner) {
+        result.suspended = false;
+        result.failureReason = L"Pending host call outside a program handle execution";
+        LogMessage(m_hostCallbacks, result.failureReason);
+        return false;
+    }
+
+    auto continuation = std::make_unique<VmContinuation>();
+    continuation->program = std::move(owner);
+    continuation->bindings = std::move(bindingsOwner);
+    continuation->stack.assign(stack.begin(), stack.end());
+    continuation->arguments.assign(frame.arguments, frame.arguments + frame.argumentCount);
+    continuation->locals.assign(frame.locals, frame.locals + frame.localCount);
+    continuation->instructionPointer = resumeInstruction;
+    continuation->stepsExecuted = result.stepsExecuted;
+    continuation->memoryBudgetBytes = frame.memoryBudgetBytes;
+    if (frame.memory) {
+        std::swap(continuation->memory, *frame.memory);
+    }
+    if (frame.timeBudgetTicks > 0) {
+        continuation->timeBudgetTicks = elapsedTicks < frame.timeBudgetTicks ? frame.timeBudgetTicks - elapsedTicks : 1;
+    }
+
+    EnterCriticalSection(&m_lock);
+    // Zero is never handed out, so a suspended result always carries a non-null continuation
+    uintptr_t id = ++m_nextContinuation;
+    if (id == 0) {
+        id = ++m_nextContinuation;
+    }
+    m_continuations.emplace(id, std::move(continuation));
+    LeaveCriticalSection(&m_lock);
+
+    result.continuation = reinterpret_cast<void*>(id);
+    return false;
+}
+
+bool ILVirtualMachine::Resume(void* continuationHandle, bool callSucceeded, const VmValue& returnValue,
+                              VmExecutionResult& result) {
+    result.suspended = false;
+    result.continuation = nullptr;
+
+    // Claiming the continuation removes it, so each one resumes exactly once
+    std::unique_ptr<VmContinuation> continuation;
+    EnterCriticalSection(&m_lock);
+    auto it = m_continuations.find(reinterpret_cast<uintptr_t>(continuationHandle));
+    if (it != m_continuations.end()) {
+        continuation = std::move(it->second);
+        m_continuations.erase(it);
+    }
+    LeaveCriticalSection(&m_lock);
+
+    if (!continuation) {
+        result.success = false;
+        result.failureReason = L"Unknown or already resumed VM continuation";
+        return false;
+    }
+
+    if (!callSucceeded) {
+        result.success = false;
+        result.stepsExecuted = continuation->stepsExecuted;
+        result.failureReason = L"Managed call dispatch failed";
+        LogMessage(m_hostCallbacks, result.failureReason);
+        return false;
+    }
+
+    // The suspended call is the instruction before the resume point
+    const VmProgram& program = *continuation->program;
+    const VmInstruction& callInstruction = program.instructions[continuation->instructionPointer - 1];
+    if (!PushCallResult(continuation->bindings->callSites[callInstruction.operand0],
+                        returnValue.GetKind() != VmValue::Kind::Uninitialized, returnValue, continuation->stack)) {
+        result.success = false;
+        result.stepsExecuted = continuation->stepsExecuted;
+        result.failureReason = L"Managed call returned no value";
+        LogMessage(m_hostCallbacks, result.failureReason);
+        return false;
+    }
+
+    VmFrame frame;
+    frame.arguments = continuation->arguments.data();
+    frame.argumentCount = static_cast<uint32_t>(continuation->arguments.size());
+    frame.locals = continuation->locals.data();
+    frame.localCount = static_cast<uint32_t>(continuation->locals.size());
+    frame.timeBudgetTicks = continuation->timeBudgetTicks;
+    frame.memoryBudgetBytes = continuation->memoryBudgetBytes;
+    frame.bindings = continuation->bindings.get();
+
+    if (program.verified && !(frame.bindings && frame.bindings->programTargets) &&
+        (frame.memoryBudgetBytes == 0 || FrameBytes(frame, program.maxStackDepth) <= frame.memoryBudgetBytes)) {
+        return Interpret<false>(program, frame, result, continuation.get());
+    }
+    return Interpret<true>(program, frame, result, continuation.get());
+}
+
+bool ILVirtualMachine::ExecuteRegisters(const VmProgram& program, VmFrame& frame, VmExecutionResult& result) {
+    const uint32_t localBase = program.argumentCount;
+    const uint32_t constantBase = program.registerCount - static_cast<uint32_t>(program.registerConstants.size());
+
+    // Charged like the interpreter's frame, with the register file standing in for the stack. The
+    // file never grows, so nothing past this can exceed the budget but allocations made under the scope.
+    FrameLease lease;
+    VmExecutionMemory& memory = lease.Storage().memory;
+    if (!OpenAccount(memory, frame, program.registerCount)) {
+        result.success = false;
+        result.failureReason = L"VM execution exceeded memory budget";
+        LogMessage(m_hostCallbacks, result.failureReason);
+        return false;
     }
+    AllocationScopeGuard allocationScope(memory.account);
+
+    std::vector<VmValue>& registers = lease.Storage().registers;
+    registers.assign(program.registerCount, VmValue());
+    std::copy_n(frame.arguments, std::min(frame.argumentCount, program.argumentCount), registers.begin());
+    std::copy_n(frame.locals, std::min(frame.localCount, program.localCount), registers.begin() + localBase);
+    std::copy(program.registerConstants.begin(), program.registerConstants.end(), registers.begin() + constantBase);
+
+    const std::vector<VmRegisterInstruction>& code = program.registerInstructions;
+    uint64_t startTicks = GetCurrentTicks();
+    result.stepsExecuted = 0;
+    result.returnValue = nullptr;
+
+    auto fail = [&](const wchar_t* reason) {
+        result.success = false;
+        result.failureReason = reason;
+        LogMessage(m_hostCallbacks, result.failureReason);
+        return false;
+    };
+
+    uint32_t instructionPointer = 0;
+    while (instructionPointer < code.size()) {
+        if (frame.timeBudgetTicks > 0 && GetCurrentTicks() - startTicks > frame.timeBudgetTicks) {
+            return fail(L"VM execution exceeded time budget");
+        }
+
+        const VmRegisterInstruction& instruction = code[instructionPointer++];
+        result.stepsExecuted++;
+
+        switch (instruction.opcode) {
+        case VmRegisterOpcode::Nop:
+            break;
+        case VmRegisterOpcode::Move:
+            registers[instruction.a] = registers[instruction.b];
+            break;
+        case VmRegisterOpcode::Add:
+        case VmRegisterOpcode::Subtract:
+        case VmRegisterOpcode::Multiply:
+        case VmRegisterOpcode::Divide: {
+            static const VmOpcode arithmetic[] = { VmOpcode::Add, VmOpcode::Subtract, VmOpcode::Multiply, VmOpcode::Divide };
+            VmOpcode opcode = arithmetic[static_cast<uint8_t>(instruction.opcode) - static_cast<uint8_t>(VmRegisterOpcode::Add)];
+            VmValue computed;
+            const wchar_t* failure = nullptr;
+            if (!ComputeArithmetic(opcode, registers[instruction.b], registers[instruction.c], computed, failure)) {
+                return fail(failure);
+            }
+            registers[instruction.a] = computed;
+            break;
+        }
+        case VmRegisterOpcode::CompareEqual:
+        case VmRegisterOpcode::CompareNotEqual:
+        case VmRegisterOpcode::CompareGreaterThan:
+        case VmRegisterOpcode::CompareLessThan: {
+            static const VmOpcode comparisons[] = { VmOpcode::CompareEqual, VmOpcode::CompareNotEqual,
+                                                    VmOpcode::CompareGreaterThan, VmOpcode::CompareLessThan };
+            VmOpcode opcode = comparisons[static_cast<uint8_t>(instruction.opcode) - static_cast<uint8_t>(VmRegisterOpcode::CompareEqual)];
+            bool outcome = false;
+            if (!CompareValues(opcode, registers[instruction.b], registers[instruction.c], outcome)) {
+                return fail(L"Comparison operands have incompatible kinds");
+            }
+            registers[instruction.a] = VmValue(outcome ? 1 : 0);
+            break;
+        }
+        case VmRegisterOpcode::Jump:
+            instructionPointer = static_cast<uint32_t>(instruction.a);
+            break;
+        case VmRegisterOpcode::JumpIfTrue:
+        case VmRegisterOpcode::JumpIfFalse: {
+            bool truthy = IsTruthy(registers[instruction.b]);
+            if (truthy == (instruction.opcode == VmRegisterOpcode::JumpIfTrue)) {
+                instructionPointer = static_cast<uint32_t>(instruction.a);
+            }
+            break;
+        }
+        case VmRegisterOpcode::JumpIfEqual:
+        case VmRegisterOpcode::JumpIfNotEqual:
+        case VmRegisterOpcode::JumpIfGreaterThan:
+        case VmRegisterOpcode::JumpIfLessOrEqual:
+        case VmRegisterOpcode::JumpIfLessThan:
+        case VmRegisterOpcode::JumpIfGreaterOrEqual:
+        case VmRegisterOpcode::JumpIfGreaterOrEqualOrdered:
+        case VmRegisterOpcode::JumpIfLessOrEqualOrdered:
+        case VmRegisterOpcode::JumpIfGreaterThanUnsigned:
+        case VmRegisterOpcode::JumpIfGreaterOrEqualUnsigned:
+        case VmRegisterOpcode::JumpIfLessThanUnsigned:
+        case VmRegisterOpcode::JumpIfLessOrEqualUnsigned: {
+            bool taken = false;
+            if (!EvaluateBranch(ToBranchOpcode(instruction.opcode), registers[instruction.b], registers[instruction.c],
+                                taken)) {
+                return fail(L"Comparison operands have incompatible kinds");
+            }
+            if (taken) {
+                instructionPointer = static_cast<uint32_t>(instruction.a);
+            }
+            break;
+        }
+        case VmRegisterOpcode::Return:
+            if (instruction.a >= 0) {
+                result.returnValue = registers[instruction.a].GetPayload();
+            }
+            instructionPointer = static_cast<uint32_t>(code.size());
+            break;
+        default:
+            return fail(L"Unsupported VM register opcode");
+        }
+    }
+
+    // Write back so the frame ends up as the stack interpreter would leave it
+    std::copy_n(registers.begin(), std::min(frame.argumentCount, program.argumentCount), frame.arguments);
+    std::copy_n(registers.begin() + localBase, std::min(frame.localCount, program.localCount), frame.locals);
 
-    context.locals = locals;
     result.success = true;
     return true;
 }
@@ -235,61 +1615,555 @@ bool ILVirtualMachine::ExecuteHandle(void* handle, VmExecutionContext& context,
         return false;
     }
 
-    std::shared_ptr<VmProgram> program;
-    EnterCriticalSection(&m_lock);
-    auto it = m_livePrograms.find(handle);
-    if (it != m_livePrograms.end()) {
-        program = it->second;
+    VmHandleTable::ReadGuard guard(*m_handles);
+    VmBindingTable* bindings = nullptr;
+    const VmProgram* program = m_handles->Find(handle, &bindings);
+    if (!program) {
+        result.success = false;
+        result.failureReason = L"VM program handle not registered";
+        return false;
     }
-    LeaveCriticalSection(&m_lock);
 
+    RecordInvocation(*program, handle);
+    return ExecuteContext(*program, handle, bindings, context, result);
+}
+
+bool ILVirtualMachine::ExecuteHandle(void* handle, VmExecutionContextNative& context, VmExecutionResult& result) {
+    if (!handle) {
+        result.success = false;
+        result.failureReason = L"Invalid VM handle";
+        return false;
+    }
+
+    VmHandleTable::ReadGuard guard(*m_handles);
+    VmBindingTable* bindings = nullptr;
+    const VmProgram* program = m_handles->Find(handle, &bindings);
     if (!program) {
         result.success = false;
         result.failureReason = L"VM program handle not registered";
         return false;
     }
-
-    return Execute(*program, context, result);
+
+    if (!m_initialized) {
+        result.success = false;
+        result.failureReason = L"VM not initialized";
+        return false;
+    }
+
+    RecordInvocation(*program, handle);
+
+    VmFrame frame;
+    frame.arguments = context.arguments;
+    frame.argumentCount = context.arguments ? context.argumentCount : 0;
+    frame.locals = context.locals;
+    frame.localCount = context.locals ? context.localCount : 0;
+    frame.timeBudgetTicks = context.timeBudgetTicks;
+    frame.memoryBudgetBytes = context.memoryBudgetBytes;
+    frame.programHandle = handle;
+    frame.bindings = bindings;
+    frame.hostArgumentCount = frame.argumentCount;
+    frame.hostLocalCount = frame.localCount;
+
+    // The caller's arrays are used in place. Only when they are shorter than the program needs
+    // does the execution run on arena scratch and copy the caller-visible prefix back afterwards.
+    FrameLease lease;
+    bool scratchArguments = frame.argumentCount < program->argumentCount;
+    bool scratchLocals = frame.localCount < program->localCount;
+
+    if (scratchArguments) {
+        std::vector<VmValue>& arguments = lease.Storage().arguments;
+        arguments.assign(program->argumentCount, VmValue());
+        std::copy_n(frame.arguments, frame.argumentCount, arguments.begin());
+        frame.arguments = arguments.data();
+        frame.argumentCount = program->argumentCount;
+    }
+    if (scratchLocals) {
+        std::vector<VmValue>& locals = lease.Storage().locals;
+        locals.assign(program->localCount, VmValue());
+        std::copy_n(frame.locals, frame.localCount, locals.begin());
+        ClearLocals(*program, locals.data(), frame.localCount, program->localCount);
+        frame.locals = locals.data();
+        frame.localCount = program->localCount;
+    }
+
+    bool success = ExecuteFrame(*program, frame, result);
+
+    if (scratchArguments && context.arguments) {
+        std::copy_n(frame.arguments, context.argumentCount, context.arguments);
+    }
+    if (scratchLocals && context.locals) {
+        std::copy_n(frame.locals, context.localCount, context.locals);
+    }
+
+    return success;
+}
+
+uint32_t ILVirtualMachine::ExecuteBatch(void* handle, VmExecutionContextNative* contexts, uint32_t count,
+                                        VmExecutionResultNative* results, uint32_t parallelism) {
+    struct BatchState {
+        ILVirtualMachine* vm;
+        void* handle;
+        VmExecutionContextNative* contexts;
+        VmExecutionResultNative* results;
+        std::atomic<uint32_t> failures;
+    };
+
+    BatchState state;
+    state.vm = this;
+    state.handle = handle;
+    state.contexts = contexts;
+    state.results = results;
+    state.failures.store(0, std::memory_order_relaxed);
+
+    VmWorkerPool::Task task = [](uint32_t index, void* context) {
+        BatchState& batch = *static_cast<BatchState*>(context);
+        VmExecutionResult result;
+        bool success = batch.vm->ExecuteHandle(batch.handle, batch.contexts[index], result) && result.success;
+
+        // A suspended context is not a failure; its continuation is resumed like any other
+        VmExecutionResultNative& native = batch.results[index];
+        native.success = success ? TRUE : FALSE;
+        native.stepsExecuted = result.stepsExecuted;
+        native.returnValue = result.returnValue;
+        native.continuation = result.suspended ? result.continuation : nullptr;
+        native.failureReason = success || result.suspended ? nullptr : batch.vm->RetainFailureReason(result.failureReason);
+        if (!success && !result.suspended) {
+            batch.failures.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    VmWorkerPool* pool = parallelism == 1 ? nullptr : EnsureWorkerPool();
+    if (pool) {
+        pool->Run(count, parallelism, task, &state);
+    } else {
+        for (uint32_t i = 0; i < count; ++i) {
+            task(i, &state);
+        }
+    }
+
+    return state.failures.load(std::memory_order_relaxed);
+}
+
+VmWorkerPool* ILVirtualMachine::EnsureWorkerPool() {
+    EnterCriticalSection(&m_lock);
+    if (!m_workerPool && m_initialized) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        uint32_t workers = systemInfo.dwNumberOfProcessors > 1 ? systemInfo.dwNumberOfProcessors - 1 : 0;
+
+        // A single-core device gets no workers; batches then run on the caller's thread
+        auto pool = std::make_unique<VmWorkerPool>();
+        if (workers > 0 && pool->Initialize(workers)) {
+            m_workerPool = std::move(pool);
+        }
+    }
+    VmWorkerPool* pool = m_workerPool.get();
+    LeaveCriticalSection(&m_lock);
+    return pool;
+}
+
+const wchar_t* ILVirtualMachine::RetainFailureReason(const std::wstring& reason) {
+    // Batch results outlive the worker threads' thread_local buffers, so distinct messages are kept
+    // for the lifetime of the VM. Messages are a small fixed set, but cap the table anyway.
+    static const wchar_t* const overflowReason = L"Execution failed";
+
+    EnterCriticalSection(&m_lock);
+    const wchar_t* retained = overflowReason;
+    auto it = m_failureReasons.find(reason);
+    if (it != m_failureReasons.end()) {
+        retained = it->second->c_str();
+    } else if (m_failureReasons.size() < 256) {
+        auto stored = std::make_unique<std::wstring>(reason);
+        retained = stored->c_str();
+        m_failureReasons.emplace(reason, std::move(stored));
+    }
+    LeaveCriticalSection(&m_lock);
+    return retained;
+}
+
+void ILVirtualMachine::GetProfile(VmProfileSnapshot& snapshot) {
+    m_profiler->GetSnapshot(snapshot);
+}
+
+void ILVirtualMachine::ResetProfile() {
+    m_profiler->Reset();
+}
+
+void ILVirtualMachine::RecordInvocation(const VmProgram& program, void* handle) {
+    VmTierState& tier = program.tier;
+    uint32_t invocations = tier.invocations.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    uint32_t threshold = m_options.tierUpThreshold;
+    if (threshold == 0 || !m_nativeCompiler || !program.verified ||
+        tier.stage.load(std::memory_order_relaxed) != VmTierState::Stage::Interpreted) {
+        return;
+    }
+
+    uint64_t hotness = static_cast<uint64_t>(invocations) + tier.backedges.load(std::memory_order_relaxed);
+    if (hotness < threshold) {
+        return;
+    }
+
+    // Only the caller that wins the transition queues the program
+    VmTierState::Stage expected = VmTierState::Stage::Interpreted;
+    if (tier.stage.compare_exchange_strong(expected, VmTierState::Stage::Queued, std::memory_order_relaxed)) {
+        // The queue outlives this execution's read guard, so it needs an owning reference
+        std::shared_ptr<VmProgram> shared = m_handles->Share(handle);
+        if (shared) {
+            m_nativeCompiler->Enqueue(shared);
+        } else {
+            tier.stage.store(VmTierState::Stage::Interpreted, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ILVirtualMachine::SetHostCallbacks(const VmHostCallbacks& callbacks) {
+    m_hostCallbacks = callbacks;
+}
+
+void ILVirtualMachine::SetOptions(const VmOptions& options) {
+    EnterCriticalSection(&m_lock);
+    m_options = options;
+    if (m_compiler) {
+        m_compiler->SetEmitRegisterCode(options.enableRegisterTier != FALSE);
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void ILVirtualMachine::FlushCache() {
+    if (m_cache) {
+        m_cache->Flush();
+    }
+}
+
+bool ILVirtualMachine::ConfigureCallSite(void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken) {
+    if (!handle) {
+        return false;
+    }
+
+    VmHandleTable::ReadGuard guard(*m_handles);
+
+    // Inline cache updates take the same lock. Holding it from the copy to the publish keeps a
+    // concurrent rebind of this handle from publishing a table that drops this edit, or vice versa.
+    EnterCriticalSection(&m_lock);
+    VmBindingTable* bindings = nullptr;
+    if (!m_handles->Find(handle, &bindings) || callSiteIndex >= bindings->callSites.size()) {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    // Zero leaves a resolved signature's count in place
+    if (argumentCount == 0 && bindings->callSites[callSiteIndex].signatureKnown) {
+        argumentCount = bindings->callSites[callSiteIndex].argumentCount;
+    }
+    if (!MatchesSignature(bindings->callSites[callSiteIndex], argumentCount)) {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    auto updated = std::make_shared<VmBindingTable>(*bindings);
+    VmCallSite& callSite = updated->callSites[callSiteIndex];
+    callSite.kind = VmCallSite::TargetKind::ManagedMethod;
+    callSite.data.managedTarget = managedTarget;
+    callSite.argumentCount = argumentCount;
+    if (metadataToken != 0) {
+        callSite.metadataToken = metadataToken;
+    }
+    bool replaced = m_handles->ReplaceBindings(handle, updated);
+    LeaveCriticalSection(&m_lock);
+    return replaced;
+}
+
+bool ILVirtualMachine::BindCallSite(void* handle, uint32_t callSiteIndex, void* calleeHandle) {
+    if (!handle || !calleeHandle) {
+        return false;
+    }
+
+    VmHandleTable::ReadGuard guard(*m_handles);
+    VmBindingTable* bindings = nullptr;
+    const VmProgram* program = m_handles->Find(handle, &bindings);
+    const VmProgram* callee = m_handles->Find(calleeHandle);
+    if (!program || !callee || callSiteIndex >= bindings->callSites.size()) {
+        return false;
+    }
+
+    // Only plain calls have a single target; callvirt and newobj keep going through the host
+    if (!HasSingleTarget(*program, callSiteIndex, false)) {
+        return false;
+    }
+
+    // The caller pushes as many arguments as the call's signature has, which can be more than the
+    // callee reads. Take the count from the site (ConfigureCallSite) or the host, never the callee.
+    // The host is asked outside the lock, so the site is rechecked once the lock is held.
+    for (;;) {
+        VmCallSite site = bindings->callSites[callSiteIndex];
+        uint32_t argumentCount = site.argumentCount;
+        if (argumentCount == 0 && site.kind != VmCallSite::TargetKind::Program && !site.signatureKnown) {
+            if (!m_hostCallbacks.managedCallArityCallback) {
+                return false;
+            }
+            argumentCount = m_hostCallbacks.managedCallArityCallback(site.metadataToken, m_hostCallbacks.userContext);
+        }
+        if (argumentCount < callee->argumentCount) {
+            return false;
+        }
+
+        // Held from the copy to the publish, like ConfigureCallSite, so concurrent rebinds can't drop this edit
+        EnterCriticalSection(&m_lock);
+        if (!m_handles->Find(handle, &bindings)) {
+            LeaveCriticalSection(&m_lock);
+            return false;
+        }
+        const VmCallSite& current = bindings->callSites[callSiteIndex];
+        if (current.kind != site.kind || current.argumentCount != site.argumentCount ||
+            current.metadataToken != site.metadataToken) {
+            LeaveCriticalSection(&m_lock);
+            continue;
+        }
+
+        auto updated = std::make_shared<VmBindingTable>(*bindings);
+        VmCallSite& callSite = updated->callSites[callSiteIndex];
+        callSite.kind = VmCallSite::TargetKind::Program;
+        callSite.data.programHandle = calleeHandle;
+        callSite.argumentCount = argumentCount;
+        updated->programTargets = true;
+        bool replaced = m_handles->ReplaceBindings(handle, updated);
+        LeaveCriticalSection(&m_lock);
+        return replaced;
+    }
+}
+
+bool ILVirtualMachine::RegisterHostFunctions(const VmHostFunction* functions, uint32_t count) {
+    if (!functions && count > 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!functions[i].function) {
+            return false;
+        }
+    }
+
+    auto sameFunction = [](const VmHostFunction& left, const VmHostFunction& right) {
+        return left.identifier == right.identifier && left.metadataToken == right.metadataToken &&
+               left.argumentCount == right.argumentCount && left.kind == right.kind && left.function == right.function;
+    };
+
+    EnterCriticalSection(&m_lock);
+    // Bound sites have already copied the first registration, so neither an ID nor a token can be redefined
+    for (uint32_t i = 0; i < count; ++i) {
+        auto it = m_hostFunctions.find(functions[i].identifier);
+        if (it != m_hostFunctions.end() && !sameFunction(it->second, functions[i])) {
+            LeaveCriticalSection(&m_lock);
+            return false;
+        }
+        for (uint32_t j = 0; j < i; ++j) {
+            if (functions[j].identifier == functions[i].identifier && !sameFunction(functions[j], functions[i])) {
+                LeaveCriticalSection(&m_lock);
+                return false;
+            }
+        }
+        if (functions[i].metadataToken != 0) {
+            auto token = m_hostFunctionTokens.find(functions[i].metadataToken);
+            if (token != m_hostFunctionTokens.end() && token->second != functions[i].identifier) {
+                LeaveCriticalSection(&m_lock);
+                return false;
+            }
+            for (uint32_t j = 0; j < i; ++j) {
+                if (functions[j].metadataToken == functions[i].metadataToken &&
+                    functions[j].identifier != functions[i].identifier) {
+                    LeaveCriticalSection(&m_lock);
+                    return false;
+                }
+            }
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        m_hostFunctions[functions[i].identifier] = functions[i];
+        if (functions[i].metadataToken != 0) {
+            m_hostFunctionTokens[functions[i].metadataToken] = functions[i].identifier;
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+    return true;
+}
+
+bool ILVirtualMachine::BindHostFunction(void* handle, uint32_t callSiteIndex, uint32_t identifier) {
+    if (!handle) {
+        return false;
+    }
+
+    VmHandleTable::ReadGuard guard(*m_handles);
+
+    // Held from the copy to the publish, like ConfigureCallSite, so concurrent rebinds can't drop this edit
+    EnterCriticalSection(&m_lock);
+    VmBindingTable* bindings = nullptr;
+    const VmProgram* program = m_handles->Find(handle, &bindings);
+    auto function = m_hostFunctions.find(identifier);
+    if (!program || callSiteIndex >= bindings->callSites.size() || !HasSingleTarget(*program, callSiteIndex, true) ||
+        function == m_hostFunctions.end() ||
+        !MatchesSignature(bindings->callSites[callSiteIndex], function->second.argumentCount)) {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    auto updated = std::make_shared<VmBindingTable>(*bindings);
+    BindHostTarget(updated->callSites[callSiteIndex], function->second);
+    bool replaced = m_handles->ReplaceBindings(handle, updated);
+    LeaveCriticalSection(&m_lock);
+    return replaced;
+}
+
+bool ILVirtualMachine::RegisterFieldLayouts(const VmFieldLayout* layouts, uint32_t count) {
+    if (!layouts && count > 0) {
+        return false;
+    }
+
+    // Strings are immutable, and interned ones live in frozen storage shared by the whole process
+    const void* stringType = g_typeSystem ? g_typeSystem->GetStringMethodTable() : nullptr;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!IsDirectFieldKind(layouts[i].kind) || !layouts[i].methodTable ||
+            layouts[i].methodTable == stringType) {
+            return false;
+        }
+    }
+
+    auto sameField = [](const VmFieldLayout& left, const VmFieldLayout& right) {
+        return left.fieldToken == right.fieldToken && left.methodTable == right.methodTable;
+    };
+
+    EnterCriticalSection(&m_lock);
+    // Executions may already have accessed objects through the first layout, so a field of a type
+    // can't be redefined
+    const VmFieldLayoutMap* current = m_fieldLayouts.load(std::memory_order_relaxed);
+    bool added = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        const VmFieldLayout* existing = nullptr;
+        if (current) {
+            auto it = current->find(layouts[i].fieldToken);
+            if (it != current->end()) {
+                for (const VmFieldLayout& layout : it->second) {
+                    existing = sameField(layout, layouts[i]) ? &layout : existing;
+                }
+            }
+        }
+        for (uint32_t j = 0; j < i && !existing; ++j) {
+            existing = sameField(layouts[j], layouts[i]) ? &layouts[j] : nullptr;
+        }
+        if (existing && (existing->offset != layouts[i].offset || existing->kind != layouts[i].kind)) {
+            LeaveCriticalSection(&m_lock);
+            return false;
+        }
+        added = added || !existing;
+    }
+
+    if (added) {
+        auto updated = current ? std::make_unique<VmFieldLayoutMap>(*current) : std::make_unique<VmFieldLayoutMap>();
+        for (uint32_t i = 0; i < count; ++i) {
+            std::vector<VmFieldLayout>& registered = (*updated)[layouts[i].fieldToken];
+            bool known = false;
+            for (const VmFieldLayout& layout : registered) {
+                known = known || sameField(layout, layouts[i]);
+            }
+            if (!known) {
+                registered.push_back(layouts[i]);
+            }
+        }
+        m_fieldLayouts.store(updated.get(), std::memory_order_release);
+        m_fieldLayoutVersions.push_back(std::move(updated));
+    }
+    LeaveCriticalSection(&m_lock);
+    return true;
+}
+
+const VmFieldLayout* ILVirtualMachine::FindFieldLayout(uint32_t fieldToken, const void* methodTable) const {
+    // Lock-free, since an ldfld/stfld asks whenever its site sees a type it hasn't resolved
+    const VmFieldLayoutMap* layouts = m_fieldLayouts.load(std::memory_order_acquire);
+    if (!layouts) {
+        return nullptr;
+    }
+    auto it = layouts->find(fieldToken);
+    if (it == layouts->end()) {
+        return nullptr;
+    }
+    for (const VmFieldLayout& layout : it->second) {
+        if (layout.methodTable == methodTable) {
+            return &layout;
+        }
+    }
+    return nullptr;
 }
 
-void ILVirtualMachine::SetHostCallbacks(const VmHostCallbacks& callbacks) {
-    m_hostCallbacks = callbacks;
+void ILVirtualMachine::GetStatistics(VmStatistics& statistics) const {
+    statistics.inlineCacheHits = m_inlineCacheHits.load(std::memory_order_relaxed);
+    statistics.inlineCacheMisses = m_inlineCacheMisses.load(std::memory_order_relaxed);
+    statistics.megamorphicDispatches = m_megamorphicDispatches.load(std::memory_order_relaxed);
+    statistics.nativeCompilations = m_nativeCompiler ? m_nativeCompiler->GetCompiledCount() : 0;
+    statistics.nativeRejections = m_nativeCompiler ? m_nativeCompiler->GetRejectedCount() : 0;
+    statistics.nativeExecutions = m_nativeExecutions.load(std::memory_order_relaxed);
+    statistics.nativeGuardFailures = m_nativeGuardFailures.load(std::memory_order_relaxed);
+
+    StringInternStats internStats;
+    GetStringInternTable().GetStatistics(internStats);
+    statistics.stringLiteralLookups = m_stringLiteralLookups.load(std::memory_order_relaxed);
+    statistics.stringLiteralHits = m_stringLiteralHits.load(std::memory_order_relaxed);
+    statistics.internedStrings = internStats.internedStrings;
+    statistics.internedStringBytes = internStats.internedBytes;
+    statistics.internedBytesSaved = internStats.bytesSaved;
 }
 
-void ILVirtualMachine::FlushCache() {
-    if (m_cache) {
-        m_cache->Flush();
-    }
-}
+VmNativeMethod ILVirtualMachine::ResolveVirtualTarget(VmCallSite& callSite, void* receiver) {
+    VmInlineCache& cache = callSite.inlineCache;
+    void* methodTable = static_cast<ObjectHeader*>(receiver)->methodTable;
 
-bool ILVirtualMachine::ConfigureCallSite(void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken) {
-    if (!handle) {
-        return false;
+    // Lock-free probe: entries below the published count are immutable
+    uint32_t count = std::atomic_ref<uint32_t>(cache.entryCount).load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (cache.entries[i].methodTable == methodTable) {
+            m_inlineCacheHits.fetch_add(1, std::memory_order_relaxed);
+            return cache.entries[i].target;
+        }
     }
 
-    std::shared_ptr<VmProgram> program;
-    EnterCriticalSection(&m_lock);
-    auto it = m_livePrograms.find(handle);
-    if (it != m_livePrograms.end()) {
-        program = it->second;
+    m_inlineCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+    auto state = std::atomic_ref<VmInlineCache::State>(cache.state);
+    if (state.load(std::memory_order_relaxed) == VmInlineCache::State::Megamorphic) {
+        m_megamorphicDispatches.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
     }
-    LeaveCriticalSection(&m_lock);
 
-    if (!program) {
-        return false;
+    VmNativeMethod target = m_hostCallbacks.resolveVirtualCallback(callSite.metadataToken, methodTable,
+                                                                   m_hostCallbacks.userContext);
+    if (!target) {
+        return nullptr;
     }
 
-    if (callSiteIndex >= program->callSites.size()) {
-        return false;
+    EnterCriticalSection(&m_lock);
+    count = cache.entryCount;
+    bool present = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (cache.entries[i].methodTable == methodTable) {
+            present = true;
+            break;
+        }
     }
 
-    VmCallSite& callSite = program->callSites[callSiteIndex];
-    callSite.data.managedTarget = managedTarget;
-    callSite.argumentCount = argumentCount;
-    if (metadataToken != 0) {
-        callSite.metadataToken = metadataToken;
+    if (!present) {
+        if (count < VmInlineCache::MaxEntries) {
+            cache.entries[count].methodTable = methodTable;
+            cache.entries[count].target = target;
+            state.store(count == 0 ? VmInlineCache::State::Monomorphic : VmInlineCache::State::Polymorphic,
+                        std::memory_order_relaxed);
+            std::atomic_ref<uint32_t>(cache.entryCount).store(count + 1, std::memory_order_release);
+        } else {
+            // Too many receiver types; stop resolving and let the host dispatch from now on
+            state.store(VmInlineCache::State::Megamorphic, std::memory_order_relaxed);
+        }
     }
-    return true;
+    LeaveCriticalSection(&m_lock);
+
+    return target;
 }
 
 void ILVirtualMachine::ReleaseHandle(void* handle) {
@@ -297,20 +2171,20 @@ void ILVirtualMachine::ReleaseHandle(void* handle) {
         return;
     }
 
-    EnterCriticalSection(&m_lock);
-    m_livePrograms.erase(handle);
-    LeaveCriticalSection(&m_lock);
+    m_handles->Release(handle);
 }
 
+template <bool Checked>
 bool ILVirtualMachine::ExecuteInstruction(const VmInstruction& instruction,
                                           const VmProgram& program,
                                           std::vector<VmValue>& stack,
-                                          std::vector<VmValue>& locals,
-                                          VmExecutionContext& context,
+                                          VmFrame& frame,
                                           VmExecutionResult& result,
                                           uint32_t& instructionPointer) {
+    // Verified programs were proven to stay within the stack, frame and branch bounds at compile
+    // time, so the unchecked instantiation compiles these guards away
     auto requireStack = [&](size_t count) -> bool {
-        if (stack.size() < count) {
+        if (Checked && stack.size() - frame.stackBase < count) {
             result.success = false;
             result.failureReason = L"VM stack underflow";
             LogMessage(m_hostCallbacks, result.failureReason);
@@ -319,46 +2193,87 @@ bool ILVirtualMachine::ExecuteInstruction(const VmInstruction& instruction,
         return true;
     };
 
-    auto ensureLocalIndex = [&](size_t index) {
-        if (index >= locals.size()) {
-            locals.resize(index + 1);
+    // Arrays are pinned only until the execution ends and the host cannot tell them from its own
+    // objects, so none may be handed to a callback, a host function or a host object's field
+    auto rejectArrays = [&](const VmValue* values, size_t count) -> bool {
+        if (frame.memory && !frame.memory->arrays.empty() &&
+            std::any_of(values, values + count, [](const VmValue& value) { return AsVmArray(value) != nullptr; })) {
+            result.success = false;
+            result.failureReason = L"VM arrays cannot be passed to the host";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+        return true;
+    };
+
+    // Frames are sized to the program up front, so an index past the end is malformed bytecode
+    auto requireLocal = [&](size_t index) {
+        if (Checked && index >= frame.localCount) {
+            result.success = false;
+            result.failureReason = L"Local index out of range";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+        return true;
+    };
+
+    auto requireArgument = [&](size_t index) {
+        if (Checked && index >= frame.argumentCount) {
+            result.success = false;
+            result.failureReason = L"Argument index out of range";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
         }
+        return true;
     };
 
-    auto ensureArgumentIndex = [&](size_t index) {
-        if (index >= context.arguments.size()) {
-            context.arguments.resize(index + 1);
+    auto requireWideOperand = [&](size_t index) {
+        if (Checked && index >= program.wideOperands.size()) {
+            result.success = false;
+            result.failureReason = L"Wide operand index out of range";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
         }
+        return true;
     };
 
-    switch (instruction.opcode) {
+    VmOpcode opcode = LoadOpcode(instruction);
+    switch (opcode) {
     case VmOpcode::Nop:
         return true;
     case VmOpcode::LoadArgument: {
-        ensureArgumentIndex(instruction.operand0);
-        stack.push_back(context.arguments[instruction.operand0]);
+        if (!requireArgument(instruction.operand0)) {
+            return false;
+        }
+        stack.push_back(frame.arguments[instruction.operand0]);
         return true;
     }
     case VmOpcode::StoreArgument: {
         if (!requireStack(1)) {
             return false;
         }
-        ensureArgumentIndex(instruction.operand0);
-        context.arguments[instruction.operand0] = stack.back();
+        if (!requireArgument(instruction.operand0)) {
+            return false;
+        }
+        frame.arguments[instruction.operand0] = stack.back();
         stack.pop_back();
         return true;
     }
     case VmOpcode::LoadLocal: {
-        ensureLocalIndex(instruction.operand0);
-        stack.push_back(locals[instruction.operand0]);
+        if (!requireLocal(instruction.operand0)) {
+            return false;
+        }
+        stack.push_back(frame.locals[instruction.operand0]);
         return true;
     }
     case VmOpcode::StoreLocal: {
         if (!requireStack(1)) {
             return false;
         }
-        ensureLocalIndex(instruction.operand0);
-        locals[instruction.operand0] = stack.back();
+        if (!requireLocal(instruction.operand0)) {
+            return false;
+        }
+        frame.locals[instruction.operand0] = stack.back();
         stack.pop_back();
         return true;
     }
@@ -366,25 +2281,90 @@ bool ILVirtualMachine::ExecuteInstruction(const VmInstruction& instruction,
         stack.emplace_back(instruction.operand0);
         return true;
     case VmOpcode::LoadConstantI8: {
-        uint64_t lower = static_cast<uint32_t>(instruction.operand0);
-        uint64_t upper = static_cast<uint32_t>(instruction.operand1);
-        int64_t value = static_cast<int64_t>((upper << 32) | lower);
+        if (!requireWideOperand(instruction.operand0)) {
+            return false;
+        }
+        VmValue value;
+        const wchar_t* failure = nullptr;
+        if (!BoxInt64(static_cast<int64_t>(program.wideOperands[instruction.operand0]), value, failure)) {
+            result.success = false;
+            result.failureReason = failure;
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+        stack.push_back(value);
+        return true;
+    }
+    case VmOpcode::LoadConstantR4: {
+        float value = 0.0f;
+        std::memcpy(&value, &instruction.operand0, sizeof(float));
+        stack.emplace_back(value);
+        return true;
+    }
+    case VmOpcode::LoadConstantR8: {
+        if (!requireWideOperand(instruction.operand0)) {
+            return false;
+        }
+        uint64_t bits = program.wideOperands[instruction.operand0];
+        double value = 0.0;
+        std::memcpy(&value, &bits, sizeof(double));
         stack.emplace_back(value);
         return true;
     }
     case VmOpcode::LoadNull:
         stack.emplace_back(nullptr, VmValue::Kind::Null);
         return true;
+    case VmOpcode::Pop:
+        if (!requireStack(1)) {
+            return false;
+        }
+        stack.pop_back();
+        return true;
     case VmOpcode::LoadString: {
+        // Tokens are scoped to the module the handle was compiled for, so the resolved literal lives
+        // in the handle's binding table; programs are shared by key and say nothing about modules
+        uint32_t token = static_cast<uint32_t>(instruction.operand0);
+        VmLiteralSite* site = frame.bindings && instructionPointer < frame.bindings->literalSites.size()
+                                  ? &frame.bindings->literalSites[instructionPointer]
+                                  : nullptr;
+        m_stringLiteralLookups.fetch_add(1, std::memory_order_relaxed);
+        if (void* literal = site ? site->object.load(std::memory_order_acquire) : nullptr) {
+            m_stringLiteralHits.fetch_add(1, std::memory_order_relaxed);
+            stack.emplace_back(literal, VmValue::Kind::Object);
+            return true;
+        }
+
+        if (m_hostCallbacks.stringLiteralDataCallback) {
+            const wchar_t* data = nullptr;
+            uint32_t length = 0;
+            void* literal = nullptr;
+            if (m_hostCallbacks.stringLiteralDataCallback(token, &data, &length, m_hostCallbacks.userContext)) {
+                literal = GetStringInternTable().Intern(data, length);
+            }
+            if (!literal) {
+                result.success = false;
+                result.failureReason = L"String literal callback failed";
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+            // Interned strings are frozen and never collected, so the site can keep it
+            if (site) {
+                site->object.store(literal, std::memory_order_release);
+            }
+            stack.emplace_back(literal, VmValue::Kind::Object);
+            return true;
+        }
+
         if (!m_hostCallbacks.stringLiteralCallback) {
             result.success = false;
             result.failureReason = L"No string literal callback registered";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
+        // The host owns the objects it returns and nothing roots them on the VM's behalf, so they are
+        // never cached; the host returns the same object for a token if identity matters
         VmValue value;
-        if (!m_hostCallbacks.stringLiteralCallback(static_cast<uint32_t>(instruction.operand0), value,
-                                                   m_hostCallbacks.userContext)) {
+        if (!m_hostCallbacks.stringLiteralCallback(token, value, m_hostCallbacks.userContext)) {
             result.success = false;
             result.failureReason = L"String literal callback failed";
             LogMessage(m_hostCallbacks, result.failureReason);
@@ -405,57 +2385,226 @@ bool ILVirtualMachine::ExecuteInstruction(const VmInstruction& instruction,
         VmValue left = stack.back();
         stack.pop_back();
 
-        if (left.kind != VmValue::Kind::Int32 || right.kind != VmValue::Kind::Int32) {
+        VmValue computed;
+        const wchar_t* failure = nullptr;
+        if (!ComputeArithmetic(opcode, left, right, computed, failure)) {
             result.success = false;
-            result.failureReason = L"Arithmetic currently supports Int32 only";
+            result.failureReason = failure;
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
 
-        int32_t computed = 0;
-        switch (instruction.opcode) {
-        case VmOpcode::Add: computed = left.data.i32 + right.data.i32; break;
-        case VmOpcode::Subtract: computed = left.data.i32 - right.data.i32; break;
-        case VmOpcode::Multiply: computed = left.data.i32 * right.data.i32; break;
-        case VmOpcode::Divide:
-            if (right.data.i32 == 0) {
-                result.success = false;
-                result.failureReason = L"Division by zero";
-                LogMessage(m_hostCallbacks, result.failureReason);
-                return false;
+        // Quicken: later executions dispatch straight to the kind-specialised handler. Other threads
+        // bump the deopt count through atomic_ref, so it is read the same way.
+        int16_t deoptimizations =
+            std::atomic_ref<int16_t>(const_cast<int16_t&>(instruction.operand1)).load(std::memory_order_relaxed);
+        if (deoptimizations < MaxArithmeticDeoptimizations) {
+            VmOpcode specialized = SpecializeArithmetic(opcode, left.GetKind(), right.GetKind());
+            if (specialized != opcode) {
+                StoreOpcode(instruction, specialized);
             }
-            computed = left.data.i32 / right.data.i32;
+        }
+
+        stack.push_back(computed);
+        return true;
+    }
+    case VmOpcode::AddI4:
+    case VmOpcode::SubtractI4:
+    case VmOpcode::MultiplyI4:
+    case VmOpcode::DivideI4:
+    case VmOpcode::AddI8:
+    case VmOpcode::SubtractI8:
+    case VmOpcode::MultiplyI8:
+    case VmOpcode::DivideI8:
+    case VmOpcode::AddR4:
+    case VmOpcode::SubtractR4:
+    case VmOpcode::MultiplyR4:
+    case VmOpcode::DivideR4:
+    case VmOpcode::AddR8:
+    case VmOpcode::SubtractR8:
+    case VmOpcode::MultiplyR8:
+    case VmOpcode::DivideR8: {
+        if (!requireStack(2)) {
+            return false;
+        }
+        VmValue& left = stack[stack.size() - 2];
+        const VmValue& right = stack.back();
+        VmOpcode generic = GeneralizeArithmetic(opcode);
+        VmValue::Kind expected = static_cast<VmValue::Kind>(
+            static_cast<int>(VmValue::Kind::Int32) + (static_cast<int>(opcode) - static_cast<int>(VmOpcode::AddI4)) / 4);
+
+        if (left.GetKind() != expected || right.GetKind() != expected) {
+            // Guard failed: deoptimise back to the generic opcode, which re-specialises on its next run
+            // unless this site keeps changing kinds
+            std::atomic_ref<int16_t>(const_cast<int16_t&>(instruction.operand1)).fetch_add(1, std::memory_order_relaxed);
+            StoreOpcode(instruction, generic);
+            return ExecuteInstruction<Checked>(instruction, program, stack, frame, result, instructionPointer);
+        }
+
+        const wchar_t* failure = nullptr;
+        bool computed = true;
+        switch (expected) {
+        case VmValue::Kind::Int32: {
+            int32_t value = 0;
+            computed = ComputeInt32(generic, left.GetInt32(), right.GetInt32(), value, failure);
+            left = VmValue(value);
+            break;
+        }
+        case VmValue::Kind::Int64: {
+            int64_t value = 0;
+            computed = ComputeInt64(generic, left.GetInt64(), right.GetInt64(), value, failure) &&
+                       BoxInt64(value, left, failure);
+            break;
+        }
+        case VmValue::Kind::Float:
+            left = VmValue(ComputeFloating<float>(generic, left.GetFloat(), right.GetFloat()));
             break;
         default:
+            left = VmValue(ComputeFloating<double>(generic, left.GetDouble(), right.GetDouble()));
             break;
         }
 
-        stack.emplace_back(computed);
+        if (!computed) {
+            result.success = false;
+            result.failureReason = failure;
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        stack.pop_back();
+        return true;
+    }
+    case VmOpcode::AddLocalConstant: {
+        if (!requireLocal(instruction.operand0)) {
+            return false;
+        }
+        if (!requireLocal(instruction.operand2)) {
+            return false;
+        }
+        const VmValue& source = frame.locals[instruction.operand0];
+        if (source.GetKind() == VmValue::Kind::Int32) {
+            int32_t computed = static_cast<int32_t>(static_cast<uint32_t>(source.GetInt32()) +
+                                                    static_cast<uint32_t>(instruction.operand1));
+            frame.locals[instruction.operand2] = VmValue(computed);
+            return true;
+        }
+
+        VmValue computed;
+        const wchar_t* failure = nullptr;
+        if (!ComputeArithmetic(VmOpcode::Add, source, VmValue(instruction.operand1), computed, failure)) {
+            result.success = false;
+            result.failureReason = failure;
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+        frame.locals[instruction.operand2] = computed;
+        return true;
+    }
+    case VmOpcode::ArithmeticLocals: {
+        if (!requireLocal(instruction.operand0)) {
+            return false;
+        }
+        if (!requireLocal(instruction.operand1)) {
+            return false;
+        }
+        VmValue computed;
+        const wchar_t* failure = nullptr;
+        if (!ComputeArithmetic(static_cast<VmOpcode>(instruction.operand2), frame.locals[instruction.operand0],
+                               frame.locals[instruction.operand1], computed, failure)) {
+            result.success = false;
+            result.failureReason = failure;
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        stack.push_back(computed);
+        return true;
+    }
+    case VmOpcode::CompareEqual:
+    case VmOpcode::CompareNotEqual:
+    case VmOpcode::CompareGreaterThan:
+    case VmOpcode::CompareLessThan: {
+        if (!requireStack(2)) {
+            return false;
+        }
+        VmValue right = stack.back();
+        stack.pop_back();
+        VmValue left = stack.back();
+        stack.pop_back();
+
+        bool outcome = false;
+        if (!CompareValues(opcode, left, right, outcome)) {
+            result.success = false;
+            result.failureReason = L"Comparison operands have incompatible kinds";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        stack.emplace_back(outcome ? 1 : 0);
+        return true;
+    }
+    case VmOpcode::BranchIfEqual:
+    case VmOpcode::BranchIfNotEqual:
+    case VmOpcode::BranchIfGreaterThan:
+    case VmOpcode::BranchIfLessOrEqual:
+    case VmOpcode::BranchIfLessThan:
+    case VmOpcode::BranchIfGreaterOrEqual:
+    case VmOpcode::BranchIfGreaterOrEqualOrdered:
+    case VmOpcode::BranchIfLessOrEqualOrdered:
+    case VmOpcode::BranchIfGreaterThanUnsigned:
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned:
+    case VmOpcode::BranchIfLessThanUnsigned:
+    case VmOpcode::BranchIfLessOrEqualUnsigned: {
+        if (!requireStack(2)) {
+            return false;
+        }
+        VmValue right = stack.back();
+        stack.pop_back();
+        VmValue left = stack.back();
+        stack.pop_back();
+
+        bool taken = false;
+        if (!EvaluateBranch(opcode, left, right, taken)) {
+            result.success = false;
+            result.failureReason = L"Comparison operands have incompatible kinds";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        if (!taken) {
+            return true;
+        }
+
+        if (Checked &&
+            (instruction.operand0 < 0 || static_cast<size_t>(instruction.operand0) >= program.instructions.size())) {
+            result.success = false;
+            result.failureReason = L"Branch target out of range";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        instructionPointer = static_cast<uint32_t>(instruction.operand0);
         return true;
     }
     case VmOpcode::Branch:
     case VmOpcode::BranchIfTrue:
     case VmOpcode::BranchIfFalse: {
-        if (instruction.opcode != VmOpcode::Branch) {
+        if (opcode != VmOpcode::Branch) {
             if (!requireStack(1)) {
                 return false;
             }
             VmValue condition = stack.back();
             stack.pop_back();
-            bool truthy = false;
-            if (condition.kind == VmValue::Kind::Int32) {
-                truthy = condition.data.i32 != 0;
-            } else if (condition.kind == VmValue::Kind::Object || condition.kind == VmValue::Kind::ManagedPointer) {
-                truthy = condition.data.object != nullptr;
-            }
+            bool truthy = IsTruthy(condition);
 
-            if ((instruction.opcode == VmOpcode::BranchIfTrue && !truthy) ||
-                (instruction.opcode == VmOpcode::BranchIfFalse && truthy)) {
+            if ((opcode == VmOpcode::BranchIfTrue && !truthy) ||
+                (opcode == VmOpcode::BranchIfFalse && truthy)) {
                 return true;
             }
         }
 
-        if (instruction.operand0 < 0 || static_cast<size_t>(instruction.operand0) >= program.instructions.size()) {
+        if (Checked &&
+            (instruction.operand0 < 0 || static_cast<size_t>(instruction.operand0) >= program.instructions.size())) {
             result.success = false;
             result.failureReason = L"Branch target out of range";
             LogMessage(m_hostCallbacks, result.failureReason);
@@ -465,153 +2614,429 @@ bool ILVirtualMachine::ExecuteInstruction(const VmInstruction& instruction,
         instructionPointer = static_cast<uint32_t>(instruction.operand0);
         return true;
     }
+    case VmOpcode::Switch: {
+        if (!requireStack(1)) {
+            return false;
+        }
+        VmValue selector = stack.back();
+        stack.pop_back();
+        if (selector.GetKind() != VmValue::Kind::Int32) {
+            result.success = false;
+            result.failureReason = L"Switch operand is not an Int32";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        size_t first = static_cast<size_t>(instruction.operand0);
+        uint32_t caseCount = static_cast<uint32_t>(instruction.operand1);
+        if (instruction.operand1 < 0) {
+            // Tables longer than op1 holds keep first << 32 | count in wideOperands
+            if (Checked && (instruction.operand0 < 0 || first >= program.wideOperands.size())) {
+                result.success = false;
+                result.failureReason = L"Branch target out of range";
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+            uint64_t table = program.wideOperands[first];
+            first = static_cast<size_t>(table >> 32);
+            caseCount = static_cast<uint32_t>(table);
+        }
+
+        // Unsigned compare sends negative values to the fall-through, as IL requires
+        uint32_t caseIndex = static_cast<uint32_t>(selector.GetInt32());
+        if (caseIndex >= caseCount) {
+            return true;
+        }
+
+        size_t entry = first + caseIndex;
+        if (Checked && (instruction.operand0 < 0 || entry >= program.switchTargets.size() ||
+                        program.switchTargets[entry] < 0 ||
+                        static_cast<size_t>(program.switchTargets[entry]) >= program.instructions.size())) {
+            result.success = false;
+            result.failureReason = L"Branch target out of range";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        instructionPointer = static_cast<uint32_t>(program.switchTargets[entry]);
+        return true;
+    }
     case VmOpcode::Call:
     case VmOpcode::CallVirtual:
     case VmOpcode::HostCall:
     case VmOpcode::NewObject: {
+        // Executions under a handle see its bindings; the program's own sites are never touched
+        const std::vector<VmCallSite>& callSites = frame.bindings ? frame.bindings->callSites : program.callSites;
         int callIndex = instruction.operand0;
-        if (callIndex < 0 || static_cast<size_t>(callIndex) >= program.callSites.size()) {
+        if (callIndex < 0 || static_cast<size_t>(callIndex) >= callSites.size()) {
             result.success = false;
             result.failureReason = L"Invalid call site index";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
 
-        const VmCallSite& callSite = program.callSites[callIndex];
+        const VmCallSite& callSite = callSites[callIndex];
         uint32_t token = callSite.metadataToken;
 
+        // A bound host function's arity is known, even when it is zero
         uint32_t argumentCount = callSite.argumentCount;
-        if (argumentCount == 0 && m_hostCallbacks.managedCallArityCallback) {
+        bool hostBound = callSite.kind == VmCallSite::TargetKind::Host;
+        if (argumentCount == 0 && !hostBound && !callSite.signatureKnown && m_hostCallbacks.managedCallArityCallback) {
             argumentCount = m_hostCallbacks.managedCallArityCallback(token, m_hostCallbacks.userContext);
         }
 
-        std::vector<VmValue> arguments(argumentCount);
-        for (uint32_t i = 0; i < argumentCount; ++i) {
-            if (!requireStack(1)) {
+        // Callees read their arguments in place at the top of the stack; they are popped once the call returns
+        if (!requireStack(argumentCount)) {
+            return false;
+        }
+        VmValue* arguments = stack.data() + (stack.size() - argumentCount);
+        if (!rejectArrays(arguments, argumentCount)) {
+            return false;
+        }
+
+        VmValue returnValue;
+        VmCallStatus status = VmCallStatus::Failed;
+        VmProfiler* profiler = ActiveProfiler();
+
+        auto dispatchToHost = [&](const wchar_t* missingReason) {
+            if (m_hostCallbacks.asyncCallCallback) {
+                status = m_hostCallbacks.asyncCallCallback(token, callSite.data.managedTarget, arguments, argumentCount,
+                                                           returnValue, m_hostCallbacks.userContext);
+                return true;
+            }
+            if (!m_hostCallbacks.managedCallCallback) {
+                result.success = false;
+                result.failureReason = missingReason;
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+            status = m_hostCallbacks.managedCallCallback(token, callSite.data.managedTarget, arguments, argumentCount,
+                                                         returnValue, m_hostCallbacks.userContext)
+                         ? VmCallStatus::Completed
+                         : VmCallStatus::Failed;
+            return true;
+        };
+        uint64_t dispatchStart = profiler ? VmReadCycleCounter() : 0;
+
+        if (hostBound) {
+            // Pre-bound native host function: called directly, without dispatch on the token
+            status = callSite.data.hostTarget.callback(arguments, argumentCount, returnValue,
+                                                       m_hostCallbacks.userContext)
+                         ? VmCallStatus::Completed
+                         : VmCallStatus::Failed;
+        } else if (opcode == VmOpcode::NewObject) {
+            if (!m_hostCallbacks.managedCtorCallback) {
+                result.success = false;
+                result.failureReason = L"No constructor callback registered";
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+            bool constructed = m_hostCallbacks.managedCtorCallback(token, callSite.data.managedTarget, arguments,
+                                                                   argumentCount, returnValue, m_hostCallbacks.userContext);
+            status = constructed ? VmCallStatus::Completed : VmCallStatus::Failed;
+        } else if (opcode == VmOpcode::HostCall) {
+            // Host calls use the managed call entry points to give host full control
+            if (!dispatchToHost(L"No host call callback registered")) {
+                return false;
+            }
+        } else {
+            VmNativeMethod directTarget = nullptr;
+            if (opcode == VmOpcode::CallVirtual && frame.bindings && m_hostCallbacks.resolveVirtualCallback &&
+                argumentCount > 0 && arguments[0].GetKind() == VmValue::Kind::Object && arguments[0].GetObject()) {
+                directTarget = ResolveVirtualTarget(frame.bindings->callSites[callIndex], arguments[0].GetObject());
+            }
+
+            if (directTarget) {
+                status = directTarget(arguments, argumentCount, returnValue, m_hostCallbacks.userContext)
+                             ? VmCallStatus::Completed
+                             : VmCallStatus::Failed;
+            } else if (!dispatchToHost(L"No managed call callback registered")) {
                 return false;
             }
-            arguments[argumentCount - 1 - i] = stack.back();
-            stack.pop_back();
         }
 
-        VmValue returnValue;
-        bool success = false;
+        if (profiler) {
+            profiler->RecordCallSite(program, static_cast<uint32_t>(callIndex), token, VmReadCycleCounter() - dispatchStart);
+        }
+        stack.resize(stack.size() - argumentCount);
+
+        if (status == VmCallStatus::Pending) {
+            // Interpret captures the frame; the call's return value arrives through Resume
+            result.success = false;
+            result.suspended = true;
+            return false;
+        }
+
+        if (status != VmCallStatus::Completed) {
+            result.success = false;
+            result.failureReason = L"Managed call dispatch failed";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+
+        if (!PushCallResult(callSite, returnValue.GetKind() != VmValue::Kind::Uninitialized, returnValue, stack)) {
+            result.success = false;
+            result.failureReason = L"Managed call returned no value";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+        return true;
+    }
+    case VmOpcode::LoadField:
+    case VmOpcode::StoreField: {
+        bool store = opcode == VmOpcode::StoreField;
+        size_t operands = store ? 2 : 1;
+        if (!requireStack(operands)) {
+            return false;
+        }
+        uint32_t fieldToken = static_cast<uint32_t>(instruction.operand0);
+
+        // Registered layouts belong to this instance, so the one a site resolved is kept in the
+        // handle's binding table rather than written into the program, which other instances may
+        // share. A layout only applies to objects whose header names the type it was registered for,
+        // so VM arrays (headed by the VM's sentinel) and strings (never registered) are left alone.
+        const VmFieldLayout* layout = nullptr;
+        void* object = nullptr;
+        if (m_fieldLayouts.load(std::memory_order_relaxed)) {
+            const VmValue& instance = stack[stack.size() - operands];
+            object = instance.GetKind() == VmValue::Kind::Object ? instance.GetObject() : nullptr;
+            if (object) {
+                const void* methodTable = static_cast<ObjectHeader*>(object)->methodTable;
+                VmFieldSite* site = frame.bindings && instructionPointer < frame.bindings->fieldSites.size()
+                                        ? &frame.bindings->fieldSites[instructionPointer]
+                                        : nullptr;
+                layout = site ? site->layout.load(std::memory_order_acquire) : nullptr;
+                if (!layout || layout->methodTable != methodTable) {
+                    layout = FindFieldLayout(fieldToken, methodTable);
+                    if (layout && site) {
+                        site->layout.store(layout, std::memory_order_release);
+                    }
+                }
+            }
+        }
+
+        // Both the instance and a stored value would outlive the execution in host memory
+        if (!rejectArrays(&stack[stack.size() - operands], operands)) {
+            return false;
+        }
 
-        if (instruction.opcode == VmOpcode::NewObject) {
-            if (!m_hostCallbacks.managedCtorCallback) {
+        if (layout) {
+            uint8_t* address = static_cast<uint8_t*>(object) + layout->offset;
+
+            if (!store) {
+                VmValue value = ReadField(address, layout->kind);
+                if (value.GetKind() == VmValue::Kind::Uninitialized) {
+                    // Only an Int64 field too wide for the compact layout reads back uninitialized
+                    result.success = false;
+                    result.failureReason = L"Int64 value exceeds the compact VmValue range";
+                    LogMessage(m_hostCallbacks, result.failureReason);
+                    return false;
+                }
+                stack.back() = value;
+                return true;
+            }
+
+            if (!WriteField(address, layout->kind, stack.back())) {
                 result.success = false;
-                result.failureReason = L"No constructor callback registered";
+                result.failureReason = L"Field store value does not match the registered field kind";
                 LogMessage(m_hostCallbacks, result.failureReason);
                 return false;
             }
-            success = m_hostCallbacks.managedCtorCallback(token, callSite.data.managedTarget, arguments.data(), argumentCount,
-                                                          returnValue, m_hostCallbacks.userContext);
-        } else if (instruction.opcode == VmOpcode::HostCall) {
-            // Host calls use the managedCallCallback entry point to give host full control
-            if (!m_hostCallbacks.managedCallCallback) {
+            stack.pop_back();
+            stack.pop_back();
+            return true;
+        }
+
+        if (!store) {
+            if (!m_hostCallbacks.fieldLoadCallback) {
                 result.success = false;
-                result.failureReason = L"No host call callback registered";
+                result.failureReason = L"No field load callback registered";
                 LogMessage(m_hostCallbacks, result.failureReason);
                 return false;
             }
-            success = m_hostCallbacks.managedCallCallback(token, callSite.data.managedTarget, arguments.data(), argumentCount,
-                                                          returnValue, m_hostCallbacks.userContext);
-        } else {
-            if (!m_hostCallbacks.managedCallCallback) {
+            VmValue instance = stack.back();
+            stack.pop_back();
+            VmValue value;
+            if (!m_hostCallbacks.fieldLoadCallback(instance.GetObject(), fieldToken, value, m_hostCallbacks.userContext)) {
                 result.success = false;
-                result.failureReason = L"No managed call callback registered";
+                result.failureReason = L"Field load callback failed";
                 LogMessage(m_hostCallbacks, result.failureReason);
                 return false;
             }
-            success = m_hostCallbacks.managedCallCallback(token, callSite.data.managedTarget, arguments.data(), argumentCount,
-                                                          returnValue, m_hostCallbacks.userContext);
+            stack.push_back(value);
+            return true;
         }
 
-        if (!success) {
+        if (!m_hostCallbacks.fieldStoreCallback) {
             result.success = false;
-            result.failureReason = L"Managed call dispatch failed";
+            result.failureReason = L"No field store callback registered";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
-
-        if (returnValue.kind != VmValue::Kind::Uninitialized) {
-            stack.push_back(returnValue);
+        VmValue value = stack.back();
+        stack.pop_back();
+        VmValue instance = stack.back();
+        stack.pop_back();
+        if (!m_hostCallbacks.fieldStoreCallback(instance.GetObject(), fieldToken, value, m_hostCallbacks.userContext)) {
+            result.success = false;
+            result.failureReason = L"Field store callback failed";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
         }
         return true;
     }
-    case VmOpcode::LoadField: {
+    case VmOpcode::Box:
+    case VmOpcode::UnboxAny:
+    case VmOpcode::CastClass: {
         if (!requireStack(1)) {
             return false;
         }
-        if (!m_hostCallbacks.fieldLoadCallback) {
+        if (!m_hostCallbacks.typeCastCallback) {
             result.success = false;
-            result.failureReason = L"No field load callback registered";
+            result.failureReason = L"No type cast callback registered";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
-        VmValue instance = stack.back();
+        if (!rejectArrays(&stack.back(), 1)) {
+            return false;
+        }
+        VmValue value = stack.back();
         stack.pop_back();
-        VmValue value;
-        if (!m_hostCallbacks.fieldLoadCallback(instance.data.object, static_cast<uint32_t>(instruction.operand0),
-                                               value, m_hostCallbacks.userContext)) {
+        if (!m_hostCallbacks.typeCastCallback(static_cast<uint32_t>(instruction.operand0), value,
+                                              m_hostCallbacks.userContext)) {
             result.success = false;
-            result.failureReason = L"Field load callback failed";
+            result.failureReason = L"Type cast callback failed";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
         stack.push_back(value);
         return true;
     }
-    case VmOpcode::StoreField: {
-        if (!requireStack(2)) {
+    case VmOpcode::NewArray: {
+        if (!requireStack(1)) {
             return false;
         }
-        if (!m_hostCallbacks.fieldStoreCallback) {
+        const VmValue& length = stack.back();
+        if (length.GetKind() != VmValue::Kind::Int32 || length.GetInt32() < 0) {
             result.success = false;
-            result.failureReason = L"No field store callback registered";
+            result.failureReason = L"Array length is negative or not an Int32";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
-        VmValue value = stack.back();
-        stack.pop_back();
-        VmValue instance = stack.back();
-        stack.pop_back();
-        if (!m_hostCallbacks.fieldStoreCallback(instance.data.object, static_cast<uint32_t>(instruction.operand0),
-                                                value, m_hostCallbacks.userContext)) {
+
+        // The execution's allocation scope charges the array against the memory budget
+        size_t count = static_cast<size_t>(length.GetInt32());
+        VmArrayHeader* array = AllocateVmArray(count);
+        if (!array) {
             result.success = false;
-            result.failureReason = L"Field store callback failed";
+            result.failureReason = frame.memory->account.exceeded ? L"VM execution exceeded memory budget"
+                                                                  : L"Array allocation failed";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
+        g_garbageCollector->PinObject(array);
+        frame.memory->arrays.push_back(array);
+
+        stack.back() = VmValue(static_cast<void*>(array));
         return true;
     }
-    case VmOpcode::Box:
-    case VmOpcode::UnboxAny:
-    case VmOpcode::CastClass: {
+    case VmOpcode::LoadLength: {
         if (!requireStack(1)) {
             return false;
         }
-        if (!m_hostCallbacks.typeCastCallback) {
+        VmArrayHeader* array = AsVmArray(stack.back());
+        if (!array) {
             result.success = false;
-            result.failureReason = L"No type cast callback registered";
+            result.failureReason = L"Null or non-array reference in array access";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
-        VmValue value = stack.back();
-        stack.pop_back();
-        if (!m_hostCallbacks.typeCastCallback(static_cast<uint32_t>(instruction.operand0), value,
-                                              m_hostCallbacks.userContext)) {
+        stack.back() = VmValue(static_cast<int32_t>(array->length));
+        return true;
+    }
+    case VmOpcode::LoadElement:
+    case VmOpcode::LoadElementUnchecked:
+    case VmOpcode::StoreElement:
+    case VmOpcode::StoreElementUnchecked: {
+        bool store = opcode == VmOpcode::StoreElement || opcode == VmOpcode::StoreElementUnchecked;
+        size_t operands = store ? 3 : 2;
+        if (!requireStack(operands)) {
+            return false;
+        }
+        const VmValue& reference = stack[stack.size() - operands];
+        const VmValue& index = stack[stack.size() - operands + 1];
+
+        // The unchecked forms sit in loops whose condition already compared the index to the length
+        if (Checked || opcode == VmOpcode::LoadElement || opcode == VmOpcode::StoreElement) {
+            VmArrayHeader* array = AsVmArray(reference);
+            if (!array) {
+                result.success = false;
+                result.failureReason = L"Null or non-array reference in array access";
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+            if (index.GetKind() != VmValue::Kind::Int32 || static_cast<uint32_t>(index.GetInt32()) >= array->length) {
+                result.success = false;
+                result.failureReason = L"Array index out of range";
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+        }
+
+        uint64_t& slot = static_cast<VmArrayHeader*>(reference.GetObject())->GetElements()[static_cast<uint32_t>(index.GetInt32())];
+        VmElementType type = static_cast<VmElementType>(instruction.operand0);
+
+        if (store) {
+            if (!WriteElement(slot, type, stack.back())) {
+                result.success = false;
+                result.failureReason = L"Array store value does not match the element type";
+                LogMessage(m_hostCallbacks, result.failureReason);
+                return false;
+            }
+            stack.resize(stack.size() - 3);
+            return true;
+        }
+
+        VmValue value = ReadElement(slot, type);
+        if (value.GetKind() == VmValue::Kind::Uninitialized) {
             result.success = false;
-            result.failureReason = L"Type cast callback failed";
+            result.failureReason = L"Int64 value exceeds the compact VmValue range";
             LogMessage(m_hostCallbacks, result.failureReason);
             return false;
         }
-        stack.push_back(value);
+        stack.pop_back();
+        stack.back() = value;
         return true;
     }
+    case VmOpcode::ConvertToInt32: {
+        if (!requireStack(1)) {
+            return false;
+        }
+        VmValue& value = stack.back();
+        switch (value.GetKind()) {
+        case VmValue::Kind::Int32:
+            return true;
+        case VmValue::Kind::Int64:
+            value = VmValue(static_cast<int32_t>(static_cast<uint32_t>(value.GetInt64())));
+            return true;
+        case VmValue::Kind::Float:
+        case VmValue::Kind::Double: {
+            // IL leaves out-of-range conversions unspecified; this yields Int32.MinValue like x86
+            double source = value.GetKind() == VmValue::Kind::Float ? value.GetFloat() : value.GetDouble();
+            bool inRange = source > -2147483649.0 && source < 2147483648.0;
+            value = VmValue(inRange ? static_cast<int32_t>(source) : std::numeric_limits<int32_t>::min());
+            return true;
+        }
+        default:
+            result.success = false;
+            result.failureReason = L"conv.i4 operand is not numeric";
+            LogMessage(m_hostCallbacks, result.failureReason);
+            return false;
+        }
+    }
     case VmOpcode::Return: {
-        if (!stack.empty()) {
-            result.returnValue = stack.back().data.object;
+        if (stack.size() > frame.stackBase) {
+            result.returnValue = stack.back().GetPayload();
         }
         instructionPointer = static_cast<uint32_t>(-1);
         return true;
@@ -628,41 +3053,102 @@ bool ILVirtualMachine::ExecuteInstruction(const VmInstruction& instruction,
 
 extern "C" {
 
+// Backs the exports that take no instance
 static ILVirtualMachine g_vmInstance;
 
-__declspec(dllexport) HRESULT CLRNet_VM_CompileIL(const void* ilCode, DWORD ilSize, const char* cacheKey, void** outHandle) {
-    if (!outHandle) {
+__declspec(dllexport) HRESULT CLRNet_VM_CreateInstance(const VmHostCallbacks* callbacks, void** outInstance) {
+    if (!outInstance) {
+        return E_POINTER;
+    }
+
+    std::unique_ptr<ILVirtualMachine> instance(new (std::nothrow) ILVirtualMachine());
+    if (!instance || !instance->Initialize()) {
+        return E_FAIL;
+    }
+    if (callbacks) {
+        instance->SetHostCallbacks(*callbacks);
+    }
+
+    *outInstance = instance.release();
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_DestroyInstance(void* instance) {
+    if (!instance) {
+        return E_POINTER;
+    }
+    if (instance == &g_vmInstance) {
+        return E_INVALIDARG;
+    }
+
+    // Drops the instance's handles and pending continuations; nothing may still be running on it
+    delete static_cast<ILVirtualMachine*>(instance);
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceCompileIL(void* instance, const void* ilCode, DWORD ilSize, const char* cacheKey, void** outHandle) {
+    if (!instance || !outHandle) {
         return E_POINTER;
     }
 
-    if (!g_vmInstance.Initialize()) {
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.Initialize()) {
         return E_FAIL;
     }
 
     std::string key = cacheKey ? std::string(cacheKey) : std::string();
-    auto program = g_vmInstance.Compile(ilCode, ilSize, key);
-    if (!program) {
+    void* handle = vm.CompileHandle(ilCode, ilSize, key);
+    if (!handle) {
         return E_FAIL;
     }
 
-    *outHandle = program.get();
+    *outHandle = handle;
     return S_OK;
 }
 
-__declspec(dllexport) HRESULT CLRNet_VM_Execute(void* handle, VmExecutionContextNative* context, VmExecutionResultNative* result) {
-    if (!handle || !context || !result) {
+__declspec(dllexport) HRESULT CLRNet_VM_CompileIL(const void* ilCode, DWORD ilSize, const char* cacheKey, void** outHandle) {
+    return CLRNet_VM_InstanceCompileIL(&g_vmInstance, ilCode, ilSize, cacheKey, outHandle);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceLoadBytecode(void* instance, const void* bytecode, DWORD size, const char* cacheKey, void** outHandle) {
+    if (!instance || !outHandle) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.Initialize()) {
+        return E_FAIL;
+    }
+
+    std::string key = cacheKey ? std::string(cacheKey) : std::string();
+    void* handle = vm.LoadBytecodeHandle(bytecode, size, key);
+    if (!handle) {
+        // Initialization succeeded, so the container itself was rejected; the reason went to logCallback
+        return E_INVALIDARG;
+    }
+
+    *outHandle = handle;
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_LoadBytecode(const void* bytecode, DWORD size, const char* cacheKey, void** outHandle) {
+    return CLRNet_VM_InstanceLoadBytecode(&g_vmInstance, bytecode, size, cacheKey, outHandle);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceExecute(void* instance, void* handle, VmExecutionContextNative* context, VmExecutionResultNative* result) {
+    if (!instance || !handle || !context || !result) {
         return E_POINTER;
     }
 
-    VmExecutionContext state = ConvertContext(*context);
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    // Runs on the caller's arrays in place; on failure they may hold partially updated values
     VmExecutionResult executionResult;
 
-    if (!g_vmInstance.ExecuteHandle(handle, state, executionResult)) {
+    if (!vm.ExecuteHandle(handle, *context, executionResult)) {
         ConvertResult(executionResult, *result);
-        return E_FAIL;
+        return executionResult.suspended ? S_FALSE : E_FAIL;
     }
 
-    CopyContextBack(state, *context);
     ConvertResult(executionResult, *result);
     if (!executionResult.success) {
         return E_FAIL;
@@ -671,31 +3157,240 @@ __declspec(dllexport) HRESULT CLRNet_VM_Execute(void* handle, VmExecutionContext
     return S_OK;
 }
 
+__declspec(dllexport) HRESULT CLRNet_VM_Execute(void* handle, VmExecutionContextNative* context, VmExecutionResultNative* result) {
+    return CLRNet_VM_InstanceExecute(&g_vmInstance, handle, context, result);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceExecuteBatch(void* instance, void* handle, VmExecutionContextNative* contexts, uint32_t count, VmExecutionResultNative* results, uint32_t parallelism) {
+    if (!instance || !handle || ((!contexts || !results) && count > 0)) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    // Contexts run in parallel and must not share argument or local arrays
+    if (vm.ExecuteBatch(handle, contexts, count, results, parallelism) != 0) {
+        return E_FAIL;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (results[i].continuation) {
+            return S_FALSE;
+        }
+    }
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_ExecuteBatch(void* handle, VmExecutionContextNative* contexts, uint32_t count, VmExecutionResultNative* results, uint32_t parallelism) {
+    return CLRNet_VM_InstanceExecuteBatch(&g_vmInstance, handle, contexts, count, results, parallelism);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceResume(void* instance, void* continuation, BOOL callSucceeded, const VmValue* returnValue, VmExecutionResultNative* result) {
+    if (!instance || !continuation || !result) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    // A null return value resumes a call that produced none
+    VmValue value = returnValue ? *returnValue : VmValue();
+    VmExecutionResult executionResult;
+    if (!vm.Resume(continuation, callSucceeded != FALSE, value, executionResult)) {
+        ConvertResult(executionResult, *result);
+        return executionResult.suspended ? S_FALSE : E_FAIL;
+    }
+
+    ConvertResult(executionResult, *result);
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_Resume(void* continuation, BOOL callSucceeded, const VmValue* returnValue, VmExecutionResultNative* result) {
+    return CLRNet_VM_InstanceResume(&g_vmInstance, continuation, callSucceeded, returnValue, result);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceRelease(void* instance, void* handle) {
+    if (!instance) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    vm.ReleaseHandle(handle);
+    return S_OK;
+}
+
 __declspec(dllexport) HRESULT CLRNet_VM_Release(void* handle) {
-    g_vmInstance.ReleaseHandle(handle);
+    return CLRNet_VM_InstanceRelease(&g_vmInstance, handle);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceRegisterHost(void* instance, const VmHostCallbacks* callbacks) {
+    if (!instance || !callbacks) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.Initialize()) {
+        return E_FAIL;
+    }
+
+    vm.SetHostCallbacks(*callbacks);
     return S_OK;
 }
 
 __declspec(dllexport) HRESULT CLRNet_VM_RegisterHost(const VmHostCallbacks* callbacks) {
-    if (!callbacks) {
+    return CLRNet_VM_InstanceRegisterHost(&g_vmInstance, callbacks);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceConfigureCallSite(void* instance, void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken) {
+    if (!instance) {
         return E_POINTER;
     }
 
-    if (!g_vmInstance.Initialize()) {
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.ConfigureCallSite(handle, callSiteIndex, managedTarget, argumentCount, metadataToken)) {
         return E_FAIL;
     }
-
-    g_vmInstance.SetHostCallbacks(*callbacks);
     return S_OK;
 }
 
 __declspec(dllexport) HRESULT CLRNet_VM_ConfigureCallSite(void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken) {
-    if (!g_vmInstance.ConfigureCallSite(handle, callSiteIndex, managedTarget, argumentCount, metadataToken)) {
+    return CLRNet_VM_InstanceConfigureCallSite(&g_vmInstance, handle, callSiteIndex, managedTarget, argumentCount, metadataToken);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceBindCallSite(void* instance, void* handle, uint32_t callSiteIndex, void* calleeHandle) {
+    if (!instance || !handle || !calleeHandle) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.BindCallSite(handle, callSiteIndex, calleeHandle)) {
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_BindCallSite(void* handle, uint32_t callSiteIndex, void* calleeHandle) {
+    return CLRNet_VM_InstanceBindCallSite(&g_vmInstance, handle, callSiteIndex, calleeHandle);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceRegisterHostFunctions(void* instance, const VmHostFunction* functions, uint32_t count) {
+    if (!instance || (!functions && count > 0)) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.RegisterHostFunctions(functions, count)) {
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_RegisterHostFunctions(const VmHostFunction* functions, uint32_t count) {
+    return CLRNet_VM_InstanceRegisterHostFunctions(&g_vmInstance, functions, count);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceBindHostFunction(void* instance, void* handle, uint32_t callSiteIndex, uint32_t identifier) {
+    if (!instance || !handle) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.BindHostFunction(handle, callSiteIndex, identifier)) {
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_BindHostFunction(void* handle, uint32_t callSiteIndex, uint32_t identifier) {
+    return CLRNet_VM_InstanceBindHostFunction(&g_vmInstance, handle, callSiteIndex, identifier);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceRegisterFieldLayouts(void* instance, const VmFieldLayout* layouts, uint32_t count) {
+    if (!instance || (!layouts && count > 0)) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.RegisterFieldLayouts(layouts, count)) {
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_RegisterFieldLayouts(const VmFieldLayout* layouts, uint32_t count) {
+    return CLRNet_VM_InstanceRegisterFieldLayouts(&g_vmInstance, layouts, count);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceGetStatistics(void* instance, VmStatistics* statistics) {
+    if (!instance || !statistics) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    vm.GetStatistics(*statistics);
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_GetStatistics(VmStatistics* statistics) {
+    return CLRNet_VM_InstanceGetStatistics(&g_vmInstance, statistics);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceSetOptions(void* instance, const VmOptions* options) {
+    if (!instance || !options) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (!vm.Initialize()) {
         return E_FAIL;
     }
+
+    vm.SetOptions(*options);
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_SetOptions(const VmOptions* options) {
+    return CLRNet_VM_InstanceSetOptions(&g_vmInstance, options);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceGetProfile(void* instance, uint32_t format, char* buffer, uint32_t bufferSize, uint32_t* requiredSize) {
+    if (!instance || !requiredSize) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    if (format > static_cast<uint32_t>(VmProfileFormat::Json)) {
+        return E_INVALIDARG;
+    }
+
+    VmProfileSnapshot snapshot;
+    vm.GetProfile(snapshot);
+    std::string text = VmProfiler::Format(snapshot, static_cast<VmProfileFormat>(format));
+
+    // Callers size the buffer with a first call; the reported size includes the terminator
+    *requiredSize = static_cast<uint32_t>(text.size() + 1);
+    if (!buffer || bufferSize < *requiredSize) {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    std::memcpy(buffer, text.c_str(), text.size() + 1);
+    return S_OK;
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_GetProfile(uint32_t format, char* buffer, uint32_t bufferSize, uint32_t* requiredSize) {
+    return CLRNet_VM_InstanceGetProfile(&g_vmInstance, format, buffer, bufferSize, requiredSize);
+}
+
+__declspec(dllexport) HRESULT CLRNet_VM_InstanceResetProfile(void* instance) {
+    if (!instance) {
+        return E_POINTER;
+    }
+
+    ILVirtualMachine& vm = *static_cast<ILVirtualMachine*>(instance);
+    vm.ResetProfile();
     return S_OK;
 }
 
+__declspec(dllexport) HRESULT CLRNet_VM_ResetProfile() {
+    return CLRNet_VM_InstanceResetProfile(&g_vmInstance);
+}
+
 } // extern "C"
 
 } // namespace VM
@@ -7,8 +7,10 @@
 #define CLRNET_VM_VIRTUAL_MACHINE_H
 
 #include <windows.h>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -21,11 +23,20 @@ namespace VM {
 
 class BytecodeCache;
 class BytecodeCompiler;
+class NativeCompiler;
+class VmProfiler;
+class VmHandleTable;
+class VmWorkerPool;
+struct VmProfileSnapshot;
 struct VmProgram;
 struct VmInstruction;
 struct VmExecutionContext;
 struct VmExecutionResult;
 struct VmCallSite;
+struct VmContinuation;
+struct VmExecutionMemory;
+struct VmBindingTable;
+struct VmFieldLayout;
 
 // Opcodes understood by the VM bytecode interpreter
 enum class VmOpcode : uint8_t {
@@ -37,7 +48,7 @@ enum class VmOpcode : uint8_t {
     LoadField,
     StoreField,
     LoadConstantI4,
-    LoadConstantI8,
+    LoadConstantI8,          // op0 indexes VmProgram::wideOperands
     LoadString,
     LoadNull,
     Box,
@@ -58,7 +69,118 @@ enum class VmOpcode : uint8_t {
     CallVirtual,
     HostCall,
     NewObject,
-    Return
+    Return,
+
+    // Superinstructions produced by the compiler's peephole pass
+    AddLocalConstant,        // locals[op2] = locals[op0] + op1
+    ArithmeticLocals,        // push locals[op0] <op2> locals[op1], op2 holds Add/Subtract/Multiply/Divide
+    BranchIfEqual,           // ceq; brtrue
+    BranchIfNotEqual,        // ceq; brfalse
+    BranchIfGreaterThan,     // cgt; brtrue
+    BranchIfLessOrEqual,     // cgt; brfalse (taken when the operands are unordered)
+    BranchIfLessThan,        // clt; brtrue
+    BranchIfGreaterOrEqual,  // clt; brfalse (taken when the operands are unordered)
+
+    LoadConstantR4,          // op0 holds the float bit pattern
+    LoadConstantR8,          // op0 indexes VmProgram::wideOperands, which holds the double bit pattern
+
+    // Quickened arithmetic: a generic Add/Subtract/Multiply/Divide rewrites itself into one of
+    // these after its first execution. Each guards on the operand kinds and falls back to the
+    // generic opcode when they change. Layout is [Add, Subtract, Multiply, Divide] x [I4, I8, R4, R8].
+    AddI4,
+    SubtractI4,
+    MultiplyI4,
+    DivideI4,
+    AddI8,
+    SubtractI8,
+    MultiplyI8,
+    DivideI8,
+    AddR4,
+    SubtractR4,
+    MultiplyR4,
+    DivideR4,
+    AddR8,
+    SubtractR8,
+    MultiplyR8,
+    DivideR8,
+
+    // Unused; they keep the opcodes after them at the values bytecode containers and cache entries use
+    ReservedA,
+    ReservedB,
+
+    Pop,                     // discards the top of the stack (IL pop, or a box the compiler proved dead)
+
+    // IL conditional branches with no ceq/cgt/clt + brtrue/brfalse equivalent. bge/ble are not taken
+    // when floating-point operands are unordered; the .un forms compare integers and references
+    // unsigned and are taken when floating-point operands are unordered.
+    BranchIfGreaterOrEqualOrdered,   // bge
+    BranchIfLessOrEqualOrdered,      // ble
+    BranchIfGreaterThanUnsigned,     // bgt.un
+    BranchIfGreaterOrEqualUnsigned,  // bge.un
+    BranchIfLessThanUnsigned,        // blt.un
+    BranchIfLessOrEqualUnsigned,     // ble.un
+
+    // IL switch: pops an Int32 and jumps to switchTargets[op0 + value] when value < op1, else falls through.
+    // Tables with more cases than op1 holds set op1 to -1; see VmProgram::GetSwitchTable.
+    Switch,
+
+    // Arrays allocated through the GarbageCollector. NewArray pops an Int32 length (op0 keeps the
+    // element type token) and LoadLength pushes the length as an Int32. The element opcodes take a
+    // VmElementType in op0 and check the array and index on every access.
+    NewArray,
+    LoadLength,
+    LoadElement,
+    StoreElement,
+    // Element access whose index the compiler proved in range (BytecodeCompiler::HoistBoundsChecks)
+    LoadElementUnchecked,
+    StoreElementUnchecked,
+
+    ConvertToInt32           // conv.i4
+};
+
+// Element operand of the array opcodes, one per ldelem.* / stelem.* form. VM arrays keep every
+// element in an 8-byte slot, so the form only decides how a slot is read and written.
+enum class VmElementType : uint8_t {
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Int64,
+    Float,
+    Double,
+    Reference
+};
+
+// Three-address opcodes for the optional register tier (operands are register indices)
+enum class VmRegisterOpcode : uint8_t {
+    Nop = 0x00,
+    Move,                   // r[a] = r[b]
+    Add,                    // r[a] = r[b] op r[c]
+    Subtract,
+    Multiply,
+    Divide,
+    CompareEqual,           // r[a] = r[b] cmp r[c] ? 1 : 0
+    CompareNotEqual,
+    CompareGreaterThan,
+    CompareLessThan,
+    Jump,                   // ip = a
+    JumpIfTrue,             // if r[b] is truthy, ip = a
+    JumpIfFalse,
+    JumpIfEqual,            // if r[b] cmp r[c], ip = a
+    JumpIfNotEqual,
+    JumpIfGreaterThan,
+    JumpIfLessOrEqual,      // taken when the operands are unordered
+    JumpIfLessThan,
+    JumpIfGreaterOrEqual,   // taken when the operands are unordered
+    Return,                 // return r[a], or nothing when a < 0
+    JumpIfGreaterOrEqualOrdered,    // same semantics as the VmOpcode branch of the same name
+    JumpIfLessOrEqualOrdered,
+    JumpIfGreaterThanUnsigned,
+    JumpIfGreaterOrEqualUnsigned,
+    JumpIfLessThanUnsigned,
+    JumpIfLessOrEqualUnsigned
 };
 
 // Result of executing bytecode in the VM
@@ -67,25 +189,36 @@ struct VmExecutionResult {
     uint32_t stepsExecuted;
     void* returnValue;
     std::wstring failureReason;
+    // Set when a host call went pending; success is false and the frame lives on in the continuation
+    bool suspended;
+    void* continuation;
 
     VmExecutionResult()
         : success(false)
         , stepsExecuted(0)
-        , returnValue(nullptr) {}
+        , returnValue(nullptr)
+        , suspended(false)
+        , continuation(nullptr) {}
 };
 
-// Represents a value on the evaluation stack or in locals
+enum class VmValueKind : uint8_t {
+    Uninitialized,
+    Int32,
+    Int64,
+    Float,
+    Double,
+    Object,
+    ManagedPointer,
+    Null
+};
+
+// Represents a value on the evaluation stack or in locals.
+// Read values through the accessors (GetKind, GetInt32, ...), which work with either layout; the
+// `kind` and `data` fields exist only in the default 16-byte layout. Defining
+// CLRNET_VM_COMPACT_VALUES for the VM and every host switches to an 8-byte NaN-boxed layout.
+#ifndef CLRNET_VM_COMPACT_VALUES
 struct VmValue {
-    enum class Kind : uint8_t {
-        Uninitialized,
-        Int32,
-        Int64,
-        Float,
-        Double,
-        Object,
-        ManagedPointer,
-        Null
-    };
+    typedef VmValueKind Kind;
 
     Kind kind;
     union {
@@ -103,6 +236,7 @@ struct VmValue {
 
     explicit VmValue(int32_t value) {
         kind = Kind::Int32;
+        data.i64 = 0;
         data.i32 = value;
     }
 
@@ -111,6 +245,12 @@ struct VmValue {
         data.i64 = value;
     }
 
+    explicit VmValue(float value) {
+        kind = Kind::Float;
+        data.i64 = 0;
+        data.f32 = value;
+    }
+
     explicit VmValue(double value) {
         kind = Kind::Double;
         data.f64 = value;
@@ -118,10 +258,114 @@ struct VmValue {
 
     explicit VmValue(void* value, Kind valueKind = Kind::Object) {
         kind = valueKind;
+        data.i64 = 0;
         data.object = value;
     }
+
+    static bool CanHoldInt64(int64_t) { return true; }
+
+    Kind GetKind() const { return kind; }
+    int32_t GetInt32() const { return data.i32; }
+    int64_t GetInt64() const { return data.i64; }
+    float GetFloat() const { return data.f32; }
+    double GetDouble() const { return data.f64; }
+    void* GetObject() const { return kind == Kind::Null ? nullptr : data.object; }
+    // Payload as a pointer-sized word, the form VmExecutionResultNative::returnValue reports
+    void* GetPayload() const { return data.object; }
+    // Bit pattern of the payload; together with the kind it identifies the value exactly
+    uint64_t GetRawBits() const { return static_cast<uint64_t>(data.i64); }
+};
+#else
+struct VmValue {
+    typedef VmValueKind Kind;
+
+    // Doubles are kept as their IEEE bits, with every NaN canonicalised to a positive quiet NaN.
+    // That frees the negative quiet-NaN space: its top 16 bits hold TagBase | kind and the low 48
+    // bits the payload (Int32 or Float bits, a sign-extended Int64, or a pointer).
+    uint64_t bits;
+
+    static const uint64_t TagBase = 0xFFF8;
+    static const uint64_t PayloadMask = 0x0000FFFFFFFFFFFFull;
+    static const uint64_t CanonicalNaN = 0x7FF8000000000000ull;
+
+    VmValue()
+        : bits(Tag(Kind::Uninitialized)) {}
+
+    explicit VmValue(int32_t value)
+        : bits(Tag(Kind::Int32) | static_cast<uint32_t>(value)) {}
+
+    // Int64 values outside the 48-bit range can't be boxed and yield an Uninitialized value
+    explicit VmValue(int64_t value)
+        : bits(CanHoldInt64(value) ? Tag(Kind::Int64) | (static_cast<uint64_t>(value) & PayloadMask)
+                                   : Tag(Kind::Uninitialized)) {}
+
+    explicit VmValue(float value) {
+        uint32_t raw;
+        std::memcpy(&raw, &value, sizeof(raw));
+        bits = Tag(Kind::Float) | raw;
+    }
+
+    explicit VmValue(double value) {
+        std::memcpy(&bits, &value, sizeof(bits));
+        if (value != value) {
+            bits = CanonicalNaN;
+        }
+    }
+
+    // User-mode pointers fit in 48 bits on every supported target
+    explicit VmValue(void* value, Kind valueKind = Kind::Object)
+        : bits(Tag(valueKind) | (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)) & PayloadMask)) {}
+
+    static bool CanHoldInt64(int64_t value) {
+        return value >= -(static_cast<int64_t>(1) << 47) && value < (static_cast<int64_t>(1) << 47);
+    }
+
+    Kind GetKind() const {
+        uint64_t top = bits >> 48;
+        return top >= TagBase ? static_cast<Kind>(top & 0x7) : Kind::Double;
+    }
+
+    int32_t GetInt32() const { return static_cast<int32_t>(static_cast<uint32_t>(bits)); }
+    int64_t GetInt64() const { return static_cast<int64_t>(bits << 16) >> 16; }
+
+    float GetFloat() const {
+        uint32_t raw = static_cast<uint32_t>(bits);
+        float value;
+        std::memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+
+    double GetDouble() const {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void* GetObject() const {
+        return GetKind() == Kind::Null ? nullptr : reinterpret_cast<void*>(static_cast<uintptr_t>(bits & PayloadMask));
+    }
+
+    // Matches the default layout: 32-bit payloads zero-extended, Int64 sign-extended, doubles as raw bits
+    void* GetPayload() const {
+        switch (GetKind()) {
+        case Kind::Double: return reinterpret_cast<void*>(static_cast<uintptr_t>(bits));
+        case Kind::Int64: return reinterpret_cast<void*>(static_cast<intptr_t>(GetInt64()));
+        case Kind::Int32:
+        case Kind::Float: return reinterpret_cast<void*>(static_cast<uintptr_t>(static_cast<uint32_t>(bits)));
+        default: return reinterpret_cast<void*>(static_cast<uintptr_t>(bits & PayloadMask));
+        }
+    }
+
+    uint64_t GetRawBits() const { return bits; }
+
+private:
+    // Double has no tag: TagBase | Double would be a negative quiet NaN, which is always canonicalised away
+    static uint64_t Tag(Kind kind) { return (TagBase | static_cast<uint64_t>(kind)) << 48; }
 };
 
+static_assert(sizeof(VmValue) == 8, "Compact VmValue must stay 8 bytes");
+#endif
+
 struct VmExecutionContextNative {
     VmValue* arguments;
     uint32_t argumentCount;
@@ -148,14 +392,49 @@ struct VmExecutionContext {
         , userData(nullptr) {}
 };
 
+// Arguments, locals and limits a single execution runs against. The arrays belong to the caller
+// (or to the executing thread's frame arena) and are updated in place.
+struct VmFrame {
+    VmValue* arguments;
+    uint32_t argumentCount;
+    VmValue* locals;
+    uint32_t localCount;
+    uint64_t timeBudgetTicks;
+    size_t memoryBudgetBytes;
+    void* programHandle;     // Lets a pending host call keep the program alive in its continuation
+    uint32_t stackBase;      // Evaluation stack height on entry; a directly called frame never pops below it
+    VmExecutionMemory* memory;  // Arrays and byte account of the running execution, owned by the interpreter
+    VmBindingTable* bindings;  // Call sites of programHandle; null runs the program's unbound call sites
+    uint32_t hostArgumentCount;  // Leading arguments and locals the host reads back after the execution
+    uint32_t hostLocalCount;
+
+    VmFrame()
+        : arguments(nullptr)
+        , argumentCount(0)
+        , locals(nullptr)
+        , localCount(0)
+        , timeBudgetTicks(0)
+        , memoryBudgetBytes(0)
+        , programHandle(nullptr)
+        , stackBase(0)
+        , memory(nullptr)
+        , bindings(nullptr)
+        , hostArgumentCount(0)
+        , hostLocalCount(0) {}
+};
+
 struct VmExecutionResultNative {
     BOOL success;
     uint32_t stepsExecuted;
     void* returnValue;
     const wchar_t* failureReason;
+    void* continuation;          // Non-null when the execution suspended; pass it to CLRNet_VM_Resume
 };
 
-// Host syscall table exposed to the VM
+// Native entry point a host can hand back for direct dispatch from the VM
+typedef bool (*VmNativeMethod)(VmValue* arguments, uint32_t argumentCount, VmValue& returnValue, void* context);
+
+// Native host function a call site is bound to; the interpreter calls `callback` directly
 struct VmHostCall {
     enum class Kind : uint8_t {
         None,
@@ -167,7 +446,7 @@ struct VmHostCall {
     } kind;
 
     uint32_t identifier;
-    void* callback;
+    VmNativeMethod callback;
 
     VmHostCall()
         : kind(Kind::None)
@@ -175,6 +454,17 @@ struct VmHostCall {
         , callback(nullptr) {}
 };
 
+// Outcome of an asynchronous host call
+enum class VmCallStatus : uint8_t {
+    Failed,
+    Completed,
+    Pending      // The host finishes the call later through CLRNet_VM_Resume
+};
+
+// Machine code produced by the native tier. Returns 0 without touching any state when its entry
+// guards reject the argument/local kinds, in which case the caller interprets the program instead.
+typedef int32_t (*VmNativeEntry)(VmValue* arguments, VmValue* locals, VmValue* returnValue);
+
 struct VmHostCallbacks {
     void (*logCallback)(const wchar_t* message, void* context);
     bool (*timerCallback)(uint32_t milliseconds, void* context);
@@ -189,6 +479,25 @@ struct VmHostCallbacks {
     bool (*typeCastCallback)(uint32_t metadataToken, VmValue& value, void* context);
     void* userContext;
 
+    // Callbacks added since the first release follow userContext, so the original layout stays a prefix.
+
+    // Resolves a callvirt token against the receiver's MethodTable*; returning nullptr keeps host dispatch
+    VmNativeMethod (*resolveVirtualCallback)(uint32_t metadataToken, void* methodTable, void* context);
+    // Optional. Returns the characters of an ldstr literal so the VM can intern it in the runtime-wide
+    // table; preferred over stringLiteralCallback when both are registered
+    bool (*stringLiteralDataCallback)(uint32_t metadataToken, const wchar_t** data, uint32_t* length, void* context);
+    // Optional. Replaces managedCallCallback for host-dispatched calls; returning Pending suspends the
+    // execution so timers, HTTP and storage requests don't hold the calling thread
+    VmCallStatus (*asyncCallCallback)(uint32_t metadataToken, void* managedTarget, VmValue* arguments, uint32_t argumentCount, VmValue& returnValue, void* context);
+    // Optional. Returns the StandAloneSig blob of a method header's LocalVarSigTok (hosts built on
+    // AssemblyLoader answer with LoadedAssembly::GetStandAloneSignature), so compiled programs get
+    // exact, typed locals; the blob only has to stay valid for the call
+    bool (*localSignatureCallback)(uint32_t signatureToken, const uint8_t** signature, uint32_t* length, void* context);
+    // Optional. Returns the MethodDefSig/MethodRefSig blob of a call, callvirt or newobj token (the
+    // generic method's blob for a MethodSpec), so the verifier knows what each call pops and pushes;
+    // the blob only has to stay valid for the call
+    bool (*methodSignatureCallback)(uint32_t metadataToken, const uint8_t** signature, uint32_t* length, void* context);
+
     VmHostCallbacks()
         : logCallback(nullptr)
         , timerCallback(nullptr)
@@ -201,7 +510,47 @@ struct VmHostCallbacks {
         , fieldStoreCallback(nullptr)
         , stringLiteralCallback(nullptr)
         , typeCastCallback(nullptr)
-        , userContext(nullptr) {}
+        , userContext(nullptr)
+        , resolveVirtualCallback(nullptr)
+        , stringLiteralDataCallback(nullptr)
+        , asyncCallCallback(nullptr)
+        , localSignatureCallback(nullptr)
+        , methodSignatureCallback(nullptr) {}
+};
+
+// Per-call-site inline cache for callvirt, keyed on the receiver's MethodTable*
+struct VmInlineCache {
+    static constexpr uint32_t MaxEntries = 4;
+
+    enum class State : uint8_t {
+        Uninitialized,
+        Monomorphic,
+        Polymorphic,
+        Megamorphic
+    };
+
+    struct Entry {
+        void* methodTable;
+        VmNativeMethod target;
+    };
+
+    // entryCount is published with release semantics once an entry is fully written
+    uint32_t entryCount;
+    State state;
+    Entry entries[MaxEntries];
+
+    VmInlineCache() {
+        Reset();
+    }
+
+    void Reset() {
+        entryCount = 0;
+        state = State::Uninitialized;
+        for (uint32_t i = 0; i < MaxEntries; ++i) {
+            entries[i].methodTable = nullptr;
+            entries[i].target = nullptr;
+        }
+    }
 };
 
 // Information about call sites emitted into bytecode
@@ -209,57 +558,288 @@ struct VmCallSite {
     enum class TargetKind : uint8_t {
         None,
         ManagedMethod,
-        Host
+        Host,
+        Program        // Another VM program, entered by the interpreter without a host round trip
     } kind;
 
-    union {
+    union Target {
         void* managedTarget;   // MethodDesc* or function pointer
         VmHostCall hostTarget;
+        void* programHandle;   // TargetKind::Program; resolved per call, so releasing the callee is safe
+
+        Target()
+            : managedTarget(nullptr) {}
     } data;
 
     uint32_t metadataToken;
     uint32_t argumentCount;
 
+    // Set when the target's signature was resolved at compile time: argumentCount is then exact
+    // (including `this`), bindings must agree with it, and the call pushes a value exactly when
+    // returnsValue is set
+    bool signatureKnown;
+    bool returnsValue;
+
+    // Filled lazily by the interpreter, in the handle's VmBindingTable; never meaningful across processes
+    VmInlineCache inlineCache;
+
     VmCallSite()
         : kind(TargetKind::None) {
-        data.managedTarget = nullptr;
         metadataToken = 0;
         argumentCount = 0;
+        signatureKnown = false;
+        returnsValue = false;
     }
 };
 
-// Compiled bytecode program
-struct VmProgram {
+// Register tier instruction: a is the destination (or jump target), b and c are sources
+struct VmRegisterInstruction {
+    VmRegisterOpcode opcode;
+    int32_t a;
+    int32_t b;
+    int32_t c;
+
+    VmRegisterInstruction()
+        : opcode(VmRegisterOpcode::Nop)
+        , a(0)
+        , b(0)
+        , c(0) {}
+
+    VmRegisterInstruction(VmRegisterOpcode op, int32_t dest = 0, int32_t left = 0, int32_t right = 0)
+        : opcode(op)
+        , a(dest)
+        , b(left)
+        , c(right) {}
+};
+
+// Hotness counters and native code for one live program. Copies start cold, since counters and
+// machine code belong to the program instance that earned them.
+struct VmTierState {
+    enum class Stage : uint8_t {
+        Interpreted,
+        Queued,
+        Native,
+        Rejected
+    };
+
+    std::atomic<uint32_t> invocations;
+    std::atomic<uint32_t> backedges;
+    std::atomic<Stage> stage;
+    std::atomic<VmNativeEntry> entry;
+
+    VmTierState()
+        : invocations(0)
+        , backedges(0)
+        , stage(Stage::Interpreted)
+        , entry(nullptr) {}
+
+    VmTierState(const VmTierState&)
+        : VmTierState() {}
+
+    VmTierState& operator=(const VmTierState&) { return *this; }
+};
+
+// Compiled bytecode program. Programs are shared through the bytecode cache by every handle
+// compiled from the same key, so they don't change once compiled; the only exceptions are the
+// atomic opcode quickenings and the tier counters, which any sharer would apply alike.
+struct VmProgram : std::enable_shared_from_this<VmProgram> {
     std::vector<VmInstruction> instructions;
-    std::vector<VmCallSite> callSites;
+    std::vector<VmCallSite> callSites;    // As decoded; each handle binds its own copy (VmBindingTable)
     std::vector<std::pair<size_t, int32_t>> branchFixups;
+    std::vector<int32_t> switchTargets;   // jump tables of all Switch instructions, as instruction indices
+    std::vector<uint64_t> wideOperands;   // 64-bit constants of LoadConstantI8/R8 and long switch tables, which don't fit a VmInstruction
+    std::vector<VmValueKind> localKinds;  // From the local signature, one per local; empty when it wasn't resolved
     uint32_t localCount;
     uint32_t argumentCount;
     std::string cacheKey;
 
+    // Optional register encoding; empty when the program needs the stack interpreter.
+    // Register file layout: [arguments][locals][stack slots][constants]
+    std::vector<VmRegisterInstruction> registerInstructions;
+    std::vector<VmValue> registerConstants;
+    uint32_t registerCount;
+
+    // Set by the verifier; verified programs run on the interpreter without per-instruction checks
+    bool verified;
+    uint32_t maxStackDepth;
+
+    mutable VmTierState tier;
+
     VmProgram()
         : localCount(0)
-        , argumentCount(0) {}
+        , argumentCount(0)
+        , registerCount(0)
+        , verified(false)
+        , maxStackDepth(0) {}
+
+    // The switchTargets entries of a Switch; false when they don't lie within switchTargets
+    bool GetSwitchTable(const VmInstruction& instruction, size_t& first, size_t& count) const;
+};
+
+// Field layout an ldfld/stfld last resolved for one handle. Layouts belong to the VM instance
+// and never change once registered, so copies of a binding table keep what was resolved.
+struct VmFieldSite {
+    std::atomic<const VmFieldLayout*> layout;
+
+    VmFieldSite()
+        : layout(nullptr) {}
+
+    VmFieldSite(const VmFieldSite& other)
+        : layout(other.layout.load(std::memory_order_relaxed)) {}
+
+    VmFieldSite& operator=(const VmFieldSite& other) {
+        layout.store(other.layout.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+};
+
+// Interned string an ldstr resolved for one handle. Literal tokens mean something only in the module
+// the handle was compiled for, so they are resolved per handle, never per program. Interned strings
+// are frozen and never collected; objects from stringLiteralCallback are not kept.
+struct VmLiteralSite {
+    std::atomic<void*> object;
+
+    VmLiteralSite()
+        : object(nullptr) {}
+
+    VmLiteralSite(const VmLiteralSite& other)
+        : object(other.object.load(std::memory_order_relaxed)) {}
+
+    VmLiteralSite& operator=(const VmLiteralSite& other) {
+        object.store(other.object.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
 };
 
-// Serialized instruction with operands
+// Call-site state of one program handle: the targets set through ConfigureCallSite and
+// BindCallSite, the inline caches the interpreter fills and the field layouts and literals it
+// resolved. Tables are replaced, never edited in place, so executions already running keep the
+// table they started with.
+struct VmBindingTable : std::enable_shared_from_this<VmBindingTable> {
+    std::vector<VmCallSite> callSites;    // Starts as a copy of the program's call sites
+    std::vector<VmFieldSite> fieldSites;  // Indexed by instruction; empty when the program has no ldfld/stfld
+    std::vector<VmLiteralSite> literalSites;  // Indexed by instruction; empty when the program has no ldstr
+    bool programTargets;                  // Some site is bound to another VM program (BindCallSite)
+
+    VmBindingTable()
+        : programTargets(false) {}
+    explicit VmBindingTable(const VmProgram& program);
+};
+
+// Interpreter instruction, packed into 8 bytes so twice as many fit a cache line. op0 is the full
+// 32-bit operand (index, token, branch target, constant); op1 and op2 only ever carry small values
+// (fused constants, a second local, switch case counts). Operands that don't fit, the 64-bit
+// constants, live in VmProgram::wideOperands; passes that would need a wider op1/op2 leave the code
+// unfused instead (see FitsOperand1/FitsOperand2).
 struct VmInstruction {
     VmOpcode opcode;
+    uint8_t operand2;
+    int16_t operand1;
     int32_t operand0;
-    int32_t operand1;
-    int32_t operand2;
 
     VmInstruction()
         : opcode(VmOpcode::Nop)
-        , operand0(0)
+        , operand2(0)
         , operand1(0)
-        , operand2(0) {}
+        , operand0(0) {}
 
     VmInstruction(VmOpcode op, int32_t op0 = 0, int32_t op1 = 0, int32_t op2 = 0)
         : opcode(op)
-        , operand0(op0)
-        , operand1(op1)
-        , operand2(op2) {}
+        , operand2(static_cast<uint8_t>(op2))
+        , operand1(static_cast<int16_t>(op1))
+        , operand0(op0) {}
+
+    static bool FitsOperand1(int64_t value) { return value >= INT16_MIN && value <= INT16_MAX; }
+    static bool FitsOperand2(int64_t value) { return value >= 0 && value <= UINT8_MAX; }
+};
+
+static_assert(sizeof(VmInstruction) == 8, "VmInstruction is packed for dispatch density");
+
+// A switch with more cases than op1 holds keeps first << 32 | count in wideOperands[op0]
+inline bool VmProgram::GetSwitchTable(const VmInstruction& instruction, size_t& first, size_t& count) const {
+    if (instruction.operand0 < 0) {
+        return false;
+    }
+    if (instruction.operand1 >= 0) {
+        first = static_cast<size_t>(instruction.operand0);
+        count = static_cast<size_t>(instruction.operand1);
+    } else {
+        if (instruction.operand1 != -1 || static_cast<size_t>(instruction.operand0) >= wideOperands.size()) {
+            return false;
+        }
+        uint64_t table = wideOperands[static_cast<size_t>(instruction.operand0)];
+        first = static_cast<size_t>(table >> 32);
+        count = static_cast<size_t>(table & 0xFFFFFFFFu);
+    }
+    return first <= switchTargets.size() && count <= switchTargets.size() - first;
+}
+
+// Object layout for one field of one type, registered through CLRNet_VM_RegisterFieldLayouts. Hosts
+// built on TypeSystem pass FieldDesc::offset; the kind fixes the width (4-byte Int32/Float, 8-byte
+// Int64/Double, pointer-sized Object/ManagedPointer). Only objects whose header names methodTable
+// are accessed directly, so a field inherited by several types is registered once per type.
+struct VmFieldLayout {
+    uint32_t fieldToken;
+    uint32_t offset;
+    VmValue::Kind kind;
+    const void* methodTable;
+};
+
+// Field token to the layouts registered for it, one per type
+typedef std::unordered_map<uint32_t, std::vector<VmFieldLayout>> VmFieldLayoutMap;
+
+// Native function registered through CLRNet_VM_RegisterHostFunctions. Call sites bound to it skip
+// managedCallCallback, so the host no longer dispatches on the metadata token at every call.
+struct VmHostFunction {
+    uint32_t identifier;       // Host-chosen ID that CLRNet_VM_BindHostFunction refers to
+    uint32_t metadataToken;    // Nonzero binds every plain call with this token in handles created later
+    uint32_t argumentCount;
+    VmHostCall::Kind kind;
+    VmNativeMethod function;   // Receives VmHostCallbacks::userContext as its context
+};
+
+// Runtime options applied through CLRNet_VM_SetOptions
+struct VmOptions {
+    BOOL enableRegisterTier;    // Translate programs to the register encoding and run them on the register loop
+    uint32_t tierUpThreshold;   // Invocations plus loop backedges before a program is compiled natively; 0 disables
+    BOOL enableProfiling;       // Collect per-opcode, per-program and per-call-site counters (CLRNet_VM_GetProfile)
+
+    VmOptions()
+        : enableRegisterTier(FALSE)
+        , tierUpThreshold(0)
+        , enableProfiling(FALSE) {}
+};
+
+// Aggregate counters reported through CLRNet_VM_GetStatistics
+struct VmStatistics {
+    uint64_t inlineCacheHits;
+    uint64_t inlineCacheMisses;
+    uint64_t megamorphicDispatches;
+    uint64_t nativeCompilations;
+    uint64_t nativeRejections;
+    uint64_t nativeExecutions;
+    uint64_t nativeGuardFailures;
+    // ldstr executions, and those answered by the literal the handle had already resolved
+    uint64_t stringLiteralLookups;
+    uint64_t stringLiteralHits;
+    // Runtime-wide string intern table
+    uint64_t internedStrings;
+    uint64_t internedStringBytes;
+    uint64_t internedBytesSaved;
+
+    VmStatistics()
+        : inlineCacheHits(0)
+        , inlineCacheMisses(0)
+        , megamorphicDispatches(0)
+        , nativeCompilations(0)
+        , nativeRejections(0)
+        , nativeExecutions(0)
+        , nativeGuardFailures(0)
+        , stringLiteralLookups(0)
+        , stringLiteralHits(0)
+        , internedStrings(0)
+        , internedStringBytes(0)
+        , internedBytesSaved(0) {}
 };
 
 // Virtual machine entry point
@@ -274,43 +854,168 @@ public:
     // Compile IL into VM bytecode, optionally retrieving a cached version
     std::shared_ptr<VmProgram> Compile(const void* ilCode, size_t ilSize, const std::string& cacheKey);
 
+    // Compile and register the program; every call returns a new handle, sharing the cached program
+    void* CompileHandle(const void* ilCode, size_t ilSize, const std::string& cacheKey);
+
+    // Load a pre-lowered VmBytecodeFormat container instead of IL; cache keys share one namespace with Compile
+    std::shared_ptr<VmProgram> LoadBytecode(const void* bytecode, size_t size, const std::string& cacheKey);
+    void* LoadBytecodeHandle(const void* bytecode, size_t size, const std::string& cacheKey);
+    void ReleaseHandle(void* handle);
+
     // Execute a previously compiled program with the provided context
     bool Execute(const VmProgram& program, VmExecutionContext& context, VmExecutionResult& result);
     bool ExecuteHandle(void* handle, VmExecutionContext& context, VmExecutionResult& result);
 
+    // Execute directly against the caller's VmValue arrays without marshaling them into containers
+    bool ExecuteHandle(void* handle, VmExecutionContextNative& context, VmExecutionResult& result);
+
+    // Execute one program over many independent contexts on the worker pool; returns the failure count.
+    // parallelism caps the threads used, the caller included; 0 uses every core.
+    uint32_t ExecuteBatch(void* handle, VmExecutionContextNative* contexts, uint32_t count,
+                          VmExecutionResultNative* results, uint32_t parallelism);
+
+    // Continue a suspended execution with the outcome of its pending host call. Any thread may resume
+    // a continuation, exactly once; it may suspend again and hand back a new one.
+    bool Resume(void* continuation, bool callSucceeded, const VmValue& returnValue, VmExecutionResult& result);
+
     // Configure host callbacks for syscalls exposed to bytecode
     void SetHostCallbacks(const VmHostCallbacks& callbacks);
 
+    // Runtime options
+    void SetOptions(const VmOptions& options);
+    VmOptions GetOptions() const { return m_options; }
+
     // Cache helpers
     void FlushCache();
+
+    // Call-site bindings apply to the given handle only, even when other handles share its program
     bool ConfigureCallSite(void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken);
 
+    // Bind a `call` site to another compiled program so the interpreter calls it directly. The
+    // site's arity comes from ConfigureCallSite or managedCallArityCallback; binding fails when
+    // neither gives one or when it is smaller than the callee's. ConfigureCallSite on the same
+    // site routes it back to the host.
+    bool BindCallSite(void* handle, uint32_t callSiteIndex, void* calleeHandle);
+
+    // Register native host functions by ID. An ID or token keeps its first registration;
+    // registering a different one for it fails.
+    bool RegisterHostFunctions(const VmHostFunction* functions, uint32_t count);
+
+    // Bind a `call` site to a registered host function, which the interpreter then calls directly.
+    // ConfigureCallSite on the same site routes it back to the host.
+    bool BindHostFunction(void* handle, uint32_t callSiteIndex, uint32_t identifier);
+
+    // Let field accesses on objects of the layouts' types bypass fieldLoadCallback/fieldStoreCallback.
+    // A field of a type keeps its first layout; registering a different one for it fails.
+    bool RegisterFieldLayouts(const VmFieldLayout* layouts, uint32_t count);
+
+    // Runtime counters
+    void GetStatistics(VmStatistics& statistics) const;
+
+    // Profiling data collected while VmOptions::enableProfiling is set
+    void GetProfile(VmProfileSnapshot& snapshot);
+    void ResetProfile();
+
 private:
     std::unique_ptr<BytecodeCompiler> m_compiler;
-    std::unique_ptr<BytecodeCache> m_cache;
+    std::shared_ptr<BytecodeCache> m_cache;              // Shared with every other instance
+    std::shared_ptr<NativeCompiler> m_nativeCompiler;    // Likewise; null without a native tier
+    std::unique_ptr<VmProfiler> m_profiler;
     VmHostCallbacks m_hostCallbacks;
+    VmOptions m_options;
     CRITICAL_SECTION m_lock;
     bool m_initialized;
-    std::unordered_map<void*, std::shared_ptr<VmProgram>> m_livePrograms;
+    std::unique_ptr<VmHandleTable> m_handles;
+    std::unique_ptr<VmWorkerPool> m_workerPool;
+    std::unordered_map<std::wstring, std::unique_ptr<std::wstring>> m_failureReasons;
+    std::unordered_map<uintptr_t, std::unique_ptr<VmContinuation>> m_continuations;
+    uintptr_t m_nextContinuation;
+    std::atomic<uint64_t> m_inlineCacheHits;
+    std::atomic<uint64_t> m_inlineCacheMisses;
+    std::atomic<uint64_t> m_megamorphicDispatches;
+    std::atomic<uint64_t> m_nativeExecutions;
+    std::atomic<uint64_t> m_nativeGuardFailures;
+    std::atomic<uint64_t> m_stringLiteralLookups;
+    std::atomic<uint64_t> m_stringLiteralHits;
+    // Registered layouts are replaced as a whole, so field accesses look them up without the lock.
+    // Replaced maps stay alive with the instance, since executions may still be reading them.
+    std::atomic<const VmFieldLayoutMap*> m_fieldLayouts;
+    std::vector<std::unique_ptr<const VmFieldLayoutMap>> m_fieldLayoutVersions;
+    std::unordered_map<uint32_t, VmHostFunction> m_hostFunctions;
+    std::unordered_map<uint32_t, uint32_t> m_hostFunctionTokens;   // Metadata token to function ID
+
+    const VmFieldLayout* FindFieldLayout(uint32_t fieldToken, const void* methodTable) const;
+    void* RegisterHandle(const std::shared_ptr<VmProgram>& program);
 
+    VmWorkerPool* EnsureWorkerPool();
+    const wchar_t* RetainFailureReason(const std::wstring& reason);
+
+    void RecordInvocation(const VmProgram& program, void* handle);
+
+    bool ExecuteContext(const VmProgram& program, void* handle, VmBindingTable* bindings, VmExecutionContext& context,
+                        VmExecutionResult& result);
+    bool ExecuteFrame(const VmProgram& program, VmFrame& frame, VmExecutionResult& result);
+    bool DispatchFrame(const VmProgram& program, VmFrame& frame, VmExecutionResult& result);
+    VmProfiler* ActiveProfiler() const { return m_options.enableProfiling ? m_profiler.get() : nullptr; }
+    template <bool Checked>
+    bool Interpret(const VmProgram& program, VmFrame& frame, VmExecutionResult& result,
+                   VmContinuation* resumeFrom = nullptr);
+    bool Suspend(const VmProgram& program, const VmFrame& frame, const std::vector<VmValue>& stack,
+                 uint32_t resumeInstruction, uint64_t elapsedTicks, const VmContinuation* resumedFrom,
+                 VmExecutionResult& result);
+    template <bool Checked>
     bool ExecuteInstruction(const VmInstruction& instruction,
                             const VmProgram& program,
                             std::vector<VmValue>& stack,
-                            std::vector<VmValue>& locals,
-                            VmExecutionContext& context,
+                            VmFrame& frame,
                             VmExecutionResult& result,
                             uint32_t& instructionPointer);
 
-    void ReleaseHandle(void* handle);
+    bool ExecuteRegisters(const VmProgram& program, VmFrame& frame, VmExecutionResult& result);
+
+    VmNativeMethod ResolveVirtualTarget(VmCallSite& callSite, void* receiver);
 };
 
 // Helper exported functions for managed callers
 extern "C" {
     __declspec(dllexport) HRESULT CLRNet_VM_CompileIL(const void* ilCode, DWORD ilSize, const char* cacheKey, void** outHandle);
+    __declspec(dllexport) HRESULT CLRNet_VM_LoadBytecode(const void* bytecode, DWORD size, const char* cacheKey, void** outHandle);
     __declspec(dllexport) HRESULT CLRNet_VM_Execute(void* handle, VmExecutionContextNative* context, VmExecutionResultNative* result);
+    __declspec(dllexport) HRESULT CLRNet_VM_ExecuteBatch(void* handle, VmExecutionContextNative* contexts, uint32_t count, VmExecutionResultNative* results, uint32_t parallelism);
+    __declspec(dllexport) HRESULT CLRNet_VM_Resume(void* continuation, BOOL callSucceeded, const VmValue* returnValue, VmExecutionResultNative* result);
     __declspec(dllexport) HRESULT CLRNet_VM_Release(void* handle);
     __declspec(dllexport) HRESULT CLRNet_VM_RegisterHost(const VmHostCallbacks* callbacks);
     __declspec(dllexport) HRESULT CLRNet_VM_ConfigureCallSite(void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken);
+    __declspec(dllexport) HRESULT CLRNet_VM_BindCallSite(void* handle, uint32_t callSiteIndex, void* calleeHandle);
+    __declspec(dllexport) HRESULT CLRNet_VM_RegisterFieldLayouts(const VmFieldLayout* layouts, uint32_t count);
+    __declspec(dllexport) HRESULT CLRNet_VM_RegisterHostFunctions(const VmHostFunction* functions, uint32_t count);
+    __declspec(dllexport) HRESULT CLRNet_VM_BindHostFunction(void* handle, uint32_t callSiteIndex, uint32_t identifier);
+    __declspec(dllexport) HRESULT CLRNet_VM_GetStatistics(VmStatistics* statistics);
+    __declspec(dllexport) HRESULT CLRNet_VM_SetOptions(const VmOptions* options);
+    __declspec(dllexport) HRESULT CLRNet_VM_GetProfile(uint32_t format, char* buffer, uint32_t bufferSize, uint32_t* requiredSize);
+    __declspec(dllexport) HRESULT CLRNet_VM_ResetProfile();
+
+    // Independent VM instances. Each has its own host callbacks, options, budgets, handles and field
+    // layouts; compiled programs are shared through one process-wide store. A handle or continuation
+    // is only valid on the instance that produced it. The exports above act on a default instance.
+    __declspec(dllexport) HRESULT CLRNet_VM_CreateInstance(const VmHostCallbacks* callbacks, void** outInstance);
+    __declspec(dllexport) HRESULT CLRNet_VM_DestroyInstance(void* instance);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceCompileIL(void* instance, const void* ilCode, DWORD ilSize, const char* cacheKey, void** outHandle);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceLoadBytecode(void* instance, const void* bytecode, DWORD size, const char* cacheKey, void** outHandle);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceExecute(void* instance, void* handle, VmExecutionContextNative* context, VmExecutionResultNative* result);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceExecuteBatch(void* instance, void* handle, VmExecutionContextNative* contexts, uint32_t count, VmExecutionResultNative* results, uint32_t parallelism);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceResume(void* instance, void* continuation, BOOL callSucceeded, const VmValue* returnValue, VmExecutionResultNative* result);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceRelease(void* instance, void* handle);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceRegisterHost(void* instance, const VmHostCallbacks* callbacks);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceConfigureCallSite(void* instance, void* handle, uint32_t callSiteIndex, void* managedTarget, uint32_t argumentCount, uint32_t metadataToken);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceBindCallSite(void* instance, void* handle, uint32_t callSiteIndex, void* calleeHandle);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceRegisterFieldLayouts(void* instance, const VmFieldLayout* layouts, uint32_t count);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceRegisterHostFunctions(void* instance, const VmHostFunction* functions, uint32_t count);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceBindHostFunction(void* instance, void* handle, uint32_t callSiteIndex, uint32_t identifier);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceGetStatistics(void* instance, VmStatistics* statistics);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceSetOptions(void* instance, const VmOptions* options);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceGetProfile(void* instance, uint32_t format, char* buffer, uint32_t bufferSize, uint32_t* requiredSize);
+    __declspec(dllexport) HRESULT CLRNet_VM_InstanceResetProfile(void* instance);
 }
 
 } // namespace VM
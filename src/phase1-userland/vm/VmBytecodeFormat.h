@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef CLRNET_VM_BYTECODE_FORMAT_H
+#define CLRNET_VM_BYTECODE_FORMAT_H
+
+#include <cstdint>
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+// Container for pre-lowered VM bytecode, loaded by CLRNet_VM_LoadBytecode. All fields are
+// little-endian and the layout does not depend on the VmValue layout or pointer size:
+//
+//   VmBytecodeHeader                    headerSize bytes
+//   VmBytecodeInstruction[instructionCount]
+//   VmBytecodeCallSite[callSiteCount]
+//   int32_t switchTargets[switchTargetCount]
+//
+// Readers reject any other major version. A newer minor version may grow the header (readers skip
+// to headerSize) and append sections after the switch targets, which older readers ignore.
+const uint32_t VmBytecodeMagic = 0x42564D43;     // "CMVB"
+const uint16_t VmBytecodeMajorVersion = 1;
+const uint16_t VmBytecodeMinorVersion = 0;
+
+struct VmBytecodeHeader {
+    uint32_t magic;
+    uint16_t majorVersion;
+    uint16_t minorVersion;
+    uint32_t headerSize;          // Offset of the instruction section
+    uint32_t flags;               // None defined yet; must be zero
+    uint32_t argumentCount;
+    uint32_t localCount;
+    uint32_t instructionCount;
+    uint32_t callSiteCount;
+    uint32_t switchTargetCount;
+};
+
+// One instruction. Operands mean what they mean in VmInstruction (branch targets and switchTargets
+// are instruction indices, call opcodes index the call-site section), but each is a full int32:
+// LoadConstantI8/R8 carry the low and high halves of the constant in operand0/operand1, Switch its
+// case count in operand1, and other opcodes ignore operand1/operand2. Only the opcodes the IL
+// compiler itself emits are accepted; superinstructions, quickened forms and the unchecked element
+// accesses are derived on load, never trusted from the container.
+struct VmBytecodeInstruction {
+    uint8_t opcode;               // VmOpcode
+    uint8_t reserved[3];          // Must be zero
+    int32_t operand0;
+    int32_t operand1;
+    int32_t operand2;
+};
+
+struct VmBytecodeCallSite {
+    uint32_t metadataToken;
+    uint32_t argumentCount;       // 0 asks managedCallArityCallback at the call
+};
+
+static_assert(sizeof(VmBytecodeHeader) == 36, "VmBytecodeHeader layout is part of the format");
+static_assert(sizeof(VmBytecodeInstruction) == 16, "VmBytecodeInstruction layout is part of the format");
+static_assert(sizeof(VmBytecodeCallSite) == 8, "VmBytecodeCallSite layout is part of the format");
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
+
+#endif // CLRNET_VM_BYTECODE_FORMAT_H
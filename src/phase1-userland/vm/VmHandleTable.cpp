@@ -0,0 +1,352 @@
+#include "VmHandleTable.h"
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+namespace {
+
+// Handles keep the slot index in the low bits and the generation above it. On 32-bit targets the
+// generation has 12 bits, so a slot has to be recycled 2048 times before a stale handle can alias.
+const uint32_t IndexBits = 20;
+const uintptr_t IndexMask = (static_cast<uintptr_t>(1) << IndexBits) - 1;
+const uintptr_t GenerationMask = ~static_cast<uintptr_t>(0) >> IndexBits;
+const uint32_t NoFreeSlot = 0xFFFFFFFFu;
+
+// Distinguishes tables that reuse an address, so a thread's cached participant is never stale
+std::atomic<uint64_t> g_nextTableSerial(1);
+
+struct ParticipantCache {
+    uint64_t tableSerial;
+    void* participant;
+};
+
+// A few entries, so a thread alternating between VM instances keeps each one's participant cached
+const uint64_t ParticipantCacheSize = 4;
+
+thread_local ParticipantCache t_participantCache[ParticipantCacheSize] = {};
+
+} // namespace
+
+VmHandleTable::ReadGuard::ReadGuard(VmHandleTable& table)
+    : m_table(table)
+    , m_participant(table.Enter()) {
+}
+
+VmHandleTable::ReadGuard::~ReadGuard() {
+    m_table.Exit(static_cast<Participant*>(m_participant));
+}
+
+VmHandleTable::VmHandleTable()
+    : m_slotCount(0)
+    , m_freeHead(NoFreeSlot)
+    , m_liveCount(0)
+    , m_epoch(1)
+    , m_participants(nullptr)
+    , m_serial(g_nextTableSerial.fetch_add(1, std::memory_order_relaxed)) {
+    InitializeCriticalSection(&m_lock);
+    for (uint32_t i = 0; i < MaxChunks; ++i) {
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+VmHandleTable::~VmHandleTable() {
+    Clear();
+
+    for (uint32_t i = 0; i < MaxChunks; ++i) {
+        delete[] m_chunks[i].load(std::memory_order_relaxed);
+    }
+
+    Participant* participant = m_participants.load(std::memory_order_relaxed);
+    while (participant) {
+        Participant* next = participant->next;
+        delete participant;
+        participant = next;
+    }
+
+    DeleteCriticalSection(&m_lock);
+}
+
+void* VmHandleTable::Register(const std::shared_ptr<VmProgram>& program, std::shared_ptr<VmBindingTable> bindings) {
+    if (!program) {
+        return nullptr;
+    }
+
+    if (!bindings) {
+        bindings = std::make_shared<VmBindingTable>(*program);
+    }
+
+    EnterCriticalSection(&m_lock);
+
+    uint32_t index = m_freeHead;
+    if (index != NoFreeSlot) {
+        m_freeHead = GetSlot(index)->nextFree;
+    } else {
+        if (m_slotCount >= MaxChunks * ChunkSize) {
+            LeaveCriticalSection(&m_lock);
+            return nullptr;
+        }
+        index = m_slotCount;
+        std::atomic<Slot*>& chunk = m_chunks[index >> ChunkShift];
+        if (!chunk.load(std::memory_order_relaxed)) {
+            chunk.store(new Slot[ChunkSize], std::memory_order_release);
+        }
+        ++m_slotCount;
+    }
+
+    Slot* slot = GetSlot(index);
+    slot->owner = program;
+    slot->bindingsOwner = std::move(bindings);
+    slot->program.store(program.get(), std::memory_order_relaxed);
+    slot->bindings.store(slot->bindingsOwner.get(), std::memory_order_relaxed);
+    uintptr_t generation = NextGeneration(slot->generation.load(std::memory_order_relaxed));
+    slot->generation.store(generation, std::memory_order_release);
+
+    void* handle = EncodeHandle(index, generation);
+    ++m_liveCount;
+
+    LeaveCriticalSection(&m_lock);
+    return handle;
+}
+
+const VmProgram* VmHandleTable::Find(void* handle, VmBindingTable** bindings) const {
+    uint32_t index;
+    uintptr_t generation;
+    if (!DecodeHandle(handle, index, generation)) {
+        return nullptr;
+    }
+
+    Slot* slot = GetSlot(index);
+    if (!slot || slot->generation.load(std::memory_order_seq_cst) != generation) {
+        return nullptr;
+    }
+
+    // The caller's guard predates any Release that could have bumped the generation we just
+    // validated, so the program can't be reclaimed until the guard is dropped
+    if (bindings) {
+        *bindings = slot->bindings.load(std::memory_order_acquire);
+    }
+    return slot->program.load(std::memory_order_acquire);
+}
+
+std::shared_ptr<VmProgram> VmHandleTable::Share(void* handle, std::shared_ptr<VmBindingTable>* bindings) {
+    uint32_t index;
+    uintptr_t generation;
+    if (!DecodeHandle(handle, index, generation)) {
+        return nullptr;
+    }
+
+    EnterCriticalSection(&m_lock);
+    std::shared_ptr<VmProgram> program;
+    Slot* slot = index < m_slotCount ? GetSlot(index) : nullptr;
+    if (slot && slot->generation.load(std::memory_order_relaxed) == generation) {
+        program = slot->owner;
+        if (bindings) {
+            *bindings = slot->bindingsOwner;
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+    return program;
+}
+
+bool VmHandleTable::ReplaceBindings(void* handle, const std::shared_ptr<VmBindingTable>& bindings) {
+    uint32_t index;
+    uintptr_t generation;
+    if (!bindings || !DecodeHandle(handle, index, generation)) {
+        return false;
+    }
+
+    EnterCriticalSection(&m_lock);
+
+    Slot* slot = index < m_slotCount ? GetSlot(index) : nullptr;
+    if (!slot || slot->generation.load(std::memory_order_relaxed) != generation) {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    slot->bindings.store(bindings.get(), std::memory_order_seq_cst);
+
+    Retired retired;
+    retired.bindings = std::move(slot->bindingsOwner);
+    retired.epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    retired.slotIndex = NoFreeSlot;
+    slot->bindingsOwner = bindings;
+    m_retired.push_back(std::move(retired));
+
+    Reclaim();
+    LeaveCriticalSection(&m_lock);
+    return true;
+}
+
+bool VmHandleTable::Release(void* handle) {
+    uint32_t index;
+    uintptr_t generation;
+    if (!DecodeHandle(handle, index, generation)) {
+        return false;
+    }
+
+    EnterCriticalSection(&m_lock);
+
+    Slot* slot = index < m_slotCount ? GetSlot(index) : nullptr;
+    if (!slot || slot->generation.load(std::memory_order_relaxed) != generation) {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    // Invalidate the handle first; readers that enter after the epoch advance below can't pass
+    // the generation check, so only readers already in an older epoch may still hold the program
+    slot->generation.store(NextGeneration(generation), std::memory_order_seq_cst);
+    slot->program.store(nullptr, std::memory_order_relaxed);
+    slot->bindings.store(nullptr, std::memory_order_relaxed);
+
+    Retired retired;
+    retired.program = std::move(slot->owner);
+    retired.bindings = std::move(slot->bindingsOwner);
+    retired.epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    retired.slotIndex = index;
+    m_retired.push_back(std::move(retired));
+    --m_liveCount;
+
+    Reclaim();
+    LeaveCriticalSection(&m_lock);
+    return true;
+}
+
+void VmHandleTable::Clear() {
+    EnterCriticalSection(&m_lock);
+
+    for (uint32_t index = 0; index < m_slotCount; ++index) {
+        Slot* slot = GetSlot(index);
+        uintptr_t generation = slot->generation.load(std::memory_order_relaxed);
+        if (generation & 1) {
+            slot->generation.store(NextGeneration(generation), std::memory_order_seq_cst);
+        }
+        slot->program.store(nullptr, std::memory_order_relaxed);
+        slot->bindings.store(nullptr, std::memory_order_relaxed);
+        slot->owner.reset();
+        slot->bindingsOwner.reset();
+    }
+
+    // Rebuild the free list in index order so slots are handed out low to high again
+    m_freeHead = NoFreeSlot;
+    for (uint32_t index = m_slotCount; index > 0; --index) {
+        GetSlot(index - 1)->nextFree = m_freeHead;
+        m_freeHead = index - 1;
+    }
+
+    m_retired.clear();
+    m_liveCount = 0;
+
+    LeaveCriticalSection(&m_lock);
+}
+
+size_t VmHandleTable::GetLiveCount() const {
+    EnterCriticalSection(&m_lock);
+    size_t count = m_liveCount;
+    LeaveCriticalSection(&m_lock);
+    return count;
+}
+
+VmHandleTable::Participant* VmHandleTable::AcquireParticipant() {
+    ParticipantCache& cached = t_participantCache[m_serial % ParticipantCacheSize];
+    if (cached.tableSerial == m_serial) {
+        return static_cast<Participant*>(cached.participant);
+    }
+
+    // Thread ids are recycled only after the previous owner exited, at which point its record is idle
+    DWORD threadId = GetCurrentThreadId();
+    Participant* participant = m_participants.load(std::memory_order_acquire);
+    while (participant && participant->ownerThread != threadId) {
+        participant = participant->next;
+    }
+
+    if (!participant) {
+        participant = new Participant();
+        participant->epoch.store(0, std::memory_order_relaxed);
+        participant->ownerThread = threadId;
+        participant->depth = 0;
+        participant->next = m_participants.load(std::memory_order_relaxed);
+        while (!m_participants.compare_exchange_weak(participant->next, participant,
+                                                     std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    cached.tableSerial = m_serial;
+    cached.participant = participant;
+    return participant;
+}
+
+VmHandleTable::Participant* VmHandleTable::Enter() {
+    Participant* participant = AcquireParticipant();
+    if (participant->depth++ == 0) {
+        participant->epoch.store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+    return participant;
+}
+
+void VmHandleTable::Exit(Participant* participant) {
+    if (--participant->depth == 0) {
+        participant->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void VmHandleTable::Reclaim() {
+    uint64_t oldestActive = UINT64_MAX;
+    for (Participant* participant = m_participants.load(std::memory_order_acquire); participant;
+         participant = participant->next) {
+        uint64_t epoch = participant->epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0 && epoch < oldestActive) {
+            oldestActive = epoch;
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < m_retired.size(); ++i) {
+        Retired& retired = m_retired[i];
+        if (retired.epoch < oldestActive) {
+            // Nobody can reach the slot through its old generation, or the table it replaced, any more
+            if (retired.slotIndex != NoFreeSlot) {
+                Slot* slot = GetSlot(retired.slotIndex);
+                slot->nextFree = m_freeHead;
+                m_freeHead = retired.slotIndex;
+            }
+            retired.program.reset();
+            retired.bindings.reset();
+        } else {
+            if (kept != i) {
+                m_retired[kept] = std::move(retired);
+            }
+            ++kept;
+        }
+    }
+    m_retired.resize(kept);
+}
+
+VmHandleTable::Slot* VmHandleTable::GetSlot(uint32_t index) const {
+    if (index >= MaxChunks * ChunkSize) {
+        return nullptr;
+    }
+    Slot* chunk = m_chunks[index >> ChunkShift].load(std::memory_order_acquire);
+    return chunk ? &chunk[index & (ChunkSize - 1)] : nullptr;
+}
+
+uintptr_t VmHandleTable::NextGeneration(uintptr_t generation) {
+    // The mask is all ones, so wrapping preserves the odd/even meaning
+    return (generation + 1) & GenerationMask;
+}
+
+void* VmHandleTable::EncodeHandle(uint32_t index, uintptr_t generation) {
+    return reinterpret_cast<void*>((generation << IndexBits) | index);
+}
+
+bool VmHandleTable::DecodeHandle(void* handle, uint32_t& index, uintptr_t& generation) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(handle);
+    generation = value >> IndexBits;
+    index = static_cast<uint32_t>(value & IndexMask);
+    // Live generations are odd, which also keeps every valid handle non-null
+    return (generation & 1) != 0;
+}
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
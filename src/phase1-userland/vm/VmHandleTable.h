@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef CLRNET_VM_HANDLE_TABLE_H
+#define CLRNET_VM_HANDLE_TABLE_H
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "VirtualMachine.h"
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+// Maps opaque program handles to VmProgram instances and each handle's VmBindingTable.
+// A handle packs a slot index and the slot's generation, so a released handle never aliases the
+// program that later reuses its slot. Lookups are lock-free: readers pin the current epoch with
+// a VmHandleTable::ReadGuard, and released programs are destroyed only once every reader that
+// could still see them has left its epoch.
+class VmHandleTable {
+public:
+    // Keeps programs looked up through the table alive until it goes out of scope. Guards nest.
+    class ReadGuard {
+    public:
+        explicit ReadGuard(VmHandleTable& table);
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+    private:
+        VmHandleTable& m_table;
+        void* m_participant;
+    };
+
+    VmHandleTable();
+    ~VmHandleTable();
+
+    // Every call returns a new handle with its own binding table, even for a program that is
+    // already registered. `bindings` replaces the program's unbound call sites; it must not be
+    // shared with another handle.
+    void* Register(const std::shared_ptr<VmProgram>& program, std::shared_ptr<VmBindingTable> bindings = nullptr);
+
+    // Requires a live ReadGuard; returns nullptr for unknown or released handles
+    const VmProgram* Find(void* handle, VmBindingTable** bindings = nullptr) const;
+
+    // Slow path for callers that must outlive the guard, e.g. the native compiler queue
+    std::shared_ptr<VmProgram> Share(void* handle, std::shared_ptr<VmBindingTable>* bindings = nullptr);
+
+    // Publishes a new binding table for the handle. Readers that already found the old table keep
+    // using it; it is destroyed once they have all left their epoch.
+    bool ReplaceBindings(void* handle, const std::shared_ptr<VmBindingTable>& bindings);
+
+    bool Release(void* handle);
+
+    // Drops every handle; callers must ensure no reader is still inside a guard
+    void Clear();
+
+    size_t GetLiveCount() const;
+
+private:
+    static const uint32_t ChunkShift = 10;
+    static const uint32_t ChunkSize = 1u << ChunkShift;
+    static const uint32_t MaxChunks = 1024;
+
+    struct Slot {
+        std::atomic<uintptr_t> generation;   // Even while free, odd while it holds a program
+        std::atomic<VmProgram*> program;
+        std::atomic<VmBindingTable*> bindings;
+        std::shared_ptr<VmProgram> owner;     // Written only under m_lock, like bindingsOwner
+        std::shared_ptr<VmBindingTable> bindingsOwner;
+        uint32_t nextFree;
+
+        Slot()
+            : generation(0)
+            , program(nullptr)
+            , bindings(nullptr)
+            , nextFree(0) {}
+    };
+
+    // Per-thread reader record; an epoch of 0 means the thread is outside any guard.
+    // Cache-line aligned so readers on different threads don't share a line.
+    struct alignas(64) Participant {
+        std::atomic<uint64_t> epoch;
+        DWORD ownerThread;
+        uint32_t depth;
+        Participant* next;
+    };
+
+    // A released handle's program and bindings, or just a replaced binding table
+    struct Retired {
+        std::shared_ptr<VmProgram> program;
+        std::shared_ptr<VmBindingTable> bindings;
+        uint64_t epoch;
+        uint32_t slotIndex;     // Slot to free on reclaim; NoFreeSlot for a replaced binding table
+    };
+
+    Participant* AcquireParticipant();
+    Participant* Enter();
+    void Exit(Participant* participant);
+    void Reclaim();
+    Slot* GetSlot(uint32_t index) const;
+    static uintptr_t NextGeneration(uintptr_t generation);
+    static void* EncodeHandle(uint32_t index, uintptr_t generation);
+    static bool DecodeHandle(void* handle, uint32_t& index, uintptr_t& generation);
+
+    mutable CRITICAL_SECTION m_lock;
+    std::atomic<Slot*> m_chunks[MaxChunks];
+    uint32_t m_slotCount;
+    uint32_t m_freeHead;
+    size_t m_liveCount;
+    std::vector<Retired> m_retired;
+
+    std::atomic<uint64_t> m_epoch;
+    std::atomic<Participant*> m_participants;
+    const uint64_t m_serial;
+};
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
+
+#endif // CLRNET_VM_HANDLE_TABLE_H
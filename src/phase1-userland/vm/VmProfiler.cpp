@@ -0,0 +1,342 @@
+#include "VmProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+namespace {
+
+struct ThreadOpcodeCounters {
+    uint64_t profilerSerial;    // 0 while the entry is unused
+    uint64_t counts[256];
+    uint64_t cycles[256];
+    bool dirty;
+};
+
+// Distinguishes profilers that reuse an address, so an entry never flushes into the wrong one
+std::atomic<uint64_t> g_nextProfilerSerial(1);
+
+// One entry per profiler, so VM instances that run on the same thread never flush each other's
+// counts. Entries are flushed when each run finishes, so more than one is only dirty while runs of
+// different instances are nested.
+const size_t ThreadCounterSlots = 4;
+
+thread_local ThreadOpcodeCounters t_opcodeCounters[ThreadCounterSlots] = {};
+thread_local size_t t_currentCounters = 0;
+thread_local uint32_t t_sampleCountdown = 0;
+thread_local uint32_t t_sampleSeed = 0x9E3779B9u;
+
+const char* GetOpcodeName(VmOpcode opcode) {
+    switch (opcode) {
+    case VmOpcode::Nop: return "Nop";
+    case VmOpcode::LoadArgument: return "LoadArgument";
+    case VmOpcode::LoadLocal: return "LoadLocal";
+    case VmOpcode::StoreLocal: return "StoreLocal";
+    case VmOpcode::StoreArgument: return "StoreArgument";
+    case VmOpcode::LoadField: return "LoadField";
+    case VmOpcode::StoreField: return "StoreField";
+    case VmOpcode::LoadConstantI4: return "LoadConstantI4";
+    case VmOpcode::LoadConstantI8: return "LoadConstantI8";
+    case VmOpcode::LoadString: return "LoadString";
+    case VmOpcode::LoadNull: return "LoadNull";
+    case VmOpcode::Box: return "Box";
+    case VmOpcode::UnboxAny: return "UnboxAny";
+    case VmOpcode::CastClass: return "CastClass";
+    case VmOpcode::Add: return "Add";
+    case VmOpcode::Subtract: return "Subtract";
+    case VmOpcode::Multiply: return "Multiply";
+    case VmOpcode::Divide: return "Divide";
+    case VmOpcode::Branch: return "Branch";
+    case VmOpcode::BranchIfTrue: return "BranchIfTrue";
+    case VmOpcode::BranchIfFalse: return "BranchIfFalse";
+    case VmOpcode::CompareEqual: return "CompareEqual";
+    case VmOpcode::CompareNotEqual: return "CompareNotEqual";
+    case VmOpcode::CompareGreaterThan: return "CompareGreaterThan";
+    case VmOpcode::CompareLessThan: return "CompareLessThan";
+    case VmOpcode::Call: return "Call";
+    case VmOpcode::CallVirtual: return "CallVirtual";
+    case VmOpcode::HostCall: return "HostCall";
+    case VmOpcode::NewObject: return "NewObject";
+    case VmOpcode::Return: return "Return";
+    case VmOpcode::Pop: return "Pop";
+    case VmOpcode::BranchIfGreaterOrEqualOrdered: return "BranchIfGreaterOrEqualOrdered";
+    case VmOpcode::BranchIfLessOrEqualOrdered: return "BranchIfLessOrEqualOrdered";
+    case VmOpcode::BranchIfGreaterThanUnsigned: return "BranchIfGreaterThanUnsigned";
+    case VmOpcode::BranchIfGreaterOrEqualUnsigned: return "BranchIfGreaterOrEqualUnsigned";
+    case VmOpcode::BranchIfLessThanUnsigned: return "BranchIfLessThanUnsigned";
+    case VmOpcode::BranchIfLessOrEqualUnsigned: return "BranchIfLessOrEqualUnsigned";
+    case VmOpcode::Switch: return "Switch";
+    case VmOpcode::NewArray: return "NewArray";
+    case VmOpcode::LoadLength: return "LoadLength";
+    case VmOpcode::LoadElement: return "LoadElement";
+    case VmOpcode::StoreElement: return "StoreElement";
+    case VmOpcode::LoadElementUnchecked: return "LoadElementUnchecked";
+    case VmOpcode::StoreElementUnchecked: return "StoreElementUnchecked";
+    case VmOpcode::ConvertToInt32: return "ConvertToInt32";
+    case VmOpcode::AddLocalConstant: return "AddLocalConstant";
+    case VmOpcode::ArithmeticLocals: return "ArithmeticLocals";
+    case VmOpcode::BranchIfEqual: return "BranchIfEqual";
+    case VmOpcode::BranchIfNotEqual: return "BranchIfNotEqual";
+    case VmOpcode::BranchIfGreaterThan: return "BranchIfGreaterThan";
+    case VmOpcode::BranchIfLessOrEqual: return "BranchIfLessOrEqual";
+    case VmOpcode::BranchIfLessThan: return "BranchIfLessThan";
+    case VmOpcode::BranchIfGreaterOrEqual: return "BranchIfGreaterOrEqual";
+    case VmOpcode::LoadConstantR4: return "LoadConstantR4";
+    case VmOpcode::LoadConstantR8: return "LoadConstantR8";
+    case VmOpcode::AddI4: return "AddI4";
+    case VmOpcode::SubtractI4: return "SubtractI4";
+    case VmOpcode::MultiplyI4: return "MultiplyI4";
+    case VmOpcode::DivideI4: return "DivideI4";
+    case VmOpcode::AddI8: return "AddI8";
+    case VmOpcode::SubtractI8: return "SubtractI8";
+    case VmOpcode::MultiplyI8: return "MultiplyI8";
+    case VmOpcode::DivideI8: return "DivideI8";
+    case VmOpcode::AddR4: return "AddR4";
+    case VmOpcode::SubtractR4: return "SubtractR4";
+    case VmOpcode::MultiplyR4: return "MultiplyR4";
+    case VmOpcode::DivideR4: return "DivideR4";
+    case VmOpcode::AddR8: return "AddR8";
+    case VmOpcode::SubtractR8: return "SubtractR8";
+    case VmOpcode::MultiplyR8: return "MultiplyR8";
+    case VmOpcode::DivideR8: return "DivideR8";
+    default: return "Unknown";
+    }
+}
+
+void AppendJsonString(std::ostringstream& stream, const std::string& value) {
+    stream << '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': stream << "\\\""; break;
+        case '\\': stream << "\\\\"; break;
+        case '\n': stream << "\\n"; break;
+        case '\r': stream << "\\r"; break;
+        case '\t': stream << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                stream << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xF] << "0123456789abcdef"[c & 0xF];
+            } else {
+                stream << c;
+            }
+            break;
+        }
+    }
+    stream << '"';
+}
+
+ThreadOpcodeCounters* FindThreadCounters(uint64_t profilerSerial, bool create) {
+    if (t_opcodeCounters[t_currentCounters].profilerSerial == profilerSerial) {
+        return &t_opcodeCounters[t_currentCounters];
+    }
+    for (size_t i = 0; i < ThreadCounterSlots; ++i) {
+        if (t_opcodeCounters[i].profilerSerial == profilerSerial) {
+            t_currentCounters = i;
+            return &t_opcodeCounters[i];
+        }
+    }
+    if (!create) {
+        return nullptr;
+    }
+
+    // Prefer an entry with nothing left to flush. Runs nested more than ThreadCounterSlots instances
+    // deep lose the counts of the entry taken over.
+    size_t slot = (t_currentCounters + 1) % ThreadCounterSlots;
+    for (size_t i = 0; i < ThreadCounterSlots; ++i) {
+        if (!t_opcodeCounters[i].dirty) {
+            slot = i;
+            break;
+        }
+    }
+    std::memset(&t_opcodeCounters[slot], 0, sizeof(ThreadOpcodeCounters));
+    t_opcodeCounters[slot].profilerSerial = profilerSerial;
+    t_currentCounters = slot;
+    return &t_opcodeCounters[slot];
+}
+
+} // namespace
+
+VmProfiler::VmProfiler()
+    : m_serial(g_nextProfilerSerial.fetch_add(1, std::memory_order_relaxed)) {
+    InitializeCriticalSection(&m_lock);
+    std::memset(m_opcodeCounts, 0, sizeof(m_opcodeCounts));
+    std::memset(m_opcodeCycles, 0, sizeof(m_opcodeCycles));
+}
+
+VmProfiler::~VmProfiler() {
+    DeleteCriticalSection(&m_lock);
+}
+
+bool VmProfiler::ShouldSample() {
+    if (t_sampleCountdown > 0) {
+        --t_sampleCountdown;
+        return false;
+    }
+
+    // xorshift32; the next gap is uniform in [0, 2 * interval - 2], averaging interval - 1
+    t_sampleSeed ^= t_sampleSeed << 13;
+    t_sampleSeed ^= t_sampleSeed >> 17;
+    t_sampleSeed ^= t_sampleSeed << 5;
+    t_sampleCountdown = t_sampleSeed % (2 * CycleSampleInterval - 1);
+    return true;
+}
+
+void VmProfiler::RecordOpcode(VmOpcode opcode, uint64_t sampledCycles) {
+    ThreadOpcodeCounters& counters = *FindThreadCounters(m_serial, true);
+    uint8_t index = static_cast<uint8_t>(opcode);
+    counters.counts[index]++;
+    counters.cycles[index] += sampledCycles * CycleSampleInterval;
+    counters.dirty = true;
+}
+
+void VmProfiler::FlushThreadCounters() {
+    ThreadOpcodeCounters* counters = FindThreadCounters(m_serial, false);
+    if (!counters || !counters->dirty) {
+        return;
+    }
+
+    EnterCriticalSection(&m_lock);
+    for (size_t i = 0; i < 256; ++i) {
+        m_opcodeCounts[i] += counters->counts[i];
+        m_opcodeCycles[i] += counters->cycles[i];
+    }
+    LeaveCriticalSection(&m_lock);
+
+    std::memset(counters->counts, 0, sizeof(counters->counts));
+    std::memset(counters->cycles, 0, sizeof(counters->cycles));
+    counters->dirty = false;
+}
+
+VmProfiler::ProgramRecord& VmProfiler::GetRecord(const VmProgram& program) {
+    ProgramRecord& record = m_programs[program.cacheKey.empty() ? std::string("<anonymous>") : program.cacheKey];
+    if (record.callSites.size() < program.callSites.size()) {
+        size_t first = record.callSites.size();
+        record.callSites.resize(program.callSites.size());
+        for (size_t i = first; i < record.callSites.size(); ++i) {
+            record.callSites[i].callSiteIndex = static_cast<uint32_t>(i);
+            record.callSites[i].metadataToken = program.callSites[i].metadataToken;
+            record.callSites[i].hits = 0;
+            record.callSites[i].cycles = 0;
+        }
+    }
+    return record;
+}
+
+void VmProfiler::RecordInvocation(const VmProgram& program, uint64_t cycles) {
+    EnterCriticalSection(&m_lock);
+    ProgramRecord& record = GetRecord(program);
+    record.invocations++;
+    record.cycles += cycles;
+    LeaveCriticalSection(&m_lock);
+}
+
+void VmProfiler::RecordCallSite(const VmProgram& program, uint32_t callSiteIndex, uint32_t metadataToken, uint64_t cycles) {
+    EnterCriticalSection(&m_lock);
+    ProgramRecord& record = GetRecord(program);
+    if (callSiteIndex < record.callSites.size()) {
+        VmCallSiteProfile& callSite = record.callSites[callSiteIndex];
+        callSite.metadataToken = metadataToken;
+        callSite.hits++;
+        callSite.cycles += cycles;
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void VmProfiler::GetSnapshot(VmProfileSnapshot& snapshot) {
+    FlushThreadCounters();
+
+    snapshot.opcodes.clear();
+    snapshot.programs.clear();
+
+    EnterCriticalSection(&m_lock);
+    for (size_t i = 0; i < 256; ++i) {
+        if (m_opcodeCounts[i] != 0) {
+            snapshot.opcodes.push_back({ static_cast<VmOpcode>(i), m_opcodeCounts[i], m_opcodeCycles[i] });
+        }
+    }
+    for (const auto& entry : m_programs) {
+        VmProgramProfile profile;
+        profile.cacheKey = entry.first;
+        profile.invocations = entry.second.invocations;
+        profile.cycles = entry.second.cycles;
+        for (const VmCallSiteProfile& callSite : entry.second.callSites) {
+            if (callSite.hits != 0) {
+                profile.callSites.push_back(callSite);
+            }
+        }
+        snapshot.programs.push_back(std::move(profile));
+    }
+    LeaveCriticalSection(&m_lock);
+
+    std::sort(snapshot.opcodes.begin(), snapshot.opcodes.end(),
+              [](const VmOpcodeProfile& a, const VmOpcodeProfile& b) { return a.cycles > b.cycles; });
+    std::sort(snapshot.programs.begin(), snapshot.programs.end(),
+              [](const VmProgramProfile& a, const VmProgramProfile& b) { return a.cycles > b.cycles; });
+}
+
+void VmProfiler::Reset() {
+    ThreadOpcodeCounters* counters = FindThreadCounters(m_serial, false);
+    if (counters) {
+        std::memset(counters->counts, 0, sizeof(counters->counts));
+        std::memset(counters->cycles, 0, sizeof(counters->cycles));
+        counters->dirty = false;
+    }
+
+    EnterCriticalSection(&m_lock);
+    std::memset(m_opcodeCounts, 0, sizeof(m_opcodeCounts));
+    std::memset(m_opcodeCycles, 0, sizeof(m_opcodeCycles));
+    m_programs.clear();
+    LeaveCriticalSection(&m_lock);
+}
+
+std::string VmProfiler::Format(const VmProfileSnapshot& snapshot, VmProfileFormat format) {
+    std::ostringstream stream;
+
+    if (format == VmProfileFormat::Json) {
+        stream << "{\"opcodes\":[";
+        for (size_t i = 0; i < snapshot.opcodes.size(); ++i) {
+            const VmOpcodeProfile& opcode = snapshot.opcodes[i];
+            stream << (i ? "," : "") << "{\"opcode\":\"" << GetOpcodeName(opcode.opcode) << "\",\"count\":"
+                   << opcode.count << ",\"cycles\":" << opcode.cycles << "}";
+        }
+        stream << "],\"programs\":[";
+        for (size_t i = 0; i < snapshot.programs.size(); ++i) {
+            const VmProgramProfile& program = snapshot.programs[i];
+            stream << (i ? "," : "") << "{\"cacheKey\":";
+            AppendJsonString(stream, program.cacheKey);
+            stream << ",\"invocations\":" << program.invocations << ",\"cycles\":" << program.cycles
+                   << ",\"callSites\":[";
+            for (size_t j = 0; j < program.callSites.size(); ++j) {
+                const VmCallSiteProfile& callSite = program.callSites[j];
+                stream << (j ? "," : "") << "{\"index\":" << callSite.callSiteIndex << ",\"token\":"
+                       << callSite.metadataToken << ",\"hits\":" << callSite.hits << ",\"cycles\":" << callSite.cycles
+                       << "}";
+            }
+            stream << "]}";
+        }
+        stream << "]}";
+        return stream.str();
+    }
+
+    stream << "Opcodes (count, estimated cycles)\n";
+    for (const VmOpcodeProfile& opcode : snapshot.opcodes) {
+        stream << "  " << GetOpcodeName(opcode.opcode) << " " << opcode.count << " " << opcode.cycles << "\n";
+    }
+    stream << "Programs (invocations, cycles)\n";
+    for (const VmProgramProfile& program : snapshot.programs) {
+        stream << "  " << program.cacheKey << " " << program.invocations << " " << program.cycles << "\n";
+        for (const VmCallSiteProfile& callSite : program.callSites) {
+            stream << "    call site " << callSite.callSiteIndex << " token 0x" << std::hex << callSite.metadataToken
+                   << std::dec << " hits " << callSite.hits << " cycles " << callSite.cycles << "\n";
+        }
+    }
+    return stream.str();
+}
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef CLRNET_VM_PROFILER_H
+#define CLRNET_VM_PROFILER_H
+
+#include <windows.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "VirtualMachine.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+// Cheap monotonic cycle source for profiling; falls back to QPC ticks where there is no TSC
+inline uint64_t VmReadCycleCounter() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<uint64_t>(counter.QuadPart);
+#endif
+}
+
+enum class VmProfileFormat : uint32_t {
+    Text = 0,
+    Json = 1
+};
+
+struct VmOpcodeProfile {
+    VmOpcode opcode;
+    uint64_t count;
+    uint64_t cycles;    // Estimated from samples, see VmProfiler::CycleSampleInterval
+};
+
+struct VmCallSiteProfile {
+    uint32_t callSiteIndex;
+    uint32_t metadataToken;
+    uint64_t hits;
+    uint64_t cycles;    // Time spent dispatching, host callback included
+};
+
+struct VmProgramProfile {
+    std::string cacheKey;
+    uint64_t invocations;
+    uint64_t cycles;
+    std::vector<VmCallSiteProfile> callSites;
+};
+
+struct VmProfileSnapshot {
+    std::vector<VmOpcodeProfile> opcodes;     // Only opcodes that executed, hottest first
+    std::vector<VmProgramProfile> programs;   // Sorted by cycles, hottest first
+};
+
+// Collects execution counters while VmOptions::enableProfiling is set.
+// Opcode counters accumulate per thread and profiler, and are merged when an interpreter run finishes.
+class VmProfiler {
+public:
+    // On average one in this many instructions is timed and its cycles are scaled up by the same
+    // factor. Gaps are randomised so loops whose length divides the interval are not aliased.
+    static const uint32_t CycleSampleInterval = 8;
+
+    VmProfiler();
+    ~VmProfiler();
+
+    bool ShouldSample();
+    void RecordOpcode(VmOpcode opcode, uint64_t sampledCycles);
+    void FlushThreadCounters();
+    void RecordInvocation(const VmProgram& program, uint64_t cycles);
+    void RecordCallSite(const VmProgram& program, uint32_t callSiteIndex, uint32_t metadataToken, uint64_t cycles);
+
+    void GetSnapshot(VmProfileSnapshot& snapshot);
+    void Reset();
+
+    static std::string Format(const VmProfileSnapshot& snapshot, VmProfileFormat format);
+
+private:
+    struct ProgramRecord {
+        uint64_t invocations;
+        uint64_t cycles;
+        std::vector<VmCallSiteProfile> callSites;
+
+        ProgramRecord()
+            : invocations(0)
+            , cycles(0) {}
+    };
+
+    ProgramRecord& GetRecord(const VmProgram& program);
+
+    const uint64_t m_serial;
+    CRITICAL_SECTION m_lock;
+    uint64_t m_opcodeCounts[256];
+    uint64_t m_opcodeCycles[256];
+
+    // Keyed by cache key so a method keeps one record across recompiles and handle reuse
+    std::unordered_map<std::string, ProgramRecord> m_programs;
+};
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
+
+#endif // CLRNET_VM_PROFILER_H
@@ -0,0 +1,240 @@
+#include "VmWorkerPool.h"
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+namespace {
+
+uint64_t PackRange(uint32_t begin, uint32_t end) {
+    return static_cast<uint64_t>(begin) | (static_cast<uint64_t>(end) << 32);
+}
+
+uint32_t RangeBegin(uint64_t bounds) {
+    return static_cast<uint32_t>(bounds);
+}
+
+uint32_t RangeEnd(uint64_t bounds) {
+    return static_cast<uint32_t>(bounds >> 32);
+}
+
+// Set while a thread runs batch tasks. A task that starts another batch runs it inline, since
+// waiting for the pool from inside the pool would deadlock.
+thread_local bool t_insideBatch = false;
+
+} // namespace
+
+VmWorkerPool::VmWorkerPool()
+    : m_nextWorker(0)
+    , m_stopping(false)
+    , m_generation(0)
+    , m_task(nullptr)
+    , m_context(nullptr)
+    , m_participants(0)
+    , m_pendingWorkers(0) {
+    InitializeCriticalSection(&m_runLock);
+    InitializeCriticalSection(&m_lock);
+    InitializeConditionVariable(&m_wake);
+    InitializeConditionVariable(&m_done);
+}
+
+VmWorkerPool::~VmWorkerPool() {
+    Shutdown();
+    DeleteCriticalSection(&m_lock);
+    DeleteCriticalSection(&m_runLock);
+}
+
+bool VmWorkerPool::Initialize(uint32_t workerCount) {
+    EnterCriticalSection(&m_runLock);
+    if (!m_threads.empty()) {
+        LeaveCriticalSection(&m_runLock);
+        return true;
+    }
+
+    // Slot 0 belongs to the thread calling Run; workers take 1..workerCount
+    m_ranges.reset(new WorkRange[workerCount + 1]);
+    for (uint32_t i = 0; i <= workerCount; ++i) {
+        m_ranges[i].bounds.store(0, std::memory_order_relaxed);
+    }
+
+    m_stopping = false;
+    m_nextWorker.store(1, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        HANDLE thread = CreateThread(nullptr, 0, WorkerThreadProc, this, 0, nullptr);
+        if (!thread) {
+            break;
+        }
+        m_threads.push_back(thread);
+    }
+
+    LeaveCriticalSection(&m_runLock);
+    return !m_threads.empty();
+}
+
+void VmWorkerPool::Shutdown() {
+    EnterCriticalSection(&m_runLock);
+
+    EnterCriticalSection(&m_lock);
+    m_stopping = true;
+    WakeAllConditionVariable(&m_wake);
+    LeaveCriticalSection(&m_lock);
+
+    for (HANDLE thread : m_threads) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+    m_threads.clear();
+
+    LeaveCriticalSection(&m_runLock);
+}
+
+void VmWorkerPool::Run(uint32_t count, uint32_t parallelism, Task task, void* context) {
+    if (count == 0) {
+        return;
+    }
+
+    if (t_insideBatch) {
+        for (uint32_t i = 0; i < count; ++i) {
+            task(i, context);
+        }
+        return;
+    }
+
+    EnterCriticalSection(&m_runLock);
+
+    uint32_t participants = static_cast<uint32_t>(m_threads.size()) + 1;
+    if (parallelism != 0 && parallelism < participants) {
+        participants = parallelism;
+    }
+    if (count < participants) {
+        participants = count;
+    }
+
+    if (participants <= 1) {
+        LeaveCriticalSection(&m_runLock);
+        for (uint32_t i = 0; i < count; ++i) {
+            task(i, context);
+        }
+        return;
+    }
+
+    uint32_t share = count / participants;
+    uint32_t remainder = count % participants;
+    uint32_t begin = 0;
+    for (uint32_t i = 0; i < participants; ++i) {
+        uint32_t end = begin + share + (i < remainder ? 1 : 0);
+        m_ranges[i].bounds.store(PackRange(begin, end), std::memory_order_relaxed);
+        begin = end;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_task = task;
+    m_context = context;
+    m_participants = participants;
+    m_pendingWorkers = participants - 1;
+    ++m_generation;
+    WakeAllConditionVariable(&m_wake);
+    LeaveCriticalSection(&m_lock);
+
+    Drain(0);
+
+    EnterCriticalSection(&m_lock);
+    while (m_pendingWorkers != 0) {
+        SleepConditionVariableCS(&m_done, &m_lock, INFINITE);
+    }
+    m_task = nullptr;
+    m_context = nullptr;
+    LeaveCriticalSection(&m_lock);
+
+    LeaveCriticalSection(&m_runLock);
+}
+
+DWORD WINAPI VmWorkerPool::WorkerThreadProc(LPVOID parameter) {
+    VmWorkerPool* pool = static_cast<VmWorkerPool*>(parameter);
+    pool->WorkerLoop(pool->m_nextWorker.fetch_add(1, std::memory_order_relaxed));
+    return 0;
+}
+
+void VmWorkerPool::WorkerLoop(uint32_t participant) {
+    uint64_t seenGeneration = 0;
+
+    EnterCriticalSection(&m_lock);
+    for (;;) {
+        while (m_generation == seenGeneration && !m_stopping) {
+            SleepConditionVariableCS(&m_wake, &m_lock, INFINITE);
+        }
+        if (m_stopping) {
+            break;
+        }
+
+        seenGeneration = m_generation;
+        if (participant >= m_participants) {
+            continue;
+        }
+
+        LeaveCriticalSection(&m_lock);
+        Drain(participant);
+        EnterCriticalSection(&m_lock);
+
+        if (--m_pendingWorkers == 0) {
+            WakeAllConditionVariable(&m_done);
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void VmWorkerPool::Drain(uint32_t participant) {
+    t_insideBatch = true;
+    uint32_t index;
+    do {
+        while (TakeOwn(participant, index)) {
+            m_task(index, m_context);
+        }
+    } while (Steal(participant));
+    t_insideBatch = false;
+}
+
+bool VmWorkerPool::TakeOwn(uint32_t participant, uint32_t& index) {
+    std::atomic<uint64_t>& bounds = m_ranges[participant].bounds;
+    uint64_t current = bounds.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t begin = RangeBegin(current);
+        uint32_t end = RangeEnd(current);
+        if (begin >= end) {
+            return false;
+        }
+        if (bounds.compare_exchange_weak(current, PackRange(begin + 1, end), std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+            index = begin;
+            return true;
+        }
+    }
+}
+
+bool VmWorkerPool::Steal(uint32_t participant) {
+    // Start with the next participant so thieves spread out instead of all hitting slot 0
+    for (uint32_t offset = 1; offset < m_participants; ++offset) {
+        uint32_t victim = (participant + offset) % m_participants;
+        std::atomic<uint64_t>& bounds = m_ranges[victim].bounds;
+        uint64_t current = bounds.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t begin = RangeBegin(current);
+            uint32_t end = RangeEnd(current);
+            if (begin >= end) {
+                break;
+            }
+            uint32_t split = end - (end - begin + 1) / 2;
+            if (bounds.compare_exchange_weak(current, PackRange(begin, split), std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+                // Our own range is empty, so nobody else can be updating it
+                m_ranges[participant].bounds.store(PackRange(split, end), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
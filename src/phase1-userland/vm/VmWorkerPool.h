@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef CLRNET_VM_WORKER_POOL_H
+#define CLRNET_VM_WORKER_POOL_H
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace CLRNet {
+namespace Phase1 {
+namespace VM {
+
+// Persistent worker threads for CLRNet_VM_ExecuteBatch.
+// A batch is split into one contiguous index range per participant. Participants take indices from
+// the front of their own range and, once it is empty, steal the back half of another one.
+class VmWorkerPool {
+public:
+    typedef void (*Task)(uint32_t index, void* context);
+
+    VmWorkerPool();
+    ~VmWorkerPool();
+
+    // workerCount excludes the calling thread, which always takes part in Run
+    bool Initialize(uint32_t workerCount);
+    void Shutdown();
+
+    uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_threads.size()); }
+
+    // Runs task(i, context) for every i in [0, count) on up to `parallelism` threads (0 = all)
+    // and returns once every index has completed. Concurrent calls are serialised.
+    void Run(uint32_t count, uint32_t parallelism, Task task, void* context);
+
+private:
+    // begin in the low 32 bits, end in the high 32 bits, so both move with one CAS
+    struct alignas(64) WorkRange {
+        std::atomic<uint64_t> bounds;
+    };
+
+    static DWORD WINAPI WorkerThreadProc(LPVOID parameter);
+    void WorkerLoop(uint32_t participant);
+    void Drain(uint32_t participant);
+    bool TakeOwn(uint32_t participant, uint32_t& index);
+    bool Steal(uint32_t participant);
+
+    CRITICAL_SECTION m_runLock;
+    CRITICAL_SECTION m_lock;
+    CONDITION_VARIABLE m_wake;
+    CONDITION_VARIABLE m_done;
+    std::vector<HANDLE> m_threads;
+    std::atomic<uint32_t> m_nextWorker;
+    bool m_stopping;
+
+    // Current batch; written under m_lock before m_generation is bumped
+    uint64_t m_generation;
+    Task m_task;
+    void* m_context;
+    uint32_t m_participants;
+    uint32_t m_pendingWorkers;
+    std::unique_ptr<WorkRange[]> m_ranges;
+};
+
+} // namespace VM
+} // namespace Phase1
+} // namespace CLRNet
+
+#endif // CLRNET_VM_WORKER_POOL_H
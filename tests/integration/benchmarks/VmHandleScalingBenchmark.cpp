@@ -0,0 +1,109 @@
+// Multi-threaded execution benchmark for the userspace IL VM.
+// Every thread executes the same program handle, so the numbers expose any contention on the
+// handle lookup path. With the lock-free handle table throughput should scale close to linearly
+// with the thread count until the cores are saturated.
+
+#include "../../../src/phase1-userland/vm/VirtualMachine.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace CLRNet::Phase1::VM;
+
+namespace {
+
+const uint32_t IterationsPerThread = 2000000;
+
+struct WorkerState {
+    void* handle;
+    uint32_t iterations;
+    uint32_t failures;
+};
+
+DWORD WINAPI WorkerProc(LPVOID parameter) {
+    WorkerState* state = static_cast<WorkerState*>(parameter);
+
+    for (uint32_t i = 0; i < state->iterations; ++i) {
+        VmValue argument(static_cast<int32_t>(i));
+        VmExecutionContextNative context = {};
+        context.arguments = &argument;
+        context.argumentCount = 1;
+
+        VmExecutionResultNative result = {};
+        if (FAILED(CLRNet_VM_Execute(state->handle, &context, &result)) ||
+            static_cast<int32_t>(reinterpret_cast<intptr_t>(result.returnValue)) != static_cast<int32_t>(i + 1)) {
+            ++state->failures;
+        }
+    }
+    return 0;
+}
+
+double RunWithThreads(void* handle, uint32_t threadCount, uint32_t& failures) {
+    std::vector<WorkerState> states(threadCount);
+    std::vector<HANDLE> threads(threadCount);
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        states[i].handle = handle;
+        states[i].iterations = IterationsPerThread;
+        states[i].failures = 0;
+        threads[i] = CreateThread(nullptr, 0, WorkerProc, &states[i], 0, nullptr);
+    }
+    WaitForMultipleObjects(threadCount, threads.data(), TRUE, INFINITE);
+
+    QueryPerformanceCounter(&end);
+
+    failures = 0;
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        CloseHandle(threads[i]);
+        failures += states[i].failures;
+    }
+
+    double seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    return static_cast<double>(threadCount) * IterationsPerThread / seconds;
+}
+
+} // namespace
+
+int main() {
+    // ldarg.0; ldc.i4.1; add; ret
+    const unsigned char body[] = { 0x02, 0x17, 0x58, 0x2A };
+    unsigned char il[1 + sizeof(body)];
+    il[0] = static_cast<unsigned char>((sizeof(body) << 2) | 0x2);
+    memcpy(il + 1, body, sizeof(body));
+
+    void* handle = nullptr;
+    if (FAILED(CLRNet_VM_CompileIL(il, sizeof(il), "bench-handle-scaling", &handle))) {
+        printf("Failed to compile benchmark program\n");
+        return 1;
+    }
+
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    uint32_t maxThreads = systemInfo.dwNumberOfProcessors;
+
+    printf("%-8s %16s %10s\n", "Threads", "Executions/sec", "Speedup");
+
+    double baseline = 0.0;
+    int exitCode = 0;
+    for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        uint32_t failures = 0;
+        double rate = RunWithThreads(handle, threadCount, failures);
+        if (threadCount == 1) {
+            baseline = rate;
+        }
+        printf("%-8u %16.0f %9.2fx\n", threadCount, rate, rate / baseline);
+        if (failures != 0) {
+            printf("  %u executions returned a wrong result\n", failures);
+            exitCode = 1;
+        }
+    }
+
+    CLRNet_VM_Release(handle);
+    return exitCode;
+}
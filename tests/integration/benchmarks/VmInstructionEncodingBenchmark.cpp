@@ -0,0 +1,152 @@
+// Instruction encoding benchmark for the userspace IL VM.
+// Compiles one long straight-line loop body, so the bytecode the interpreter walks is far larger
+// than the L1 data cache, then reports the in-memory instruction footprint, the size of the
+// program's .vmc cache entry and interpreter throughput. Run it on builds before and after an
+// encoding change to compare dispatch speed and cache size.
+
+#include "../../../src/phase1-userland/vm/VirtualMachine.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace CLRNet::Phase1::VM;
+
+namespace {
+
+const uint32_t BodyBlocks = 1024;
+const int32_t Iterations = 16;
+const uint32_t Executions = 2000;
+const char* CacheKey = "bench-instruction-encoding";
+
+void Emit(std::vector<unsigned char>& code, std::initializer_list<unsigned char> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+void EmitInt32(std::vector<unsigned char>& code, int32_t value) {
+    unsigned char bytes[4];
+    memcpy(bytes, &value, sizeof(bytes));
+    code.insert(code.end(), bytes, bytes + 4);
+}
+
+// s = 0; for (i = 0; i < arg0; i++) { s = s * 3 + i; ... BodyBlocks times } return s;
+std::vector<unsigned char> BuildMethod() {
+    std::vector<unsigned char> code;
+    Emit(code, { 0x16, 0x0A, 0x16, 0x0B });          // ldc.i4.0; stloc.0; ldc.i4.0; stloc.1
+    Emit(code, { 0x38 });                            // br <condition>
+    size_t branchOperand = code.size();
+    EmitInt32(code, 0);
+
+    size_t body = code.size();
+    for (uint32_t i = 0; i < BodyBlocks; ++i) {
+        Emit(code, { 0x06, 0x19, 0x5A, 0x07, 0x58, 0x0A });   // ldloc.0; ldc.i4.3; mul; ldloc.1; add; stloc.0
+    }
+    Emit(code, { 0x07, 0x17, 0x58, 0x0B });          // ldloc.1; ldc.i4.1; add; stloc.1
+
+    size_t condition = code.size();
+    int32_t forward = static_cast<int32_t>(condition - (branchOperand + 4));
+    memcpy(&code[branchOperand], &forward, sizeof(forward));
+    Emit(code, { 0x07, 0x02, 0x3F });                // ldloc.1; ldarg.0; blt <body>
+    EmitInt32(code, static_cast<int32_t>(body) - static_cast<int32_t>(code.size() + 4));
+    Emit(code, { 0x06, 0x2A });                      // ldloc.0; ret
+
+    // Fat header: flags 0x3003 (fat format, 3-dword header), max stack, code size, no locals signature
+    std::vector<unsigned char> method(12);
+    uint16_t flags = 0x3003;
+    uint16_t maxStack = 8;
+    uint32_t codeSize = static_cast<uint32_t>(code.size());
+    memcpy(&method[0], &flags, sizeof(flags));
+    memcpy(&method[2], &maxStack, sizeof(maxStack));
+    memcpy(&method[4], &codeSize, sizeof(codeSize));
+    method.insert(method.end(), code.begin(), code.end());
+    return method;
+}
+
+int32_t Expected(int32_t iterations) {
+    uint32_t s = 0;
+    for (int32_t i = 0; i < iterations; ++i) {
+        for (uint32_t block = 0; block < BodyBlocks; ++block) {
+            s = s * 3u + static_cast<uint32_t>(i);
+        }
+    }
+    return static_cast<int32_t>(s);
+}
+
+// Size of the program's cache entry, or -1 when the cache directory is unavailable
+long long CacheEntrySize() {
+    wchar_t buffer[MAX_PATH];
+    DWORD length = GetModuleFileNameW(nullptr, buffer, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) {
+        return -1;
+    }
+
+    std::wstring path(buffer, length);
+    path = path.substr(0, path.find_last_of(L"\\/") + 1) + L"LocalCache\\VmBytecode\\";
+    path.append(CacheKey, CacheKey + strlen(CacheKey));
+#ifdef CLRNET_VM_COMPACT_VALUES
+    path += L".compact.vmc";
+#else
+    path += L".vmc";
+#endif
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes)) {
+        return -1;
+    }
+    return (static_cast<long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+}
+
+} // namespace
+
+int main() {
+    std::vector<unsigned char> method = BuildMethod();
+
+    void* handle = nullptr;
+    if (FAILED(CLRNet_VM_CompileIL(method.data(), static_cast<DWORD>(method.size()), CacheKey, &handle))) {
+        printf("Failed to compile benchmark program\n");
+        return 1;
+    }
+
+    VmValue argument(Iterations);
+    VmValue locals[2];
+    int32_t expected = Expected(Iterations);
+    uint32_t failures = 0;
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    for (uint32_t i = 0; i < Executions; ++i) {
+        VmExecutionContextNative context = {};
+        context.arguments = &argument;
+        context.argumentCount = 1;
+        context.locals = locals;
+        context.localCount = 2;
+
+        VmExecutionResultNative result = {};
+        if (FAILED(CLRNet_VM_Execute(handle, &context, &result)) ||
+            static_cast<int32_t>(reinterpret_cast<intptr_t>(result.returnValue)) != expected) {
+            ++failures;
+        }
+    }
+    QueryPerformanceCounter(&end);
+
+    double seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    double instructions = static_cast<double>(Executions) * Iterations * (BodyBlocks * 6 + 7);
+
+    long long cacheBytes = CacheEntrySize();
+    printf("%12s %14s %16s\n", "Instruction", ".vmc entry", "IL instrs/sec");
+    if (cacheBytes < 0) {
+        printf("%11zuB %14s %16.0f\n", sizeof(VmInstruction), "n/a", instructions / seconds);
+    } else {
+        printf("%11zuB %13lldB %16.0f\n", sizeof(VmInstruction), cacheBytes, instructions / seconds);
+    }
+
+    CLRNet_VM_Release(handle);
+    if (failures != 0) {
+        printf("  %u executions returned a wrong result\n", failures);
+        return 1;
+    }
+    return 0;
+}
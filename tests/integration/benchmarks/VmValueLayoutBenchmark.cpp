@@ -0,0 +1,91 @@
+// Value layout benchmark for the userspace IL VM.
+// Build it once as is and once with CLRNET_VM_COMPACT_VALUES defined (for the VM as well) to
+// compare the 16-byte and the 8-byte NaN-boxed VmValue. Each execution reads a block of
+// arguments from a working set far larger than the caches, so the numbers show how much the
+// smaller values save in memory traffic on top of the footprint reported up front.
+
+#include "../../../src/phase1-userland/vm/VirtualMachine.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace CLRNet::Phase1::VM;
+
+namespace {
+
+const uint32_t ArgumentsPerCall = 4;
+const uint32_t WorkingSetBlocks = 1 << 20;
+const uint32_t Passes = 4;
+
+double MeasureWorkingSet(void* handle, const std::vector<VmValue>& arguments, uint32_t& failures) {
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    failures = 0;
+    for (uint32_t pass = 0; pass < Passes; ++pass) {
+        // Stride through the blocks so consecutive executions never share a cache line
+        for (uint32_t i = 0; i < WorkingSetBlocks; ++i) {
+            uint32_t block = (i * 7919u) % WorkingSetBlocks;
+            VmExecutionContextNative context = {};
+            context.arguments = const_cast<VmValue*>(&arguments[block * ArgumentsPerCall]);
+            context.argumentCount = ArgumentsPerCall;
+
+            VmExecutionResultNative result = {};
+            int32_t expected = static_cast<int32_t>(block) * 4 + 6;
+            if (FAILED(CLRNet_VM_Execute(handle, &context, &result)) ||
+                static_cast<int32_t>(reinterpret_cast<intptr_t>(result.returnValue)) != expected) {
+                ++failures;
+            }
+        }
+    }
+
+    QueryPerformanceCounter(&end);
+    double seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    return static_cast<double>(Passes) * WorkingSetBlocks / seconds;
+}
+
+} // namespace
+
+int main() {
+    // ldarg.0; ldarg.1; add; ldarg.2; add; ldarg.3; add; ret
+    const unsigned char body[] = { 0x02, 0x03, 0x58, 0x04, 0x58, 0x05, 0x58, 0x2A };
+    unsigned char il[1 + sizeof(body)];
+    il[0] = static_cast<unsigned char>((sizeof(body) << 2) | 0x2);
+    memcpy(il + 1, body, sizeof(body));
+
+    void* handle = nullptr;
+    if (FAILED(CLRNet_VM_CompileIL(il, sizeof(il), "bench-value-layout", &handle))) {
+        printf("Failed to compile benchmark program\n");
+        return 1;
+    }
+
+    std::vector<VmValue> arguments(static_cast<size_t>(WorkingSetBlocks) * ArgumentsPerCall);
+    for (uint32_t block = 0; block < WorkingSetBlocks; ++block) {
+        for (uint32_t slot = 0; slot < ArgumentsPerCall; ++slot) {
+            arguments[block * ArgumentsPerCall + slot] = VmValue(static_cast<int32_t>(block + slot));
+        }
+    }
+
+#ifdef CLRNET_VM_COMPACT_VALUES
+    const char* layout = "compact";
+#else
+    const char* layout = "wide";
+#endif
+
+    printf("%-10s %8s %14s %16s\n", "Layout", "Value", "Working set", "Executions/sec");
+
+    uint32_t failures = 0;
+    double rate = MeasureWorkingSet(handle, arguments, failures);
+    printf("%-10s %7zuB %12.1fMB %16.0f\n", layout, sizeof(VmValue),
+           arguments.size() * sizeof(VmValue) / (1024.0 * 1024.0), rate);
+
+    CLRNet_VM_Release(handle);
+    if (failures != 0) {
+        printf("  %u executions returned a wrong result\n", failures);
+        return 1;
+    }
+    return 0;
+}
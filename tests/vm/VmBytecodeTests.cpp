@@ -0,0 +1,389 @@
+// Compiler-side tests for the userspace IL VM: superinstruction fusion, verification, box/unbox
+// elimination, switch and branch decoding, array bounds-check hoisting, bytecode containers,
+// wide constants, local signatures and call signatures.
+
+#include "VmTestSupport.h"
+#include "../../src/phase1-userland/vm/BytecodeCompiler.h"
+#include "../../src/phase1-userland/vm/VmBytecodeFormat.h"
+
+#include <cmath>
+
+using namespace VmTests;
+
+namespace {
+
+// int sum = 0; for (int i = 0; i < arg0; i++) sum += i; return sum;
+const std::vector<unsigned char> SumLoop = {
+    0x16, 0x0A, 0x16, 0x0B, 0x2B, 0x08,             // ldc.i4.0 stloc.0 ldc.i4.0 stloc.1 br.s COND
+    0x06, 0x07, 0x58, 0x0A,                         // LOOP: ldloc.0 ldloc.1 add stloc.0
+    0x07, 0x17, 0x58, 0x0B,                         // ldloc.1 ldc.i4.1 add stloc.1
+    0x07, 0x02, 0xFE, 0x04, 0x2D, 0xF2,             // COND: ldloc.1 ldarg.0 clt brtrue.s LOOP
+    0x06, 0x2A};                                    // ldloc.0 ret
+
+// int[] a = new int[arg0]; for (i...) a[i] = i * 2; for (j...) s += a[j]; return s;
+const std::vector<unsigned char> ArraySum = {
+    0x02, 0x8D, VM_I4(0x01000001), 0x0A, 0x16, 0x0B, 0x2B, 0x0A,
+    0x06, 0x07, 0x07, 0x18, 0x5A, 0x9E, 0x07, 0x17, 0x58, 0x0B, 0x07, 0x06, 0x8E, 0x69, 0x32, 0xF0,
+    0x16, 0x0C, 0x16, 0x0D, 0x2B, 0x0A,
+    0x08, 0x06, 0x09, 0x94, 0x58, 0x0C, 0x09, 0x17, 0x58, 0x0D, 0x09, 0x06, 0x8E, 0x69, 0x32, 0xF0, 0x08, 0x2A};
+
+long g_typeCasts = 0;
+
+bool CountTypeCast(uint32_t, VmValue&, void*) {
+    ++g_typeCasts;
+    return true;
+}
+
+const uint8_t IntDoubleObjectLocals[] = {0x07, 0x03, 0x08, 0x0D, 0x1C};
+
+bool ResolveLocalSignature(uint32_t token, const uint8_t** signature, uint32_t* length, void*) {
+    if (token != 0x11000001) {
+        return false;
+    }
+    *signature = IntDoubleObjectLocals;
+    *length = sizeof(IntDoubleObjectLocals);
+    return true;
+}
+
+// static int Add(int, int); instance void Log(int); instance .ctor(int)
+const uint8_t StaticAddSignature[] = {0x00, 0x02, 0x08, 0x08, 0x08};
+const uint8_t InstanceVoidSignature[] = {0x20, 0x01, 0x01, 0x08};
+
+bool ResolveMethodSignature(uint32_t token, const uint8_t** signature, uint32_t* length, void*) {
+    switch (token) {
+    case 0x0A000001:
+        *signature = StaticAddSignature;
+        *length = sizeof(StaticAddSignature);
+        return true;
+    case 0x0A000002:
+    case 0x0A000003:
+        *signature = InstanceVoidSignature;
+        *length = sizeof(InstanceVoidSignature);
+        return true;
+    }
+    return false;
+}
+
+// Returns a value for every token, including the void one; 0x0A000001 returns nothing for 0
+bool ReturnSum(uint32_t, void*, VmValue* arguments, uint32_t argumentCount, VmValue& returnValue, void*) {
+    if (argumentCount == 2 && arguments[0].GetInt32() == 0) {
+        return true;
+    }
+    returnValue = VmValue(argumentCount == 2 ? arguments[0].GetInt32() + arguments[1].GetInt32() : int32_t(-1));
+    return true;
+}
+
+VmBytecodeInstruction Bytecode(VmOpcode opcode, int32_t operand0 = 0) {
+    VmBytecodeInstruction instruction = {};
+    instruction.opcode = static_cast<uint8_t>(opcode);
+    instruction.operand0 = operand0;
+    return instruction;
+}
+
+std::vector<uint8_t> BytecodeContainer(const std::vector<VmBytecodeInstruction>& code, uint32_t arguments,
+                                       uint32_t locals, uint16_t majorVersion = 1) {
+    VmBytecodeHeader header = {};
+    header.magic = VmBytecodeMagic;
+    header.majorVersion = majorVersion;
+    header.headerSize = sizeof(header);
+    header.argumentCount = arguments;
+    header.localCount = locals;
+    header.instructionCount = static_cast<uint32_t>(code.size());
+
+    std::vector<uint8_t> container(sizeof(header) + code.size() * sizeof(VmBytecodeInstruction));
+    memcpy(container.data(), &header, sizeof(header));
+    memcpy(container.data() + sizeof(header), code.data(), code.size() * sizeof(VmBytecodeInstruction));
+    return container;
+}
+
+void TestSuperinstructionFusion() {
+    ILVirtualMachine vm;
+    vm.Initialize();
+    std::vector<unsigned char> method = TinyMethod(SumLoop);
+    std::shared_ptr<VmProgram> program = vm.Compile(method.data(), method.size(), "");
+    VM_CHECK(program != nullptr);
+    if (!program) {
+        return;
+    }
+
+    // clt + brtrue fuse into one compare-and-branch, the counter increment into AddLocalConstant
+    VM_CHECK_EQ(1, CountOpcode(*program, VmOpcode::BranchIfLessThan));
+    VM_CHECK_EQ(1, CountOpcode(*program, VmOpcode::AddLocalConstant));
+    VM_CHECK_EQ(0, CountOpcode(*program, VmOpcode::CompareLessThan));
+
+    VmExecutionContext context;
+    context.arguments.push_back(VmValue(int32_t(100)));
+    VmExecutionResult result;
+    VM_CHECK(vm.Execute(*program, context, result));
+    VM_CHECK_EQ(4950, reinterpret_cast<intptr_t>(result.returnValue));
+}
+
+void TestVerifier() {
+    ILVirtualMachine vm;
+    vm.Initialize();
+    std::vector<unsigned char> method = TinyMethod(SumLoop);
+    std::shared_ptr<VmProgram> program = vm.Compile(method.data(), method.size(), "");
+    VM_CHECK(program && program->verified);
+    if (!program) {
+        return;
+    }
+
+    VmProgram corrupted = *program;
+    for (VmInstruction& instruction : corrupted.instructions) {
+        if (instruction.opcode == VmOpcode::LoadLocal) {
+            instruction.operand0 = 9;
+            break;
+        }
+    }
+    VM_CHECK(!BytecodeCompiler::Verify(corrupted));
+
+    // ldc.i4.0; add; ret underflows, so it stays on the checked interpreter and fails there
+    std::vector<unsigned char> underflow = TinyMethod({0x16, 0x58, 0x2A});
+    std::shared_ptr<VmProgram> unverified = vm.Compile(underflow.data(), underflow.size(), "");
+    VM_CHECK(unverified && !unverified->verified);
+    if (unverified) {
+        VmExecutionContext context;
+        VmExecutionResult result;
+        VM_CHECK(!vm.Execute(*unverified, context, result));
+    }
+}
+
+void TestBoxUnboxElimination() {
+    VmHostCallbacks callbacks;
+    callbacks.typeCastCallback = CountTypeCast;
+    Instance instance(&callbacks);
+    const uint32_t type = 0x1B000001;
+    const uint32_t otherType = 0x1B000002;
+
+    // ldarg.0; box T; unbox.any T; ldc.i4.1; add; ret
+    void* pair = instance.Compile(TinyMethod({0x02, 0x8C, VM_I4(type), 0xA5, VM_I4(type), 0x17, 0x58, 0x2A}));
+    g_typeCasts = 0;
+    VM_CHECK_EQ(42, instance.ExecuteInt32(pair, {VmValue(int32_t(41))}));
+    VM_CHECK_EQ(0, g_typeCasts);
+
+    // Different tokens: the host must still check the cast
+    void* mismatch = instance.Compile(TinyMethod({0x02, 0x8C, VM_I4(type), 0xA5, VM_I4(otherType), 0x17, 0x58, 0x2A}));
+    g_typeCasts = 0;
+    instance.ExecuteInt32(mismatch, {VmValue(int32_t(41))});
+    VM_CHECK(g_typeCasts > 0);
+}
+
+void TestSwitchAndBranches() {
+    Instance instance;
+
+    // ldarg.0; switch (L0, L1, L2); ldc.i4.s 99; ret; L0: 10; L1: 20; L2: 30
+    void* table = instance.Compile(TinyMethod({0x02, 0x45, VM_I4(3), VM_I4(3), VM_I4(6), VM_I4(9),
+                                               0x1F, 99, 0x2A, 0x1F, 10, 0x2A, 0x1F, 20, 0x2A, 0x1F, 30, 0x2A}));
+    const int expected[] = {99, 10, 20, 30, 99};
+    for (int value = -1; value <= 3; ++value) {
+        VM_CHECK_EQ(expected[value + 1], instance.ExecuteInt32(table, {VmValue(int32_t(value))}));
+    }
+
+    // ldarg.0; ldarg.1; <branch> +2; ldc.i4.0; ret; ldc.i4.1; ret, for blt, bge.un and bge
+    void* lessThan = instance.Compile(TinyMethod({0x02, 0x03, 0x3F, VM_I4(2), 0x16, 0x2A, 0x17, 0x2A}));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(lessThan, {VmValue(int32_t(-1)), VmValue(int32_t(1))}));
+    VM_CHECK_EQ(0, instance.ExecuteInt32(lessThan, {VmValue(int32_t(2)), VmValue(int32_t(1))}));
+
+    void* unsignedGreaterOrEqual = instance.Compile(TinyMethod({0x02, 0x03, 0x34, 0x02, 0x16, 0x2A, 0x17, 0x2A}));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(unsignedGreaterOrEqual, {VmValue(int32_t(-1)), VmValue(int32_t(1))}));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(unsignedGreaterOrEqual, {VmValue(std::nan("")), VmValue(1.0)}));
+
+    void* greaterOrEqual = instance.Compile(TinyMethod({0x02, 0x03, 0x2F, 0x02, 0x16, 0x2A, 0x17, 0x2A}));
+    VM_CHECK_EQ(0, instance.ExecuteInt32(greaterOrEqual, {VmValue(std::nan("")), VmValue(1.0)}));
+
+    // A switch target outside the method is rejected at compile time
+    VM_CHECK(instance.Compile(TinyMethod({0x02, 0x45, VM_I4(1), VM_I4(100), 0x2A})) == nullptr);
+
+    // Tables too long for op1: ldarg.0; switch (40000 cases, the last to L1); ldc.i4.0; ret; L1: ldc.i4.1; ret
+    const uint32_t cases = 40000;
+    std::vector<unsigned char> code = {0x02, 0x45, VM_I4(cases)};
+    for (uint32_t i = 0; i < cases; ++i) {
+        int32_t target = i + 1 == cases ? 2 : 0;
+        code.insert(code.end(), {VM_I4(target)});
+    }
+    code.insert(code.end(), {0x16, 0x2A, 0x17, 0x2A});
+    void* wide = instance.Compile(FatMethod(code, 0));
+    VM_CHECK(wide != nullptr);
+    VM_CHECK_EQ(0, instance.ExecuteInt32(wide, {VmValue(int32_t(0))}));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(wide, {VmValue(int32_t(cases - 1))}));
+    VM_CHECK_EQ(0, instance.ExecuteInt32(wide, {VmValue(int32_t(cases))}));
+}
+
+void TestBoundsCheckHoisting() {
+    ScopedCollector collector;
+
+    // Both counted loops index with their own counter, so every access is proven in range
+    BytecodeCompiler compiler;
+    compiler.Initialize();
+    std::vector<unsigned char> method = TinyMethod(ArraySum);
+    std::shared_ptr<VmProgram> program = compiler.Compile(method.data(), method.size(), "");
+    VM_CHECK(program != nullptr);
+    if (program) {
+        VM_CHECK_EQ(1, CountOpcode(*program, VmOpcode::StoreElementUnchecked));
+        VM_CHECK_EQ(1, CountOpcode(*program, VmOpcode::LoadElementUnchecked));
+        VM_CHECK_EQ(0, CountOpcode(*program, VmOpcode::LoadElement) + CountOpcode(*program, VmOpcode::StoreElement));
+    }
+
+    Instance instance;
+    void* sum = instance.Compile(method);
+    for (int length : {0, 1, 10, 1000}) {
+        VM_CHECK_EQ(length * (length - 1), instance.ExecuteInt32(sum, {VmValue(int32_t(length))}));
+    }
+
+    // new int[3][3] has no loop to prove it, so the access keeps its check and fails
+    std::vector<unsigned char> outOfRange = TinyMethod({0x19, 0x8D, VM_I4(1), 0x19, 0x94, 0x2A});
+    program = compiler.Compile(outOfRange.data(), outOfRange.size(), "");
+    VM_CHECK(program && CountOpcode(*program, VmOpcode::LoadElement) == 1);
+    VmExecutionResultNative result;
+    VM_CHECK(FAILED(instance.Execute(instance.Compile(outOfRange), {}, result)));
+
+    // stelem.i1 truncates; ldelem.u1 and ldelem.i1 reread the byte unsigned and signed
+    void* unsignedByte = instance.Compile(TinyMethod({0x17, 0x8D, VM_I4(1), 0x0A, 0x06, 0x16, 0x02, 0x9C, 0x06, 0x16, 0x91, 0x2A}));
+    void* signedByte = instance.Compile(TinyMethod({0x17, 0x8D, VM_I4(1), 0x0A, 0x06, 0x16, 0x02, 0x9C, 0x06, 0x16, 0x90, 0x2A}));
+    VM_CHECK_EQ(44, instance.ExecuteInt32(unsignedByte, {VmValue(int32_t(300))}));
+    VM_CHECK_EQ(-56, instance.ExecuteInt32(signedByte, {VmValue(int32_t(200))}));
+}
+
+void TestBytecodeContainers() {
+    // The sum loop, pre-lowered
+    std::vector<VmBytecodeInstruction> code = {
+        Bytecode(VmOpcode::LoadConstantI4, 0), Bytecode(VmOpcode::StoreLocal, 0),
+        Bytecode(VmOpcode::LoadConstantI4, 0), Bytecode(VmOpcode::StoreLocal, 1), Bytecode(VmOpcode::Branch, 13),
+        Bytecode(VmOpcode::LoadLocal, 0), Bytecode(VmOpcode::LoadLocal, 1), Bytecode(VmOpcode::Add), Bytecode(VmOpcode::StoreLocal, 0),
+        Bytecode(VmOpcode::LoadLocal, 1), Bytecode(VmOpcode::LoadConstantI4, 1), Bytecode(VmOpcode::Add), Bytecode(VmOpcode::StoreLocal, 1),
+        Bytecode(VmOpcode::LoadLocal, 1), Bytecode(VmOpcode::LoadArgument, 0), Bytecode(VmOpcode::BranchIfLessThan, 5),
+        Bytecode(VmOpcode::LoadLocal, 0), Bytecode(VmOpcode::Return)};
+
+    Instance instance;
+    auto load = [&](const std::vector<uint8_t>& container) {
+        void* handle = nullptr;
+        HRESULT hr = CLRNet_VM_InstanceLoadBytecode(instance.Get(), container.data(), static_cast<DWORD>(container.size()),
+                                                    nullptr, &handle);
+        return SUCCEEDED(hr) ? handle : nullptr;
+    };
+
+    void* handle = load(BytecodeContainer(code, 1, 2));
+    VM_CHECK(handle != nullptr);
+    VM_CHECK_EQ(4950, instance.ExecuteInt32(handle, {VmValue(int32_t(100))}));
+
+    VM_CHECK(load(BytecodeContainer(code, 1, 2, 2)) == nullptr);
+
+    std::vector<uint8_t> truncated = BytecodeContainer(code, 1, 2);
+    truncated.pop_back();
+    VM_CHECK(load(truncated) == nullptr);
+
+    std::vector<VmBytecodeInstruction> badBranch = code;
+    badBranch[4] = Bytecode(VmOpcode::Branch, 99);
+    VM_CHECK(load(BytecodeContainer(badBranch, 1, 2)) == nullptr);
+
+    // Quickened and field-direct opcodes are the VM's own state and never come from a container
+    std::vector<VmBytecodeInstruction> quickened = code;
+    quickened[7] = Bytecode(VmOpcode::AddI4);
+    VM_CHECK(load(BytecodeContainer(quickened, 1, 2)) == nullptr);
+}
+
+void TestWideConstants() {
+    Instance instance;
+
+    // ldc.i8 0x123456789ABCDEF0; conv.i4; ret
+    void* low = instance.Compile(TinyMethod({0x21, VM_I8(0x123456789ABCDEF0ull), 0x69, 0x2A}));
+    VM_CHECK_EQ(static_cast<int32_t>(0x9ABCDEF0u), instance.ExecuteInt32(low, {}));
+
+    // ldc.i4 0x7fffffff; ret
+    void* maximum = instance.Compile(TinyMethod({0x20, VM_I4(0x7fffffff), 0x2A}));
+    VM_CHECK_EQ(0x7fffffff, instance.ExecuteInt32(maximum, {}));
+
+    // long.MaxValue + 1 == long.MinValue
+    void* wraps = instance.Compile(TinyMethod({0x21, VM_I8(0x7fffffffffffffffull), 0x21, VM_I8(1ull), 0x58,
+                                               0x21, VM_I8(0x8000000000000000ull), 0x2E, 0x02, 0x16, 0x2A, 0x17, 0x2A}));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(wraps, {}));
+}
+
+void TestLocalSignatures() {
+    VmHostCallbacks callbacks;
+    callbacks.localSignatureCallback = ResolveLocalSignature;
+    Instance instance(&callbacks);
+
+    // Locals (int, double, object): ldloc.0 starts at 0, ldloc.2 at null
+    void* intLocal = instance.Compile(FatMethod({0x06, 0x1B, 0x58, 0x2A}, 0x11000001));
+    VM_CHECK_EQ(5, instance.ExecuteInt32(intLocal, {}));
+
+    void* objectLocal = instance.Compile(FatMethod({0x08, 0x14, 0xFE, 0x01, 0x2A}, 0x11000001));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(objectLocal, {}));
+
+    // ldloc.1 (double 0.0) + 1.5, conv.i4
+    void* doubleLocal = instance.Compile(FatMethod({0x07, 0x23, VM_I8(0x3FF8000000000000ull), 0x58, 0x69, 0x2A}, 0x11000001));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(doubleLocal, {}));
+
+    // ldloc.3 is not declared by the signature
+    VM_CHECK(instance.Compile(FatMethod({0x09, 0x2A}, 0x11000001)) == nullptr);
+
+    // An instance without the callback infers its locals, and doesn't share a program with one that has it
+    Instance inferring;
+    VM_CHECK(inferring.Compile(FatMethod({0x09, 0x2A}, 0x11000001), "shared-locals") != nullptr);
+    VM_CHECK(instance.Compile(FatMethod({0x09, 0x2A}, 0x11000001), "shared-locals") == nullptr);
+}
+
+void TestCallSignatures() {
+    VmHostCallbacks callbacks;
+    callbacks.methodSignatureCallback = ResolveMethodSignature;
+    callbacks.managedCallCallback = ReturnSum;
+    ILVirtualMachine vm;
+    vm.SetHostCallbacks(callbacks);
+    vm.Initialize();
+
+    // ldarg.0; ldarg.0; call Add; ldarg.0; call Log; ldarg.0; ret: pops two, pushes one, then pops one
+    std::vector<unsigned char> method = TinyMethod({0x02, 0x02, 0x28, VM_I4(0x0A000001), 0x02,
+                                                    0x28, VM_I4(0x0A000002), 0x02, 0x2A});
+    std::shared_ptr<VmProgram> program = vm.Compile(method.data(), method.size(), "");
+    VM_CHECK(program && program->verified);
+    if (!program) {
+        return;
+    }
+    VM_CHECK_EQ(2, program->maxStackDepth);
+
+    // Log's value is dropped, as its signature says it returns none
+    VmExecutionContext context;
+    context.arguments.push_back(VmValue(int32_t(4)));
+    VmExecutionResult result;
+    VM_CHECK(vm.Execute(*program, context, result));
+    VM_CHECK_EQ(4, reinterpret_cast<intptr_t>(result.returnValue));
+
+    // Add returning nothing leaves the verified stack short, so the call fails
+    context.arguments[0] = VmValue(int32_t(0));
+    VM_CHECK(!vm.Execute(*program, context, result));
+
+    // ldc.i4.5; newobj .ctor(int); ret pushes the new object
+    std::vector<unsigned char> construct = TinyMethod({0x1B, 0x73, VM_I4(0x0A000003), 0x2A});
+    std::shared_ptr<VmProgram> constructed = vm.Compile(construct.data(), construct.size(), "");
+    VM_CHECK(constructed && constructed->verified && constructed->maxStackDepth == 1);
+
+    // An unresolved target leaves the whole method unverified, and a static signature can't construct
+    std::vector<unsigned char> unknown = TinyMethod({0x02, 0x28, VM_I4(0x0A000004), 0x2A});
+    std::shared_ptr<VmProgram> unverified = vm.Compile(unknown.data(), unknown.size(), "");
+    VM_CHECK(unverified && !unverified->verified);
+    std::vector<unsigned char> staticConstruct = TinyMethod({0x02, 0x02, 0x73, VM_I4(0x0A000001), 0x2A});
+    unverified = vm.Compile(staticConstruct.data(), staticConstruct.size(), "");
+    VM_CHECK(unverified && !unverified->verified);
+
+    // Without the callback nothing that calls verifies
+    ILVirtualMachine plain;
+    plain.Initialize();
+    std::shared_ptr<VmProgram> hosted = plain.Compile(method.data(), method.size(), "");
+    VM_CHECK(hosted && !hosted->verified);
+}
+
+} // namespace
+
+int main() {
+    RunTest("SuperinstructionFusion", TestSuperinstructionFusion);
+    RunTest("Verifier", TestVerifier);
+    RunTest("BoxUnboxElimination", TestBoxUnboxElimination);
+    RunTest("SwitchAndBranches", TestSwitchAndBranches);
+    RunTest("BoundsCheckHoisting", TestBoundsCheckHoisting);
+    RunTest("BytecodeContainers", TestBytecodeContainers);
+    RunTest("WideConstants", TestWideConstants);
+    RunTest("LocalSignatures", TestLocalSignatures);
+    RunTest("CallSignatures", TestCallSignatures);
+    return Report();
+}
@@ -0,0 +1,333 @@
+// Call tests for the userspace IL VM: callvirt inline caches, suspending on pending host calls,
+// direct calls between programs, per-handle bindings and pre-bound host functions.
+
+#include "VmTestSupport.h"
+
+using namespace VmTests;
+
+namespace {
+
+// int Fib(int n) => n < 2 ? n : Fib(n - 1) + Fib(n - 2), both calls through token 0x0A000001
+const std::vector<unsigned char> Fibonacci = {
+    0x02, 0x18, 0xFE, 0x04, 0x2C, 0x02, 0x02, 0x2A,
+    0x02, 0x17, 0x59, 0x28, VM_I4(0x0A000001),
+    0x02, 0x18, 0x59, 0x28, VM_I4(0x0A000001), 0x58, 0x2A};
+
+struct TestObject {
+    void* methodTable;
+    int32_t value;
+};
+
+// static int Fib(int)
+const uint8_t FibonacciSignature[] = {0x00, 0x01, 0x08, 0x08};
+
+bool ResolveFibonacciSignature(uint32_t token, const uint8_t** signature, uint32_t* length, void*) {
+    if (token != 0x0A000001) {
+        return false;
+    }
+    *signature = FibonacciSignature;
+    *length = sizeof(FibonacciSignature);
+    return true;
+}
+
+int g_typeA = 0;
+int g_hostCalls = 0;
+const Instance* g_calleeInstance = nullptr;
+void* g_calleeHandle = nullptr;
+
+bool ReadValuePlusOne(VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    returnValue = VmValue(static_cast<TestObject*>(arguments[0].GetObject())->value + 1);
+    return true;
+}
+
+VmNativeMethod ResolveTypeA(uint32_t, void* methodTable, void*) {
+    return methodTable == &g_typeA ? ReadValuePlusOne : nullptr;
+}
+
+uint32_t OneArgument(uint32_t, void*) {
+    return 1;
+}
+
+// Completes synchronously for 7, fails for negative arguments and leaves everything else pending
+VmCallStatus StartOperation(uint32_t, void*, VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    if (arguments[0].GetInt32() < 0) {
+        return VmCallStatus::Failed;
+    }
+    if (arguments[0].GetInt32() == 7) {
+        returnValue = VmValue(int32_t(100));
+        return VmCallStatus::Completed;
+    }
+    return VmCallStatus::Pending;
+}
+
+// Reconfigures a site of g_calleeHandle while its call is still pending
+VmCallStatus StartOperationAndRebind(uint32_t, void*, VmValue*, uint32_t, VmValue&, void*) {
+    CLRNet_VM_InstanceConfigureCallSite(g_calleeInstance->Get(), g_calleeHandle, 1, nullptr, 1, 0);
+    return VmCallStatus::Pending;
+}
+
+// Host dispatch that re-enters the VM on g_calleeHandle
+bool CallThroughHost(uint32_t, void*, VmValue* arguments, uint32_t argumentCount, VmValue& returnValue, void*) {
+    ++g_hostCalls;
+    VmExecutionContextNative context = {};
+    context.arguments = arguments;
+    context.argumentCount = argumentCount;
+    VmExecutionResultNative result = {};
+    if (FAILED(CLRNet_VM_InstanceExecute(g_calleeInstance->Get(), g_calleeHandle, &context, &result))) {
+        return false;
+    }
+    returnValue = VmValue(static_cast<int32_t>(reinterpret_cast<intptr_t>(result.returnValue)));
+    return true;
+}
+
+bool ManagedArithmetic(uint32_t token, void*, VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    ++g_hostCalls;
+    switch (token) {
+    case 0x0A000001: returnValue = VmValue(arguments[0].GetInt32() + arguments[1].GetInt32()); return true;
+    case 0x0A000002: returnValue = VmValue(arguments[0].GetInt32() * 10); return true;
+    case 0x0A000003: returnValue = VmValue(int32_t(7)); return true;
+    }
+    return false;
+}
+
+uint32_t ManagedArithmeticArity(uint32_t token, void*) {
+    return token == 0x0A000001 ? 2 : token == 0x0A000002 ? 1 : 0;
+}
+
+bool AddFunction(VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    returnValue = VmValue(arguments[0].GetInt32() + arguments[1].GetInt32());
+    return true;
+}
+
+bool TimesHundredFunction(VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    returnValue = VmValue(arguments[0].GetInt32() * 100);
+    return true;
+}
+
+bool SeventyFunction(VmValue*, uint32_t argumentCount, VmValue& returnValue, void*) {
+    returnValue = VmValue(int32_t(70 + argumentCount));
+    return true;
+}
+
+void TestVirtualDispatchInlineCache() {
+    VmHostCallbacks callbacks;
+    callbacks.resolveVirtualCallback = ResolveTypeA;
+    callbacks.managedCallArityCallback = OneArgument;
+    Instance instance(&callbacks);
+
+    // ldarg.0; callvirt 0x0A000001; ret. No managedCallCallback, so only the resolved target can answer.
+    void* handle = instance.Compile(TinyMethod({0x02, 0x6F, VM_I4(0x0A000001), 0x2A}));
+    TestObject receiver = {&g_typeA, 41};
+    VM_CHECK_EQ(42, instance.ExecuteInt32(handle, {VmValue(static_cast<void*>(&receiver))}));
+    VM_CHECK_EQ(42, instance.ExecuteInt32(handle, {VmValue(static_cast<void*>(&receiver))}));
+
+    VmStatistics statistics;
+    CLRNet_VM_InstanceGetStatistics(instance.Get(), &statistics);
+    VM_CHECK_EQ(1, statistics.inlineCacheMisses);
+    VM_CHECK_EQ(1, statistics.inlineCacheHits);
+
+    // An unresolved receiver type falls back to the host, which has no callback here
+    int typeB = 0;
+    TestObject other = {&typeB, 1};
+    VmExecutionResultNative result;
+    VM_CHECK(FAILED(instance.Execute(handle, {VmValue(static_cast<void*>(&other))}, result)));
+}
+
+void TestSuspendAndResume() {
+    VmHostCallbacks callbacks;
+    callbacks.asyncCallCallback = StartOperation;
+    Instance instance(&callbacks);
+
+    // ldarg.0; ldarg.0; call; add; ldarg.0; call; add; ret
+    void* handle = instance.Compile(TinyMethod({0x02, 0x02, 0x28, VM_I4(0x0A000001), 0x58,
+                                                0x02, 0x28, VM_I4(0x0A000001), 0x58, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), handle, 0, nullptr, 1, 0);
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), handle, 1, nullptr, 1, 0);
+
+    VmExecutionResultNative result;
+    VM_CHECK_EQ(S_FALSE, instance.Execute(handle, {VmValue(int32_t(5))}, result));
+    VM_CHECK(result.continuation != nullptr && !result.success);
+
+    // The continuation keeps the program alive
+    CLRNet_VM_InstanceRelease(instance.Get(), handle);
+
+    void* first = result.continuation;
+    VmValue ten(int32_t(10));
+    VM_CHECK_EQ(S_FALSE, CLRNet_VM_InstanceResume(instance.Get(), first, TRUE, &ten, &result));
+    void* second = result.continuation;
+    VmValue twenty(int32_t(20));
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceResume(instance.Get(), second, TRUE, &twenty, &result));
+    VM_CHECK_EQ(35, reinterpret_cast<intptr_t>(result.returnValue));
+    VM_CHECK(FAILED(CLRNet_VM_InstanceResume(instance.Get(), second, TRUE, &twenty, &result)));
+
+    // Synchronous completion, and a failed resume
+    handle = instance.Compile(TinyMethod({0x02, 0x02, 0x28, VM_I4(0x0A000001), 0x58,
+                                          0x02, 0x28, VM_I4(0x0A000001), 0x58, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), handle, 0, nullptr, 1, 0);
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), handle, 1, nullptr, 1, 0);
+    VM_CHECK_EQ(207, instance.ExecuteInt32(handle, {VmValue(int32_t(7))}));
+    VM_CHECK_EQ(S_FALSE, instance.Execute(handle, {VmValue(int32_t(1))}, result));
+    VM_CHECK(FAILED(CLRNet_VM_InstanceResume(instance.Get(), result.continuation, FALSE, nullptr, &result)));
+
+    // A host that rebinds the handle while starting the operation still gets a continuation
+    VmHostCallbacks rebinding;
+    rebinding.asyncCallCallback = StartOperationAndRebind;
+    Instance rebound(&rebinding);
+    handle = rebound.Compile(TinyMethod({0x02, 0x02, 0x28, VM_I4(0x0A000001), 0x58, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(rebound.Get(), handle, 0, nullptr, 1, 0);
+    g_calleeInstance = &rebound;
+    g_calleeHandle = handle;
+    VM_CHECK_EQ(S_FALSE, rebound.Execute(handle, {VmValue(int32_t(5))}, result));
+    VM_CHECK(result.continuation != nullptr);
+    VmValue one(int32_t(1));
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceResume(rebound.Get(), result.continuation, TRUE, &one, &result));
+    VM_CHECK_EQ(6, reinterpret_cast<intptr_t>(result.returnValue));
+}
+
+void TestDirectCalls() {
+    Instance instance;
+    void* fibonacci = instance.Compile(TinyMethod(Fibonacci));
+    for (uint32_t site = 0; site < 2; ++site) {
+        VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceConfigureCallSite(instance.Get(), fibonacci, site, nullptr, 1, 0));
+        VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceBindCallSite(instance.Get(), fibonacci, site, fibonacci));
+    }
+    VM_CHECK_EQ(610, instance.ExecuteInt32(fibonacci, {VmValue(int32_t(15))}));
+    VM_CHECK(FAILED(CLRNet_VM_InstanceBindCallSite(instance.Get(), fibonacci, 7, fibonacci)));
+
+    // ldarg.0; call; ret bound to itself never returns
+    std::vector<unsigned char> forward = TinyMethod({0x02, 0x28, VM_I4(0x0A000001), 0x2A});
+    void* runaway = instance.Compile(forward);
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), runaway, 0, nullptr, 1, 0);
+    CLRNet_VM_InstanceBindCallSite(instance.Get(), runaway, 0, runaway);
+    VmExecutionResultNative result;
+    VM_CHECK(FAILED(instance.Execute(runaway, {VmValue(int32_t(1))}, result)));
+
+    // Calls resolve the callee by handle, so releasing it fails later calls
+    void* caller = instance.Compile(forward);
+    void* callee = instance.Compile(TinyMethod({0x02, 0x17, 0x58, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), caller, 0, nullptr, 1, 0);
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceBindCallSite(instance.Get(), caller, 0, callee));
+    VM_CHECK_EQ(6, instance.ExecuteInt32(caller, {VmValue(int32_t(5))}));
+    CLRNet_VM_InstanceRelease(instance.Get(), callee);
+    VM_CHECK(FAILED(instance.Execute(caller, {VmValue(int32_t(5))}, result)));
+
+    // The site's arity decides how many arguments a call takes, not the highest one the callee reads:
+    // 100 + first(arg, 7) with a callee that ignores its second parameter
+    void* partial = instance.Compile(TinyMethod({0x1F, 100, 0x02, 0x1D, 0x28, VM_I4(0x0A000002), 0x58, 0x2A}));
+    void* first = instance.Compile(TinyMethod({0x02, 0x2A}));
+    VM_CHECK(FAILED(CLRNet_VM_InstanceBindCallSite(instance.Get(), partial, 0, first)));
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), partial, 0, nullptr, 2, 0);
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceBindCallSite(instance.Get(), partial, 0, first));
+    VM_CHECK_EQ(105, instance.ExecuteInt32(partial, {VmValue(int32_t(5))}));
+
+    // A site declaring fewer arguments than the callee reads can't be bound
+    void* second = instance.Compile(TinyMethod({0x03, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), caller, 0, nullptr, 1, 0);
+    VM_CHECK(FAILED(CLRNet_VM_InstanceBindCallSite(instance.Get(), caller, 0, second)));
+
+    // With resolved signatures the sites know their arity, and reject a different one
+    VmHostCallbacks callbacks;
+    callbacks.methodSignatureCallback = ResolveFibonacciSignature;
+    Instance resolved(&callbacks);
+    void* verified = resolved.Compile(TinyMethod(Fibonacci));
+    for (uint32_t site = 0; site < 2; ++site) {
+        VM_CHECK(FAILED(CLRNet_VM_InstanceConfigureCallSite(resolved.Get(), verified, site, nullptr, 2, 0)));
+        VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceBindCallSite(resolved.Get(), verified, site, verified));
+    }
+    VM_CHECK_EQ(610, resolved.ExecuteInt32(verified, {VmValue(int32_t(15))}));
+}
+
+void TestPerHandleBindings() {
+    VmHostCallbacks callbacks;
+    callbacks.managedCallCallback = CallThroughHost;
+    Instance instance(&callbacks);
+
+    // Two handles share one program; only the first is bound to itself
+    void* bound = instance.Compile(TinyMethod(Fibonacci), "fib");
+    void* hosted = instance.Compile(TinyMethod(Fibonacci), "fib");
+    VM_CHECK(bound != hosted);
+    for (uint32_t site = 0; site < 2; ++site) {
+        CLRNet_VM_InstanceConfigureCallSite(instance.Get(), bound, site, nullptr, 1, 0);
+        CLRNet_VM_InstanceBindCallSite(instance.Get(), bound, site, bound);
+        CLRNet_VM_InstanceConfigureCallSite(instance.Get(), hosted, site, nullptr, 1, 0);
+    }
+    g_calleeInstance = &instance;
+    g_calleeHandle = bound;
+
+    g_hostCalls = 0;
+    VM_CHECK_EQ(610, instance.ExecuteInt32(bound, {VmValue(int32_t(15))}));
+    VM_CHECK_EQ(0, g_hostCalls);
+
+    g_hostCalls = 0;
+    VM_CHECK_EQ(610, instance.ExecuteInt32(hosted, {VmValue(int32_t(15))}));
+    VM_CHECK_EQ(2, g_hostCalls);
+}
+
+void TestHostFunctions() {
+    VmHostCallbacks callbacks;
+    callbacks.managedCallCallback = ManagedArithmetic;
+    callbacks.managedCallArityCallback = ManagedArithmeticArity;
+    Instance instance(&callbacks);
+
+    // ((arg + arg) via 0x0A000001, then via 0x0A000002) + 0x0A000003()
+    std::vector<unsigned char> method = TinyMethod({0x02, 0x02, 0x28, VM_I4(0x0A000001), 0x28, VM_I4(0x0A000002),
+                                                    0x28, VM_I4(0x0A000003), 0x58, 0x2A});
+    void* before = instance.Compile(method);
+    VM_CHECK_EQ(47, instance.ExecuteInt32(before, {VmValue(int32_t(2))}));
+
+    VmHostFunction functions[3] = {};
+    functions[0].identifier = 1;
+    functions[0].metadataToken = 0x0A000001;
+    functions[0].argumentCount = 2;
+    functions[0].kind = VmHostCall::Kind::Custom;
+    functions[0].function = AddFunction;
+    functions[1].identifier = 2;
+    functions[1].argumentCount = 1;
+    functions[1].kind = VmHostCall::Kind::Custom;
+    functions[1].function = TimesHundredFunction;
+    functions[2].identifier = 3;
+    functions[2].metadataToken = 0x0A000003;
+    functions[2].kind = VmHostCall::Kind::Timer;
+    functions[2].function = SeventyFunction;
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceRegisterHostFunctions(instance.Get(), functions, 3));
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceRegisterHostFunctions(instance.Get(), functions, 3));
+
+    VmHostFunction redefined = functions[1];
+    redefined.function = AddFunction;
+    VM_CHECK_EQ(E_INVALIDARG, CLRNet_VM_InstanceRegisterHostFunctions(instance.Get(), &redefined, 1));
+
+    // Handles created before the registration keep calling through the host
+    g_hostCalls = 0;
+    VM_CHECK_EQ(47, instance.ExecuteInt32(before, {VmValue(int32_t(2))}));
+    VM_CHECK_EQ(3, g_hostCalls);
+
+    // New handles start with the token-registered functions bound
+    void* after = instance.Compile(method);
+    g_hostCalls = 0;
+    VM_CHECK_EQ(110, instance.ExecuteInt32(after, {VmValue(int32_t(2))}));
+    VM_CHECK_EQ(1, g_hostCalls);
+
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceBindHostFunction(instance.Get(), after, 1, 2));
+    VM_CHECK(FAILED(CLRNet_VM_InstanceBindHostFunction(instance.Get(), after, 1, 42)));
+    g_hostCalls = 0;
+    VM_CHECK_EQ(470, instance.ExecuteInt32(after, {VmValue(int32_t(2))}));
+    VM_CHECK_EQ(0, g_hostCalls);
+
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), after, 1, nullptr, 1, 0);
+    VM_CHECK_EQ(110, instance.ExecuteInt32(after, {VmValue(int32_t(2))}));
+
+    // callvirt sites keep going through the host
+    void* virtualCall = instance.Compile(TinyMethod({0x02, 0x6F, VM_I4(0x0A000002), 0x2A}));
+    VM_CHECK(FAILED(CLRNet_VM_InstanceBindHostFunction(instance.Get(), virtualCall, 0, 2)));
+}
+
+} // namespace
+
+int main() {
+    RunTest("VirtualDispatchInlineCache", TestVirtualDispatchInlineCache);
+    RunTest("SuspendAndResume", TestSuspendAndResume);
+    RunTest("DirectCalls", TestDirectCalls);
+    RunTest("PerHandleBindings", TestPerHandleBindings);
+    RunTest("HostFunctions", TestHostFunctions);
+    return Report();
+}
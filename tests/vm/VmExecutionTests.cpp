@@ -0,0 +1,277 @@
+// Interpreter tests for the userspace IL VM: the register tier, arithmetic quickening, in-place
+// native contexts, the compact VmValue layout and per-execution memory budgets.
+
+#include "VmTestSupport.h"
+#include "../../src/phase1-userland/vm/BytecodeCompiler.h"
+
+#include <limits>
+
+using namespace VmTests;
+
+namespace {
+
+// int sum = 0; for (int i = 0; i < arg0; i++) sum += i; return sum;
+const std::vector<unsigned char> SumLoop = {
+    0x16, 0x0A, 0x16, 0x0B, 0x2B, 0x08, 0x06, 0x07, 0x58, 0x0A, 0x07, 0x17, 0x58, 0x0B,
+    0x07, 0x02, 0xFE, 0x04, 0x2D, 0xF2, 0x06, 0x2A};
+
+VmCallStatus AllocateOnHost(uint32_t, void*, VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    for (int32_t i = 0; i < arguments[0].GetInt32(); ++i) {
+        if (!CLRNet::Phase1::GCAlloc(1000)) {
+            return VmCallStatus::Failed;
+        }
+    }
+    returnValue = arguments[0];
+    return VmCallStatus::Completed;
+}
+
+int g_hostCallsSeen = 0;
+
+VmCallStatus CountHostCall(uint32_t, void*, VmValue*, uint32_t, VmValue&, void*) {
+    ++g_hostCallsSeen;
+    return VmCallStatus::Completed;
+}
+
+bool CountFieldStore(void*, uint32_t, const VmValue&, void*) {
+    ++g_hostCallsSeen;
+    return true;
+}
+
+void TestRegisterTier() {
+    // max(a, b) * 2 with a diamond, and a local read before it is overwritten
+    const std::vector<unsigned char> doubledMax = {0x02, 0x03, 0xFE, 0x02, 0x2C, 0x03, 0x02, 0x2B, 0x01, 0x03, 0x18, 0x5A, 0x2A};
+    const std::vector<unsigned char> aliasing = {0x02, 0x0A, 0x06, 0x06, 0x17, 0x58, 0x0A, 0x0B, 0x07, 0x1F, 0x0A, 0x5A, 0x06, 0x58, 0x2A};
+
+    for (BOOL registerTier : {FALSE, TRUE}) {
+        Instance instance;
+        VmOptions options;
+        options.enableRegisterTier = registerTier;
+        CLRNet_VM_InstanceSetOptions(instance.Get(), &options);
+
+        VM_CHECK_EQ(4950, instance.ExecuteInt32(instance.Compile(TinyMethod(SumLoop)), {VmValue(int32_t(100))}));
+        void* maximum = instance.Compile(TinyMethod(doubledMax));
+        VM_CHECK_EQ(18, instance.ExecuteInt32(maximum, {VmValue(int32_t(3)), VmValue(int32_t(9))}));
+        VM_CHECK_EQ(24, instance.ExecuteInt32(maximum, {VmValue(int32_t(12)), VmValue(int32_t(9))}));
+        VM_CHECK_EQ(56, instance.ExecuteInt32(instance.Compile(TinyMethod(aliasing)), {VmValue(int32_t(5))}));
+    }
+
+    // Instances with and without the register tier don't share a program compiled for the other
+    std::vector<unsigned char> method = TinyMethod(SumLoop);
+    ILVirtualMachine stackOnly;
+    ILVirtualMachine registers;
+    stackOnly.Initialize();
+    registers.Initialize();
+    VmOptions options;
+    options.enableRegisterTier = TRUE;
+    registers.SetOptions(options);
+    std::shared_ptr<VmProgram> stackProgram = stackOnly.Compile(method.data(), method.size(), "register-variant");
+    std::shared_ptr<VmProgram> registerProgram = registers.Compile(method.data(), method.size(), "register-variant");
+    VM_CHECK(stackProgram && stackProgram->registerInstructions.empty());
+    VM_CHECK(registerProgram && !registerProgram->registerInstructions.empty());
+
+    // Register code read back from a cache file is checked before the tier indexes with it
+    VmProgram checked = *registerProgram;
+    VM_CHECK(BytecodeCompiler::VerifyRegisters(checked));
+    VmProgram outOfRange = *registerProgram;
+    outOfRange.registerInstructions[0].b = static_cast<int32_t>(outOfRange.registerCount);
+    VM_CHECK(!BytecodeCompiler::VerifyRegisters(outOfRange));
+    VmProgram tooFewRegisters = *registerProgram;
+    tooFewRegisters.registerCount = static_cast<uint32_t>(tooFewRegisters.registerConstants.size()) - 1;
+    VM_CHECK(!BytecodeCompiler::VerifyRegisters(tooFewRegisters));
+    VmProgram forgedConstant = *registerProgram;
+    forgedConstant.registerConstants[0] = VmValue(static_cast<void*>(&checked));
+    VM_CHECK(!BytecodeCompiler::VerifyRegisters(forgedConstant));
+}
+
+void TestWideBranchConditions() {
+    // ldc.i8 1 << 32; brtrue.s +2; ldc.i4.0; ret; ldc.i4.1; ret
+    const std::vector<unsigned char> int64Condition = {0x21, VM_I8(int64_t(1) << 32), 0x2D, 0x02, 0x16, 0x2A, 0x17, 0x2A};
+    // ldc.r8 0.5; brfalse.s +2; ldc.i4.1; ret; ldc.i4.0; ret
+    const std::vector<unsigned char> doubleCondition = {0x23, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0x3F,
+                                                        0x2C, 0x02, 0x17, 0x2A, 0x16, 0x2A};
+
+    for (BOOL registerTier : {FALSE, TRUE}) {
+        Instance instance;
+        VmOptions options;
+        options.enableRegisterTier = registerTier;
+        CLRNet_VM_InstanceSetOptions(instance.Get(), &options);
+
+        VM_CHECK_EQ(1, instance.ExecuteInt32(instance.Compile(TinyMethod(int64Condition)), {}));
+        VM_CHECK_EQ(1, instance.ExecuteInt32(instance.Compile(TinyMethod(doubleCondition)), {}));
+    }
+}
+
+void TestArithmeticQuickening() {
+    ILVirtualMachine vm;
+    vm.Initialize();
+    std::vector<unsigned char> method = TinyMethod({0x02, 0x03, 0x58, 0x2A});   // ldarg.0 ldarg.1 add ret
+    std::shared_ptr<VmProgram> program = vm.Compile(method.data(), method.size(), "");
+    VM_CHECK(program != nullptr);
+    if (!program) {
+        return;
+    }
+
+    auto add = [&](VmValue left, VmValue right, VmExecutionResult& result) {
+        VmExecutionContext context;
+        context.arguments = {left, right};
+        return vm.Execute(*program, context, result);
+    };
+
+    VmExecutionResult result;
+    VM_CHECK(add(VmValue(int32_t(2)), VmValue(int32_t(3)), result));
+    VM_CHECK_EQ(5, reinterpret_cast<intptr_t>(result.returnValue));
+    VM_CHECK(program->instructions[2].opcode == VmOpcode::AddI4);
+
+    // Doubles miss the Int32 guard and requicken
+    VM_CHECK(add(VmValue(1.5), VmValue(2.25), result));
+    double sum = 0;
+    memcpy(&sum, &result.returnValue, sizeof(sum));
+    VM_CHECK(sum == 3.75);
+    VM_CHECK(program->instructions[2].opcode == VmOpcode::AddR8);
+
+    VM_CHECK(add(VmValue(int64_t(1) << 40), VmValue(int64_t(2)), result));
+    VM_CHECK_EQ((int64_t(1) << 40) + 2, reinterpret_cast<intptr_t>(result.returnValue));
+}
+
+void TestInPlaceLocals() {
+    Instance instance;
+    void* handle = instance.Compile(TinyMethod(SumLoop));
+
+    // The caller's locals are the frame's locals
+    VmValue locals[2];
+    VmExecutionResultNative result;
+    VM_CHECK_EQ(S_OK, instance.Execute(handle, {VmValue(int32_t(100))}, result, locals, 2));
+    VM_CHECK_EQ(4950, reinterpret_cast<intptr_t>(result.returnValue));
+    VM_CHECK_EQ(4950, locals[0].GetInt32());
+    VM_CHECK_EQ(100, locals[1].GetInt32());
+
+    // Without caller locals the VM uses scratch space
+    VM_CHECK_EQ(4950, instance.ExecuteInt32(handle, {VmValue(int32_t(100))}));
+}
+
+void TestValueLayout() {
+    VM_CHECK(VmValue(int32_t(-5)).GetKind() == VmValue::Kind::Int32);
+    VM_CHECK_EQ(-5, VmValue(int32_t(-5)).GetInt32());
+    VM_CHECK_EQ(-(int64_t(1) << 40), VmValue(-(int64_t(1) << 40)).GetInt64());
+    VM_CHECK(VmValue(3.5f).GetKind() == VmValue::Kind::Float && VmValue(3.5f).GetFloat() == 3.5f);
+    VM_CHECK(VmValue(-2.25).GetKind() == VmValue::Kind::Double && VmValue(-2.25).GetDouble() == -2.25);
+
+    double nan = VmValue(std::numeric_limits<double>::quiet_NaN()).GetDouble();
+    VM_CHECK(nan != nan);
+
+    int object = 0;
+    VmValue reference(static_cast<void*>(&object));
+    VM_CHECK(reference.GetKind() == VmValue::Kind::Object && reference.GetObject() == &object);
+    VM_CHECK(VmValue(nullptr, VmValue::Kind::Null).GetObject() == nullptr);
+
+    // An Int64 the layout cannot hold fails the execution instead of truncating
+    Instance instance;
+    void* handle = instance.Compile(TinyMethod({0x21, VM_I8(int64_t(1) << 50), 0x2A}));
+    VmExecutionResultNative result;
+    HRESULT hr = instance.Execute(handle, {}, result);
+    if (VmValue::CanHoldInt64(int64_t(1) << 50)) {
+        VM_CHECK_EQ(S_OK, hr);
+        VM_CHECK_EQ(int64_t(1) << 50, reinterpret_cast<intptr_t>(result.returnValue));
+    } else {
+        VM_CHECK(FAILED(hr));
+    }
+}
+
+void TestMemoryBudget() {
+    ScopedCollector collector;
+    VmHostCallbacks callbacks;
+    callbacks.asyncCallCallback = AllocateOnHost;
+    Instance instance(&callbacks);
+    VmExecutionResultNative result;
+
+    // Host allocations made during a call count against the calling execution
+    void* call = instance.Compile(TinyMethod({0x02, 0x28, VM_I4(0x0A000001), 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(instance.Get(), call, 0, nullptr, 1, 0);
+    VM_CHECK_EQ(S_OK, instance.Execute(call, {VmValue(int32_t(2))}, result, nullptr, 0, 4096));
+    VM_CHECK(FAILED(instance.Execute(call, {VmValue(int32_t(10))}, result, nullptr, 0, 4096)));
+    VM_CHECK_EQ(S_OK, instance.Execute(call, {VmValue(int32_t(10))}, result));
+
+    // The frame's locals are charged, including ones the caller provides
+    void* one = instance.Compile(TinyMethod({0x17, 0x2A}));
+    std::vector<VmValue> locals(100);
+    VM_CHECK_EQ(S_OK, instance.Execute(one, {VmValue(int32_t(0))}, result, nullptr, 0, 1024));
+    VM_CHECK(FAILED(instance.Execute(one, {VmValue(int32_t(0))}, result, locals.data(), 100, 1024)));
+    VM_CHECK_EQ(S_OK, instance.Execute(one, {VmValue(int32_t(0))}, result, locals.data(), 100, 4096));
+
+    // The register tier charges the same frame, on top of its register file
+    Instance registers;
+    VmOptions options;
+    options.enableRegisterTier = TRUE;
+    CLRNet_VM_InstanceSetOptions(registers.Get(), &options);
+    void* registerOne = registers.Compile(TinyMethod({0x17, 0x2A}));
+    VM_CHECK_EQ(S_OK, registers.Execute(registerOne, {VmValue(int32_t(0))}, result, nullptr, 0, 1024));
+    VM_CHECK(FAILED(registers.Execute(registerOne, {VmValue(int32_t(0))}, result, locals.data(), 100, 1024)));
+
+    // Arrays are charged at their full size
+    void* array = instance.Compile(TinyMethod({0x02, 0x8D, VM_I4(0x01000001), 0x8E, 0x69, 0x2A}));
+    VM_CHECK_EQ(S_OK, instance.Execute(array, {VmValue(int32_t(100))}, result, nullptr, 0, 2000));
+    VM_CHECK(FAILED(instance.Execute(array, {VmValue(int32_t(1000))}, result, nullptr, 0, 2000)));
+    VM_CHECK_EQ(S_OK, instance.Execute(array, {VmValue(int32_t(1000))}, result));
+
+    // No allocation scope outlives an execution
+    VM_CHECK(CLRNet::Phase1::GarbageCollector::SetAllocationScope(nullptr) == nullptr);
+}
+
+void TestArrayEscape() {
+    ScopedCollector collector;
+    Instance instance;
+    VmExecutionResultNative result;
+
+    // A host object whose second word looks like a VM array's slot size is still not an array
+    struct {
+        void* methodTable;
+        size_t elementSize;
+        uint64_t data[2];
+    } lookalike = {nullptr, 8, {0, 0}};
+    void* length = instance.Compile(TinyMethod({0x02, 0x8E, 0x69, 0x2A}));   // ldarg.0; ldlen; conv.i4; ret
+    VM_CHECK(FAILED(instance.Execute(length, {VmValue(static_cast<void*>(&lookalike))}, result)));
+
+    // Arrays are unpinned when the execution ends, so they can't be handed back to the host
+    void* returned = instance.Compile(TinyMethod({0x19, 0x8D, VM_I4(0x01000001), 0x2A}));
+    VM_CHECK(FAILED(instance.Execute(returned, {}, result)));
+    void* stored = instance.Compile(TinyMethod({0x19, 0x8D, VM_I4(0x01000001), 0x0A, 0x17, 0x2A}));
+    VmValue locals[1];
+    VM_CHECK(FAILED(instance.Execute(stored, {}, result, locals, 1)));
+
+    // ... but they can be used inside it: ldc.i4.3; newarr; ldlen; conv.i4; ret
+    VM_CHECK_EQ(3, instance.ExecuteInt32(instance.Compile(TinyMethod({0x19, 0x8D, VM_I4(0x01000001), 0x8E, 0x69, 0x2A})), {}));
+
+    // Nor passed to it while the execution runs
+    VmHostCallbacks callbacks;
+    callbacks.asyncCallCallback = CountHostCall;
+    callbacks.fieldStoreCallback = CountFieldStore;
+    Instance host(&callbacks);
+    // ldc.i4.3; newarr; call; ldc.i4.1; ret
+    void* passed = host.Compile(TinyMethod({0x19, 0x8D, VM_I4(0x01000001), 0x28, VM_I4(0x0A000001), 0x17, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(host.Get(), passed, 0, nullptr, 1, 0);
+    VM_CHECK(FAILED(host.Execute(passed, {}, result)));
+    // ldarg.0; ldc.i4.3; newarr; stfld; ldc.i4.1; ret
+    void* field = host.Compile(TinyMethod({0x02, 0x19, 0x8D, VM_I4(0x01000001), 0x7D, VM_I4(0x04000001), 0x17, 0x2A}));
+    int hostObject = 0;
+    VM_CHECK(FAILED(host.Execute(field, {VmValue(static_cast<void*>(&hostObject))}, result)));
+    VM_CHECK_EQ(0, g_hostCallsSeen);
+
+    // Host objects still reach the host: ldarg.0; call; ldc.i4.1; ret
+    void* plain = host.Compile(TinyMethod({0x02, 0x28, VM_I4(0x0A000001), 0x17, 0x2A}));
+    CLRNet_VM_InstanceConfigureCallSite(host.Get(), plain, 0, nullptr, 1, 0);
+    VM_CHECK_EQ(S_OK, host.Execute(plain, {VmValue(static_cast<void*>(&hostObject))}, result));
+    VM_CHECK_EQ(1, g_hostCallsSeen);
+}
+
+} // namespace
+
+int main() {
+    RunTest("RegisterTier", TestRegisterTier);
+    RunTest("WideBranchConditions", TestWideBranchConditions);
+    RunTest("ArithmeticQuickening", TestArithmeticQuickening);
+    RunTest("InPlaceLocals", TestInPlaceLocals);
+    RunTest("ValueLayout", TestValueLayout);
+    RunTest("MemoryBudget", TestMemoryBudget);
+    RunTest("ArrayEscape", TestArrayEscape);
+    return Report();
+}
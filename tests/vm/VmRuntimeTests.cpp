@@ -0,0 +1,401 @@
+// Runtime tests for the userspace IL VM: the native tier, the profiler, direct field access, the
+// string intern table, the handle table, batch execution and independent VM instances.
+
+#include "VmTestSupport.h"
+#include "../../src/phase1-userland/core/StringInternTable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+
+using namespace VmTests;
+
+namespace {
+
+// int sum = 0; for (int i = 0; i < arg0; i++) sum += i; return sum;
+const std::vector<unsigned char> SumLoop = {
+    0x16, 0x0A, 0x16, 0x0B, 0x2B, 0x08, 0x06, 0x07, 0x58, 0x0A, 0x07, 0x17, 0x58, 0x0B,
+    0x07, 0x02, 0xFE, 0x04, 0x2D, 0xF2, 0x06, 0x2A};
+
+struct TestObject {
+    void* methodTable;
+    int32_t value;
+};
+
+// Stand-ins for the method tables of host types; only their addresses matter
+int g_testType = 0;
+int g_pairType = 0;
+int g_otherType = 0;
+
+int g_literalCallbacks = 0;
+
+bool HelloLiteral(uint32_t, const wchar_t** data, uint32_t* length, void*) {
+    ++g_literalCallbacks;
+    *data = L"hello";
+    *length = 5;
+    return true;
+}
+
+int g_otherModuleCallbacks = 0;
+
+// Another module whose token 0x70000001 names a different string
+bool WorldLiteral(uint32_t, const wchar_t** data, uint32_t* length, void*) {
+    ++g_otherModuleCallbacks;
+    *data = L"world";
+    *length = 5;
+    return true;
+}
+
+int g_hostLiteralCallbacks = 0;
+int g_hostLiteral = 0;
+
+bool HostLiteral(uint32_t, VmValue& value, void*) {
+    ++g_hostLiteralCallbacks;
+    value = VmValue(&g_hostLiteral, VmValue::Kind::Object);
+    return true;
+}
+
+bool PlusOne(uint32_t, void*, VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    returnValue = VmValue(arguments[0].GetInt32() + 1);
+    return true;
+}
+
+bool PlusHundred(uint32_t, void*, VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    returnValue = VmValue(arguments[0].GetInt32() + 100);
+    return true;
+}
+
+uint32_t OneArgument(uint32_t, void*) {
+    return 1;
+}
+
+const Instance* g_nestedInstance = nullptr;
+void* g_nestedHandle = nullptr;
+
+bool RunNested(uint32_t, void*, VmValue* arguments, uint32_t, VmValue& returnValue, void*) {
+    returnValue = VmValue(g_nestedInstance->ExecuteInt32(g_nestedHandle, {arguments[0]}));
+    return true;
+}
+
+std::string GetProfileText(const Instance& instance) {
+    uint32_t required = 0;
+    CLRNet_VM_InstanceGetProfile(instance.Get(), 0, nullptr, 0, &required);
+    std::vector<char> text(required);
+    CLRNet_VM_InstanceGetProfile(instance.Get(), 0, text.data(), required, &required);
+    return std::string(text.data());
+}
+
+void TestNativeTier() {
+    Instance instance;
+    VmOptions options;
+    options.tierUpThreshold = 100;
+    CLRNet_VM_InstanceSetOptions(instance.Get(), &options);
+    void* handle = instance.Compile(TinyMethod(SumLoop));
+
+    // Compilation happens on a background thread; keep executing until the program is promoted
+    VmStatistics statistics;
+    for (int attempt = 0; attempt < 500; ++attempt) {
+        VM_CHECK_EQ(4950, instance.ExecuteInt32(handle, {VmValue(int32_t(100))}));
+        CLRNet_VM_InstanceGetStatistics(instance.Get(), &statistics);
+        if (statistics.nativeExecutions > 0 || statistics.nativeRejections > 0) {
+            break;
+        }
+        Sleep(10);
+    }
+
+#if (defined(_M_X64) || defined(__x86_64__)) && !defined(CLRNET_VM_COMPACT_VALUES)
+    VM_CHECK_EQ(1, statistics.nativeCompilations);
+    VM_CHECK(statistics.nativeExecutions > 0);
+
+    // Compiled code runs no interpreter steps
+    VmExecutionResultNative result;
+    VM_CHECK_EQ(S_OK, instance.Execute(handle, {VmValue(int32_t(10))}, result));
+    VM_CHECK_EQ(45, reinterpret_cast<intptr_t>(result.returnValue));
+    VM_CHECK_EQ(0, result.stepsExecuted);
+#else
+    VM_CHECK(statistics.nativeRejections > 0);
+#endif
+}
+
+void TestProfiler() {
+    Instance instance;
+    VmOptions options;
+    options.enableProfiling = TRUE;
+    CLRNet_VM_InstanceSetOptions(instance.Get(), &options);
+    void* handle = instance.Compile(TinyMethod(SumLoop), "profiled-sum");
+    VM_CHECK_EQ(4950, instance.ExecuteInt32(handle, {VmValue(int32_t(100))}));
+
+    uint32_t required = 0;
+    VM_CHECK_EQ(E_NOT_SUFFICIENT_BUFFER, CLRNet_VM_InstanceGetProfile(instance.Get(), 0, nullptr, 0, &required));
+    VM_CHECK(required > 0);
+    std::vector<char> text(required);
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceGetProfile(instance.Get(), 0, text.data(), required, &required));
+    VM_CHECK(std::string(text.data()).find("profiled-sum") != std::string::npos);
+
+    CLRNet_VM_InstanceGetProfile(instance.Get(), 1, nullptr, 0, &required);
+    std::vector<char> json(required);
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceGetProfile(instance.Get(), 1, json.data(), required, &required));
+    VM_CHECK(json[0] == '{' && std::string(json.data()).find("profiled-sum") != std::string::npos);
+
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceResetProfile(instance.Get()));
+    CLRNet_VM_InstanceGetProfile(instance.Get(), 0, nullptr, 0, &required);
+    text.resize(required);
+    CLRNet_VM_InstanceGetProfile(instance.Get(), 0, text.data(), required, &required);
+    VM_CHECK(std::string(text.data()).find("profiled-sum") == std::string::npos);
+
+    // A nested run on another instance keeps its counts apart from the run that called it.
+    // ldnull; pop; ldarg.0; call 0x0A000001; ret
+    VmHostCallbacks callbacks;
+    callbacks.managedCallCallback = RunNested;
+    callbacks.managedCallArityCallback = OneArgument;
+    Instance outer(&callbacks);
+    CLRNet_VM_InstanceSetOptions(outer.Get(), &options);
+    void* outerHandle = outer.Compile(TinyMethod({0x14, 0x26, 0x02, 0x28, VM_I4(0x0A000001), 0x2A}));
+    g_nestedInstance = &instance;
+    g_nestedHandle = handle;
+    VM_CHECK_EQ(45, outer.ExecuteInt32(outerHandle, {VmValue(int32_t(10))}));
+    VM_CHECK(GetProfileText(outer).find("LoadNull") != std::string::npos);
+    VM_CHECK(GetProfileText(instance).find("LoadNull") == std::string::npos);
+}
+
+void TestDirectFieldAccess() {
+    Instance instance;
+
+    // arg0.value += 5; return arg0.value;
+    void* handle = instance.Compile(TinyMethod({0x02, 0x02, 0x7B, VM_I4(0x04000001), 0x1B, 0x58, 0x7D, VM_I4(0x04000001),
+                                                0x02, 0x7B, VM_I4(0x04000001), 0x2A}));
+    TestObject object = {&g_testType, 10};
+    VmExecutionResultNative result;
+
+    // Without a layout the access needs the field callbacks, which aren't registered
+    VM_CHECK(FAILED(instance.Execute(handle, {VmValue(static_cast<void*>(&object))}, result)));
+
+    VmFieldLayout untyped = {0x04000001, offsetof(TestObject, value), VmValue::Kind::Int32, nullptr};
+    VM_CHECK_EQ(E_INVALIDARG, CLRNet_VM_InstanceRegisterFieldLayouts(instance.Get(), &untyped, 1));
+    VmFieldLayout layout = {0x04000001, offsetof(TestObject, value), VmValue::Kind::Int32, &g_testType};
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceRegisterFieldLayouts(instance.Get(), &layout, 1));
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceRegisterFieldLayouts(instance.Get(), &layout, 1));
+    VmFieldLayout conflicting = {0x04000001, 12, VmValue::Kind::Int32, &g_testType};
+    VM_CHECK_EQ(E_INVALIDARG, CLRNet_VM_InstanceRegisterFieldLayouts(instance.Get(), &conflicting, 1));
+
+    VM_CHECK_EQ(15, instance.ExecuteInt32(handle, {VmValue(static_cast<void*>(&object))}));
+    VM_CHECK_EQ(20, instance.ExecuteInt32(handle, {VmValue(static_cast<void*>(&object))}));
+    VM_CHECK_EQ(20, object.value);
+
+    VM_CHECK(FAILED(instance.Execute(handle, {VmValue(nullptr, VmValue::Kind::Null)}, result)));
+
+    // Objects of a type without a layout for the token go to the callbacks, even at a site that
+    // already resolved another type's layout
+    TestObject stranger = {&g_otherType, 10};
+    VM_CHECK(FAILED(instance.Execute(handle, {VmValue(static_cast<void*>(&stranger))}, result)));
+    VM_CHECK_EQ(10, stranger.value);
+
+    // The same token on another type has its own layout, and the site follows the receiver's type
+    struct Derived {
+        void* methodTable;
+        int32_t padding;
+        int32_t value;
+    } derived = {&g_otherType, 0, 1};
+    VmFieldLayout derivedLayout = {0x04000001, offsetof(Derived, value), VmValue::Kind::Int32, &g_otherType};
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceRegisterFieldLayouts(instance.Get(), &derivedLayout, 1));
+    VM_CHECK_EQ(6, instance.ExecuteInt32(handle, {VmValue(static_cast<void*>(&derived))}));
+    VM_CHECK_EQ(25, instance.ExecuteInt32(handle, {VmValue(static_cast<void*>(&object))}));
+    VM_CHECK_EQ(0, derived.padding);
+
+    // A VM array never matches a registered type: ldc.i4.0; newarr; ldc.i4.5; stfld; ldc.i4.1; ret
+    void* arrayStore = instance.Compile(TinyMethod({0x16, 0x8D, VM_I4(0x01000001), 0x1B, 0x7D, VM_I4(0x04000001), 0x17, 0x2A}));
+    VM_CHECK(FAILED(instance.Execute(arrayStore, {}, result)));
+
+    // Instances sharing a program each use their own layout for the same token
+    struct Pair {
+        void* methodTable;
+        int32_t first;
+        int32_t second;
+    } pair = {&g_pairType, 1, 2};
+    std::vector<unsigned char> loadField = TinyMethod({0x02, 0x7B, VM_I4(0x04000002), 0x2A});
+    Instance other;
+    VmFieldLayout firstLayout = {0x04000002, offsetof(Pair, first), VmValue::Kind::Int32, &g_pairType};
+    VmFieldLayout secondLayout = {0x04000002, offsetof(Pair, second), VmValue::Kind::Int32, &g_pairType};
+    CLRNet_VM_InstanceRegisterFieldLayouts(instance.Get(), &firstLayout, 1);
+    CLRNet_VM_InstanceRegisterFieldLayouts(other.Get(), &secondLayout, 1);
+    void* first = instance.Compile(loadField, "shared-field");
+    void* second = other.Compile(loadField, "shared-field");
+    VM_CHECK_EQ(1, instance.ExecuteInt32(first, {VmValue(static_cast<void*>(&pair))}));
+    VM_CHECK_EQ(2, other.ExecuteInt32(second, {VmValue(static_cast<void*>(&pair))}));
+    VM_CHECK_EQ(1, instance.ExecuteInt32(first, {VmValue(static_cast<void*>(&pair))}));
+}
+
+void TestStringLiterals() {
+    VmHostCallbacks callbacks;
+    callbacks.stringLiteralDataCallback = HelloLiteral;
+    Instance instance(&callbacks);
+
+    // ldstr 0x70000001; ret
+    void* handle = instance.Compile(TinyMethod({0x72, VM_I4(0x70000001), 0x2A}));
+    void* first = nullptr;
+    for (int i = 0; i < 10; ++i) {
+        VmExecutionResultNative result;
+        VM_CHECK_EQ(S_OK, instance.Execute(handle, {}, result));
+        if (!first) {
+            first = result.returnValue;
+        }
+        VM_CHECK(result.returnValue == first);
+    }
+    VM_CHECK_EQ(1, g_literalCallbacks);
+
+    // The literal is the runtime-wide interned string
+    VM_CHECK(CLRNet::Phase1::GetStringInternTable().Intern(L"hello", 5) == first);
+
+    // Same token and the same (null) userContext in another module: resolved per handle, not shared
+    VmHostCallbacks otherCallbacks;
+    otherCallbacks.stringLiteralDataCallback = WorldLiteral;
+    Instance other(&otherCallbacks);
+    void* otherHandle = other.Compile(TinyMethod({0x72, VM_I4(0x70000001), 0x2A}));
+    for (int i = 0; i < 3; ++i) {
+        VmExecutionResultNative result;
+        VM_CHECK_EQ(S_OK, other.Execute(otherHandle, {}, result));
+        VM_CHECK(result.returnValue == CLRNet::Phase1::GetStringInternTable().Intern(L"world", 5));
+    }
+    VM_CHECK_EQ(1, g_otherModuleCallbacks);
+    VM_CHECK_EQ(1, g_literalCallbacks);
+
+    // Host-created objects are not rooted by the VM, so they are requested on every execution
+    VmHostCallbacks hostCallbacks;
+    hostCallbacks.stringLiteralCallback = HostLiteral;
+    Instance host(&hostCallbacks);
+    void* hostHandle = host.Compile(TinyMethod({0x72, VM_I4(0x70000001), 0x2A}));
+    for (int i = 0; i < 3; ++i) {
+        VmExecutionResultNative result;
+        VM_CHECK_EQ(S_OK, host.Execute(hostHandle, {}, result));
+        VM_CHECK(result.returnValue == &g_hostLiteral);
+    }
+    VM_CHECK_EQ(3, g_hostLiteralCallbacks);
+}
+
+void TestHandleTable() {
+    Instance instance;
+    std::vector<unsigned char> method = TinyMethod({0x02, 0x17, 0x58, 0x2A});   // ldarg.0 ldc.i4.1 add ret
+    void* handle = instance.Compile(method, "increment");
+    void* second = instance.Compile(method, "increment");
+    VM_CHECK(handle && second && handle != second);
+
+    // Release while other threads execute: every call either succeeds or fails cleanly
+    std::atomic<bool> stop(false);
+    std::atomic<long> corrupted(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            while (!stop.load()) {
+                VmValue argument(int32_t(1));
+                VmExecutionContextNative context = {};
+                context.arguments = &argument;
+                context.argumentCount = 1;
+                VmExecutionResultNative result = {};
+                HRESULT hr = CLRNet_VM_InstanceExecute(instance.Get(), handle, &context, &result);
+                if (hr == S_OK && reinterpret_cast<intptr_t>(result.returnValue) != 2) {
+                    ++corrupted;
+                }
+            }
+        });
+    }
+    Sleep(20);
+    VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceRelease(instance.Get(), handle));
+    Sleep(20);
+    stop.store(true);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    VM_CHECK_EQ(0, corrupted.load());
+
+    // A released handle stays invalid even after its slot is reused
+    VmExecutionResultNative result;
+    VM_CHECK(FAILED(instance.Execute(handle, {VmValue(int32_t(5))}, result)));
+    void* reused = instance.Compile(method, "increment");
+    VM_CHECK(reused != handle);
+    VM_CHECK_EQ(6, instance.ExecuteInt32(reused, {VmValue(int32_t(5))}));
+    VM_CHECK_EQ(6, instance.ExecuteInt32(second, {VmValue(int32_t(5))}));
+}
+
+void TestBatchExecution() {
+    Instance instance;
+    void* handle = instance.Compile(TinyMethod(SumLoop));
+
+    const uint32_t count = 2000;
+    std::vector<VmValue> arguments(count);
+    std::vector<VmValue> locals(count * 2);
+    std::vector<VmExecutionContextNative> contexts(count);
+    std::vector<VmExecutionResultNative> results(count);
+    for (uint32_t parallelism : {1u, 0u, 3u}) {
+        for (uint32_t i = 0; i < count; ++i) {
+            arguments[i] = VmValue(int32_t(i % 200));
+            contexts[i] = VmExecutionContextNative();
+            contexts[i].arguments = &arguments[i];
+            contexts[i].argumentCount = 1;
+            contexts[i].locals = &locals[i * 2];
+            contexts[i].localCount = 2;
+        }
+        VM_CHECK_EQ(S_OK, CLRNet_VM_InstanceExecuteBatch(instance.Get(), handle, contexts.data(), count, results.data(), parallelism));
+        uint32_t wrong = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            int32_t n = static_cast<int32_t>(i % 200);
+            wrong += results[i].success && reinterpret_cast<intptr_t>(results[i].returnValue) == n * (n - 1) / 2 ? 0 : 1;
+        }
+        VM_CHECK_EQ(0, wrong);
+    }
+
+    CLRNet_VM_InstanceRelease(instance.Get(), handle);
+    VM_CHECK_EQ(E_FAIL, CLRNet_VM_InstanceExecuteBatch(instance.Get(), handle, contexts.data(), 10, results.data(), 0));
+    VM_CHECK(!results[0].success && results[0].failureReason != nullptr);
+}
+
+void TestInstances() {
+    VmHostCallbacks plusOne;
+    plusOne.managedCallCallback = PlusOne;
+    plusOne.managedCallArityCallback = OneArgument;
+    VmHostCallbacks plusHundred;
+    plusHundred.managedCallCallback = PlusHundred;
+    plusHundred.managedCallArityCallback = OneArgument;
+
+    void* ignored = nullptr;
+    VM_CHECK_EQ(E_POINTER, CLRNet_VM_CreateInstance(&plusOne, nullptr));
+    VM_CHECK_EQ(E_POINTER, CLRNet_VM_DestroyInstance(nullptr));
+    VM_CHECK_EQ(E_POINTER, CLRNet_VM_InstanceCompileIL(nullptr, nullptr, 0, nullptr, &ignored));
+
+    // ldarg.0; call 0x0A000001; ret, compiled under one key by both instances
+    std::vector<unsigned char> method = TinyMethod({0x02, 0x28, VM_I4(0x0A000001), 0x2A});
+    auto first = std::make_unique<Instance>(&plusOne);
+    Instance second(&plusHundred);
+    void* firstHandle = first->Compile(method, "shared-call");
+    void* secondHandle = second.Compile(method, "shared-call");
+    VM_CHECK_EQ(6, first->ExecuteInt32(firstHandle, {VmValue(int32_t(5))}));
+    VM_CHECK_EQ(105, second.ExecuteInt32(secondHandle, {VmValue(int32_t(5))}));
+
+    // Each instance keeps its own handles
+    VmExecutionResultNative result;
+    VM_CHECK(FAILED(second.Execute(firstHandle, {VmValue(int32_t(5))}, result)) || firstHandle == secondHandle);
+
+    first.reset();
+    VM_CHECK_EQ(105, second.ExecuteInt32(secondHandle, {VmValue(int32_t(5))}));
+    VM_CHECK_EQ(107, second.ExecuteInt32(second.Compile(method, "shared-call"), {VmValue(int32_t(7))}));
+
+    // Callbacks can be registered after creation
+    Instance late;
+    void* lateHandle = late.Compile(method, "shared-call");
+    VM_CHECK(FAILED(late.Execute(lateHandle, {VmValue(int32_t(1))}, result)));
+    CLRNet_VM_InstanceRegisterHost(late.Get(), &plusOne);
+    VM_CHECK_EQ(2, late.ExecuteInt32(lateHandle, {VmValue(int32_t(1))}));
+}
+
+} // namespace
+
+int main() {
+    RunTest("NativeTier", TestNativeTier);
+    RunTest("Profiler", TestProfiler);
+    RunTest("DirectFieldAccess", TestDirectFieldAccess);
+    RunTest("StringLiterals", TestStringLiterals);
+    RunTest("HandleTable", TestHandleTable);
+    RunTest("BatchExecution", TestBatchExecution);
+    RunTest("Instances", TestInstances);
+    return Report();
+}
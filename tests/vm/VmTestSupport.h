@@ -0,0 +1,179 @@
+#pragma once
+
+// Shared helpers for the userspace IL VM tests: IL method builders, execution wrappers around the
+// CLRNet_VM_* exports and a minimal check harness. Every test file builds into its own executable
+// whose exit code is the number of failed checks.
+
+#ifndef CLRNET_TESTS_VM_TEST_SUPPORT_H
+#define CLRNET_TESTS_VM_TEST_SUPPORT_H
+
+#include "../../src/phase1-userland/core/GarbageCollector.h"
+#include "../../src/phase1-userland/vm/VirtualMachine.h"
+
+#include <windows.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+namespace VmTests {
+
+using namespace CLRNet::Phase1::VM;
+
+// IL operands are little-endian
+#define VM_I4(value) \
+    static_cast<unsigned char>(value), static_cast<unsigned char>((value) >> 8), \
+    static_cast<unsigned char>((value) >> 16), static_cast<unsigned char>((value) >> 24)
+#define VM_I8(value) VM_I4(static_cast<uint64_t>(value)), VM_I4(static_cast<uint64_t>(value) >> 32)
+
+#define VM_CHECK(condition) ::VmTests::Check((condition), #condition, __FILE__, __LINE__)
+#define VM_CHECK_EQ(expected, actual) \
+    ::VmTests::CheckEqual(static_cast<long long>(expected), static_cast<long long>(actual), \
+                          #expected, #actual, __FILE__, __LINE__)
+
+inline int& FailureCount() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void Check(bool condition, const char* text, const char* file, int line) {
+    if (!condition) {
+        printf("  FAILED %s(%d): %s\n", file, line, text);
+        ++FailureCount();
+    }
+}
+
+inline void CheckEqual(long long expected, long long actual, const char* expectedText, const char* actualText,
+                       const char* file, int line) {
+    if (expected != actual) {
+        printf("  FAILED %s(%d): %s == %s (expected %lld, got %lld)\n",
+               file, line, expectedText, actualText, expected, actual);
+        ++FailureCount();
+    }
+}
+
+inline void RunTest(const char* name, void (*test)()) {
+    int before = FailureCount();
+    test();
+    printf("%s %s\n", FailureCount() == before ? "[PASS]" : "[FAIL]", name);
+}
+
+inline int Report() {
+    printf("%d check(s) failed\n", FailureCount());
+    return FailureCount();
+}
+
+// Tiny-format method: the header byte carries the code size, max stack is 8, no locals signature
+inline std::vector<unsigned char> TinyMethod(const std::vector<unsigned char>& code) {
+    std::vector<unsigned char> method;
+    method.push_back(static_cast<unsigned char>((code.size() << 2) | 0x2));
+    method.insert(method.end(), code.begin(), code.end());
+    return method;
+}
+
+// Fat-format method with a LocalVarSigTok and InitLocals set
+inline std::vector<unsigned char> FatMethod(const std::vector<unsigned char>& code, uint32_t localSignature,
+                                            uint16_t maxStack = 8) {
+    std::vector<unsigned char> method(12);
+    uint16_t flags = 0x3013;
+    uint32_t codeSize = static_cast<uint32_t>(code.size());
+    memcpy(&method[0], &flags, sizeof(flags));
+    memcpy(&method[2], &maxStack, sizeof(maxStack));
+    memcpy(&method[4], &codeSize, sizeof(codeSize));
+    memcpy(&method[8], &localSignature, sizeof(localSignature));
+    method.insert(method.end(), code.begin(), code.end());
+    return method;
+}
+
+inline size_t CountOpcode(const VmProgram& program, VmOpcode opcode) {
+    size_t count = 0;
+    for (const VmInstruction& instruction : program.instructions) {
+        count += instruction.opcode == opcode ? 1 : 0;
+    }
+    return count;
+}
+
+// Installs a collector for the scope; VM arrays and GC-accounted allocations need one
+class ScopedCollector {
+public:
+    ScopedCollector() {
+        CLRNet::Phase1::GCConfig config;
+        config.collectionThreshold = 64 * 1024 * 1024;
+        config.heapMaxSize = 256 * 1024 * 1024;
+        m_collector.Initialize(config);
+        CLRNet::Phase1::g_garbageCollector = &m_collector;
+    }
+
+    ~ScopedCollector() {
+        CLRNet::Phase1::g_garbageCollector = nullptr;
+        m_collector.Shutdown();
+    }
+
+    CLRNet::Phase1::GarbageCollector& Get() { return m_collector; }
+
+private:
+    CLRNet::Phase1::GarbageCollector m_collector;
+};
+
+// An instance with its own callbacks, destroyed with the scope
+class Instance {
+public:
+    explicit Instance(const VmHostCallbacks* callbacks = nullptr)
+        : m_vm(nullptr) {
+        CLRNet_VM_CreateInstance(callbacks, &m_vm);
+    }
+
+    ~Instance() {
+        if (m_vm) {
+            CLRNet_VM_DestroyInstance(m_vm);
+        }
+    }
+
+    Instance(const Instance&) = delete;
+    Instance& operator=(const Instance&) = delete;
+
+    void* Get() const { return m_vm; }
+
+    // Null when compilation fails; a null cache key keys the program by the hash of its IL
+    void* Compile(const std::vector<unsigned char>& method, const char* cacheKey = nullptr) const {
+        void* handle = nullptr;
+        if (FAILED(CLRNet_VM_InstanceCompileIL(m_vm, method.data(), static_cast<DWORD>(method.size()), cacheKey, &handle))) {
+            return nullptr;
+        }
+        return handle;
+    }
+
+    HRESULT Execute(void* handle, std::initializer_list<VmValue> arguments, VmExecutionResultNative& result,
+                    VmValue* locals = nullptr, uint32_t localCount = 0, size_t memoryBudgetBytes = 0) const {
+        std::vector<VmValue> values(arguments);
+        VmExecutionContextNative context = {};
+        context.arguments = values.data();
+        context.argumentCount = static_cast<uint32_t>(values.size());
+        context.locals = locals;
+        context.localCount = localCount;
+        context.memoryBudgetBytes = memoryBudgetBytes;
+        result = VmExecutionResultNative();
+        return CLRNet_VM_InstanceExecute(m_vm, handle, &context, &result);
+    }
+
+    // Return value of a successful execution; failures are counted and give INT32_MIN
+    int32_t ExecuteInt32(void* handle, std::initializer_list<VmValue> arguments) const {
+        VmExecutionResultNative result;
+        HRESULT hr = Execute(handle, arguments, result);
+        if (hr != S_OK) {
+            printf("  execution failed (hr=0x%08lX): %ls\n", static_cast<unsigned long>(hr),
+                   result.failureReason ? result.failureReason : L"");
+            ++FailureCount();
+            return INT32_MIN;
+        }
+        return static_cast<int32_t>(reinterpret_cast<intptr_t>(result.returnValue));
+    }
+
+private:
+    void* m_vm;
+};
+
+} // namespace VmTests
+
+#endif // CLRNET_TESTS_VM_TEST_SUPPORT_H